@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <windows.h>
 #include "config.h"
 #include "diffing.h"
+#include "filter.h"
 #include "hooking.h"
 #include "ignore.h"
 #include "log.h"
@@ -50,16 +51,32 @@ void monitor_init(HMODULE module_handle)
 
     pipe_init(cfg.pipe_name, cfg.pipe_pid);
     native_init();
+    pipe_async_init(cfg.pipe_async);
 
     // Re-initialize capstone with our custom allocator which is now
     // accessible after native_init().
     hook_init2();
 
     misc_init(cfg.shutdown_mutex);
+    reg_key_cache_enable(cfg.regkey_cache);
+    file_path_cache_enable(cfg.file_cache);
     diffing_init(cfg.hashes_path, cfg.diffing_enable);
 
     copy_init();
-    log_init(cfg.logpipe, cfg.track);
+    log_ring_init(cfg.log_ring, cfg.log_ring_size);
+    log_symbols_init(cfg.log_symbols, cfg.log_stacktrace);
+    log_init(cfg.logpipe, cfg.track, cfg.log_format, cfg.log_compress,
+        cfg.log_strings);
+    if(cfg.log_explain_all != 0) {
+        log_explain_all();
+    }
+    log_collapse_init(cfg.log_collapse, cfg.log_collapse_window);
+    log_buffer_dedup_init(cfg.log_buffer_dedup);
+    log_rate_init(cfg.log_rate, cfg.log_burst, cfg.log_sample,
+        cfg.log_summary);
+    log_exception_init(cfg.exception_policy, cfg.exception_limit,
+        cfg.exception_sites, cfg.exception_interval);
+    filter_init();
     ignore_init();
 
     misc_init2(&monitor_hook, &monitor_unhook);
@@ -86,6 +103,9 @@ void monitor_init(HMODULE module_handle)
     destroy_pe_header(module_handle);
 
     misc_set_monitor_options(cfg.track, cfg.mode, cfg.trigger);
+
+    // Start taking commands from the host once everything is in place.
+    pipe_command_init(cfg.command_interval);
 }
 
 void monitor_hook(const char *library, void *module_handle)
@@ -144,6 +164,14 @@ BOOL APIENTRY DllMain(HANDLE hModule, DWORD dwReason, LPVOID lpReserved)
         monitor_hook(NULL, NULL);
         pipe("LOADED:%d,%d", get_current_process_id(), g_monitor_track);
     }
+    else if(dwReason == DLL_THREAD_DETACH) {
+        free_unicode_buffers();
+    }
+    else if(dwReason == DLL_PROCESS_DETACH) {
+        log_flush();
+        pipe_flush();
+        log_ring_close();
+    }
 
     return TRUE;
 }
@@ -0,0 +1,195 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares dnq lookups against the branchy binary search over the sorted
+// list which dnq_t used to do, for lists of random 64-bit values, like the
+// call hashes of the diffing whitelist, and of their lower halves, like the
+// guard pages on 32-bit, from a handful up to 10 million entries. Half of
+// the lookups hit. Also compares dnq_init(), which radix sorts larger
+// lists, against qsort().
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dnq.h"
+
+#define BENCH_LOOKUPS 4000000
+
+static uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t _random(uint64_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static int _cmp64(const void *a, const void *b)
+{
+    uint64_t _a = *(const uint64_t *) a;
+    uint64_t _b = *(const uint64_t *) b;
+    return (_a > _b) - (_a < _b);
+}
+
+// The searches dnq_has32() and dnq_has64() used to do.
+static int _branchy32(const uint32_t *list, uint32_t length, uint32_t value)
+{
+    uint32_t low = 0, high = length - 1;
+
+    while (high - low > 1) {
+        uint32_t index = low + (high - low) / 2;
+        if(value == list[index]) {
+            return 1;
+        }
+
+        if(value > list[index]) {
+            low = index;
+            continue;
+        }
+
+        if(value < list[index]) {
+            high = index;
+            continue;
+        }
+    }
+
+    return value == list[low] || value == list[high];
+}
+
+static int _branchy64(const uint64_t *list, uint32_t length, uint64_t value)
+{
+    uint32_t low = 0, high = length - 1;
+
+    while (high - low > 1) {
+        uint32_t index = low + (high - low) / 2;
+        if(value == list[index]) {
+            return 1;
+        }
+
+        if(value > list[index]) {
+            low = index;
+            continue;
+        }
+
+        if(value < list[index]) {
+            high = index;
+            continue;
+        }
+    }
+
+    return value == list[low] || value == list[high];
+}
+
+// Runs the lookups through the old search, if branchy is set, or through
+// dnq. Returns the nanoseconds per lookup and adds up the hits.
+static double _lookups(dnq_t *dnq, const uint64_t *queries, int branchy,
+    uint64_t *hits)
+{
+    uint64_t start = _now_ns(), count = 0;
+
+    for (uint32_t idx = 0; idx < BENCH_LOOKUPS; idx++) {
+        if(dnq->size == sizeof(uint32_t)) {
+            count += branchy != 0 ?
+                _branchy32(dnq_iter32(dnq), dnq->length, queries[idx]) :
+                dnq_has32(dnq, queries[idx]);
+        }
+        else {
+            count += branchy != 0 ?
+                _branchy64(dnq_iter64(dnq), dnq->length, queries[idx]) :
+                dnq_has64(dnq, queries[idx]);
+        }
+    }
+
+    *hits += count;
+    return (double)(_now_ns() - start) / BENCH_LOOKUPS;
+}
+
+int main()
+{
+    static const uint32_t sizes[] = {
+        16, 32, 100, 1000, 10000, 100000, 1000000, 10000000,
+    };
+    uint32_t max = sizes[sizeof(sizes)/sizeof(*sizes) - 1];
+
+    uint64_t *values = malloc(max * sizeof(uint64_t));
+    uint64_t *list = malloc(max * sizeof(uint64_t));
+    uint32_t *list32 = malloc(max * sizeof(uint32_t));
+    uint64_t *queries = malloc(BENCH_LOOKUPS * sizeof(uint64_t));
+
+    printf("%-10s %9s %9s %11s %11s %11s %11s\n", "entries", "qsort ms",
+        "init ms", "branchy64", "dnq64 ns", "branchy32", "dnq32 ns");
+
+    for (uint32_t idx = 0; idx < sizeof(sizes)/sizeof(*sizes); idx++) {
+        uint32_t length = sizes[idx]; uint64_t seed = 0x1337 + length;
+        uint64_t hits = 0, expected = 0, start; dnq_t dnq, dnq32;
+
+        for (uint32_t j = 0; j < length; j++) {
+            values[j] = _random(&seed);
+            list32[j] = (uint32_t) values[j];
+        }
+
+        for (uint32_t j = 0; j < BENCH_LOOKUPS; j++) {
+            uint64_t r = _random(&seed);
+            queries[j] = r & 1 ? values[r % length] : r | 1;
+            expected += r & 1;
+        }
+
+        memcpy(list, values, length * sizeof(uint64_t));
+        start = _now_ns();
+        qsort(list, length, sizeof(uint64_t), &_cmp64);
+        double qsort_ms = (_now_ns() - start) / 1e6;
+
+        memcpy(list, values, length * sizeof(uint64_t));
+        start = _now_ns();
+        dnq_init(&dnq, list, sizeof(uint64_t), length);
+        double init_ms = (_now_ns() - start) / 1e6;
+
+        dnq_init(&dnq32, list32, sizeof(uint32_t), length);
+
+        double branchy64 = _lookups(&dnq, queries, 1, &hits);
+        double dnq64 = _lookups(&dnq, queries, 0, &hits);
+        double branchy32 = _lookups(&dnq32, queries, 1, &hits);
+        double dnq32_ns = _lookups(&dnq32, queries, 0, &hits);
+
+        // The odd misses could, by chance, be in the list as well.
+        if(hits < 4 * expected) {
+            fprintf(stderr, "%u entries: lookups missed\n", length);
+            return 1;
+        }
+
+        printf("%-10u %9.2f %9.2f %11.1f %11.1f %11.1f %11.1f\n", length,
+            qsort_ms, init_ms, branchy64, dnq64, branchy32, dnq32_ns);
+        dnq_free(&dnq);
+        dnq_free(&dnq32);
+    }
+
+    free(values);
+    free(list);
+    free(list32);
+    free(queries);
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the decode & index throughput of logread on a synthetic log.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include "bson.h"
+#include "logread.h"
+#include "logsynth.h"
+
+#define LOOKUP_COUNT 1000000
+
+static double _now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _bench_open(const char *filepath, int flags, const char *mode)
+{
+    logread_t lr;
+
+    double start = _now();
+    if(logread_open(&lr, filepath, flags) < 0) {
+        fprintf(stderr, "Error opening log: %s at offset %" PRIu64 "\n",
+            lr.error, lr.error_offset);
+        logread_close(&lr);
+        return -1;
+    }
+    double elapsed = _now() - start;
+
+    printf("%-6s %10.1f MB/s %10.2f Mcalls/s  (%u calls, %u threads, "
+        "%s time index, %.3fs)\n", mode, lr.size / elapsed / 1e6,
+        lr.record_count / elapsed / 1e6, lr.record_count, lr.thread_count,
+        lr.by_time != NULL ? "sorted" : "identity", elapsed);
+
+    // Random access through the indices.
+    uint32_t state = 1, found = 0, count;
+    start = _now();
+    for (uint32_t idx = 0; idx < LOOKUP_COUNT; idx++) {
+        state = state * 1103515245 + 12345;
+
+        const uint32_t *recs = logread_api_records(&lr,
+            state % LOGSYNTH_APIS, &count);
+        if(recs != NULL) {
+            found += logread_record(&lr, recs[state % count])->length != 0;
+        }
+
+        recs = logread_thread_records(&lr,
+            1000 + 4 * (state % LOGSYNTH_THREADS), &count);
+        if(recs != NULL) {
+            found += logread_record(&lr, recs[state % count])->length != 0;
+        }
+
+        uint32_t pos = logread_time_lower_bound(&lr, state % 0x10000);
+        found += pos < lr.record_count;
+    }
+    elapsed = _now() - start;
+
+    printf("%-6s %10.1f ns/lookup  (%u hits)\n", mode,
+        elapsed * 1e9 / (3.0 * LOOKUP_COUNT), found);
+
+    logread_close(&lr);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filepath = "/tmp/logread-bench.bson";
+    uint64_t size = 4096; int reuse = 0, format = LOGSYNTH_BSON, opt;
+
+    while ((opt = getopt(argc, argv, "s:o:rpd")) != -1) {
+        switch (opt) {
+        case 's':
+            size = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'o':
+            filepath = optarg;
+            break;
+
+        case 'r':
+            reuse = 1;
+            break;
+
+        case 'p':
+            format |= LOGSYNTH_PACKED;
+            break;
+
+        case 'd':
+            format |= LOGSYNTH_STRINGS;
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-s size-in-MB] [-o path] [-r] [-p] "
+                "[-d]\n"
+                "  -r  reuse an existing log at path\n"
+                "  -p  generate packed rather than BSON records\n"
+                "  -d  intern strings in the string dictionary\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(reuse == 0 || access(filepath, R_OK) != 0) {
+        logsynth_stats_t stats;
+        FILE *fp = fopen(filepath, "wb");
+        if(fp == NULL) {
+            fprintf(stderr, "Error creating %s\n", filepath);
+            return 1;
+        }
+
+        static char iobuf[1024*1024];
+        setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));
+
+        printf("Generating %" PRIu64 " MB synthetic %s log at %s..\n",
+            size, (format & LOGSYNTH_PACKED) != 0 ? "packed" : "BSON",
+            filepath);
+
+        double start = _now();
+        if(logsynth_write(fp, size * 1024 * 1024, 1, format, &stats) < 0 ||
+                fclose(fp) != 0) {
+            fprintf(stderr, "Error writing %s\n", filepath);
+            return 1;
+        }
+        double elapsed = _now() - start;
+
+        printf("%u calls, %u info, %u buffer documents, %.1f bytes/call, "
+            "%.2f Mcalls/s written\n", stats.calls, stats.infos,
+            stats.buffers, (double) stats.size / stats.calls,
+            stats.calls / elapsed / 1e6);
+    }
+
+    if(_bench_open(filepath, 0, "mmap") < 0 ||
+            _bench_open(filepath, LOGREAD_NOMMAP, "read") < 0) {
+        return 1;
+    }
+    return 0;
+}
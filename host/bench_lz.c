@@ -0,0 +1,209 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Measures the compression ratio and speed of the log compression on a
+// recorded log, by compressing it the way the monitor does: the process
+// identifier and header as-is, followed by frames of LZ_BLOCK_MAX bytes.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include "bson.h"
+#include "logread.h"
+#include "logsynth.h"
+#include "lz.h"
+
+static double _now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t *_read_file(const char *filepath, uint64_t *size)
+{
+    FILE *fp = fopen(filepath, "rb");
+    if(fp == NULL) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *buf = malloc(*size);
+    if(buf != NULL && fread(buf, 1, *size, fp) != *size) {
+        free(buf), buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+// Length of the raw process identifier and the header line.
+static uint64_t _header_length(const uint8_t *buf, uint64_t size)
+{
+    const uint8_t *newline = size > 4 ? memchr(buf + 4, '\n', size - 4) : NULL;
+    return newline != NULL ? newline + 1 - buf : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outpath = NULL, *filepath = "/tmp/logread-bench.bson";
+    uint64_t size = 256; int format = LOGSYNTH_BSON, opt;
+
+    while ((opt = getopt(argc, argv, "s:o:p")) != -1) {
+        switch (opt) {
+        case 's':
+            size = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'o':
+            outpath = optarg;
+            break;
+
+        case 'p':
+            format = LOGSYNTH_PACKED;
+            break;
+
+        default:
+            fprintf(stderr, "Usage: %s [-s size-in-MB] [-p] [-o out] [log]\n"
+                "  without a log a synthetic one of the given size is used\n"
+                "  -p  generate packed rather than BSON records\n"
+                "  -o  write the compressed log to out\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind < argc) {
+        filepath = argv[optind];
+    }
+    else {
+        logsynth_stats_t stats;
+        FILE *fp = fopen(filepath, "wb");
+        if(fp == NULL || logsynth_write(fp, size * 1024 * 1024, 1,
+                format, &stats) < 0 || fclose(fp) != 0) {
+            fprintf(stderr, "Error writing %s\n", filepath);
+            return 1;
+        }
+    }
+
+    uint64_t length, hdrlen;
+    uint8_t *buf = _read_file(filepath, &length);
+    if(buf == NULL || (hdrlen = _header_length(buf, length)) == 0) {
+        fprintf(stderr, "Error reading log %s\n", filepath);
+        return 1;
+    }
+
+    uint64_t blocks = (length - hdrlen + LZ_BLOCK_MAX - 1) / LZ_BLOCK_MAX;
+    uint8_t *out = malloc(hdrlen + 16 + blocks * LZ_FRAME_BOUND(LZ_BLOCK_MAX));
+    uint8_t *dec = malloc(length);
+    static lz_table_t table;
+
+    if(out == NULL || dec == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Announce the compression in the header, as the monitor does.
+    memcpy(out, buf, hdrlen - 1);
+    memcpy(out + hdrlen - 1, " compress=lz4\n", 14);
+    uint64_t outlen = hdrlen + 13, stored = 0;
+
+    double start = _now();
+    for (uint64_t offset = hdrlen; offset < length; offset += LZ_BLOCK_MAX) {
+        uint32_t block = length - offset < LZ_BLOCK_MAX ?
+            length - offset : LZ_BLOCK_MAX;
+        uint32_t framelen = lz_frame(buf + offset, block, out + outlen, &table);
+        stored += (out[outlen + 3] & 0x80) != 0;
+        outlen += framelen;
+    }
+    double compress = _now() - start;
+
+    // Decompress the frames without any further processing.
+    uint64_t declen = 0;
+    start = _now();
+    for (uint64_t offset = hdrlen + 13; offset < outlen; ) {
+        uint32_t header = out[offset] | out[offset+1] << 8 |
+            out[offset+2] << 16 | (uint32_t) out[offset+3] << 24;
+        uint32_t framelen = header & ~LZ_FRAME_RAW;
+        const uint8_t *payload = out + offset + LZ_FRAME_HEADER;
+
+        if((header & LZ_FRAME_RAW) != 0) {
+            memcpy(dec + declen, payload, framelen);
+            declen += framelen;
+        }
+        else {
+            int32_t ret = lz_decompress(payload, framelen,
+                dec + declen, LZ_BLOCK_MAX);
+            if(ret < 0) {
+                fprintf(stderr, "Error decompressing frame at %" PRIu64 "\n",
+                    offset);
+                return 1;
+            }
+            declen += ret;
+        }
+        offset += LZ_FRAME_HEADER + framelen;
+    }
+    double decompress = _now() - start;
+
+    if(declen != length - hdrlen ||
+            memcmp(dec, buf + hdrlen, declen) != 0) {
+        fprintf(stderr, "Decompressed log differs from the original\n");
+        return 1;
+    }
+
+    uint64_t payload = length - hdrlen;
+    printf("%" PRIu64 " -> %" PRIu64 " bytes, ratio %.2f, "
+        "%" PRIu64 "/%" PRIu64 " blocks stored\n", length, outlen,
+        (double) length / outlen, stored, blocks);
+    printf("compress   %10.1f MB/s\n", payload / compress / 1e6);
+    printf("decompress %10.1f MB/s\n", payload / decompress / 1e6);
+
+    // End-to-end decoding and indexing of the compressed log.
+    logread_t lr;
+    start = _now();
+    if(logread_open_buffer(&lr, out, outlen) < 0) {
+        fprintf(stderr, "Error opening compressed log: %s at offset %"
+            PRIu64 "\n", lr.error, lr.error_offset);
+        return 1;
+    }
+    double elapsed = _now() - start;
+
+    printf("logread    %10.1f MB/s %10.2f Mcalls/s  (%u calls)\n",
+        payload / elapsed / 1e6, lr.record_count / elapsed / 1e6,
+        lr.record_count);
+    logread_close(&lr);
+
+    if(outpath != NULL) {
+        FILE *fp = fopen(outpath, "wb");
+        if(fp == NULL || fwrite(out, outlen, 1, fp) != 1 || fclose(fp) != 0) {
+            fprintf(stderr, "Error writing %s\n", outpath);
+            return 1;
+        }
+    }
+
+    free(buf);
+    free(out);
+    free(dec);
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares lookups in the radix map against the dense array guarded by a
+// lock which array_t used to be, with a growing number of threads each
+// looking up its own thread identifier-like key, the way the monitor does
+// for every hooked call, and occasionally setting it. Also reports the
+// memory taken by either for the keys used.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "radix.h"
+
+#define BENCH_LOOKUPS 2000000
+#define BENCH_THREADS_MAX 8
+
+// One in this many operations is a write.
+#define BENCH_WRITE_RATIO 64
+
+typedef struct _dense_t {
+    pthread_mutex_t mutex;
+    void **elements;
+    uint32_t length;
+} dense_t;
+
+static radix_t g_radix;
+static dense_t g_dense;
+static uint64_t g_radix_memory;
+
+static uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *_radix_alloc(uint32_t length)
+{
+    __atomic_fetch_add(&g_radix_memory, length, __ATOMIC_RELAXED);
+    return calloc(1, length);
+}
+
+static void _dense_set(dense_t *d, uint32_t index, void *value)
+{
+    pthread_mutex_lock(&d->mutex);
+    if(index >= d->length) {
+        uint32_t length = d->length != 0 ? d->length : 1024;
+        while (length <= index) {
+            length *= 2;
+        }
+
+        d->elements = realloc(d->elements, length * sizeof(void *));
+        memset(d->elements + d->length, 0,
+            (length - d->length) * sizeof(void *));
+        d->length = length;
+    }
+    d->elements[index] = value;
+    pthread_mutex_unlock(&d->mutex);
+}
+
+static void *_dense_get(dense_t *d, uint32_t index)
+{
+    void *ret = NULL;
+    pthread_mutex_lock(&d->mutex);
+    if(index < d->length) {
+        ret = d->elements[index];
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return ret;
+}
+
+// Windows thread identifiers are multiples of four and, in a long running
+// system, easily in the tens of thousands.
+static uint32_t _key(uint32_t thread)
+{
+    return 40000 + thread * 4 * 101;
+}
+
+static void *_bench_radix(void *arg)
+{
+    uint32_t key = _key((uint32_t)(uintptr_t) arg); uintptr_t hits = 0;
+
+    for (uint32_t idx = 0; idx < BENCH_LOOKUPS; idx++) {
+        if(idx % BENCH_WRITE_RATIO == 0) {
+            radix_set(&g_radix, key, arg);
+        }
+        hits += radix_get(&g_radix, key) == arg;
+    }
+    return (void *) hits;
+}
+
+static void *_bench_dense(void *arg)
+{
+    uint32_t key = _key((uint32_t)(uintptr_t) arg); uintptr_t hits = 0;
+
+    for (uint32_t idx = 0; idx < BENCH_LOOKUPS; idx++) {
+        if(idx % BENCH_WRITE_RATIO == 0) {
+            _dense_set(&g_dense, key, arg);
+        }
+        hits += _dense_get(&g_dense, key) == arg;
+    }
+    return (void *) hits;
+}
+
+// Returns the number of million operations per second.
+static double _bench(void *(*fn)(void *), uint32_t threads)
+{
+    pthread_t tids[BENCH_THREADS_MAX]; uint64_t hits = 0; void *ret;
+    uint64_t start = _now_ns();
+
+    for (uint32_t idx = 0; idx < threads; idx++) {
+        pthread_create(&tids[idx], NULL, fn, (void *)(uintptr_t)(idx + 1));
+    }
+    for (uint32_t idx = 0; idx < threads; idx++) {
+        pthread_join(tids[idx], &ret);
+        hits += (uintptr_t) ret;
+    }
+
+    if(hits != (uint64_t) threads * BENCH_LOOKUPS) {
+        fprintf(stderr, "lookups returned the wrong value\n");
+        exit(1);
+    }
+
+    double seconds = (_now_ns() - start) / 1e9;
+    return threads * (double) BENCH_LOOKUPS / seconds / 1e6;
+}
+
+int main()
+{
+    pthread_mutex_init(&g_dense.mutex, NULL);
+    radix_init(&g_radix, &_radix_alloc, &free);
+
+    printf("%-8s %14s %14s\n", "threads", "dense Mops/s", "radix Mops/s");
+    for (uint32_t threads = 1; threads <= BENCH_THREADS_MAX; threads *= 2) {
+        double dense = _bench(&_bench_dense, threads);
+        double radix = _bench(&_bench_radix, threads);
+        printf("%-8u %14.1f %14.1f\n", threads, dense, radix);
+    }
+
+    printf("memory for %u keys up to %u: dense %zu KiB, radix %zu KiB\n",
+        BENCH_THREADS_MAX, _key(BENCH_THREADS_MAX),
+        (size_t) g_dense.length * sizeof(void *) / 1024,
+        (size_t) g_radix_memory / 1024);
+
+    radix_destroy(&g_radix);
+    free(g_dense.elements);
+    return 0;
+}
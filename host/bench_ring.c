@@ -0,0 +1,290 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares the shared-memory ring transport against writing each record to
+// a pipe, the way the monitor writes to the log pipe. A child process
+// produces records which carry their send time and the parent drains them.
+// Throughput is measured with the producer writing as fast as it can, in
+// which case the latency mostly reflects how much the transport buffers, and
+// latency with the producer pacing its records so that the queue is empty.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "ring.h"
+
+#define TRANSPORT_PIPE 0
+#define TRANSPORT_RING 1
+
+typedef struct _bench_t {
+    int transport;
+    uint32_t records;
+    uint32_t size;
+    uint32_t pace_ns;
+
+    // Ring, or both ends of the pipe.
+    void *mem;
+    uint32_t memsize;
+    ring_t ring;
+    int fds[2];
+} bench_t;
+
+static uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int _cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void _produce(bench_t *b)
+{
+    uint8_t *record = calloc(1, b->size);
+
+    for (uint32_t idx = 0; idx < b->records; idx++) {
+        // Sleep rather than spin, so that the reader gets to run even on
+        // a single processor.
+        if(b->pace_ns != 0) {
+            struct timespec ts = {0, b->pace_ns};
+            nanosleep(&ts, NULL);
+        }
+
+        uint64_t now = _now_ns();
+        memcpy(record, &now, sizeof(now));
+
+        if(b->transport == TRANSPORT_PIPE) {
+            for (uint32_t offset = 0; offset < b->size; ) {
+                ssize_t ret = write(b->fds[1], record + offset,
+                    b->size - offset);
+                if(ret <= 0) {
+                    _exit(1);
+                }
+                offset += ret;
+            }
+            continue;
+        }
+
+        while (ring_write(&b->ring, record, b->size) == 0) {
+            sched_yield();
+        }
+    }
+
+    if(b->transport == TRANSPORT_RING) {
+        ring_close(&b->ring, RING_STATE_CLOSED);
+    }
+    _exit(0);
+}
+
+// Returns the amount of bytes received, filling in the latency of each
+// record.
+static uint64_t _consume(bench_t *b, uint64_t *latency)
+{
+    uint8_t *record = malloc(b->size); uint32_t count = 0, filled = 0;
+    uint64_t total = 0; ring_t ring;
+
+    if(b->transport == TRANSPORT_RING) {
+        if(ring_attach(&ring, b->mem, b->memsize) != 0) {
+            return 0;
+        }
+    }
+
+    while (count < b->records) {
+        const uint8_t *data; uint32_t length;
+
+        if(b->transport == TRANSPORT_PIPE) {
+            ssize_t ret = read(b->fds[0], record + filled, b->size - filled);
+            if(ret <= 0) {
+                break;
+            }
+            data = record + filled, length = ret;
+        }
+        else {
+            uint32_t state = ring_state(&ring);
+            length = ring_peek(&ring, &data);
+            if(length == 0) {
+                if(state != RING_STATE_OPEN) {
+                    break;
+                }
+                sched_yield();
+                continue;
+            }
+        }
+
+        // Reassemble records, as the transport only guarantees a stream.
+        for (uint32_t offset = 0; offset < length; ) {
+            uint32_t chunk = length - offset < b->size - filled ?
+                length - offset : b->size - filled;
+            if(data + offset != record + filled) {
+                memcpy(record + filled, data + offset, chunk);
+            }
+            offset += chunk, filled += chunk;
+
+            if(filled == b->size) {
+                uint64_t sent;
+                memcpy(&sent, record, sizeof(sent));
+                latency[count++] = _now_ns() - sent;
+                filled = 0;
+            }
+        }
+
+        if(b->transport == TRANSPORT_RING) {
+            ring_consume(&ring);
+        }
+        total += length;
+    }
+
+    free(record);
+    return total;
+}
+
+static int _run(bench_t *b, const char *name)
+{
+    uint64_t *latency = calloc(b->records, sizeof(uint64_t));
+
+    if(b->transport == TRANSPORT_PIPE && pipe(b->fds) < 0) {
+        return -1;
+    }
+
+    // Created up front, so the reader never attaches to the previous run.
+    if(b->transport == TRANSPORT_RING &&
+            ring_create(&b->ring, b->mem, b->memsize) < 0) {
+        return -1;
+    }
+
+    uint64_t start = _now_ns();
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        if(b->transport == TRANSPORT_PIPE) {
+            close(b->fds[0]);
+        }
+        _produce(b);
+    }
+
+    if(b->transport == TRANSPORT_PIPE) {
+        close(b->fds[1]);
+    }
+
+    uint64_t total = _consume(b, latency);
+    double elapsed = (_now_ns() - start) / 1e9; int status;
+
+    waitpid(pid, &status, 0);
+    if(b->transport == TRANSPORT_PIPE) {
+        close(b->fds[0]);
+    }
+
+    if(total != (uint64_t) b->records * b->size) {
+        fprintf(stderr, "%s: received %" PRIu64 " bytes\n", name, total);
+        free(latency);
+        return -1;
+    }
+
+    qsort(latency, b->records, sizeof(uint64_t), &_cmp_u64);
+
+    printf("%-5s %-10s %6u bytes  %9.0f rec/s  %8.1f MB/s  "
+        "latency p50 %6.1f us  p99 %7.1f us\n", name,
+        b->pace_ns != 0 ? "paced" : "saturated", b->size,
+        b->records / elapsed, total / elapsed / 1e6,
+        latency[b->records / 2] / 1e3, latency[b->records * 99 / 100] / 1e3);
+
+    free(latency);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filepath = "/tmp/logread-bench.ring";
+    uint32_t records = 1000000, capacity = 4*1024*1024; int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:f:")) != -1) {
+        switch (opt) {
+        case 'n':
+            records = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'c':
+            capacity = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'f':
+            filepath = optarg;
+            break;
+
+        default:
+            fprintf(stderr,
+                "Usage: %s [-n records] [-c capacity] [-f ring]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The ring lives in a file mapping, as it would with a reader on the
+    // other side of a shared file.
+    uint32_t memsize = RING_SIZE(capacity);
+    int fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, memsize) < 0) {
+        fprintf(stderr, "Error creating %s\n", filepath);
+        return 1;
+    }
+
+    void *mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        fprintf(stderr, "Error mapping %s\n", filepath);
+        return 1;
+    }
+
+    static const uint32_t sizes[] = {64, 256, 4096};
+    int ret = 0;
+
+    for (uint32_t idx = 0; idx < sizeof(sizes) / sizeof(*sizes); idx++) {
+        for (uint32_t pace = 0; pace < 2; pace++) {
+            bench_t b = {
+                .records = pace != 0 ? records / 20 : records,
+                .size = sizes[idx],
+                .pace_ns = pace != 0 ? 20000 : 0,
+                .mem = mem,
+                .memsize = memsize,
+            };
+
+            b.transport = TRANSPORT_PIPE;
+            ret |= _run(&b, "pipe");
+
+            b.transport = TRANSPORT_RING;
+            ret |= _run(&b, "ring");
+        }
+    }
+
+    munmap(mem, memsize);
+    unlink(filepath);
+    return ret != 0;
+}
@@ -0,0 +1,110 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares the SHA-1 backends which are supported by this processor on
+// buffers of the sizes the monitor typically checksums, from small
+// registry values up to dumped files. Each buffer is hashed in one update
+// and in 4 KiB chunks, the way streamed buffers are.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sha1.h"
+
+// Amount of bytes hashed per measurement.
+#define BENCH_TOTAL (256 * 1024 * 1024)
+
+#define BENCH_CHUNK 4096
+
+static uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Returns the throughput in MB/s.
+static double _bench(const uint8_t *buf, uint32_t size, uint32_t chunk,
+    uint8_t *digest)
+{
+    uint32_t rounds = BENCH_TOTAL / size; sha1_t ctx;
+    uint64_t start = _now_ns();
+
+    for (uint32_t idx = 0; idx < rounds; idx++) {
+        sha1_init(&ctx);
+        for (uint32_t offset = 0; offset < size; offset += chunk) {
+            sha1_update(&ctx, buf + offset,
+                size - offset < chunk ? size - offset : chunk);
+        }
+        sha1_final(&ctx, digest);
+    }
+
+    double seconds = (_now_ns() - start) / 1e9;
+    return (double) rounds * size / seconds / 1e6;
+}
+
+int main()
+{
+    static const uint32_t sizes[] = {64, 256, 4096, 65536, 1024 * 1024};
+    uint8_t reference[SHA1_DIGEST_SIZE], digest[SHA1_DIGEST_SIZE];
+    uint32_t size = sizes[sizeof(sizes)/sizeof(*sizes) - 1];
+
+    uint8_t *buf = malloc(size);
+    for (uint32_t idx = 0, seed = 1; idx < size; idx++) {
+        seed = seed * 1103515245 + 12345;
+        buf[idx] = seed >> 16;
+    }
+
+    sha1_backend(SHA1_BACKEND_AUTO);
+    printf("auto-selected backend: %s\n",
+        sha1_backend_name(sha1_backend_current()));
+
+    printf("%-10s %10s %12s %12s\n", "backend", "size", "MB/s", "chunked");
+
+    for (int backend = SHA1_BACKEND_PORTABLE;
+            backend < SHA1_BACKEND_COUNT; backend++) {
+        if(sha1_backend(backend) < 0) {
+            printf("%-10s not supported\n", sha1_backend_name(backend));
+            continue;
+        }
+
+        for (uint32_t idx = 0; idx < sizeof(sizes)/sizeof(*sizes); idx++) {
+            double whole = _bench(buf, sizes[idx], sizes[idx], digest);
+            double chunked = _bench(buf, sizes[idx], BENCH_CHUNK, digest);
+            printf("%-10s %10u %12.1f %12.1f\n", sha1_backend_name(backend),
+                sizes[idx], whole, chunked);
+        }
+
+        // The last digest covers the whole buffer, so all backends should
+        // agree on it.
+        if(backend == SHA1_BACKEND_PORTABLE) {
+            memcpy(reference, digest, sizeof(reference));
+        }
+        else if(memcmp(reference, digest, sizeof(reference)) != 0) {
+            fprintf(stderr, "%s: digest mismatch\n",
+                sha1_backend_name(backend));
+            return 1;
+        }
+    }
+
+    free(buf);
+    return 0;
+}
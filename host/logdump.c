@@ -0,0 +1,453 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Dumps or summarizes a monitor log, optionally restricted to a thread, an
+// API or a time range, which are looked up through the logread indices.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "bson.h"
+#include "logread.h"
+#include "symbolize.h"
+
+// Maximum number of characters printed for a string argument.
+#define STRING_MAX 256
+
+// Maximum number of directories searched for module files.
+#define SYMBOL_DIRS_MAX 16
+
+// Set with -k, to print the stack traces of the calls.
+static symbolize_t *g_symbolize;
+
+static void _usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [-n] [-s] [-k] [-S dir]... [-t tid] [-a api] [-f time] "
+        "[-u time] <log>\n"
+        "  -n       read the log in chunks instead of mapping it\n"
+        "  -s       print a summary rather than the calls\n"
+        "  -k       print the stack trace of each call\n"
+        "  -S dir   look up module files in dir to symbolize stack traces\n"
+        "  -t tid   only calls made by this thread\n"
+        "  -a api   only calls to this API (name or index)\n"
+        "  -f time  only calls at or after this time (ms)\n"
+        "  -u time  only calls before this time (ms)\n"
+        "Use - to read the log from stdin.\n", argv0);
+}
+
+static void _print_string(const char *s, int length)
+{
+    putchar('"');
+    for (int idx = 0; idx < length && idx < STRING_MAX; idx++) {
+        unsigned char ch = s[idx];
+        if(ch == '"' || ch == '\\') {
+            printf("\\%c", ch);
+        }
+        else if(ch < 0x20 || ch == 0x7f) {
+            printf("\\x%02x", ch);
+        }
+        else {
+            putchar(ch);
+        }
+    }
+    printf(length > STRING_MAX ? "\"..." : "\"");
+}
+
+static void _print_value(const bson_iterator *it, char fmt)
+{
+    switch (bson_iterator_type(it)) {
+    case BSON_INT:
+        if(fmt == 'p' || fmt == 'x') {
+            printf("0x%08x", (uint32_t) bson_iterator_int(it));
+        }
+        else {
+            printf("%d", bson_iterator_int(it));
+        }
+        break;
+
+    case BSON_LONG:
+        if(fmt == 'p' || fmt == 'x') {
+            printf("0x%016" PRIx64, (uint64_t) bson_iterator_long(it));
+        }
+        else {
+            printf("%" PRId64, (int64_t) bson_iterator_long(it));
+        }
+        break;
+
+    case BSON_STRING:
+        _print_string(bson_iterator_string(it),
+            bson_iterator_string_len(it) - 1);
+        break;
+
+    case BSON_BINDATA:
+        printf("<%d bytes>", bson_iterator_bin_len(it));
+        break;
+
+    case BSON_ARRAY:
+        printf("[...]");
+        break;
+
+    case BSON_OBJECT:
+        printf("{...}");
+        break;
+
+    case BSON_NULL:
+        printf("null");
+        break;
+
+    default:
+        printf("?");
+        break;
+    }
+}
+
+// Print a stack trace, resolving the addresses which the monitor has left
+// to the host.
+static void _print_stacktrace(uint32_t recno, const bson_iterator *array)
+{
+    bson_iterator it; char buf[1024];
+
+    bson_iterator_subiterator(array, &it);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(bson_iterator_type(&it) == BSON_STRING) {
+            printf("    %s\n", symbolize_frame(g_symbolize, recno,
+                bson_iterator_string(&it), buf, sizeof(buf)));
+        }
+    }
+}
+
+// The exception address of an "exception" argument, unless the monitor
+// has symbolized it already.
+static void _print_exception(uint32_t recno, const bson_iterator *object)
+{
+    bson_iterator it; const char *address = NULL; char buf[1024];
+
+    bson_iterator_subiterator(object, &it);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(strcmp(bson_iterator_key(&it), "symbol") == 0) {
+            return;
+        }
+
+        if(strcmp(bson_iterator_key(&it), "address") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING) {
+            address = bson_iterator_string(&it);
+        }
+    }
+
+    if(address != NULL) {
+        printf("  exception at %s\n",
+            symbolize_frame(g_symbolize, recno, address, buf, sizeof(buf)));
+    }
+}
+
+static void _print_stacktraces(uint32_t recno,
+    const logread_api_t *api, const bson *b)
+{
+    bson_iterator doc, it; uint32_t argnum = 0;
+
+    bson_iterator_init(&doc, b);
+    while (bson_iterator_next(&doc) != BSON_EOO) {
+        const char *key = bson_iterator_key(&doc);
+
+        if(strcmp(key, "s") == 0 && bson_iterator_type(&doc) == BSON_ARRAY) {
+            _print_stacktrace(recno, &doc);
+        }
+
+        if(strcmp(key, "args") != 0 || api == NULL) {
+            continue;
+        }
+
+        // The stack trace and address of exceptions are arguments.
+        bson_iterator_subiterator(&doc, &it);
+        while (bson_iterator_next(&it) != BSON_EOO && argnum < api->argc) {
+            const char *argname = api->argnames[argnum++];
+
+            if(strcmp(argname, "exception") == 0 &&
+                    bson_iterator_type(&it) == BSON_OBJECT) {
+                _print_exception(recno, &it);
+            }
+            else if(strcmp(argname, "stacktrace") == 0 &&
+                    bson_iterator_type(&it) == BSON_ARRAY) {
+                _print_stacktrace(recno, &it);
+            }
+        }
+    }
+}
+
+static void _print_record(const logread_t *lr, uint32_t recno)
+{
+    const logread_record_t *rec = logread_record(lr, recno);
+    const logread_api_t *api = logread_api(lr, rec->index);
+    bson_iterator it; bson b; int is_success = 1, decoded;
+    uint64_t retval = 0; uint32_t argnum = 0;
+
+    printf("%10u %6u ", rec->time, rec->tid);
+    if(api != NULL) {
+        printf("%s(", api->name);
+    }
+    else {
+        printf("#%u(", rec->index);
+    }
+
+    decoded = logread_record_args(lr, rec, &b, &it) == 0;
+    if(decoded != 0) {
+        while (bson_iterator_next(&it) != BSON_EOO) {
+            if(argnum == 0) {
+                is_success = bson_iterator_int(&it);
+            }
+            else if(argnum == 1) {
+                retval = bson_iterator_long(&it);
+            }
+            else {
+                if(argnum != 2) {
+                    printf(", ");
+                }
+
+                if(api != NULL && argnum < api->argc) {
+                    printf("%s=", api->argnames[argnum]);
+                }
+
+                _print_value(&it, api != NULL && argnum < api->argc ?
+                    api->argfmt[argnum] : 0);
+            }
+            argnum++;
+        }
+    }
+    else {
+        // E.g., a string argument which isn't valid UTF-8.
+        printf("<undecodable>");
+    }
+
+    printf(") = 0x%" PRIx64 "%s", retval, is_success ? "" : " (failed)");
+
+    if(rec->repeat != 0) {
+        printf(" (repeated %u times)", rec->repeat);
+    }
+    putchar('\n');
+
+    if(g_symbolize != NULL && decoded != 0) {
+        _print_stacktraces(recno, api, &b);
+    }
+
+    bson_destroy(&b);
+}
+
+static void _print_summary(const logread_t *lr)
+{
+    printf("pid %u, %u calls, %u apis explained, %u buffers, "
+        "%u unresolved calls\n", lr->pid, lr->record_count,
+        lr->info_count, lr->buffer_count, lr->unresolved_count);
+
+    if(lr->bufref_count != 0) {
+        printf("%u buffers sent again by reference, %u unresolved\n",
+            lr->bufref_count, lr->unresolved_bufref_count);
+    }
+
+    if(lr->stream_count != 0 || lr->incomplete_stream_count != 0) {
+        printf("%u buffers streamed in chunks, %u incomplete\n",
+            lr->stream_count, lr->incomplete_stream_count);
+    }
+
+    if(lr->repeat_count != 0) {
+        printf("%" PRIu64 " repeated calls collapsed into %u documents\n",
+            lr->repeated_calls, lr->repeat_count);
+    }
+
+    if(lr->exception_summary_count != 0) {
+        printf("%" PRIu64 " exceptions, %" PRIu64 " at untracked sites\n",
+            lr->exception_count, lr->exception_other);
+
+        for (uint32_t idx = 0; idx < lr->exception_site_count; idx++) {
+            const logread_exception_t *site = &lr->exceptions[idx];
+            if(site->count == 0) {
+                continue;
+            }
+
+            printf("  %10" PRIu64 " x 0x%08x at 0x%" PRIx64 "\n",
+                site->count, site->code, site->address);
+        }
+    }
+
+    printf("\n%8s %10s %10s  %s\n", "index", "calls", "dropped", "api");
+    for (uint32_t idx = 0; idx < lr->api_count; idx++) {
+        uint32_t count;
+        logread_api_records(lr, idx, &count);
+
+        const logread_api_t *api = logread_api(lr, idx);
+        if(api != NULL || count != 0) {
+            printf("%8u %10u %10" PRIu64 "  %s%s%s\n", idx, count,
+                lr->apis[idx].dropped,
+                api != NULL ? api->category : "",
+                api != NULL ? ":" : "", api != NULL ? api->name : "?");
+        }
+    }
+
+    printf("\n%8s %10s %10s %10s\n", "tid", "calls", "first", "last");
+    for (uint32_t idx = 0; idx < lr->thread_count; idx++) {
+        const logread_thread_t *thread = &lr->threads[idx];
+        const uint32_t *recs = &lr->by_thread[thread->first];
+
+        printf("%8u %10u %10u %10u\n", thread->tid, thread->count,
+            lr->records[recs[0]].time,
+            lr->records[recs[thread->count-1]].time);
+    }
+}
+
+static int _lookup_api(const logread_t *lr, const char *api, uint32_t *index)
+{
+    char *end;
+
+    *index = strtoul(api, &end, 0);
+    if(*api != 0 && *end == 0) {
+        return 0;
+    }
+
+    for (uint32_t idx = 0; idx < lr->api_count; idx++) {
+        const logread_api_t *entry = logread_api(lr, idx);
+        if(entry != NULL && strcmp(entry->name, api) == 0) {
+            *index = idx;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int flags = 0, summary = 0, opt, has_tid = 0;
+    uint32_t tid = 0, from = 0, until = UINT32_MAX, index = 0;
+    const char *api = NULL, *dirs[SYMBOL_DIRS_MAX];
+    uint32_t dir_count = 0; int stacktraces = 0;
+    logread_t lr; symbolize_t sym;
+
+    while ((opt = getopt(argc, argv, "nskS:t:a:f:u:")) != -1) {
+        switch (opt) {
+        case 'n':
+            flags |= LOGREAD_NOMMAP;
+            break;
+
+        case 's':
+            summary = 1;
+            break;
+
+        case 'k':
+            stacktraces = 1;
+            break;
+
+        case 'S':
+            if(dir_count == SYMBOL_DIRS_MAX) {
+                fprintf(stderr, "Too many symbol directories\n");
+                return 1;
+            }
+            dirs[dir_count++] = optarg;
+            break;
+
+        case 't':
+            has_tid = 1, tid = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'a':
+            api = optarg;
+            break;
+
+        case 'f':
+            from = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'u':
+            until = strtoul(optarg, NULL, 0);
+            break;
+
+        default:
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind + 1 != argc) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    int ret = logread_open(&lr, argv[optind], flags);
+    if(ret < 0) {
+        fprintf(stderr, "%s: %s at offset %" PRIu64 "\n", argv[optind],
+            lr.error, lr.error_offset);
+    }
+
+    if(api != NULL && _lookup_api(&lr, api, &index) < 0) {
+        fprintf(stderr, "Unknown api: %s\n", api);
+        logread_close(&lr);
+        return 1;
+    }
+
+    symbolize_init(&sym, &lr, dirs, dir_count);
+    if(stacktraces != 0) {
+        g_symbolize = &sym;
+    }
+
+    if(summary != 0) {
+        _print_summary(&lr);
+    }
+    else if(has_tid != 0 || api != NULL) {
+        // Walk the smallest of the applicable indices.
+        const uint32_t *recs; uint32_t count, count2;
+
+        if(has_tid != 0) {
+            recs = logread_thread_records(&lr, tid, &count);
+            if(api != NULL) {
+                const uint32_t *recs2 =
+                    logread_api_records(&lr, index, &count2);
+                if(count2 < count) {
+                    recs = recs2, count = count2;
+                }
+            }
+        }
+        else {
+            recs = logread_api_records(&lr, index, &count);
+        }
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            const logread_record_t *rec = logread_record(&lr, recs[idx]);
+            if((has_tid == 0 || rec->tid == tid) &&
+                    (api == NULL || rec->index == index) &&
+                    rec->time >= from && rec->time < until) {
+                _print_record(&lr, recs[idx]);
+            }
+        }
+    }
+    else {
+        for (uint32_t pos = logread_time_lower_bound(&lr, from);
+                pos < lr.record_count; pos++) {
+            uint32_t recno = logread_time_record(&lr, pos);
+            if(logread_record(&lr, recno)->time >= until) {
+                break;
+            }
+            _print_record(&lr, recno);
+        }
+    }
+
+    symbolize_close(&sym);
+    logread_close(&lr);
+    return ret < 0 ? 1 : 0;
+}
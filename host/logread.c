@@ -0,0 +1,2140 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bson.h"
+#include "logread.h"
+#include "lz.h"
+#include "packed.h"
+#include "sha1.h"
+
+// Nesting depth of BSON documents which we're willing to validate. The
+// monitor itself never goes deeper than a handful of levels.
+#define LOGREAD_MAX_DEPTH 32
+
+// Upper bound on API indices, to avoid huge allocations on garbage input.
+#define LOGREAD_MAX_INDEX 0x10000
+
+// Size of the chunks read when the log can't be mapped into memory.
+#define LOGREAD_CHUNK_SIZE (4*1024*1024)
+
+// Maximum length of the "BSON <pid>\n" header line.
+#define LOGREAD_HEADER_MAX 64
+
+typedef struct _docinfo_t {
+    int has_index, has_tid, has_time;
+    uint32_t index, tid, time;
+    const char *type;
+} docinfo_t;
+
+static inline uint32_t _le32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Returns the length of the string at p including its terminator, or 0
+// if there's no terminator within length bytes.
+static inline uint64_t _cstrlen(const uint8_t *p, uint64_t length)
+{
+    const uint8_t *end = memchr(p, 0, length);
+    return end != NULL ? (uint64_t)(end - p) + 1 : 0;
+}
+
+// Length prefixed string as used by BSON_STRING, BSON_CODE and BSON_SYMBOL.
+static inline uint64_t _lstrlen(const uint8_t *p, uint64_t length)
+{
+    if(length < 4) {
+        return 0;
+    }
+
+    uint32_t strlen = _le32(p);
+    if(strlen == 0 || strlen > length - 4 || p[4 + strlen - 1] != 0) {
+        return 0;
+    }
+    return 4 + (uint64_t) strlen;
+}
+
+static int _validate(const uint8_t *doc, uint64_t length,
+    uint32_t depth, docinfo_t *info)
+{
+    if(length < 5 || _le32(doc) != length || doc[length-1] != 0 ||
+            depth > LOGREAD_MAX_DEPTH) {
+        return -1;
+    }
+
+    const uint8_t *p = doc + 4, *end = doc + length - 1;
+
+    while (p != end) {
+        uint8_t type = *p++;
+
+        uint64_t keylen = _cstrlen(p, end - p);
+        if(keylen == 0) {
+            return -1;
+        }
+
+        const uint8_t *key = p, *value = p + keylen;
+        uint64_t remaining = end - value, size = 0;
+
+        switch (type) {
+        case BSON_UNDEFINED: case BSON_NULL:
+        case BSON_MAXKEY: case BSON_MINKEY:
+            break;
+
+        case BSON_BOOL:
+            size = 1;
+            break;
+
+        case BSON_INT:
+            size = 4;
+            break;
+
+        case BSON_DOUBLE: case BSON_DATE:
+        case BSON_TIMESTAMP: case BSON_LONG:
+            size = 8;
+            break;
+
+        case BSON_OID:
+            size = 12;
+            break;
+
+        case BSON_STRING: case BSON_CODE: case BSON_SYMBOL:
+            size = _lstrlen(value, remaining);
+            if(size == 0) {
+                return -1;
+            }
+            break;
+
+        case BSON_OBJECT: case BSON_ARRAY:
+            if(remaining < 5) {
+                return -1;
+            }
+
+            size = _le32(value);
+            if(size > remaining ||
+                    _validate(value, size, depth + 1, NULL) < 0) {
+                return -1;
+            }
+            break;
+
+        case BSON_BINDATA:
+            if(remaining < 5) {
+                return -1;
+            }
+
+            size = 5 + (uint64_t) _le32(value);
+            break;
+
+        case BSON_REGEX:
+            size = _cstrlen(value, remaining);
+            if(size == 0) {
+                return -1;
+            }
+
+            uint64_t optlen = _cstrlen(value + size, remaining - size);
+            if(optlen == 0) {
+                return -1;
+            }
+
+            size += optlen;
+            break;
+
+        case BSON_CODEWSCOPE:
+            if(remaining < 14) {
+                return -1;
+            }
+
+            size = _le32(value);
+            if(size < 14 || size > remaining) {
+                return -1;
+            }
+
+            uint64_t codelen = _lstrlen(value + 4, size - 4);
+            if(codelen == 0 || _validate(value + 4 + codelen,
+                    size - 4 - codelen, depth + 1, NULL) < 0) {
+                return -1;
+            }
+            break;
+
+        default:
+            return -1;
+        }
+
+        if(size > remaining) {
+            return -1;
+        }
+
+        // Pick up the fields we index on from the top-level document.
+        if(info != NULL && key[0] != 0 && key[1] == 0) {
+            if(key[0] == 'I' && type == BSON_INT) {
+                info->has_index = 1, info->index = _le32(value);
+            }
+            else if(key[0] == 'T' && type == BSON_INT) {
+                info->has_tid = 1, info->tid = _le32(value);
+            }
+            else if(key[0] == 't' && type == BSON_INT) {
+                info->has_time = 1, info->time = _le32(value);
+            }
+        }
+        else if(info != NULL && type == BSON_STRING &&
+                strcmp((const char *) key, "type") == 0) {
+            info->type = (const char *) value + 4;
+        }
+
+        p = value + size;
+    }
+
+    return 0;
+}
+
+int logread_validate(const uint8_t *doc, uint64_t length)
+{
+    return _validate(doc, length, 0, NULL);
+}
+
+static int _error(logread_t *lr, const char *msg)
+{
+    if(lr->error == NULL) {
+        lr->error = msg;
+        lr->error_offset = lr->scanned;
+    }
+    return -1;
+}
+
+static int _api_reserve(logread_t *lr, uint32_t index)
+{
+    if(index >= LOGREAD_MAX_INDEX) {
+        return _error(lr, "API index out of range");
+    }
+
+    if(index < lr->api_count) {
+        return 0;
+    }
+
+    uint32_t count = lr->api_count != 0 ? lr->api_count : 64;
+    while (count <= index) {
+        count *= 2;
+    }
+
+    logread_api_t *apis = realloc(lr->apis, count * sizeof(logread_api_t));
+    if(apis == NULL) {
+        return _error(lr, "out of memory");
+    }
+
+    memset(&apis[lr->api_count], 0,
+        (count - lr->api_count) * sizeof(logread_api_t));
+
+    lr->apis = apis;
+    lr->api_count = count;
+    return 0;
+}
+
+static void _api_free(logread_api_t *api)
+{
+    for (uint32_t idx = 0; idx < api->argc; idx++) {
+        free(api->argnames[idx]);
+    }
+
+    free(api->name);
+    free(api->category);
+    free(api->argnames);
+    free(api->argfmt);
+    free(api->fmt);
+
+    api->name = api->category = api->argfmt = api->fmt = NULL;
+    api->argnames = NULL;
+    api->argc = 0;
+}
+
+// Cache the signature described by an "info" document. The strings are
+// copied as the underlying buffer may move while reading in chunks.
+static int _explain(logread_t *lr, const char *doc, uint32_t index)
+{
+    bson_iterator it, args, arg;
+
+    if(_api_reserve(lr, index) < 0) {
+        return -1;
+    }
+
+    logread_api_t *api = &lr->apis[index];
+    _api_free(api);
+
+    bson_iterator_from_buffer(&it, doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+
+        if(strcmp(key, "name") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING) {
+            api->name = strdup(bson_iterator_string(&it));
+        }
+        else if(strcmp(key, "category") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING) {
+            api->category = strdup(bson_iterator_string(&it));
+        }
+        else if(strcmp(key, "fmt") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING) {
+            api->fmt = strdup(bson_iterator_string(&it));
+        }
+        else if(strcmp(key, "args") == 0 &&
+                bson_iterator_type(&it) == BSON_ARRAY) {
+            uint32_t argc = 0;
+
+            bson_iterator_subiterator(&it, &args);
+            while (bson_iterator_next(&args) != BSON_EOO) {
+                argc++;
+            }
+
+            api->argnames = calloc(argc + 1, sizeof(char *));
+            api->argfmt = calloc(argc + 1, sizeof(char));
+            if(api->argnames == NULL || api->argfmt == NULL) {
+                return _error(lr, "out of memory");
+            }
+
+            bson_iterator_subiterator(&it, &args);
+            while (bson_iterator_next(&args) != BSON_EOO) {
+                const char *name = "", *fmt = "";
+
+                if(bson_iterator_type(&args) == BSON_STRING) {
+                    name = bson_iterator_string(&args);
+                }
+                else if(bson_iterator_type(&args) == BSON_ARRAY) {
+                    bson_iterator_subiterator(&args, &arg);
+                    if(bson_iterator_next(&arg) == BSON_STRING) {
+                        name = bson_iterator_string(&arg);
+                    }
+                    if(bson_iterator_next(&arg) == BSON_STRING) {
+                        fmt = bson_iterator_string(&arg);
+                    }
+                }
+
+                api->argnames[api->argc] = strdup(name);
+                api->argfmt[api->argc] = *fmt;
+                api->argc++;
+            }
+        }
+    }
+
+    if(api->name == NULL) {
+        api->name = strdup("");
+    }
+    if(api->category == NULL) {
+        api->category = strdup("");
+    }
+
+    api->explained = 1;
+    lr->info_count++;
+    return 0;
+}
+
+// Open addressing table mapping thread identifiers to their slot in
+// lr->threads, only used while scanning.
+typedef struct _tidmap_t {
+    uint32_t *tids;
+    uint32_t *slots;
+    uint32_t mask;
+
+    uint32_t last_tid, last_slot;
+} tidmap_t;
+
+static inline uint32_t _tid_hash(uint32_t tid)
+{
+    return (tid * 0x9e3779b1) >> 7;
+}
+
+static int _tidmap_grow(tidmap_t *tm)
+{
+    uint32_t mask = tm->mask != 0 ? tm->mask * 2 + 1 : 255;
+    uint32_t *tids = calloc(mask + 1, sizeof(uint32_t));
+    uint32_t *slots = calloc(mask + 1, sizeof(uint32_t));
+
+    if(tids == NULL || slots == NULL) {
+        free(tids), free(slots);
+        return -1;
+    }
+
+    for (uint32_t idx = 0; tm->mask != 0 && idx <= tm->mask; idx++) {
+        if(tm->slots[idx] == 0) {
+            continue;
+        }
+
+        uint32_t pos = _tid_hash(tm->tids[idx]) & mask;
+        while (slots[pos] != 0) {
+            pos = (pos + 1) & mask;
+        }
+
+        tids[pos] = tm->tids[idx];
+        slots[pos] = tm->slots[idx];
+    }
+
+    free(tm->tids), free(tm->slots);
+    tm->tids = tids, tm->slots = slots, tm->mask = mask;
+    return 0;
+}
+
+static void _tidmap_free(tidmap_t *tm)
+{
+    free(tm->tids), free(tm->slots);
+    memset(tm, 0, sizeof(tidmap_t));
+}
+
+// Returns the slot of the thread in lr->threads, registering it if needed.
+static int _thread_slot(logread_t *lr, tidmap_t *tm,
+    uint32_t tid, uint32_t *slot)
+{
+    if(lr->thread_count != 0 && tm->last_tid == tid) {
+        *slot = tm->last_slot;
+        return 0;
+    }
+
+    if(tm->mask == 0 || lr->thread_count * 2 > tm->mask) {
+        if(_tidmap_grow(tm) < 0) {
+            return _error(lr, "out of memory");
+        }
+    }
+
+    uint32_t pos = _tid_hash(tid) & tm->mask;
+    while (tm->slots[pos] != 0 && tm->tids[pos] != tid) {
+        pos = (pos + 1) & tm->mask;
+    }
+
+    if(tm->slots[pos] == 0) {
+        logread_thread_t *threads = realloc(lr->threads,
+            (lr->thread_count + 1) * sizeof(logread_thread_t));
+        if(threads == NULL) {
+            return _error(lr, "out of memory");
+        }
+
+        lr->threads = threads;
+        lr->threads[lr->thread_count].tid = tid;
+        lr->threads[lr->thread_count].first = 0;
+        lr->threads[lr->thread_count].count = 0;
+        lr->threads[lr->thread_count].last = 0;
+
+        tm->tids[pos] = tid;
+        tm->slots[pos] = ++lr->thread_count;
+    }
+
+    tm->last_tid = tid;
+    tm->last_slot = *slot = tm->slots[pos] - 1;
+    return 0;
+}
+
+static int _record(logread_t *lr, tidmap_t *tm,
+    const docinfo_t *info, uint64_t offset, uint64_t length)
+{
+    uint32_t slot;
+
+    if(lr->record_count == UINT32_MAX) {
+        return _error(lr, "too many records");
+    }
+
+    if(lr->record_count == lr->record_capacity) {
+        uint32_t capacity = lr->record_capacity != 0 ?
+            lr->record_capacity * 2 : 0x10000;
+        if(capacity < lr->record_capacity) {
+            capacity = UINT32_MAX;
+        }
+
+        logread_record_t *records = realloc(lr->records,
+            (size_t) capacity * sizeof(logread_record_t));
+        if(records == NULL) {
+            return _error(lr, "out of memory");
+        }
+
+        lr->records = records;
+        lr->record_capacity = capacity;
+    }
+
+    if(_api_reserve(lr, info->index) < 0 ||
+            _thread_slot(lr, tm, info->tid, &slot) < 0) {
+        return -1;
+    }
+
+    if(lr->apis[info->index].explained == 0) {
+        lr->unresolved_count++;
+    }
+
+    logread_record_t *rec = &lr->records[lr->record_count++];
+    rec->offset = offset;
+    rec->index = info->index;
+    rec->tid = info->tid;
+    rec->time = info->time;
+    rec->length = (uint32_t) length;
+    rec->repeat = 0;
+
+    lr->apis[info->index].count++;
+    lr->threads[slot].count++;
+    lr->threads[slot].last = lr->record_count;
+    return 0;
+}
+
+static int _header(logread_t *lr, int final)
+{
+    const uint8_t *p = lr->data; uint64_t size = lr->size;
+
+    // The raw process identifier precedes the textual header.
+    if(size >= 4 && memcmp(p, "BSON", 4) != 0) {
+        lr->pid = _le32(p);
+        p += 4, size -= 4;
+    }
+
+    uint64_t length = size < LOGREAD_HEADER_MAX ? size : LOGREAD_HEADER_MAX;
+    const uint8_t *newline = memchr(p, '\n', length);
+
+    if(newline == NULL) {
+        if(final != 0 || size >= LOGREAD_HEADER_MAX) {
+            return _error(lr, "missing BSON header");
+        }
+        return 1;
+    }
+
+    if(size < 4 || memcmp(p, "BSON", 4) != 0) {
+        return _error(lr, "missing BSON header");
+    }
+
+    char header[LOGREAD_HEADER_MAX+1], *ptr;
+    memcpy(header, p, newline - p);
+    header[newline - p] = 0;
+
+    if(lr->pid == 0) {
+        lr->pid = strtoul(header + 4, NULL, 10);
+    }
+
+    // Options negotiated by the monitor, e.g., "format=packed ptr=4".
+    lr->ptrsize = 8;
+    for (char *opt = strtok_r(header + 4, " ", &ptr); opt != NULL;
+            opt = strtok_r(NULL, " ", &ptr)) {
+        if(strcmp(opt, "format=packed") == 0) {
+            lr->packed = 1;
+        }
+        else if(strcmp(opt, "strings=dict") == 0) {
+            lr->dict = 1;
+        }
+        else if(strcmp(opt, "compress=lz4") == 0) {
+            lr->compressed = 1;
+        }
+        else if(strncmp(opt, "ptr=", 4) == 0) {
+            lr->ptrsize = strtoul(opt + 4, NULL, 10);
+        }
+    }
+
+    lr->scanned = newline + 1 - lr->data;
+    return 0;
+}
+
+// Read a varint from [*p, end).
+static inline const logread_string_t *_string(const logread_t *lr,
+    uint64_t id)
+{
+    if(id >= lr->string_count || lr->strings[id].offset == 0) {
+        return NULL;
+    }
+    return &lr->strings[id];
+}
+
+// Attach a "repeat" document to the most recent record of its thread,
+// which is the call that has been repeated.
+static int _repeat(logread_t *lr, tidmap_t *tm,
+    const uint8_t *doc, const docinfo_t *info)
+{
+    bson_iterator it; uint32_t count = 0, slot;
+
+    if(info->has_index == 0 || info->has_tid == 0 ||
+            _thread_slot(lr, tm, info->tid, &slot) < 0) {
+        return -1;
+    }
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(strcmp(bson_iterator_key(&it), "n") == 0 &&
+                bson_iterator_type(&it) == BSON_INT) {
+            count = (uint32_t) bson_iterator_int(&it);
+        }
+    }
+
+    uint32_t last = lr->threads[slot].last;
+    if(count == 0 || last == 0 ||
+            lr->records[last - 1].index != info->index) {
+        return -1;
+    }
+
+    lr->records[last - 1].repeat += count;
+    lr->repeated_calls += count;
+    lr->repeat_count++;
+    return 0;
+}
+
+// Take over the counters of a "ratelimit" summary. These are cumulative,
+// so the most recent summary is the one that counts.
+static int _ratelimit(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it, apis, api; int found = 0;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (found == 0 && bson_iterator_next(&it) != BSON_EOO) {
+        found = strcmp(bson_iterator_key(&it), "apis") == 0 &&
+            bson_iterator_type(&it) == BSON_ARRAY;
+    }
+
+    if(found == 0) {
+        return -1;
+    }
+
+    bson_iterator_subiterator(&it, &apis);
+    while (bson_iterator_next(&apis) != BSON_EOO) {
+        int64_t values[3]; uint32_t count = 0;
+
+        if(bson_iterator_type(&apis) != BSON_ARRAY) {
+            return -1;
+        }
+
+        bson_iterator_subiterator(&apis, &api);
+        while (bson_iterator_next(&api) != BSON_EOO && count < 3) {
+            values[count++] = bson_iterator_long(&api);
+        }
+
+        if(count != 3 || values[0] < 0 || _api_reserve(lr, values[0]) < 0) {
+            return -1;
+        }
+
+        lr->apis[values[0]].calls = values[1];
+        lr->apis[values[0]].dropped = values[2];
+    }
+
+    lr->ratelimit_count++;
+    return 0;
+}
+
+// Find the slot of a checksum, or, if it's not there and bufno is
+// non-zero, fill the empty slot with it. Returns the buffer number plus
+// one, or zero.
+static uint32_t _buffer_slot(const logread_t *lr, const char *checksum,
+    uint32_t bufno)
+{
+    uint32_t mask = 2 * lr->buffer_capacity - 1;
+
+    if(lr->buffer_capacity == 0) {
+        return 0;
+    }
+
+    // The checksum is a hash already.
+    uint32_t slot = 0;
+    for (uint32_t idx = 0; idx < 8; idx++) {
+        char ch = checksum[idx] | 0x20;
+        slot = (slot << 4) | (ch <= '9' ? ch - '0' : ch - 'a' + 10);
+    }
+
+    for (slot &= mask; lr->buffer_slots[slot] != 0; slot = (slot + 1) & mask) {
+        const logread_buffer_t *buf = &lr->buffers[lr->buffer_slots[slot] - 1];
+        if(memcmp(lr->data + buf->checksum, checksum, 40) == 0) {
+            return lr->buffer_slots[slot];
+        }
+    }
+
+    if(bufno != 0) {
+        lr->buffer_slots[slot] = bufno;
+    }
+    return bufno;
+}
+
+static const char *_checksum(const uint8_t *doc)
+{
+    bson_iterator it;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(strcmp(bson_iterator_key(&it), "checksum") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING &&
+                bson_iterator_string_len(&it) == 41) {
+            return bson_iterator_string(&it);
+        }
+    }
+    return NULL;
+}
+
+// Add a buffer to the buffer table, which takes ownership of its copy.
+static int _buffer_add(logread_t *lr, logread_buffer_t *buf,
+    const char *checksum)
+{
+    // The slot table has twice the capacity, and is rebuilt as it grows.
+    if(lr->unique_buffer_count == lr->buffer_capacity) {
+        uint32_t count = lr->buffer_capacity != 0 ?
+            2 * lr->buffer_capacity : 64;
+
+        logread_buffer_t *buffers =
+            realloc(lr->buffers, count * sizeof(logread_buffer_t));
+        if(buffers == NULL) {
+            free(buf->copy);
+            return _error(lr, "out of memory");
+        }
+        lr->buffers = buffers;
+
+        uint32_t *slots = calloc(2 * count, sizeof(uint32_t));
+        if(slots == NULL) {
+            free(buf->copy);
+            return _error(lr, "out of memory");
+        }
+
+        free(lr->buffer_slots);
+        lr->buffer_slots = slots;
+        lr->buffer_capacity = count;
+
+        for (uint32_t idx = 0; idx < lr->unique_buffer_count; idx++) {
+            _buffer_slot(lr, (const char *) lr->data +
+                lr->buffers[idx].checksum, idx + 1);
+        }
+    }
+
+    buf->checksum = (const uint8_t *) checksum - lr->data;
+    lr->buffers[lr->unique_buffer_count++] = *buf;
+    _buffer_slot(lr, checksum, lr->unique_buffer_count);
+    return 0;
+}
+
+// Remember where the contents of a buffer are, unless they've been seen
+// before or are missing.
+static int _buffer(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it; logread_buffer_t buf = {};
+
+    const char *checksum = _checksum(doc);
+    if(checksum == NULL || logread_buffer(lr, checksum, NULL) != NULL) {
+        return 0;
+    }
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(strcmp(bson_iterator_key(&it), "buffer") == 0 &&
+                bson_iterator_type(&it) == BSON_BINDATA) {
+            buf.data = (const uint8_t *) bson_iterator_bin_data(&it) -
+                lr->data;
+            buf.length = bson_iterator_bin_len(&it);
+        }
+    }
+
+    if(buf.data == 0) {
+        return 0;
+    }
+
+    return _buffer_add(lr, &buf, checksum);
+}
+
+// Keep track of a chunk until the end of its stream.
+static int _bufchunk(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it; logread_chunk_t chunk = {};
+    int has_stream = 0, has_offset = 0, has_data = 0;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+        bson_type type = bson_iterator_type(&it);
+
+        if(strcmp(key, "stream") == 0 && type == BSON_INT) {
+            chunk.stream = bson_iterator_int(&it), has_stream = 1;
+        }
+        else if(strcmp(key, "offset") == 0 && type == BSON_LONG) {
+            chunk.offset = bson_iterator_long(&it), has_offset = 1;
+        }
+        else if(strcmp(key, "data") == 0 && type == BSON_BINDATA) {
+            chunk.data = (const uint8_t *) bson_iterator_bin_data(&it) -
+                lr->data;
+            chunk.length = bson_iterator_bin_len(&it), has_data = 1;
+        }
+    }
+
+    if(has_stream == 0 || has_offset == 0 || has_data == 0) {
+        return -1;
+    }
+
+    if(lr->chunk_count == lr->chunk_capacity) {
+        uint32_t count = lr->chunk_capacity != 0 ?
+            2 * lr->chunk_capacity : 64;
+
+        logread_chunk_t *chunks =
+            realloc(lr->chunks, count * sizeof(logread_chunk_t));
+        if(chunks == NULL) {
+            return -1;
+        }
+
+        lr->chunks = chunks;
+        lr->chunk_capacity = count;
+    }
+
+    lr->chunks[lr->chunk_count++] = chunk;
+    return 0;
+}
+
+// Reassemble a stream from its chunks. Streams which were cut short, of
+// which chunks are missing, or of which the contents don't match the
+// checksum are counted as incomplete.
+static int _bufend(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it; uint32_t stream = 0; uint64_t size = 0;
+    int has_stream = 0, has_size = 0;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+        bson_type type = bson_iterator_type(&it);
+
+        if(strcmp(key, "stream") == 0 && type == BSON_INT) {
+            stream = bson_iterator_int(&it), has_stream = 1;
+        }
+        else if(strcmp(key, "size") == 0 && type == BSON_LONG) {
+            size = bson_iterator_long(&it), has_size = 1;
+        }
+    }
+
+    if(has_stream == 0 || has_size == 0) {
+        return -1;
+    }
+
+    const char *checksum = _checksum(doc);
+    uint8_t *copy = NULL; uint64_t total = 0; int complete = 1;
+
+    if(checksum == NULL || size > UINT32_MAX ||
+            logread_buffer(lr, checksum, NULL) != NULL) {
+        complete = 0;
+    }
+    else if((copy = malloc(size != 0 ? size : 1)) == NULL) {
+        return _error(lr, "out of memory");
+    }
+
+    // Move the chunks of the stream out of the pending chunks.
+    uint32_t count = 0;
+    for (uint32_t idx = 0; idx < lr->chunk_count; idx++) {
+        const logread_chunk_t *chunk = &lr->chunks[idx];
+        if(chunk->stream != stream) {
+            lr->chunks[count++] = *chunk;
+            continue;
+        }
+
+        if(chunk->offset > size || chunk->length > size - chunk->offset) {
+            complete = 0;
+        }
+        else if(copy != NULL) {
+            memcpy(copy + chunk->offset, lr->data + chunk->data,
+                chunk->length);
+        }
+        total += chunk->length;
+    }
+    lr->chunk_count = count;
+
+    if(complete != 0 && total == size) {
+        uint8_t digest[SHA1_DIGEST_SIZE]; char hexdigest[41]; sha1_t ctx;
+
+        sha1_init(&ctx);
+        sha1_update(&ctx, copy, size);
+        sha1_final(&ctx, digest);
+
+        for (uint32_t idx = 0; idx < SHA1_DIGEST_SIZE; idx++) {
+            sprintf(hexdigest + 2 * idx, "%02x", digest[idx]);
+        }
+
+        if(memcmp(hexdigest, checksum, 40) == 0) {
+            logread_buffer_t buf = {0, 0, size, copy};
+            lr->stream_count++;
+            return _buffer_add(lr, &buf, checksum);
+        }
+    }
+
+    // Buffers which have been sent before are merely not stored again.
+    if(checksum == NULL || logread_buffer(lr, checksum, NULL) == NULL) {
+        lr->incomplete_stream_count++;
+    }
+    else {
+        lr->stream_count++;
+    }
+
+    free(copy);
+    return 0;
+}
+
+static int _bufref(logread_t *lr, const uint8_t *doc)
+{
+    const char *checksum = _checksum(doc);
+    if(checksum == NULL) {
+        return -1;
+    }
+
+    if(logread_buffer(lr, checksum, NULL) == NULL) {
+        lr->unresolved_bufref_count++;
+    }
+
+    lr->bufref_count++;
+    return 0;
+}
+
+// Append a module to the module map.
+static int _module(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it; logread_module_t mod = {}; int has_base = 0;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+        bson_type type = bson_iterator_type(&it);
+
+        if(strcmp(key, "base") == 0 &&
+                (type == BSON_LONG || type == BSON_INT)) {
+            mod.base = (uint64_t) bson_iterator_long(&it);
+            has_base = 1;
+        }
+        else if(strcmp(key, "size") == 0 && type == BSON_INT) {
+            mod.size = (uint32_t) bson_iterator_int(&it);
+        }
+        else if(strcmp(key, "hash") == 0 && type == BSON_INT) {
+            mod.hash = (uint32_t) bson_iterator_int(&it);
+        }
+        else if(strcmp(key, "timestamp") == 0 && type == BSON_INT) {
+            mod.timestamp = (uint32_t) bson_iterator_int(&it);
+        }
+        else if(strcmp(key, "path") == 0 && type == BSON_STRING) {
+            mod.path = (const uint8_t *) bson_iterator_string(&it) - lr->data;
+            mod.path_length = bson_iterator_string_len(&it) - 1;
+        }
+    }
+
+    if(has_base == 0) {
+        return -1;
+    }
+
+    for (uint32_t idx = lr->module_count; mod.path == 0 && idx-- != 0;) {
+        if(lr->modules[idx].hash == mod.hash) {
+            mod.path = lr->modules[idx].path;
+            mod.path_length = lr->modules[idx].path_length;
+        }
+    }
+
+    if(lr->module_count == lr->module_capacity) {
+        uint32_t count = lr->module_capacity != 0 ?
+            2 * lr->module_capacity : 64;
+
+        logread_module_t *modules =
+            realloc(lr->modules, count * sizeof(logread_module_t));
+        if(modules == NULL) {
+            return _error(lr, "out of memory");
+        }
+
+        lr->modules = modules;
+        lr->module_capacity = count;
+    }
+
+    mod.recno = lr->record_count;
+    lr->modules[lr->module_count++] = mod;
+    return 0;
+}
+
+// Take over an "exceptions" summary, which is cumulative as well, but only
+// lists the sites whose counts changed. Sites are kept by their number.
+static int _exceptions(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it, sites, site;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+
+        if(strcmp(key, "n") == 0) {
+            lr->exception_count = (uint64_t) bson_iterator_long(&it);
+        }
+        else if(strcmp(key, "other") == 0) {
+            lr->exception_other = (uint64_t) bson_iterator_long(&it);
+        }
+
+        if(strcmp(key, "sites") != 0 ||
+                bson_iterator_type(&it) != BSON_ARRAY) {
+            continue;
+        }
+
+        bson_iterator_subiterator(&it, &sites);
+        while (bson_iterator_next(&sites) != BSON_EOO) {
+            int64_t values[4]; uint32_t length = 0;
+
+            if(bson_iterator_type(&sites) != BSON_ARRAY) {
+                return -1;
+            }
+
+            bson_iterator_subiterator(&sites, &site);
+            while (bson_iterator_next(&site) != BSON_EOO && length < 4) {
+                values[length++] = bson_iterator_long(&site);
+            }
+
+            if(length != 4 || values[3] < 0 ||
+                    values[3] >= LOGREAD_EXCEPTION_SITES_MAX) {
+                return -1;
+            }
+
+            uint32_t id = (uint32_t) values[3];
+            if(id >= lr->exception_site_capacity) {
+                uint32_t capacity = lr->exception_site_capacity * 2;
+                if(capacity <= id) {
+                    capacity = id + 64;
+                }
+
+                logread_exception_t *exceptions = realloc(lr->exceptions,
+                    capacity * sizeof(logread_exception_t));
+                if(exceptions == NULL) {
+                    return _error(lr, "out of memory");
+                }
+
+                memset(&exceptions[lr->exception_site_capacity], 0,
+                    (capacity - lr->exception_site_capacity) *
+                    sizeof(logread_exception_t));
+                lr->exceptions = exceptions;
+                lr->exception_site_capacity = capacity;
+            }
+
+            lr->exceptions[id].code = (uint32_t) values[0];
+            lr->exceptions[id].address = (uint64_t) values[1];
+            lr->exceptions[id].count = (uint64_t) values[2];
+            if(id >= lr->exception_site_count) {
+                lr->exception_site_count = id + 1;
+            }
+        }
+    }
+
+    lr->exception_summary_count++;
+    return 0;
+}
+
+// Register a "string" document in the dictionary.
+static int _define(logread_t *lr, const uint8_t *doc)
+{
+    bson_iterator it; uint64_t id = 0;
+    const char *value = NULL; uint32_t length = 0;
+
+    bson_iterator_from_buffer(&it, (const char *) doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        const char *key = bson_iterator_key(&it);
+
+        if(strcmp(key, "i") == 0 && bson_iterator_type(&it) == BSON_INT) {
+            id = (uint32_t) bson_iterator_int(&it);
+        }
+        else if(strcmp(key, "s") == 0 &&
+                bson_iterator_type(&it) == BSON_STRING) {
+            value = bson_iterator_string(&it);
+            length = bson_iterator_string_len(&it) - 1;
+        }
+    }
+
+    if(id == 0 || value == NULL ||
+            id >= (uint64_t) lr->string_count + LOGREAD_MAX_INDEX) {
+        return -1;
+    }
+
+    if(id >= lr->string_count) {
+        uint32_t count = lr->string_count != 0 ? lr->string_count : 256;
+        while (count <= id) {
+            count *= 2;
+        }
+
+        logread_string_t *strings =
+            realloc(lr->strings, count * sizeof(logread_string_t));
+        if(strings == NULL) {
+            return _error(lr, "out of memory");
+        }
+
+        memset(&strings[lr->string_count], 0,
+            (count - lr->string_count) * sizeof(logread_string_t));
+        lr->strings = strings;
+        lr->string_count = count;
+    }
+
+    lr->strings[id].offset = (const uint8_t *) value - lr->data;
+    lr->strings[id].length = length;
+    return 0;
+}
+
+static inline int _varint(const uint8_t **p, const uint8_t *end,
+    uint64_t *value)
+{
+    return packed_read_varint(p, end, value);
+}
+
+static inline int _svarint(const uint8_t **p, const uint8_t *end,
+    int64_t *value)
+{
+    uint64_t raw;
+    if(packed_read_varint(p, end, &raw) < 0) {
+        return -1;
+    }
+    *value = packed_unzigzag(raw);
+    return 0;
+}
+
+static inline int _bytes(const uint8_t **p, const uint8_t *end,
+    uint64_t length, const char **value)
+{
+    if(length > (uint64_t)(end - *p)) {
+        return -1;
+    }
+    *value = (const char *) *p;
+    *p += length;
+    return 0;
+}
+
+// A packed string, which may be flagged as binary data or reference the
+// string dictionary.
+static int _packed_string(const logread_t *lr, const uint8_t **p,
+    const uint8_t *end, bson *b, const char *key)
+{
+    uint64_t header; const char *value;
+
+    if(_varint(p, end, &header) < 0) {
+        return -1;
+    }
+
+    if((header & 3) == PACKED_STRING_REF) {
+        const logread_string_t *s = _string(lr, header >> 2);
+        if(s == NULL) {
+            return -1;
+        }
+
+        if(b != NULL) {
+            bson_append_string_n(b, key,
+                (const char *) lr->data + s->offset, s->length);
+        }
+        return 0;
+    }
+
+    if((header & 3) > PACKED_STRING_BINARY ||
+            _bytes(p, end, header >> 2, &value) < 0) {
+        return -1;
+    }
+
+    if(b != NULL && (header & 3) == PACKED_STRING_BINARY) {
+        bson_append_binary(b, key, BSON_BIN_BINARY, value, header >> 2);
+    }
+    else if(b != NULL) {
+        bson_append_string_n(b, key, value, header >> 2);
+    }
+    return 0;
+}
+
+static int _packed_blob(const uint8_t **p, const uint8_t *end,
+    bson *b, const char *key)
+{
+    uint64_t length; const char *value;
+
+    if(_varint(p, end, &length) < 0 ||
+            _bytes(p, end, length, &value) < 0) {
+        return -1;
+    }
+
+    if(b != NULL) {
+        bson_append_binary(b, key, BSON_BIN_BINARY, value, length);
+    }
+    return 0;
+}
+
+static int _packed_int(const uint8_t **p, const uint8_t *end,
+    bson *b, const char *key, int is_long)
+{
+    int64_t value;
+
+    if(_svarint(p, end, &value) < 0) {
+        return -1;
+    }
+
+    if(b != NULL && is_long != 0) {
+        bson_append_long(b, key, value);
+    }
+    else if(b != NULL) {
+        bson_append_int(b, key, (int32_t) value);
+    }
+    return 0;
+}
+
+// Embedded BSON object or array, or null.
+static int _packed_element(const uint8_t **p, const uint8_t *end,
+    bson *b, const char *key)
+{
+    if(*p == end) {
+        return -1;
+    }
+
+    uint8_t type = *(*p)++;
+
+    if(type == BSON_NULL) {
+        if(b != NULL) {
+            bson_append_null(b, key);
+        }
+        return 0;
+    }
+
+    if((type != BSON_OBJECT && type != BSON_ARRAY) || end - *p < 5) {
+        return -1;
+    }
+
+    uint32_t length = _le32(*p);
+    if(length > (uint64_t)(end - *p) || _validate(*p, length, 1, NULL) < 0) {
+        return -1;
+    }
+
+    if(b != NULL) {
+        // Wrap the document in an element so it can be appended as-is.
+        char *element = malloc(length + 3);
+        if(element == NULL) {
+            return -1;
+        }
+
+        bson_iterator it = {.cur = element, .first = 0};
+        element[0] = type, element[1] = 'z', element[2] = 0;
+        memcpy(element + 3, *p, length);
+        bson_append_element(b, key, &it);
+        free(element);
+    }
+
+    *p += length;
+    return 0;
+}
+
+// Walk the body of a packed record following its API index, see packed.h.
+// Validates the record if b is NULL, appends its BSON equivalent otherwise.
+static int _packed_body(const logread_t *lr, const logread_api_t *api,
+    const uint8_t *p, const uint8_t *end, bson *b)
+{
+    uint64_t hash, value, count, key = 0;
+    char idx[16], key2[16];
+
+    if(_varint(&p, end, &hash) < 0 || p == end) {
+        return -1;
+    }
+
+    uint8_t flags = *p++;
+
+    if(b != NULL) {
+        bson_append_long(b, "h", hash);
+    }
+
+    if((flags & PACKED_FLAG_ERROR) != 0) {
+        for (uint32_t idx = 0; idx < 2; idx++) {
+            if(_varint(&p, end, &value) < 0) {
+                return -1;
+            }
+            if(b != NULL) {
+                bson_append_int(b, idx == 0 ? "e" : "E", (int32_t) value);
+            }
+        }
+    }
+
+    if((flags & PACKED_FLAG_STACKTRACE) != 0) {
+        if(_varint(&p, end, &count) < 0) {
+            return -1;
+        }
+
+        if(b != NULL) {
+            bson_append_start_array(b, "s");
+        }
+
+        for (uint64_t idx = 0; idx < count; idx++) {
+            snprintf(key2, sizeof(key2), "%u", (uint32_t) idx);
+            if(_packed_string(lr, &p, end, b, key2) < 0) {
+                return -1;
+            }
+        }
+
+        if(b != NULL) {
+            bson_append_finish_array(b);
+        }
+    }
+
+    int64_t retval;
+    if(_svarint(&p, end, &retval) < 0) {
+        return -1;
+    }
+
+    if(b != NULL) {
+        if(lr->ptrsize == 4) {
+            retval = (uint32_t) retval;
+        }
+
+        bson_append_start_array(b, "args");
+        bson_append_int(b, "0", (flags & PACKED_FLAG_SUCCESS) != 0);
+        bson_append_long(b, "1", retval);
+    }
+
+    uint32_t argnum = 2;
+    for (const char *fmt = api->fmt; *fmt != 0; fmt++) {
+        if(*fmt == '!') {
+            continue;
+        }
+
+        snprintf(idx, sizeof(idx), "%u", argnum++);
+
+        int ret = -1;
+        switch (*fmt) {
+        case 's': case 'S': case 'u': case 'U':
+        case 'o': case 'c': case 't': case 'v':
+            ret = _packed_string(lr, &p, end, b, idx);
+            break;
+
+        case 'b': case 'B':
+            ret = _packed_blob(&p, end, b, idx);
+            break;
+
+        case 'i': case 'x': case 'I':
+            ret = _packed_int(&p, end, b, idx, 0);
+            break;
+
+        case 'l': case 'p': case 'L': case 'P':
+            ret = _packed_int(&p, end, b, idx, lr->ptrsize == 8);
+            break;
+
+        case 'q': case 'Q':
+            ret = _packed_int(&p, end, b, idx, 1);
+            break;
+
+        case 'a': case 'A':
+            if(_varint(&p, end, &count) < 0) {
+                break;
+            }
+
+            if(b != NULL) {
+                bson_append_start_array(b, idx);
+            }
+
+            ret = 0;
+            for (uint64_t j = 0; j < count && ret == 0; j++) {
+                ret = _varint(&p, end, &key);
+                snprintf(key2, sizeof(key2), "%u", (uint32_t) key);
+                if(ret == 0) {
+                    ret = _packed_string(lr, &p, end, b, key2);
+                }
+            }
+
+            if(b != NULL) {
+                bson_append_finish_array(b);
+            }
+            break;
+
+        case 'r': case 'R':
+            if(p == end) {
+                break;
+            }
+
+            switch (*p++) {
+            case PACKED_TYPE_INT32:
+                ret = _packed_int(&p, end, b, idx, 0);
+                break;
+
+            case PACKED_TYPE_INT64:
+                ret = _packed_int(&p, end, b, idx, 1);
+                break;
+
+            case PACKED_TYPE_STRING:
+                ret = _packed_string(lr, &p, end, b, idx);
+                break;
+
+            case PACKED_TYPE_BINARY:
+                ret = _packed_blob(&p, end, b, idx);
+                break;
+            }
+            break;
+
+        case 'z':
+            ret = _packed_element(&p, end, b, idx);
+            break;
+        }
+
+        if(ret < 0) {
+            return -1;
+        }
+    }
+
+    if(b != NULL) {
+        bson_append_finish_array(b);
+    }
+
+    return p == end ? 0 : -1;
+}
+
+// Scan a BSON document, preceded by a tag byte of hdrlen bytes in packed
+// mode. Returns the number of bytes consumed, 0 if the document has not
+// been read completely yet, or -1 on error.
+static int64_t _scan_bson(logread_t *lr, tidmap_t *tm, uint32_t hdrlen)
+{
+    if(lr->size - lr->scanned < hdrlen + 4) {
+        return 0;
+    }
+
+    const uint8_t *doc = lr->data + lr->scanned + hdrlen;
+    uint64_t length = _le32(doc);
+
+    if(length < 5) {
+        return _error(lr, "invalid document length");
+    }
+
+    if(length > lr->size - lr->scanned - hdrlen) {
+        return 0;
+    }
+
+    docinfo_t info = {};
+    if(_validate(doc, length, 0, &info) < 0) {
+        return _error(lr, "malformed document");
+    }
+
+    if(info.type != NULL) {
+        if(strcmp(info.type, "info") == 0) {
+            if(info.has_index == 0 ||
+                    _explain(lr, (const char *) doc, info.index) < 0) {
+                return _error(lr, "malformed info document");
+            }
+        }
+        else if(strcmp(info.type, "buffer") == 0) {
+            if(_buffer(lr, doc) < 0) {
+                return -1;
+            }
+            lr->buffer_count++;
+        }
+        else if(strcmp(info.type, "bufchunk") == 0) {
+            if(_bufchunk(lr, doc) < 0) {
+                return _error(lr, "malformed bufchunk document");
+            }
+        }
+        else if(strcmp(info.type, "bufend") == 0) {
+            if(_bufend(lr, doc) < 0) {
+                return _error(lr, "malformed bufend document");
+            }
+            lr->buffer_count++;
+        }
+        else if(strcmp(info.type, "bufref") == 0) {
+            if(_bufref(lr, doc) < 0) {
+                return _error(lr, "malformed bufref document");
+            }
+        }
+        else if(strcmp(info.type, "string") == 0) {
+            if(_define(lr, doc) < 0) {
+                return _error(lr, "malformed string document");
+            }
+        }
+        else if(strcmp(info.type, "exceptions") == 0) {
+            if(_exceptions(lr, doc) < 0) {
+                return _error(lr, "malformed exceptions document");
+            }
+        }
+        else if(strcmp(info.type, "module") == 0) {
+            if(_module(lr, doc) < 0) {
+                return _error(lr, "malformed module document");
+            }
+        }
+        else if(strcmp(info.type, "ratelimit") == 0) {
+            if(_ratelimit(lr, doc) < 0) {
+                return _error(lr, "malformed ratelimit document");
+            }
+        }
+        else if(strcmp(info.type, "repeat") == 0) {
+            if(_repeat(lr, tm, doc, &info) < 0) {
+                return _error(lr, "unmatched repeat document");
+            }
+        }
+    }
+    else if(info.has_index != 0 && lr->packed == 0) {
+        if(_record(lr, tm, &info, lr->scanned, length) < 0) {
+            return -1;
+        }
+    }
+    else {
+        return _error(lr, "document without API index");
+    }
+
+    return hdrlen + length;
+}
+
+// Decode the fields of a packed record preceding its body.
+static int _packed_head(const uint8_t **p, const uint8_t *end,
+    int64_t *dtime, int64_t *dtid, uint64_t *index)
+{
+    if(_svarint(p, end, dtime) < 0 || _svarint(p, end, dtid) < 0 ||
+            _varint(p, end, index) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int64_t _scan_packed(logread_t *lr, tidmap_t *tm)
+{
+    const uint8_t *p = lr->data + lr->scanned + 1;
+    const uint8_t *end = lr->data + lr->size;
+    uint64_t length, index; int64_t dtime, dtid;
+
+    if(_varint(&p, end, &length) < 0) {
+        if(end - p < PACKED_VARINT_MAX) {
+            return 0;
+        }
+        return _error(lr, "invalid record length");
+    }
+
+    if(length > (uint64_t)(end - p)) {
+        return 0;
+    }
+
+    uint64_t offset = p - lr->data;
+    end = p + length;
+
+    if(_packed_head(&p, end, &dtime, &dtid, &index) < 0) {
+        return _error(lr, "malformed packed record");
+    }
+
+    const logread_api_t *api = logread_api(lr, index);
+    if(api == NULL || api->fmt == NULL) {
+        return _error(lr, "packed record without schema");
+    }
+
+    if(_packed_body(lr, api, p, end, NULL) < 0) {
+        return _error(lr, "malformed packed record");
+    }
+
+    docinfo_t info = {};
+    info.index = index;
+    info.tid = lr->packed_tid += dtid;
+    info.time = lr->packed_time += dtime;
+
+    if(_record(lr, tm, &info, offset, length) < 0) {
+        return -1;
+    }
+
+    return offset + length - lr->scanned;
+}
+
+// Make room for at least length more bytes of (decompressed) stream.
+static int _reserve(logread_t *lr, uint64_t length)
+{
+    if(lr->capacity - lr->size >= length) {
+        return 0;
+    }
+
+    uint64_t capacity = lr->capacity != 0 ?
+        lr->capacity : 2 * LOGREAD_CHUNK_SIZE;
+    while (capacity - lr->size < length) {
+        capacity *= 2;
+    }
+
+    uint8_t *data = realloc((void *) lr->data, capacity);
+    if(data == NULL) {
+        return _error(lr, "out of memory");
+    }
+
+    lr->data = data;
+    lr->capacity = capacity;
+    return 0;
+}
+
+static int _zin_reserve(logread_t *lr, uint64_t length)
+{
+    if(lr->zin_capacity - lr->zin_size >= length) {
+        return 0;
+    }
+
+    uint64_t capacity = lr->zin_capacity != 0 ?
+        lr->zin_capacity : LOGREAD_CHUNK_SIZE;
+    while (capacity - lr->zin_size < length) {
+        capacity *= 2;
+    }
+
+    uint8_t *zin = realloc(lr->zin, capacity);
+    if(zin == NULL) {
+        return _error(lr, "out of memory");
+    }
+
+    lr->zin = zin;
+    lr->zin_capacity = capacity;
+    return 0;
+}
+
+// Decompress the complete frames in zin and append them to the stream.
+static int _inflate(logread_t *lr)
+{
+    uint64_t offset = 0; int ret = 0;
+
+    while (lr->zin_size - offset >= LZ_FRAME_HEADER) {
+        uint32_t header = _le32(lr->zin + offset);
+        uint32_t length = header & ~LZ_FRAME_RAW;
+        const uint8_t *payload = lr->zin + offset + LZ_FRAME_HEADER;
+
+        if(length == 0 || length > LZ_BLOCK_MAX) {
+            ret = _error(lr, "invalid frame length");
+            break;
+        }
+
+        if(length > lr->zin_size - offset - LZ_FRAME_HEADER) {
+            break;
+        }
+
+        if(_reserve(lr, LZ_BLOCK_MAX) < 0) {
+            ret = -1;
+            break;
+        }
+
+        uint8_t *out = (uint8_t *) lr->data + lr->size;
+        int32_t size = length;
+
+        if((header & LZ_FRAME_RAW) != 0) {
+            memcpy(out, payload, length);
+        }
+        else {
+            size = lz_decompress(payload, length, out, LZ_BLOCK_MAX);
+            if(size < 0) {
+                ret = _error(lr, "malformed frame");
+                break;
+            }
+        }
+
+        lr->size += size;
+        offset += LZ_FRAME_HEADER + length;
+    }
+
+    memmove(lr->zin, lr->zin + offset, lr->zin_size - offset);
+    lr->zin_size -= offset;
+    return ret;
+}
+
+// Once the header announces compression, move everything following it
+// into zin and decompress it into a buffer of our own.
+static int _inflate_start(logread_t *lr)
+{
+    uint64_t length = lr->size - lr->scanned;
+
+    if(_zin_reserve(lr, length) < 0) {
+        return -1;
+    }
+
+    memcpy(lr->zin, lr->data + lr->scanned, length);
+    lr->zin_size = length;
+
+    if(lr->capacity == 0) {
+        uint8_t *data = malloc(2 * LOGREAD_CHUNK_SIZE);
+        if(data == NULL) {
+            return _error(lr, "out of memory");
+        }
+
+        memcpy(data, lr->data, lr->scanned);
+
+        if(lr->mapped != 0) {
+            munmap((void *) lr->data, lr->size);
+            lr->mapped = 0;
+        }
+
+        lr->data = data;
+        lr->capacity = 2 * LOGREAD_CHUNK_SIZE;
+    }
+
+    lr->size = lr->scanned;
+    return _inflate(lr);
+}
+
+// Validate and index all complete documents which have been read so far.
+static int _scan(logread_t *lr, tidmap_t *tm, int final)
+{
+    if(lr->scanned == 0) {
+        int ret = _header(lr, final);
+        if(ret != 0) {
+            return ret < 0 ? -1 : 0;
+        }
+
+        // Errors in the compressed stream don't prevent indexing what has
+        // been decompressed so far.
+        if(lr->compressed != 0 && _inflate_start(lr) < 0) {
+            final = 1;
+        }
+    }
+
+    while (lr->scanned != lr->size) {
+        int64_t length;
+
+        if(lr->packed == 0) {
+            length = _scan_bson(lr, tm, 0);
+        }
+        else if(lr->data[lr->scanned] == PACKED_TAG_BSON) {
+            length = _scan_bson(lr, tm, 1);
+        }
+        else if(lr->data[lr->scanned] == PACKED_TAG_CALL) {
+            length = _scan_packed(lr, tm);
+        }
+        else {
+            return _error(lr, "invalid frame tag");
+        }
+
+        if(length <= 0) {
+            if(length < 0) {
+                return -1;
+            }
+            break;
+        }
+
+        lr->scanned += length;
+    }
+
+    if(final != 0 && lr->zin_size != 0) {
+        return _error(lr, "truncated frame");
+    }
+
+    if(final != 0 && lr->scanned != lr->size) {
+        return _error(lr, "truncated document");
+    }
+    return lr->error != NULL ? -1 : 0;
+}
+
+static int _thread_compare(const void *a, const void *b)
+{
+    const logread_thread_t *ta = a, *tb = b;
+    return ta->tid < tb->tid ? -1 : ta->tid > tb->tid;
+}
+
+// Build the by-API, by-thread and by-time indices from the scanned records.
+static int _index(logread_t *lr, tidmap_t *tm)
+{
+    uint32_t count = lr->record_count, first = 0, ordered = 1;
+
+    lr->by_api = malloc((count + 1) * sizeof(uint32_t));
+    lr->by_thread = malloc((count + 1) * sizeof(uint32_t));
+    if(lr->by_api == NULL || lr->by_thread == NULL) {
+        return _error(lr, "out of memory");
+    }
+
+    for (uint32_t idx = 0; idx < lr->api_count; idx++) {
+        lr->apis[idx].first = first;
+        first += lr->apis[idx].count;
+        lr->apis[idx].count = 0;
+    }
+
+    first = 0;
+    for (uint32_t idx = 0; idx < lr->thread_count; idx++) {
+        lr->threads[idx].first = first;
+        first += lr->threads[idx].count;
+        lr->threads[idx].count = 0;
+    }
+
+    for (uint32_t idx = 0; idx < count; idx++) {
+        const logread_record_t *rec = &lr->records[idx];
+        logread_api_t *api = &lr->apis[rec->index];
+        uint32_t slot;
+
+        lr->by_api[api->first + api->count++] = idx;
+
+        _thread_slot(lr, tm, rec->tid, &slot);
+        logread_thread_t *thread = &lr->threads[slot];
+        lr->by_thread[thread->first + thread->count++] = idx;
+
+        if(idx != 0 && rec->time < rec[-1].time) {
+            ordered = 0;
+        }
+    }
+
+    if(lr->thread_count != 0) {
+        qsort(lr->threads, lr->thread_count,
+            sizeof(logread_thread_t), &_thread_compare);
+    }
+
+    if(ordered != 0) {
+        return 0;
+    }
+
+    // Stable radix sort on the timestamp, 16 bits at a time.
+    uint32_t *tmp = malloc((count + 1) * sizeof(uint32_t));
+    uint32_t *histogram = malloc(0x10000 * sizeof(uint32_t));
+    lr->by_time = malloc((count + 1) * sizeof(uint32_t));
+
+    if(tmp == NULL || histogram == NULL || lr->by_time == NULL) {
+        free(tmp), free(histogram);
+        return _error(lr, "out of memory");
+    }
+
+    for (uint32_t idx = 0; idx < count; idx++) {
+        lr->by_time[idx] = idx;
+    }
+
+    for (uint32_t shift = 0; shift < 32; shift += 16) {
+        memset(histogram, 0, 0x10000 * sizeof(uint32_t));
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            histogram[(lr->records[idx].time >> shift) & 0xffff]++;
+        }
+
+        for (uint32_t idx = 0, total = 0; idx < 0x10000; idx++) {
+            uint32_t value = histogram[idx];
+            histogram[idx] = total, total += value;
+        }
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            uint32_t recno = lr->by_time[idx];
+            uint32_t key = (lr->records[recno].time >> shift) & 0xffff;
+            tmp[histogram[key]++] = recno;
+        }
+
+        uint32_t *swap = lr->by_time;
+        lr->by_time = tmp, tmp = swap;
+    }
+
+    free(tmp);
+    free(histogram);
+    return 0;
+}
+
+static int _finish(logread_t *lr, tidmap_t *tm)
+{
+    // Even if the log turned out to be corrupted we index what we've got.
+    int ret = _scan(lr, tm, 1);
+
+    if(_index(lr, tm) < 0) {
+        ret = -1;
+    }
+
+    _tidmap_free(tm);
+    return ret;
+}
+
+int logread_open_buffer(logread_t *lr, const void *buf, uint64_t size)
+{
+    tidmap_t tm = {};
+
+    memset(lr, 0, sizeof(logread_t));
+    lr->data = buf;
+    lr->size = size;
+    return _finish(lr, &tm);
+}
+
+static int _open_mmap(logread_t *lr, int fd)
+{
+    struct stat st;
+
+    if(fstat(fd, &st) < 0 || S_ISREG(st.st_mode) == 0 || st.st_size == 0) {
+        return -1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+        return -1;
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    lr->data = data;
+    lr->size = st.st_size;
+    lr->mapped = 1;
+    return 0;
+}
+
+static int _open_read(logread_t *lr, tidmap_t *tm, int fd)
+{
+    while (1) {
+        uint8_t *buf; ssize_t length;
+
+        // Compressed data is collected in zin until its frames are complete,
+        // anything else is read straight into the stream.
+        if(lr->compressed != 0) {
+            if(_zin_reserve(lr, LOGREAD_CHUNK_SIZE) < 0) {
+                return -1;
+            }
+            buf = lr->zin + lr->zin_size;
+        }
+        else {
+            if(_reserve(lr, LOGREAD_CHUNK_SIZE) < 0) {
+                return -1;
+            }
+            buf = (uint8_t *) lr->data + lr->size;
+        }
+
+        length = read(fd, buf, LOGREAD_CHUNK_SIZE);
+        if(length < 0) {
+            return _error(lr, "error reading log");
+        }
+
+        if(length == 0) {
+            return 0;
+        }
+
+        if(lr->compressed != 0) {
+            lr->zin_size += length;
+            if(_inflate(lr) < 0) {
+                _scan(lr, tm, 0);
+                return -1;
+            }
+        }
+        else {
+            lr->size += length;
+        }
+
+        // Index whatever has been read completely so far, so the stream is
+        // processed while it's being read.
+        if(_scan(lr, tm, 0) < 0) {
+            return -1;
+        }
+    }
+}
+
+int logread_open(logread_t *lr, const char *filepath, int flags)
+{
+    tidmap_t tm = {}; int fd = 0, ret;
+
+    memset(lr, 0, sizeof(logread_t));
+
+    if(strcmp(filepath, "-") != 0) {
+        fd = open(filepath, O_RDONLY);
+        if(fd < 0) {
+            lr->error = "unable to open log";
+            return -1;
+        }
+    }
+
+    if((flags & LOGREAD_NOMMAP) == 0 && _open_mmap(lr, fd) == 0) {
+        ret = _finish(lr, &tm);
+    }
+    else if(_open_read(lr, &tm, fd) < 0) {
+        _index(lr, &tm);
+        _tidmap_free(&tm);
+        ret = -1;
+    }
+    else {
+        ret = _finish(lr, &tm);
+    }
+
+    if(fd != 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+void logread_close(logread_t *lr)
+{
+    if(lr->mapped != 0) {
+        munmap((void *) lr->data, lr->size);
+    }
+    else if(lr->capacity != 0) {
+        free((void *) lr->data);
+    }
+
+    for (uint32_t idx = 0; idx < lr->api_count; idx++) {
+        _api_free(&lr->apis[idx]);
+    }
+
+    free(lr->zin);
+    free(lr->strings);
+    free(lr->apis);
+    free(lr->threads);
+    free(lr->records);
+    free(lr->modules);
+    for (uint32_t idx = 0; idx < lr->unique_buffer_count; idx++) {
+        free(lr->buffers[idx].copy);
+    }
+    free(lr->buffers);
+    free(lr->buffer_slots);
+    free(lr->chunks);
+    free(lr->exceptions);
+    free(lr->by_api);
+    free(lr->by_thread);
+    free(lr->by_time);
+    memset(lr, 0, sizeof(logread_t));
+}
+
+const uint8_t *logread_buffer(const logread_t *lr, const char *checksum,
+    uint32_t *length)
+{
+    uint32_t bufno = _buffer_slot(lr, checksum, 0);
+    if(bufno == 0) {
+        return NULL;
+    }
+
+    const logread_buffer_t *buf = &lr->buffers[bufno - 1];
+    if(length != NULL) {
+        *length = buf->length;
+    }
+    return buf->copy != NULL ? buf->copy : lr->data + buf->data;
+}
+
+const logread_module_t *logread_module(const logread_t *lr,
+    uint32_t recno, uint64_t addr)
+{
+    // Later loads take precedence, as the range may have been reused.
+    for (uint32_t idx = lr->module_count; idx-- != 0;) {
+        const logread_module_t *mod = &lr->modules[idx];
+        if(mod->recno <= recno && addr >= mod->base &&
+                addr - mod->base < mod->size) {
+            return mod;
+        }
+    }
+    return NULL;
+}
+
+const logread_api_t *logread_api(const logread_t *lr, uint32_t index)
+{
+    if(index >= lr->api_count || lr->apis[index].explained == 0) {
+        return NULL;
+    }
+    return &lr->apis[index];
+}
+
+const logread_thread_t *logread_thread(const logread_t *lr, uint32_t tid)
+{
+    logread_thread_t key = {.tid = tid};
+    return bsearch(&key, lr->threads, lr->thread_count,
+        sizeof(logread_thread_t), &_thread_compare);
+}
+
+const uint32_t *logread_api_records(const logread_t *lr,
+    uint32_t index, uint32_t *count)
+{
+    *count = 0;
+    if(index >= lr->api_count || lr->apis[index].count == 0) {
+        return NULL;
+    }
+
+    *count = lr->apis[index].count;
+    return &lr->by_api[lr->apis[index].first];
+}
+
+const uint32_t *logread_thread_records(const logread_t *lr,
+    uint32_t tid, uint32_t *count)
+{
+    const logread_thread_t *thread = logread_thread(lr, tid);
+
+    *count = 0;
+    if(thread == NULL || thread->count == 0) {
+        return NULL;
+    }
+
+    *count = thread->count;
+    return &lr->by_thread[thread->first];
+}
+
+uint32_t logread_time_lower_bound(const logread_t *lr, uint32_t time)
+{
+    uint32_t lo = 0, hi = lr->record_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if(lr->records[logread_time_record(lr, mid)].time < time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Finish a converted call record. The conversion may have appended a
+// string which isn't valid UTF-8, which bson_finish() refuses, in which
+// case b is replaced by an empty document and -1 is returned.
+static int _finish_bson(bson *b)
+{
+    if(bson_finish(b) == BSON_OK) {
+        return 0;
+    }
+
+    bson_destroy(b);
+    bson_init_empty(b);
+    return -1;
+}
+
+// Copy a BSON call record, replacing the string references among its
+// arguments by the strings themselves.
+static int _resolve(const logread_t *lr, const char *doc, bson *b)
+{
+    bson_iterator it, args;
+
+    bson_init(b);
+    bson_iterator_from_buffer(&it, doc);
+    while (bson_iterator_next(&it) != BSON_EOO) {
+        if(bson_iterator_type(&it) != BSON_ARRAY ||
+                strcmp(bson_iterator_key(&it), "args") != 0) {
+            bson_append_element(b, NULL, &it);
+            continue;
+        }
+
+        bson_append_start_array(b, "args");
+        bson_iterator_subiterator(&it, &args);
+        while (bson_iterator_next(&args) != BSON_EOO) {
+            const logread_string_t *s = NULL;
+
+            if(bson_iterator_type(&args) == BSON_BINDATA &&
+                    (uint8_t) bson_iterator_bin_type(&args) ==
+                        PACKED_BSON_STRINGREF &&
+                    bson_iterator_bin_len(&args) == 4) {
+                s = _string(lr, _le32((const uint8_t *)
+                    bson_iterator_bin_data(&args)));
+            }
+
+            if(s != NULL) {
+                bson_append_string_n(b, bson_iterator_key(&args),
+                    (const char *) lr->data + s->offset, s->length);
+            }
+            else {
+                bson_append_element(b, NULL, &args);
+            }
+        }
+        bson_append_finish_array(b);
+    }
+    return _finish_bson(b);
+}
+
+int logread_record_bson(const logread_t *lr,
+    const logread_record_t *rec, bson *b)
+{
+    const uint8_t *p = lr->data + rec->offset, *end = p + rec->length;
+    uint64_t index; int64_t dtime, dtid;
+
+    if(lr->packed == 0 && lr->dict == 0) {
+        return bson_init_finished_data(b, (char *) p, 0);
+    }
+
+    if(lr->packed == 0) {
+        return _resolve(lr, (const char *) p, b);
+    }
+
+    bson_init(b);
+    bson_append_int(b, "I", rec->index);
+    bson_append_int(b, "T", rec->tid);
+    bson_append_int(b, "t", rec->time);
+
+    // Records have been validated while scanning.
+    _packed_head(&p, end, &dtime, &dtid, &index);
+    _packed_body(lr, &lr->apis[rec->index], p, end, b);
+    return _finish_bson(b);
+}
+
+int logread_record_args(const logread_t *lr,
+    const logread_record_t *rec, bson *b, bson_iterator *it)
+{
+    bson_iterator doc;
+
+    if(logread_record_bson(lr, rec, b) < 0) {
+        return -1;
+    }
+
+    bson_iterator_init(&doc, b);
+    while (bson_iterator_next(&doc) != BSON_EOO) {
+        if(bson_iterator_type(&doc) == BSON_ARRAY &&
+                strcmp(bson_iterator_key(&doc), "args") == 0) {
+            bson_iterator_subiterator(&doc, it);
+            return 0;
+        }
+    }
+    return -1;
+}
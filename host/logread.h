@@ -0,0 +1,327 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_LOGREAD_H
+#define MONITOR_LOGREAD_H
+
+#include <stdint.h>
+#include "bson.h"
+
+// Host-side reader for the BSON stream emitted by the monitor (see log.c).
+// The stream consists of the raw 32-bit process identifier, the
+// "BSON <pid>\n" header, and a sequence of BSON documents: "info" documents
+// explaining the signature of an API index, "buffer" documents carrying
+// non-truncated buffers, "bufchunk" and "bufend" documents streaming the
+// larger ones in pieces, "bufref" documents referencing a buffer sent
+// before by its checksum, "repeat" documents counting the calls identical
+// to the previous call of a thread, "ratelimit" documents summarizing the
+// calls dropped by rate limiting, "exceptions" documents summarizing the
+// exceptions which haven't been logged in detail, "module" documents mapping the loaded
+// modules for offline symbolization (see symbolize.h), and call documents
+// referencing an API index. With
+// "format=packed" in the header the calls are packed records instead, and
+// with "compress=lz4" the stream is block-compressed.
+
+// Force reading the log in chunks rather than mapping it into memory.
+#define LOGREAD_NOMMAP 1
+
+typedef struct _logread_api_t {
+    // Non-zero if an "info" document has been seen for this index.
+    uint32_t explained;
+    char *name;
+    char *category;
+
+    // Argument names, including "is_success" and "retval". The format is
+    // 'p' or 'x' for pointers and hexadecimal values, respectively, and 0
+    // for arguments without display hint.
+    uint32_t argc;
+    char **argnames;
+    char *argfmt;
+
+    // Parameter types as per sig_paramtypes(), only sent in packed mode.
+    char *fmt;
+
+    // Call records referencing this index, see logread_api_records().
+    uint32_t first, count;
+
+    // Exact number of calls and of calls dropped by rate limiting as of the
+    // most recent "ratelimit" document, zero if none of its calls have been
+    // dropped.
+    uint64_t calls;
+    uint64_t dropped;
+} logread_api_t;
+
+typedef struct _logread_thread_t {
+    uint32_t tid;
+    uint32_t first, count;
+
+    // Most recent record of the thread plus one, only used while scanning.
+    uint32_t last;
+} logread_thread_t;
+
+typedef struct _logread_record_t {
+    uint64_t offset;
+    uint32_t index;
+    uint32_t tid;
+    uint32_t time;
+    uint32_t length;
+
+    // Number of identical calls which followed this one and have been
+    // collapsed into "repeat" documents.
+    uint32_t repeat;
+} logread_record_t;
+
+// A string dictionary entry, referencing the "string" document defining it.
+typedef struct _logread_string_t {
+    uint64_t offset;
+    uint32_t length;
+} logread_string_t;
+
+// A non-truncated buffer, i.e., the offsets of its contents and of its
+// SHA-1 checksum in data. The contents of streamed buffers are reassembled
+// from their chunks into copy instead.
+typedef struct _logread_buffer_t {
+    uint64_t data;
+    uint64_t checksum;
+    uint32_t length;
+    uint8_t *copy;
+} logread_buffer_t;
+
+// A chunk of a streamed buffer which hasn't been completed yet.
+typedef struct _logread_chunk_t {
+    uint32_t stream;
+    uint32_t length;
+    uint64_t offset;
+    uint64_t data;
+} logread_chunk_t;
+
+// Exception sites are numbered by the monitor, which tracks at most about
+// this many of them.
+#define LOGREAD_EXCEPTION_SITES_MAX (1 << 21)
+
+// An exception site of the "exceptions" summaries: the exception code and
+// address, and the number of exceptions raised there so far, which is zero
+// for sites that haven't been summarized.
+typedef struct _logread_exception_t {
+    uint32_t code;
+    uint64_t address;
+    uint64_t count;
+} logread_exception_t;
+
+// A module as announced by a "module" document. Modules of which the path
+// has been seen before only reference it by hash, in which case the path
+// is taken over from the earlier module.
+typedef struct _logread_module_t {
+    uint64_t base;
+    uint32_t size;
+    uint32_t hash;
+    uint32_t timestamp;
+
+    // Offset and length of the path in data, zero if unknown.
+    uint64_t path;
+    uint32_t path_length;
+
+    // Number of records preceding the document, i.e., the first record
+    // which may reference the module.
+    uint32_t recno;
+} logread_module_t;
+
+typedef struct _logread_t {
+    const uint8_t *data;
+    uint64_t size;
+    uint64_t capacity;
+    int mapped;
+
+    uint32_t pid;
+
+    // Options from the header: packed records (see packed.h) and the
+    // pointer size of the monitored process.
+    int packed;
+    uint32_t ptrsize;
+
+    // With "compress=lz4" the stream following the header consists of
+    // frames (see lz.h), which are decompressed into data as they come in.
+    // With "strings=dict" records may reference the string dictionary.
+    // Incomplete frames are kept in zin until the rest has been read.
+    int compressed;
+    int dict;
+    uint8_t *zin;
+    uint64_t zin_size;
+    uint64_t zin_capacity;
+
+    // Running timestamp and thread identifier of packed records.
+    uint32_t packed_time;
+    uint32_t packed_tid;
+
+    // Offset up to which the stream has been validated and indexed.
+    uint64_t scanned;
+
+    logread_record_t *records;
+    uint32_t record_count;
+    uint32_t record_capacity;
+
+    logread_api_t *apis;
+    uint32_t api_count;
+
+    logread_thread_t *threads;
+    uint32_t thread_count;
+
+    // String dictionary indexed by identifier, see packed.h.
+    logread_string_t *strings;
+    uint32_t string_count;
+
+    // Modules in the order they have been loaded.
+    logread_module_t *modules;
+    uint32_t module_count;
+    uint32_t module_capacity;
+
+    // Record numbers grouped by API index, by thread, and ordered by time.
+    // When the records already appear in chronological order the latter is
+    // the identity and by_time is NULL.
+    uint32_t *by_api;
+    uint32_t *by_thread;
+    uint32_t *by_time;
+
+    uint32_t info_count;
+    uint32_t buffer_count;
+
+    // Buffers by their first occurrence, and the number of "bufref"
+    // documents and of those referencing unknown buffers.
+    logread_buffer_t *buffers;
+    uint32_t buffer_capacity;
+
+    // Open addressing table of buffer numbers plus one, keyed by checksum.
+    uint32_t *buffer_slots;
+    uint32_t unique_buffer_count;
+    uint32_t bufref_count;
+    uint32_t unresolved_bufref_count;
+
+    // Chunks of the streams in progress, and the number of streams which
+    // have been reassembled and of those which were incomplete or corrupt.
+    logread_chunk_t *chunks;
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+    uint32_t stream_count;
+    uint32_t incomplete_stream_count;
+    uint32_t unresolved_count;
+
+    // Number of "repeat" documents and of the calls collapsed into them.
+    uint32_t repeat_count;
+    uint64_t repeated_calls;
+
+    // Number of "ratelimit" documents, see logread_api_t.
+    uint32_t ratelimit_count;
+
+    // Number of "exceptions" documents, and, as of the most recent one, the
+    // number of exceptions and of those at sites which couldn't be tracked.
+    // The sites of which not every exception has been logged, indexed by
+    // their number, as of the most recent summary that listed them.
+    uint32_t exception_summary_count;
+    uint64_t exception_count;
+    uint64_t exception_other;
+    logread_exception_t *exceptions;
+    uint32_t exception_site_count;
+    uint32_t exception_site_capacity;
+
+    // Set when the stream is corrupted or truncated; the records up to
+    // error_offset remain accessible. For compressed logs, the offsets are
+    // those in the decompressed stream.
+    const char *error;
+    uint64_t error_offset;
+} logread_t;
+
+// Open and index the log at filepath ("-" for stdin). Returns 0 on success
+// and -1 on error, in which case lr->error describes the problem.
+int logread_open(logread_t *lr, const char *filepath, int flags);
+
+// Index a log which is already in memory. The buffer must outlive lr.
+int logread_open_buffer(logread_t *lr, const void *buf, uint64_t size);
+
+void logread_close(logread_t *lr);
+
+const logread_api_t *logread_api(const logread_t *lr, uint32_t index);
+const logread_thread_t *logread_thread(const logread_t *lr, uint32_t tid);
+
+// Record numbers of all calls to the given API index or made by the given
+// thread, in stream order. Returns NULL if there are none.
+const uint32_t *logread_api_records(const logread_t *lr,
+    uint32_t index, uint32_t *count);
+const uint32_t *logread_thread_records(const logread_t *lr,
+    uint32_t tid, uint32_t *count);
+
+// Position, in chronological order, of the first record at or after the
+// given time. Use logread_time_record() to map a position to a record.
+uint32_t logread_time_lower_bound(const logread_t *lr, uint32_t time);
+
+static inline uint32_t logread_time_record(const logread_t *lr,
+    uint32_t position)
+{
+    return lr->by_time != NULL ? lr->by_time[position] : position;
+}
+
+static inline const logread_record_t *logread_record(const logread_t *lr,
+    uint32_t recno)
+{
+    return &lr->records[recno];
+}
+
+// Raw data of a record, valid as long as lr is open. This is the BSON
+// document of the call, or the packed record following its length.
+static inline const char *logread_record_data(const logread_t *lr,
+    const logread_record_t *rec)
+{
+    return (const char *) lr->data + rec->offset;
+}
+
+// Contents of the buffer with the given SHA-1 checksum as sent by the
+// first "buffer" document or stream carrying it, NULL if there's none.
+const uint8_t *logread_buffer(const logread_t *lr, const char *checksum,
+    uint32_t *length);
+
+// The module which contained addr at the time of the given record, or NULL
+// if it isn't known to be part of any module.
+const logread_module_t *logread_module(const logread_t *lr,
+    uint32_t recno, uint64_t addr);
+
+// Path of a module, not zero-terminated, or NULL if it is unknown.
+static inline const char *logread_module_path(const logread_t *lr,
+    const logread_module_t *mod)
+{
+    return mod->path != 0 ? (const char *) lr->data + mod->path : NULL;
+}
+
+// Initialize b with the BSON document of a call record. Packed records are
+// converted, BSON records are referenced without copying them unless they
+// reference the string dictionary. Returns 0 on success and -1 if the
+// converted document can't be finished, e.g., as one of its strings isn't
+// valid UTF-8, in which case b is an empty document. Either way b has to
+// be released with bson_destroy().
+int logread_record_bson(const logread_t *lr,
+    const logread_record_t *rec, bson *b);
+
+// Initialize an iterator over the "args" array of a call record, using b
+// as in logread_record_bson(). Returns 0 on success and -1 if the record
+// has no arguments or its document can't be built.
+int logread_record_args(const logread_t *lr,
+    const logread_record_t *rec, bson *b, bson_iterator *it);
+
+// Validate a BSON document of the given length without copying it.
+// Returns 0 if the document is well-formed.
+int logread_validate(const uint8_t *doc, uint64_t length);
+
+#endif
@@ -0,0 +1,438 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "bson.h"
+#include "logsynth.h"
+#include "packed.h"
+
+#define SYNTH_PID 1337
+
+// Shortest string which is interned, as in log.c.
+#define SYNTH_STRING_MIN 8
+
+#define SYNTH_PATHS 5
+#define SYNTH_PATH_MAX 128
+
+typedef struct _synthstate_t {
+    int format;
+
+    // Previous packed record, for delta encoding.
+    uint32_t time, tid;
+
+    // Call hash of the previous call.
+    uint64_t hash;
+
+    // Dictionary identifiers of the path prefixes.
+    uint32_t ids[SYNTH_PATHS][SYNTH_PATH_MAX];
+    uint32_t string_id;
+} synthstate_t;
+
+static const char *g_categories[] = {
+    "file", "registry", "process", "network", "synchronisation", "system",
+};
+
+static const char *g_paths[] = {
+    "C:\\Windows\\System32\\kernel32.dll",
+    "C:\\Users\\cuckoo\\AppData\\Local\\Temp\\sample.exe",
+    "HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion",
+    "\\??\\C:\\Documents and Settings\\All Users\\Application Data",
+    "http://example.com/index.html",
+};
+
+static inline uint32_t _rand(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// The parameter types of synthetic API index; mirrors sig_paramtypes().
+static const char *_paramtypes(uint32_t index)
+{
+    static const char *types[] = {
+        "pupi", "uxb", "ppl", "isu", "p!b", "upx", "q", "",
+    };
+    return types[index % (sizeof(types) / sizeof(*types))];
+}
+
+// Serialization target, much like the one in log.c.
+typedef struct _synthenc_t {
+    bson *b;
+    packed_t *p;
+} synthenc_t;
+
+static void _enc_int32(synthenc_t *e, const char *idx, int32_t value)
+{
+    if(e->b != NULL) {
+        bson_append_int(e->b, idx, value);
+    }
+    else {
+        packed_svarint(e->p, value);
+    }
+}
+
+static void _enc_int64(synthenc_t *e, const char *idx, int64_t value)
+{
+    if(e->b != NULL) {
+        bson_append_long(e->b, idx, value);
+    }
+    else {
+        packed_svarint(e->p, value);
+    }
+}
+
+static void _enc_string(synthenc_t *e, const char *idx,
+    const char *str, uint32_t length)
+{
+    if(e->b != NULL) {
+        bson_append_string_n(e->b, idx, str, length);
+    }
+    else {
+        packed_string(e->p, str, length, 0);
+    }
+}
+
+static void _enc_buffer(synthenc_t *e, const char *idx,
+    const uint8_t *buf, uint32_t length)
+{
+    if(e->b != NULL) {
+        bson_append_binary(e->b, idx, BSON_BIN_BINARY,
+            (const char *) buf, length);
+    }
+    else {
+        packed_blob(e->p, buf, length);
+    }
+}
+
+static void _enc_stringref(synthenc_t *e, const char *idx, uint32_t id)
+{
+    if(e->b != NULL) {
+        bson_append_binary(e->b, idx, PACKED_BSON_STRINGREF,
+            (const char *) &id, sizeof(id));
+    }
+    else {
+        packed_stringref(e->p, id);
+    }
+}
+
+static int _write(FILE *fp, bson *b, int format, logsynth_stats_t *stats)
+{
+    uint8_t tag = PACKED_TAG_BSON;
+
+    bson_finish(b);
+    int packed = (format & LOGSYNTH_PACKED) != 0;
+
+    if((packed != 0 && fwrite(&tag, 1, 1, fp) != 1) ||
+            fwrite(bson_data(b), bson_size(b), 1, fp) != 1) {
+        bson_destroy(b);
+        return -1;
+    }
+    stats->size += bson_size(b) + packed;
+    bson_destroy(b);
+    return 0;
+}
+
+static int _explain(FILE *fp, uint32_t index, int format,
+    logsynth_stats_t *stats)
+{
+    char name[32], argidx[8], argname[16]; bson b;
+
+    bson_init(&b);
+    bson_append_int(&b, "I", index);
+    snprintf(name, sizeof(name), "SyntheticApi%u", index);
+    bson_append_string(&b, "name", name);
+    bson_append_string(&b, "type", "info");
+    bson_append_string(&b, "category",
+        g_categories[index % (sizeof(g_categories) / sizeof(char *))]);
+
+    bson_append_start_array(&b, "args");
+    bson_append_string(&b, "0", "is_success");
+    bson_append_string(&b, "1", "retval");
+
+    uint32_t argnum = 2;
+    for (const char *fmt = _paramtypes(index); *fmt != 0; fmt++) {
+        if(*fmt == '!') {
+            continue;
+        }
+
+        snprintf(argidx, sizeof(argidx), "%u", argnum);
+        snprintf(argname, sizeof(argname), "arg%u", argnum - 2);
+
+        if(*fmt == 'p' || *fmt == 'x') {
+            bson_append_start_array(&b, argidx);
+            bson_append_string(&b, "0", argname);
+            bson_append_string(&b, "1", *fmt == 'p' ? "p" : "x");
+            bson_append_finish_array(&b);
+        }
+        else {
+            bson_append_string(&b, argidx, argname);
+        }
+        argnum++;
+    }
+
+    bson_append_finish_array(&b);
+    bson_append_start_object(&b, "flags_value");
+    bson_append_finish_object(&b);
+    bson_append_start_object(&b, "flags_bitmask");
+    bson_append_finish_object(&b);
+
+    if((format & LOGSYNTH_PACKED) != 0) {
+        bson_append_string(&b, "fmt", _paramtypes(index));
+    }
+
+    stats->infos++;
+    return _write(fp, &b, format, stats);
+}
+
+// Look up a path prefix in the string dictionary, defining it first if
+// required. Returns 0 if the string isn't interned and -1 on error.
+static int64_t _intern(FILE *fp, synthstate_t *ss, uint32_t path,
+    uint32_t length, logsynth_stats_t *stats)
+{
+    if((ss->format & LOGSYNTH_STRINGS) == 0 || length < SYNTH_STRING_MIN) {
+        return 0;
+    }
+
+    if(ss->ids[path][length] == 0) {
+        bson b;
+        ss->ids[path][length] = ++ss->string_id;
+
+        bson_init(&b);
+        bson_append_string(&b, "type", "string");
+        bson_append_int(&b, "i", ss->string_id);
+        bson_append_string_n(&b, "s", g_paths[path], length);
+        stats->strings++;
+        if(_write(fp, &b, ss->format, stats) < 0) {
+            return -1;
+        }
+    }
+    return ss->ids[path][length];
+}
+
+// Collapse a number of calls identical to the previous one of the thread,
+// like log.c does for tight polling loops.
+static int _repeat(FILE *fp, uint32_t index, uint32_t tid, uint32_t time,
+    uint32_t *state, synthstate_t *ss, logsynth_stats_t *stats)
+{
+    uint32_t count = 1 + _rand(state) % 1000; bson b;
+
+    bson_init(&b);
+    bson_append_string(&b, "type", "repeat");
+    bson_append_int(&b, "I", index);
+    bson_append_int(&b, "T", tid);
+    bson_append_int(&b, "t", time);
+    bson_append_int(&b, "l", time + count / 64);
+    bson_append_long(&b, "h", ss->hash);
+    bson_append_int(&b, "n", count);
+
+    stats->repeats++;
+    stats->repeated += count;
+    return _write(fp, &b, ss->format, stats);
+}
+
+// Write a call, and any oversized buffer which precedes it.
+static int _call(FILE *fp, uint32_t index, uint32_t tid, uint32_t time,
+    uint32_t *state, synthstate_t *ss, logsynth_stats_t *stats)
+{
+    static uint8_t buffer[8192];
+    char argidx[8]; bson b; packed_t p; synthenc_t e = {};
+    uint32_t argnum = 2; int override = 0, ret = 0;
+    int is_success = _rand(state) % 8 != 0;
+    uint64_t hash = ((uint64_t) _rand(state) << 32) | index;
+
+    ss->hash = hash;
+
+    if((ss->format & LOGSYNTH_PACKED) != 0) {
+        packed_init(&p, 256);
+        packed_varint(&p, index);
+        packed_varint(&p, hash);
+        packed_byte(&p, is_success != 0 ?
+            PACKED_FLAG_SUCCESS : PACKED_FLAG_ERROR);
+
+        if(is_success == 0) {
+            packed_varint(&p, 5);
+            packed_varint(&p, 0xc0000022);
+        }
+
+        packed_svarint(&p, is_success ? 0 : -1);
+        e.p = &p;
+    }
+    else {
+        bson_init(&b);
+        bson_append_int(&b, "I", index);
+        bson_append_int(&b, "T", tid);
+        bson_append_int(&b, "t", time);
+        bson_append_long(&b, "h", hash);
+
+        if(is_success == 0) {
+            bson_append_int(&b, "e", 5);
+            bson_append_int(&b, "E", 0xc0000022);
+        }
+
+        bson_append_start_array(&b, "args");
+        bson_append_int(&b, "0", is_success);
+        bson_append_long(&b, "1", is_success ? 0 : -1);
+        e.b = &b;
+    }
+
+    for (const char *fmt = _paramtypes(index); *fmt != 0; fmt++) {
+        uint32_t pathidx = _rand(state) % SYNTH_PATHS, length;
+        const char *path = g_paths[pathidx];
+        int64_t id;
+
+        if(*fmt == '!') {
+            override = 1;
+            continue;
+        }
+
+        snprintf(argidx, sizeof(argidx), "%u", argnum++);
+
+        switch (*fmt) {
+        case 'u': case 's':
+            length = *fmt == 'u' ? strlen(path) : _rand(state) % 16;
+            id = _intern(fp, ss, pathidx, length, stats);
+            if(id < 0) {
+                ret = -1;
+            }
+            else if(id != 0) {
+                _enc_stringref(&e, argidx, id);
+            }
+            else {
+                _enc_string(&e, argidx, path, length);
+            }
+            break;
+
+        case 'i': case 'x':
+            _enc_int32(&e, argidx, _rand(state) % 0x1000);
+            break;
+
+        case 'p': case 'l':
+            _enc_int64(&e, argidx, 0x400000 + _rand(state) % 0x10000);
+            break;
+
+        case 'q':
+            _enc_int64(&e, argidx, _rand(state));
+            break;
+
+        case 'b':
+            if(override != 0 && _rand(state) % 64 == 0) {
+                // Oversized buffer, logged separately like
+                // log_buffer_notrunc() does.
+                bson o;
+                bson_init(&o);
+                bson_append_string(&o, "type", "buffer");
+                bson_append_binary(&o, "buffer", BSON_BIN_BINARY,
+                    (const char *) buffer, sizeof(buffer));
+                bson_append_string(&o, "checksum",
+                    "0000000000000000000000000000000000000000");
+                stats->buffers++;
+                if(_write(fp, &o, ss->format, stats) < 0) {
+                    ret = -1;
+                }
+                _enc_buffer(&e, argidx, buffer, 0);
+            }
+            else {
+                _enc_buffer(&e, argidx, buffer, _rand(state) % 96);
+            }
+            break;
+        }
+
+        override = 0;
+    }
+
+    stats->calls++;
+
+    if(e.b != NULL) {
+        bson_append_finish_array(&b);
+        return _write(fp, &b, ss->format, stats) < 0 ? -1 : ret;
+    }
+
+    uint8_t header[1 + 3*PACKED_VARINT_MAX]; uint32_t length;
+
+    length = packed_encode_varint(header,
+        packed_zigzag((int32_t)(time - ss->time)));
+    length += packed_encode_varint(header + length,
+        packed_zigzag((int64_t) tid - ss->tid));
+    packed_prepend(&p, header, length);
+
+    header[0] = PACKED_TAG_CALL;
+    length = 1 + packed_encode_varint(header + 1, packed_size(&p));
+    packed_prepend(&p, header, length);
+
+    ss->time = time, ss->tid = tid;
+
+    if(fwrite(packed_data(&p), packed_size(&p), 1, fp) != 1) {
+        ret = -1;
+    }
+
+    stats->size += packed_size(&p);
+    packed_destroy(&p);
+    return ret;
+}
+
+int logsynth_write(FILE *fp, uint64_t size, uint32_t seed, int format,
+    logsynth_stats_t *stats)
+{
+    uint8_t explained[LOGSYNTH_APIS] = {};
+    uint32_t state = seed != 0 ? seed : 1, time = 0;
+    uint32_t pid = SYNTH_PID; char header[64];
+    synthstate_t ss = {.format = format};
+
+    memset(stats, 0, sizeof(logsynth_stats_t));
+
+    int length = snprintf(header, sizeof(header), "BSON %u%s%s\n", pid,
+        (format & LOGSYNTH_PACKED) != 0 ? " format=packed ptr=8" : "",
+        (format & LOGSYNTH_STRINGS) != 0 ? " strings=dict" : "");
+    if(fwrite(&pid, sizeof(pid), 1, fp) != 1 ||
+            fwrite(header, length, 1, fp) != 1) {
+        return -1;
+    }
+    stats->size = sizeof(pid) + length;
+
+    while (stats->size < size) {
+        uint32_t index = _rand(&state) % LOGSYNTH_APIS;
+        uint32_t tid = 1000 + 4 * (_rand(&state) % LOGSYNTH_THREADS);
+
+        // Timestamps are taken before the log lock is acquired, so calls
+        // from different threads may be written slightly out of order.
+        time += _rand(&state) % 4 == 0;
+        uint32_t jitter = _rand(&state) % 3;
+
+        if(explained[index] == 0) {
+            if(_explain(fp, index, format, stats) < 0) {
+                return -1;
+            }
+            explained[index] = 1;
+        }
+
+        if(_call(fp, index, tid, time > jitter ? time - jitter : 0,
+                &state, &ss, stats) < 0) {
+            return -1;
+        }
+
+        if((format & LOGSYNTH_REPEATS) != 0 && _rand(&state) % 16 == 0 &&
+                _repeat(fp, index, tid, time, &state, &ss, stats) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_LOGSYNTH_H
+#define MONITOR_LOGSYNTH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Number of distinct APIs and threads in a synthetic log.
+#define LOGSYNTH_APIS 64
+#define LOGSYNTH_THREADS 16
+
+// Record format, optionally combined with LOGSYNTH_STRINGS to intern the
+// string arguments in the string dictionary, and with LOGSYNTH_REPEATS to
+// collapse some calls into "repeat" documents.
+#define LOGSYNTH_BSON 0
+#define LOGSYNTH_PACKED 1
+#define LOGSYNTH_STRINGS 2
+#define LOGSYNTH_REPEATS 4
+
+typedef struct _logsynth_stats_t {
+    uint64_t size;
+    uint32_t calls;
+    uint32_t infos;
+    uint32_t buffers;
+    uint32_t strings;
+    uint32_t repeats;
+    uint64_t repeated;
+} logsynth_stats_t;
+
+// Write a synthetic log of at least the given size which mimics the output
+// of log.c: explain documents are emitted before the first call to an API,
+// calls of several threads are interleaved with slightly out of order
+// timestamps, and some calls carry an oversized "buffer" document. The
+// calls are either BSON documents or packed records, see packed.h.
+int logsynth_write(FILE *fp, uint64_t size, uint32_t seed, int format,
+    logsynth_stats_t *stats);
+
+#endif
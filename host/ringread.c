@@ -0,0 +1,155 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Stand-alone reader of the shared-memory ring transport, see ring.h. The
+// ring is mapped from a file, e.g., a section object backed by a file which
+// is shared with the analysis machine, and drained to a file or stdout until
+// the monitor closes it. The output is the log stream as it would have been
+// sent over the log pipe, so it can be piped into logdump.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ring.h"
+
+static void _usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [-o output] [-w ms] <ring>\n"
+        "  -o output  write the log here instead of to stdout\n"
+        "  -w ms      give up if the ring isn't created within this time\n",
+        argv0);
+}
+
+static void _sleep_ms(uint32_t ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outpath = NULL; uint32_t wait = 10000; int opt;
+
+    while ((opt = getopt(argc, argv, "o:w:")) != -1) {
+        switch (opt) {
+        case 'o':
+            outpath = optarg;
+            break;
+
+        case 'w':
+            wait = strtoul(optarg, NULL, 0);
+            break;
+
+        default:
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind + 1 != argc) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDWR);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0 || st.st_size > UINT32_MAX) {
+        fprintf(stderr, "Error opening ring %s\n", argv[optind]);
+        return 1;
+    }
+
+    void *mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        fprintf(stderr, "Error mapping ring %s\n", argv[optind]);
+        return 1;
+    }
+
+    // The monitor initializes the ring once it starts logging.
+    ring_t ring; int ret; uint32_t waited = 0;
+    while ((ret = ring_attach(&ring, mem, st.st_size)) == 1 && waited < wait) {
+        _sleep_ms(10), waited += 10;
+    }
+
+    if(ret != 0) {
+        fprintf(stderr, "No valid ring in %s\n", argv[optind]);
+        return 1;
+    }
+
+    FILE *fp = outpath != NULL ? fopen(outpath, "wb") : stdout;
+    if(fp == NULL) {
+        fprintf(stderr, "Error opening output %s\n", outpath);
+        return 1;
+    }
+
+    uint64_t total = 0, entries = 0; uint32_t idle = 0, state;
+
+    while (1) {
+        // The state has to be read before looking for entries, as the
+        // monitor writes its last entries before closing the ring.
+        const uint8_t *data; state = ring_state(&ring);
+        uint32_t length = ring_peek(&ring, &data);
+
+        if(length == 0) {
+            if(state != RING_STATE_OPEN) {
+                break;
+            }
+
+            // Spin briefly before backing off, as entries typically arrive
+            // in bursts.
+            if(idle++ < 1000) {
+                continue;
+            }
+
+            fflush(fp);
+            _sleep_ms(1);
+            continue;
+        }
+
+        if(fwrite(data, 1, length, fp) != length) {
+            fprintf(stderr, "Error writing output\n");
+            return 1;
+        }
+
+        ring_consume(&ring);
+        total += length, entries++, idle = 0;
+    }
+
+    if(fp != stdout) {
+        fclose(fp);
+    }
+    else {
+        fflush(fp);
+    }
+
+    fprintf(stderr, "%" PRIu64 " bytes in %" PRIu64 " entries, ring %s\n",
+        total, entries, state == RING_STATE_CLOSED ?
+        "closed" : "detached, the log continues on the pipe");
+    munmap(mem, st.st_size);
+    return 0;
+}
@@ -0,0 +1,463 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <dirent.h>
+#include "logread.h"
+#include "symbolize.h"
+
+// Largest module file which is considered.
+#define SYMBOLIZE_FILE_MAX (256*1024*1024)
+
+typedef struct _pe_t {
+    const uint8_t *data;
+    uint64_t size;
+    const uint8_t *sections;
+    uint32_t section_count;
+} pe_t;
+
+static inline uint16_t _le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t _le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Map length bytes at a relative virtual address to the file, NULL if they
+// aren't backed by the file.
+static const uint8_t *_pe_rva(const pe_t *pe, uint32_t rva, uint32_t length)
+{
+    uint64_t offset = rva;
+
+    for (uint32_t idx = 0; idx < pe->section_count; idx++) {
+        const uint8_t *section = pe->sections + 40 * idx;
+        uint32_t vsize = _le32(section + 8), va = _le32(section + 12);
+        uint32_t rawsize = _le32(section + 16), raw = _le32(section + 20);
+
+        if(rva >= va && rva - va < (vsize > rawsize ? vsize : rawsize)) {
+            offset = (uint64_t) raw + rva - va;
+            break;
+        }
+    }
+
+    if(offset > pe->size || pe->size - offset < length) {
+        return NULL;
+    }
+    return pe->data + offset;
+}
+
+static int _export_compare(const void *a, const void *b)
+{
+    const symbolize_export_t *x = a, *y = b;
+
+    // Names are stored in export table order, which breaks ties the way
+    // the monitor does, i.e., the first of several aliases wins.
+    if(x->rva != y->rva) {
+        return x->rva < y->rva ? -1 : 1;
+    }
+    return x->name < y->name ? -1 : x->name > y->name;
+}
+
+int symbolize_image_parse(symbolize_image_t *img,
+    const uint8_t *data, uint64_t size)
+{
+    pe_t pe = {data, size, NULL, 0};
+    uint32_t ddoff;
+
+    img->exports = NULL, img->names = NULL, img->count = 0;
+
+    if(size < 0x40 || data[0] != 'M' || data[1] != 'Z') {
+        return -1;
+    }
+
+    uint32_t lfanew = _le32(data + 0x3c);
+    if(lfanew > size || size - lfanew < 24 ||
+            memcmp(data + lfanew, "PE\0\0", 4) != 0) {
+        return -1;
+    }
+
+    const uint8_t *header = data + lfanew + 4;
+    const uint8_t *opt = header + 20;
+    uint32_t optsize = _le16(header + 16);
+
+    pe.section_count = _le16(header + 2);
+    pe.sections = opt + optsize;
+    img->timestamp = _le32(header + 4);
+
+    if((uint64_t)(pe.sections - data) + 40 * pe.section_count > size ||
+            optsize < 2) {
+        return -1;
+    }
+
+    switch (_le16(opt)) {
+    case 0x10b:
+        ddoff = 96;
+        break;
+
+    case 0x20b:
+        ddoff = 112;
+        break;
+
+    default:
+        return -1;
+    }
+
+    // No export directory, hence no exports.
+    if(optsize < ddoff + 8 || _le32(opt + ddoff - 4) == 0 ||
+            _le32(opt + ddoff) == 0) {
+        return 0;
+    }
+
+    const uint8_t *dir = _pe_rva(&pe, _le32(opt + ddoff), 40);
+    if(dir == NULL) {
+        return -1;
+    }
+
+    uint32_t function_count = _le32(dir + 20), count = _le32(dir + 24);
+    const uint8_t *functions = _pe_rva(&pe, _le32(dir + 28),
+        function_count * 4);
+    const uint8_t *names = _pe_rva(&pe, _le32(dir + 32), count * 4);
+    const uint8_t *ordinals = _pe_rva(&pe, _le32(dir + 36), count * 2);
+
+    if(count == 0) {
+        return 0;
+    }
+
+    if(count > size / 4 || function_count > size / 4 ||
+            functions == NULL || names == NULL || ordinals == NULL) {
+        return -1;
+    }
+
+    uint32_t names_size = 0, names_capacity = 4096;
+    img->exports = malloc(count * sizeof(symbolize_export_t));
+    img->names = malloc(names_capacity);
+    if(img->exports == NULL || img->names == NULL) {
+        symbolize_image_free(img);
+        return -1;
+    }
+
+    for (uint32_t idx = 0; idx < count; idx++) {
+        uint16_t ordinal = _le16(ordinals + 2 * idx);
+        const char *name =
+            (const char *) _pe_rva(&pe, _le32(names + 4 * idx), 1);
+        if(ordinal >= function_count || name == NULL) {
+            continue;
+        }
+
+        uint32_t length = strnlen(name,
+            data + size - (const uint8_t *) name);
+
+        if(names_size + length + 1 > names_capacity) {
+            while (names_size + length + 1 > names_capacity) {
+                names_capacity *= 2;
+            }
+
+            char *buf = realloc(img->names, names_capacity);
+            if(buf == NULL) {
+                symbolize_image_free(img);
+                return -1;
+            }
+            img->names = buf;
+        }
+
+        memcpy(img->names + names_size, name, length);
+        img->names[names_size + length] = 0;
+
+        img->exports[img->count].rva = _le32(functions + 4 * ordinal);
+        img->exports[img->count].name = names_size;
+        img->count++;
+
+        names_size += length + 1;
+    }
+
+    qsort(img->exports, img->count, sizeof(symbolize_export_t),
+        &_export_compare);
+    return 0;
+}
+
+void symbolize_image_free(symbolize_image_t *img)
+{
+    free(img->exports);
+    free(img->names);
+    img->exports = NULL, img->names = NULL, img->count = 0;
+}
+
+void symbolize_init(symbolize_t *s, const logread_t *lr,
+    const char *const *dirs, uint32_t dir_count)
+{
+    memset(s, 0, sizeof(symbolize_t));
+    s->lr = lr;
+    s->dirs = dirs;
+    s->dir_count = dir_count;
+}
+
+void symbolize_close(symbolize_t *s)
+{
+    for (uint32_t idx = 0; idx < s->image_count; idx++) {
+        symbolize_image_free(&s->images[idx]);
+    }
+
+    free(s->images);
+    memset(s, 0, sizeof(symbolize_t));
+}
+
+// Basename of a Windows path, of which the length is returned.
+static uint32_t _basename(const logread_t *lr,
+    const logread_module_t *mod, const char **name)
+{
+    const char *path = logread_module_path(lr, mod);
+    uint32_t length = mod->path_length;
+
+    *name = path;
+    for (uint32_t idx = 0; idx < length; idx++) {
+        if(path[idx] == '\\' || path[idx] == '/') {
+            *name = &path[idx + 1];
+        }
+    }
+    return path + length - *name;
+}
+
+static int _read_file(const char *filepath, uint8_t **data, uint64_t *size)
+{
+    FILE *fp = fopen(filepath, "rb");
+    if(fp == NULL) {
+        return -1;
+    }
+
+    long length = -1;
+    if(fseek(fp, 0, SEEK_END) == 0) {
+        length = ftell(fp);
+    }
+
+    if(length <= 0 || length > SYMBOLIZE_FILE_MAX ||
+            fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    *data = malloc(length);
+    if(*data == NULL || fread(*data, 1, length, fp) != (size_t) length) {
+        free(*data);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    *size = length;
+    return 0;
+}
+
+// Look for the module file in the directories and parse its exports.
+static int _image_load(symbolize_t *s, const logread_module_t *mod,
+    symbolize_image_t *img)
+{
+    char basename[256], filepath[4096];
+    const char *name;
+
+    uint32_t length = _basename(s->lr, mod, &name);
+    if(length == 0 || length >= sizeof(basename)) {
+        return -1;
+    }
+
+    memcpy(basename, name, length);
+    basename[length] = 0;
+
+    for (uint32_t idx = 0; idx < s->dir_count; idx++) {
+        DIR *dir = opendir(s->dirs[idx]);
+        struct dirent *entry;
+
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            uint8_t *data; uint64_t size;
+
+            if(strcasecmp(entry->d_name, basename) != 0) {
+                continue;
+            }
+
+            snprintf(filepath, sizeof(filepath), "%s/%s",
+                s->dirs[idx], entry->d_name);
+            if(_read_file(filepath, &data, &size) < 0) {
+                continue;
+            }
+
+            int ret = symbolize_image_parse(img, data, size);
+            free(data);
+
+            if(ret == 0 && (mod->timestamp == 0 ||
+                    img->timestamp == mod->timestamp)) {
+                closedir(dir);
+                return 0;
+            }
+
+            symbolize_image_free(img);
+        }
+
+        if(dir != NULL) {
+            closedir(dir);
+        }
+    }
+    return -1;
+}
+
+static const symbolize_image_t *_image(symbolize_t *s,
+    const logread_module_t *mod)
+{
+    if(mod->path == 0) {
+        return NULL;
+    }
+
+    for (uint32_t idx = 0; idx < s->image_count; idx++) {
+        const symbolize_image_t *img = &s->images[idx];
+        if(img->path == mod->path && img->timestamp == mod->timestamp) {
+            return img->found != 0 ? img : NULL;
+        }
+    }
+
+    if(s->image_count == s->image_capacity) {
+        uint32_t count = s->image_capacity != 0 ? 2 * s->image_capacity : 16;
+
+        symbolize_image_t *images =
+            realloc(s->images, count * sizeof(symbolize_image_t));
+        if(images == NULL) {
+            return NULL;
+        }
+
+        s->images = images;
+        s->image_capacity = count;
+    }
+
+    symbolize_image_t *img = &s->images[s->image_count++];
+    memset(img, 0, sizeof(symbolize_image_t));
+
+    img->found = _image_load(s, mod, img) == 0;
+
+    // Keyed by the timestamp of the loaded module, not the one of the file.
+    img->path = mod->path;
+    img->timestamp = mod->timestamp;
+    return img->found != 0 ? img : NULL;
+}
+
+int symbolize(symbolize_t *s, uint32_t recno, uint64_t addr,
+    char *sym, uint32_t length)
+{
+    const symbolize_export_t *lower = NULL, *higher = NULL;
+    uint32_t offset = 0;
+
+    *sym = 0;
+
+    const logread_module_t *mod = logread_module(s->lr, recno, addr);
+    if(mod == NULL) {
+        return -1;
+    }
+
+    uint32_t rva = (uint32_t)(addr - mod->base);
+    const symbolize_image_t *img = _image(s, mod);
+
+    if(img != NULL && img->count != 0) {
+        // First export at or beyond the address.
+        uint32_t low = 0, high = img->count;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if(img->exports[mid].rva < rva) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+
+        if(low != 0) {
+            uint32_t idx = low - 1;
+            while (idx != 0 &&
+                    img->exports[idx - 1].rva == img->exports[low - 1].rva) {
+                idx--;
+            }
+            lower = &img->exports[idx];
+        }
+
+        while (low < img->count && img->exports[low].rva == rva) {
+            low++;
+        }
+
+        if(low < img->count) {
+            higher = &img->exports[low];
+        }
+    }
+
+    if(lower != NULL) {
+        offset += snprintf(sym + offset, length - offset, "%s+0x%" PRIx32,
+            img->names + lower->name, rva - lower->rva);
+    }
+
+    if(higher != NULL && offset < length) {
+        offset += snprintf(sym + offset, length - offset, "%s%s-0x%" PRIx32,
+            lower != NULL ? " " : "", img->names + higher->name,
+            higher->rva - rva);
+    }
+
+    if(mod->path != 0 && offset < length) {
+        const char *name;
+        uint32_t namelen = _basename(s->lr, mod, &name);
+
+        if(lower != NULL || higher != NULL) {
+            sym[offset++] = ' ';
+        }
+
+        for (uint32_t idx = 0; idx < namelen && name[idx] != '.' &&
+                offset + 1 < length; idx++) {
+            sym[offset++] = tolower((unsigned char) name[idx]);
+        }
+
+        if(offset < length) {
+            snprintf(sym + offset, length - offset, "+0x%" PRIx32, rva);
+        }
+    }
+
+    if(offset >= length) {
+        sym[length - 1] = 0;
+    }
+    return 0;
+}
+
+const char *symbolize_frame(symbolize_t *s, uint32_t recno,
+    const char *frame, char *buf, uint32_t length)
+{
+    char sym[512], *end;
+
+    if(frame[0] != '0' || frame[1] != 'x' || isxdigit(frame[2]) == 0) {
+        return frame;
+    }
+
+    uint64_t addr = strtoull(frame + 2, &end, 16);
+    if(*end != 0 || symbolize(s, recno, addr, sym, sizeof(sym)) < 0 ||
+            sym[0] == 0) {
+        return frame;
+    }
+
+    snprintf(buf, length, "%s @ %s", sym, frame);
+    return buf;
+}
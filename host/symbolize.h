@@ -0,0 +1,84 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_SYMBOLIZE_H
+#define MONITOR_SYMBOLIZE_H
+
+#include <stdint.h>
+#include "logread.h"
+
+// Offline symbolization of the return addresses logged with
+// "log-symbols=host" (see log.h). Addresses are mapped to a module through
+// the "module" documents of the log, and to the nearest exported functions
+// through the export table of the module file, which is looked up by its
+// basename (case-insensitively) in the given directories, e.g., the dumped
+// modules or a copy of the guest's system directory. Files of which the
+// timestamp doesn't match the one of the loaded module are skipped. The
+// symbols are formatted exactly like symbol() in the monitor does.
+
+typedef struct _symbolize_export_t {
+    uint32_t rva;
+    uint32_t name;
+} symbolize_export_t;
+
+// Exports of a module file, sorted by address, with their names in names.
+typedef struct _symbolize_image_t {
+    uint64_t path;
+    uint32_t timestamp;
+    int found;
+
+    symbolize_export_t *exports;
+    uint32_t count;
+    char *names;
+} symbolize_image_t;
+
+typedef struct _symbolize_t {
+    const logread_t *lr;
+    const char *const *dirs;
+    uint32_t dir_count;
+
+    symbolize_image_t *images;
+    uint32_t image_count;
+    uint32_t image_capacity;
+} symbolize_t;
+
+// The directories must outlive s.
+void symbolize_init(symbolize_t *s, const logread_t *lr,
+    const char *const *dirs, uint32_t dir_count);
+void symbolize_close(symbolize_t *s);
+
+// Symbol of an address referenced by the given record. Returns 0 on
+// success, or -1 if the address isn't part of any known module, in which
+// case sym is empty.
+int symbolize(symbolize_t *s, uint32_t recno, uint64_t addr,
+    char *sym, uint32_t length);
+
+// Resolve a stack trace entry, i.e., turn a bare address into "<symbol> @
+// <address>". Entries which have been symbolized by the monitor already are
+// returned as-is.
+const char *symbolize_frame(symbolize_t *s, uint32_t recno,
+    const char *frame, char *buf, uint32_t length);
+
+// Parse the export table of a PE file in memory. Returns 0 on success and
+// -1 if the file is malformed, the image has to be released with
+// symbolize_image_free().
+int symbolize_image_parse(symbolize_image_t *img,
+    const uint8_t *data, uint64_t size);
+void symbolize_image_free(symbolize_image_t *img);
+
+#endif
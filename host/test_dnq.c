@@ -0,0 +1,124 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests the sorting and membership queries of dnq_t.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnq.h"
+
+static int g_failed;
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        fprintf(stderr, "Test didn't pass: %s (line %d)\n", \
+            #expr, __LINE__); \
+        g_failed = 1; \
+    }
+
+// Sizes around the linear scan and radix sort thresholds.
+static const uint32_t g_dnq_lengths[] = {
+    0, 1, 2, 7, 16, 17, 32, 33, 100, 1023, 1024, 5000,
+};
+
+static uint64_t _dnq_random(uint64_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static int _dnq_cmp(const void *a, const void *b)
+{
+    uint64_t _a = *(const uint64_t *) a;
+    uint64_t _b = *(const uint64_t *) b;
+    return (_a > _b) - (_a < _b);
+}
+
+int main()
+{
+    static uint64_t values[5000], sorted[5000], list64[5000];
+    static uint32_t list32[5000];
+    uint64_t seed = 42; dnq_t d32, d64;
+
+    // Values which only differ in their upper half, which the old
+    // comparator, truncating the difference to an int, got wrong.
+    uint64_t high[] = {3ull << 32, 1ull << 32, 2ull << 32, 1, 1ull << 63};
+    assert(dnq_init(&d64, high, sizeof(uint64_t), 5) == 0);
+    assert(high[0] == 1 && high[1] == 1ull << 32 && high[4] == 1ull << 63);
+    assert(dnq_has64(&d64, 2ull << 32) == 1);
+    assert(dnq_has64(&d64, 4ull << 32) == 0);
+    assert(dnq_init(&d64, high, 3, 5) < 0);
+
+    for (uint32_t idx = 0; idx < sizeof(g_dnq_lengths)/sizeof(uint32_t);
+            idx++) {
+        uint32_t length = g_dnq_lengths[idx], errors = 0;
+
+        // Even values, so that odd ones are guaranteed misses, with the
+        // odd duplicate, and spread over either the whole 64-bit range or,
+        // for the smaller lengths, a small one.
+        for (uint32_t j = 0; j < length; j++) {
+            values[j] = _dnq_random(&seed) & ~1ull;
+            if(length < 100) {
+                values[j] &= 0xffff;
+            }
+            if(j % 16 == 15) {
+                values[j] = values[j / 2];
+            }
+            list64[j] = values[j];
+            list32[j] = (uint32_t) values[j];
+        }
+
+        memcpy(sorted, values, length * sizeof(uint64_t));
+        qsort(sorted, length, sizeof(uint64_t), &_dnq_cmp);
+
+        assert(dnq_init(&d64, list64, sizeof(uint64_t), length) == 0);
+        assert(dnq_init(&d32, list32, sizeof(uint32_t), length) == 0);
+        assert(dnq_isempty(&d64) == (length == 0));
+        assert(memcmp(dnq_iter64(&d64), sorted,
+            length * sizeof(uint64_t)) == 0);
+
+        for (uint32_t j = 1; j < length; j++) {
+            errors += dnq_iter32(&d32)[j - 1] > dnq_iter32(&d32)[j];
+        }
+
+        for (uint32_t j = 0; j < length; j++) {
+            errors += dnq_has64(&d64, values[j]) != 1;
+            errors += dnq_has64(&d64, values[j] + 1) != 0;
+            errors += dnq_has64(&d64, values[j] ^ (1ull << 62)) !=
+                (bsearch(&(uint64_t){values[j] ^ (1ull << 62)}, sorted,
+                    length, sizeof(uint64_t), &_dnq_cmp) != NULL);
+            errors += dnq_has32(&d32, (uint32_t) values[j]) != 1;
+            errors += dnq_has32(&d32, (uint32_t) values[j] + 1) != 0;
+        }
+
+        errors += dnq_has64(&d64, 0xffffffffffffffffull) != 0;
+        errors += dnq_has32(&d32, 0xffffffff) != 0;
+        errors += dnq_has64(&d64, 1) != 0;
+        assert(errors == 0);
+
+        dnq_free(&d32);
+        dnq_free(&d64);
+    }
+
+    printf("dnq: %s\n", g_failed ? "FAILED" : "OK");
+    return g_failed;
+}
@@ -0,0 +1,1046 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests the logread decoder and its indices.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bson.h"
+#include "logread.h"
+#include "logsynth.h"
+#include "lz.h"
+#include "packed.h"
+#include "ring.h"
+#include "sha1.h"
+#include "symbolize.h"
+
+static int g_failed;
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        fprintf(stderr, "Test didn't pass: %s (line %d)\n", \
+            #expr, __LINE__); \
+        g_failed = 1; \
+    }
+
+static char *_read_file(const char *filepath, uint64_t *size)
+{
+    FILE *fp = fopen(filepath, "rb");
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char *buf = malloc(*size);
+    if(fread(buf, 1, *size, fp) != *size) {
+        *size = 0;
+    }
+    fclose(fp);
+    return buf;
+}
+
+// Compress a log the way the monitor does.
+static char *_compress(const char *buf, uint64_t size, uint64_t *outsize)
+{
+    static lz_table_t table;
+    const char *newline = memchr(buf + 4, '\n', size - 4);
+    uint64_t hdrlen = newline - buf, length = hdrlen;
+    char *out = malloc(size + size / 16 + 64);
+
+    memcpy(out, buf, hdrlen);
+    length += sprintf(out + hdrlen, " compress=lz4\n");
+
+    for (uint64_t offset = hdrlen + 1; offset < size; offset += LZ_BLOCK_MAX) {
+        uint32_t block = size - offset < LZ_BLOCK_MAX ?
+            size - offset : LZ_BLOCK_MAX;
+        length += lz_frame(buf + offset, block, out + length, &table);
+    }
+
+    *outsize = length;
+    return out;
+}
+
+static void _test_lz()
+{
+    static uint8_t src[LZ_BLOCK_MAX], dst[LZ_FRAME_BOUND(LZ_BLOCK_MAX)];
+    static uint8_t out[LZ_BLOCK_MAX];
+    static lz_table_t table;
+    uint32_t state = 1, length;
+
+    // Incompressible data is stored as-is.
+    for (uint32_t idx = 0; idx < sizeof(src); idx++) {
+        state = state * 1103515245 + 12345;
+        src[idx] = state >> 16;
+    }
+    length = lz_frame(src, sizeof(src), dst, &table);
+    assert(length == LZ_FRAME_HEADER + sizeof(src));
+    assert((dst[3] & 0x80) != 0);
+    assert(memcmp(dst + LZ_FRAME_HEADER, src, sizeof(src)) == 0);
+
+    // Runs, i.e., overlapping matches, and long literal and match lengths.
+    memset(src, 'A', 1000);
+    memcpy(src + 5000, src + 20000, 3000);
+    memcpy(src + 40000, src, 8000);
+    length = lz_compress(src, sizeof(src), dst, sizeof(dst), &table);
+    assert(length != 0 && length < sizeof(src));
+    assert(lz_decompress(dst, length, out, sizeof(out)) == sizeof(src));
+    assert(memcmp(src, out, sizeof(src)) == 0);
+
+    // Blocks too short to contain a match, and empty ones.
+    for (uint32_t size = 0; size < 20; size++) {
+        length = lz_compress("ABCDEFGHIJKLMNOPQRST", size,
+            dst, sizeof(dst), &table);
+        assert(length == size + 1 + (size >= 15));
+        assert(lz_decompress(dst, length, out, sizeof(out)) == (int) size);
+    }
+
+    // Output which doesn't fit, and corrupted input.
+    length = lz_compress(src, sizeof(src), dst, sizeof(dst), &table);
+    assert(lz_decompress(dst, length, out, sizeof(out) - 1) < 0);
+    assert(lz_compress(src, sizeof(src), dst, 64, &table) == 0);
+    assert(lz_decompress("\xf0", 1, out, sizeof(out)) < 0);
+    assert(lz_decompress("\x10" "A" "\x02\x00", 4, out, sizeof(out)) < 0);
+    assert(lz_decompress("\x10" "A" "\x01", 3, out, sizeof(out)) < 0);
+}
+
+// Every record has to be reachable through each of the indices exactly
+// once, and the by-time index has to be ordered.
+static void _check_indices(const logread_t *lr)
+{
+    uint32_t total = 0, count;
+
+    for (uint32_t idx = 0; idx < lr->api_count; idx++) {
+        const uint32_t *recs = logread_api_records(lr, idx, &count);
+        for (uint32_t j = 0; j < count; j++) {
+            assert(lr->records[recs[j]].index == idx);
+            assert(j == 0 || recs[j-1] < recs[j]);
+        }
+        total += count;
+    }
+    assert(total == lr->record_count);
+
+    total = 0;
+    for (uint32_t idx = 0; idx < lr->thread_count; idx++) {
+        uint32_t tid = lr->threads[idx].tid;
+        const uint32_t *recs = logread_thread_records(lr, tid, &count);
+        for (uint32_t j = 0; j < count; j++) {
+            assert(lr->records[recs[j]].tid == tid);
+        }
+        total += count;
+    }
+    assert(total == lr->record_count);
+
+    for (uint32_t pos = 1; pos < lr->record_count; pos++) {
+        assert(lr->records[logread_time_record(lr, pos-1)].time <=
+            lr->records[logread_time_record(lr, pos)].time);
+    }
+}
+
+// Drain everything that's currently in the ring.
+static uint32_t _ring_drain(ring_t *ring, uint8_t *out)
+{
+    const uint8_t *data; uint32_t length, total = 0;
+
+    while ((length = ring_peek(ring, &data)) != 0) {
+        memcpy(out + total, data, length);
+        ring_consume(ring);
+        total += length;
+    }
+    return total;
+}
+
+static void _test_ring()
+{
+    static uint8_t mem[RING_SIZE(RING_CAPACITY_MIN)];
+    static uint8_t buf[3 * RING_CHUNK_MAX], out[RING_CAPACITY_MIN];
+    ring_t producer, reader;
+
+    // Periodic contents, so that writing from buf + offset % 4093 yields a
+    // stream of which each byte is known by its position.
+    for (uint32_t idx = 0; idx < sizeof(buf); idx++) {
+        buf[idx] = (uint8_t)((idx % 4093) * 7 + (idx % 4093) / 251);
+    }
+
+    assert(ring_create(&producer, mem, sizeof(mem) - 1) < 0);
+    assert(ring_attach(&reader, mem, sizeof(mem)) == 1);
+    assert(ring_create(&producer, mem, sizeof(mem)) == 0);
+    assert(producer.mask + 1 == RING_CAPACITY_MIN);
+    assert(ring_attach(&reader, mem, sizeof(mem) - 1) < 0);
+    assert(ring_attach(&reader, mem, sizeof(mem)) == 0);
+    assert(ring_state(&reader) == RING_STATE_OPEN);
+
+    // Writes larger than a chunk are split, and whatever doesn't fit is
+    // left for the caller.
+    assert(ring_write(&producer, buf, sizeof(buf)) == sizeof(buf));
+    assert(ring_write(&producer, buf, RING_CHUNK_MAX) == 0);
+    assert(ring_write(&producer, buf, 1000) == 1000);
+    assert(_ring_drain(&reader, out) == sizeof(buf) + 1000);
+    assert(memcmp(out, buf, sizeof(buf)) == 0);
+    assert(memcmp(out + sizeof(buf), buf, 1000) == 0);
+    assert(ring_tail(&producer) == producer.pos);
+
+    // Odd lengths, which wrap around the end several times.
+    uint32_t written = 0, read = 0, length = 1;
+    while (read < 8 * RING_CAPACITY_MIN) {
+        length = (length * 1103515245 + 12345) % (2 * RING_CHUNK_MAX) + 1;
+        uint32_t ret = ring_write(&producer, buf + written % 4093, length);
+        assert(ret == 0 || ret == length);
+        written += ret;
+
+        uint32_t count = _ring_drain(&reader, out);
+        for (uint32_t idx = 0; idx < count; idx++) {
+            if(out[idx] != buf[(read + idx) % 4093]) {
+                assert(out[idx] == buf[(read + idx) % 4093]);
+                break;
+            }
+        }
+        read += count;
+        if(ret == 0) {
+            assert(count != 0);
+        }
+    }
+    assert(read == written);
+
+    // A reader attaching later continues where the previous one left off.
+    assert(ring_write(&producer, buf, 100) == 100);
+    assert(ring_attach(&reader, mem, sizeof(mem)) == 0);
+    assert(_ring_drain(&reader, out) == 100);
+    assert(memcmp(out, buf, 100) == 0);
+
+    // Recreating the ring discards the entries of the previous one.
+    assert(ring_write(&producer, buf, 100) == 100);
+    assert(ring_create(&producer, mem, sizeof(mem)) == 0);
+    assert(ring_attach(&reader, mem, sizeof(mem)) == 0);
+    assert(_ring_drain(&reader, out) == 0);
+
+    ring_close(&producer, RING_STATE_DETACHED);
+    assert(ring_state(&reader) == RING_STATE_DETACHED);
+}
+
+// Stream a log through a ring in a file mapping from a child process, and
+// check that the parent reads back the exact same log.
+static void _test_ring_processes(const char *filepath)
+{
+    const char *ringpath = "test_logread.ring";
+    uint32_t memsize = RING_SIZE(RING_CAPACITY_MIN); uint64_t size;
+    char *log = _read_file(filepath, &size);
+
+    int fd = open(ringpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0 && ftruncate(fd, memsize) == 0);
+    close(fd);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        // The child maps the file on its own, as an unrelated process would.
+        fd = open(ringpath, O_RDWR);
+        void *mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        ring_t ring; uint32_t state = 1;
+
+        if(mem == MAP_FAILED || ring_create(&ring, mem, memsize) < 0) {
+            _exit(1);
+        }
+
+        for (uint64_t offset = 0; offset < size; ) {
+            state = state * 1103515245 + 12345;
+            uint32_t length = (state >> 8) % (3 * RING_CHUNK_MAX) + 1;
+            if(length > size - offset) {
+                length = size - offset;
+            }
+
+            uint32_t ret = ring_write(&ring, log + offset, length);
+            if(ret == 0) {
+                sched_yield();
+            }
+            offset += ret;
+        }
+
+        ring_close(&ring, RING_STATE_CLOSED);
+        _exit(0);
+    }
+
+    fd = open(ringpath, O_RDWR);
+    void *mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    assert(mem != MAP_FAILED);
+
+    ring_t ring; int ret;
+    while ((ret = ring_attach(&ring, mem, memsize)) == 1) {
+        sched_yield();
+    }
+    assert(ret == 0);
+
+    char *out = malloc(size + RING_CHUNK_MAX); uint64_t total = 0;
+    while (ret == 0 && total <= size) {
+        const uint8_t *data; uint32_t state = ring_state(&ring);
+        uint32_t length = ring_peek(&ring, &data);
+        if(length == 0) {
+            if(state != RING_STATE_OPEN) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        memcpy(out + total, data, length);
+        ring_consume(&ring);
+        total += length;
+    }
+
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(total == size && memcmp(out, log, size) == 0);
+
+    logread_t lr;
+    assert(logread_open_buffer(&lr, out, total) == 0);
+    assert(lr.pid == 1337);
+    logread_close(&lr);
+
+    munmap(mem, memsize);
+    remove(ringpath);
+    free(out);
+    free(log);
+}
+
+static void _put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value, p[1] = value >> 8, p[2] = value >> 16, p[3] = value >> 24;
+}
+
+// A PE32+ image with a single section holding the export directory, of
+// which the functions are at 0x2000, 0x2100 (under two names) and 0x2200.
+static void _synthetic_pe(uint8_t *pe, uint32_t timestamp)
+{
+    static const char *names[] = {"Alias", "First", "Second", "Third"};
+    static const uint16_t ordinals[] = {1, 0, 1, 2};
+
+    memset(pe, 0, 0x1000);
+    memcpy(pe, "MZ", 2);
+    _put32(pe + 0x3c, 0x80);
+
+    memcpy(pe + 0x80, "PE\0\0\x64\x86\x01\x00", 8);
+    _put32(pe + 0x88, timestamp);
+    pe[0x94] = 0xf0;
+
+    uint8_t *opt = pe + 0x98;
+    opt[0] = 0x0b, opt[1] = 0x02;
+    _put32(opt + 108, 16);
+    _put32(opt + 112, 0x1000);
+    _put32(opt + 116, 0x100);
+
+    uint8_t *section = opt + 0xf0;
+    memcpy(section, ".edata", 6);
+    _put32(section + 8, 0x1000);
+    _put32(section + 12, 0x1000);
+    _put32(section + 16, 0x400);
+    _put32(section + 20, 0x400);
+
+    uint8_t *dir = pe + 0x400;
+    _put32(dir + 20, 3);
+    _put32(dir + 24, 4);
+    _put32(dir + 28, 0x1040);
+    _put32(dir + 32, 0x1050);
+    _put32(dir + 36, 0x1060);
+
+    for (uint32_t idx = 0; idx < 3; idx++) {
+        _put32(dir + 0x40 + 4 * idx, 0x2000 + 0x100 * idx);
+    }
+
+    for (uint32_t idx = 0, offset = 0x80; idx < 4; idx++) {
+        _put32(dir + 0x50 + 4 * idx, 0x1000 + offset);
+        dir[0x60 + 2 * idx] = ordinals[idx];
+        strcpy((char *) dir + offset, names[idx]);
+        offset += strlen(names[idx]) + 1;
+    }
+}
+
+static void _module_doc(bson *b, uint64_t base, uint32_t hash,
+    uint32_t timestamp, const char *path)
+{
+    bson_init(b);
+    bson_append_string(b, "type", "module");
+    bson_append_long(b, "base", base);
+    bson_append_int(b, "size", 0x10000);
+    bson_append_int(b, "hash", hash);
+    bson_append_int(b, "timestamp", timestamp);
+    if(path != NULL) {
+        bson_append_string(b, "path", path);
+    }
+    bson_finish(b);
+}
+
+static void _call_doc(bson *b, uint32_t time, const char *frame)
+{
+    bson_init(b);
+    bson_append_int(b, "I", 0);
+    bson_append_int(b, "T", 1);
+    bson_append_int(b, "t", time);
+    bson_append_start_array(b, "s");
+    bson_append_string(b, "0", frame);
+    bson_append_finish_array(b);
+    bson_append_start_array(b, "args");
+    bson_append_int(b, "0", 1);
+    bson_append_long(b, "1", 0);
+    bson_append_finish_array(b);
+    bson_finish(b);
+}
+
+static void _test_symbolize()
+{
+    const char *dirpath = "test_symbolize.d";
+    const char *filepath = "test_symbolize.d/TestMod.DLL";
+    static uint8_t pe[0x1000]; static char log[4096];
+    uint32_t length = 4; char sym[512], buf[512];
+    symbolize_image_t img; symbolize_t s; logread_t lr; bson b;
+
+    _synthetic_pe(pe, 0x5a5a5a5a);
+    assert(symbolize_image_parse(&img, pe, sizeof(pe)) == 0);
+    assert(img.count == 4 && img.timestamp == 0x5a5a5a5a);
+    assert(img.exports[0].rva == 0x2000);
+    assert(strcmp(img.names + img.exports[1].name, "Alias") == 0);
+    assert(strcmp(img.names + img.exports[2].name, "Second") == 0);
+    symbolize_image_free(&img);
+
+    assert(symbolize_image_parse(&img, pe, 0x200) < 0);
+    assert(symbolize_image_parse(&img, (const uint8_t *) "MZ", 2) < 0);
+
+    mkdir(dirpath, 0755);
+    FILE *fp = fopen(filepath, "wb");
+    assert(fp != NULL && fwrite(pe, 1, sizeof(pe), fp) == sizeof(pe));
+    fclose(fp);
+
+    // The module is loaded at a second address later on, referencing the
+    // path by its hash, and a module of which the file doesn't match.
+    memcpy(log, "\x01\x00\x00\x00" "BSON 1\n", 11);
+    length = 11;
+
+    _module_doc(&b, 0x7ff000000000, 7, 0x5a5a5a5a,
+        "C:\\Windows\\System32\\testmod.dll");
+    memcpy(log + length, bson_data(&b), bson_size(&b));
+    length += bson_size(&b);
+    bson_destroy(&b);
+
+    _call_doc(&b, 1, "0x7ff000002150");
+    memcpy(log + length, bson_data(&b), bson_size(&b));
+    length += bson_size(&b);
+    bson_destroy(&b);
+
+    _module_doc(&b, 0x10000000, 7, 0x5a5a5a5a, NULL);
+    memcpy(log + length, bson_data(&b), bson_size(&b));
+    length += bson_size(&b);
+    bson_destroy(&b);
+
+    _module_doc(&b, 0x20000000, 8, 0x12345678, "C:\\other\\testmod.dll");
+    memcpy(log + length, bson_data(&b), bson_size(&b));
+    length += bson_size(&b);
+    bson_destroy(&b);
+
+    _call_doc(&b, 2, "Exported+0x10 kernel32+0x1010 @ 0x77001010");
+    memcpy(log + length, bson_data(&b), bson_size(&b));
+    length += bson_size(&b);
+    bson_destroy(&b);
+
+    assert(logread_open_buffer(&lr, log, length) == 0);
+    assert(lr.record_count == 2 && lr.module_count == 3);
+    assert(lr.modules[1].path == lr.modules[0].path);
+    assert(lr.modules[1].recno == 1);
+    assert(logread_module(&lr, 0, 0x10002000) == NULL);
+    assert(logread_module(&lr, 1, 0x10002000) == &lr.modules[1]);
+    assert(logread_module(&lr, 1, 0x10010000) == NULL);
+
+    const char *dirs[] = {"test_symbolize.missing", dirpath};
+    symbolize_init(&s, &lr, dirs, 2);
+
+    // The first of several names of a function is taken.
+    assert(symbolize(&s, 0, 0x7ff000002150, sym, sizeof(sym)) == 0);
+    assert(strcmp(sym, "Alias+0x50 Third-0xb0 testmod+0x2150") == 0);
+
+    assert(symbolize(&s, 1, 0x10002000, sym, sizeof(sym)) == 0);
+    assert(strcmp(sym, "Alias-0x100 testmod+0x2000") == 0);
+
+    assert(symbolize(&s, 1, 0x10002300, sym, sizeof(sym)) == 0);
+    assert(strcmp(sym, "Third+0x100 testmod+0x2300") == 0);
+
+    assert(symbolize(&s, 1, 0x20000010, sym, sizeof(sym)) == 0);
+    assert(strcmp(sym, "testmod+0x10") == 0);
+
+    assert(symbolize(&s, 0, 0x10002000, sym, sizeof(sym)) < 0);
+    assert(sym[0] == 0);
+
+    assert(symbolize(&s, 0, 0x7ff000002150, sym, 16) == 0);
+    assert(strcmp(sym, "Alias+0x50 Thir") == 0);
+
+    assert(strcmp(symbolize_frame(&s, 0, "0x7ff000002010", buf, sizeof(buf)),
+        "First+0x10 Alias-0xf0 testmod+0x2010 @ 0x7ff000002010") == 0);
+    assert(strcmp(symbolize_frame(&s, 0, "0x1234", buf, sizeof(buf)),
+        "0x1234") == 0);
+    assert(strcmp(symbolize_frame(&s, 0, "a @ 0x1", buf, sizeof(buf)),
+        "a @ 0x1") == 0);
+
+    symbolize_close(&s);
+    logread_close(&lr);
+
+    remove(filepath);
+    rmdir(dirpath);
+}
+
+// A call referencing a dictionary string which isn't valid UTF-8 can't be
+// converted into BSON, which has to be reported rather than handing out an
+// unfinished document.
+static void _test_undecodable()
+{
+    const char *header = "BSON 1337 strings=dict\n";
+    uint8_t ref[4] = {1, 0, 0, 0}; char buf[512], *invalid;
+    uint32_t pid = 1337, size = 0; bson string, call, b;
+    bson_iterator it; logread_t lr;
+
+    bson_init(&string);
+    bson_append_string(&string, "type", "string");
+    bson_append_int(&string, "i", 1);
+    bson_append_string(&string, "s", "C:\\file?.txt");
+    bson_finish(&string);
+
+    // The BSON encoder won't take it, so patch it in afterwards.
+    invalid = memchr(bson_data(&string), '?', bson_size(&string));
+    *invalid = (char) 0xff;
+
+    bson_init(&call);
+    bson_append_int(&call, "I", 0);
+    bson_append_int(&call, "T", 1000);
+    bson_append_int(&call, "t", 0);
+    bson_append_start_array(&call, "args");
+    bson_append_int(&call, "0", 1);
+    bson_append_long(&call, "1", 0);
+    bson_append_binary(&call, "2", PACKED_BSON_STRINGREF,
+        (const char *) ref, sizeof(ref));
+    bson_append_finish_array(&call);
+    bson_finish(&call);
+
+    memcpy(buf, &pid, sizeof(pid)), size += sizeof(pid);
+    memcpy(buf + size, header, strlen(header)), size += strlen(header);
+    memcpy(buf + size, bson_data(&string), bson_size(&string));
+    size += bson_size(&string);
+    memcpy(buf + size, bson_data(&call), bson_size(&call));
+    size += bson_size(&call);
+
+    assert(logread_open_buffer(&lr, buf, size) == 0);
+    assert(lr.dict == 1 && lr.record_count == 1);
+
+    assert(logread_record_bson(&lr, logread_record(&lr, 0), &b) < 0);
+    assert(bson_size(&b) == 5);
+    bson_destroy(&b);
+
+    assert(logread_record_args(&lr, logread_record(&lr, 0), &b, &it) < 0);
+    bson_destroy(&b);
+
+    logread_close(&lr);
+    bson_destroy(&string);
+    bson_destroy(&call);
+}
+
+int main()
+{
+    const char *filepath = "test_logread.bson";
+    const char *packedpath = "test_logread.packed.bson";
+    logsynth_stats_t stats; logread_t lr, lr2; uint64_t size;
+
+    FILE *fp = fopen(filepath, "wb");
+    assert(logsynth_write(fp, 4 * 1024 * 1024, 42,
+        LOGSYNTH_BSON, &stats) == 0);
+    fclose(fp);
+
+    assert(logread_open(&lr, filepath, 0) == 0);
+    assert(lr.mapped == 1);
+    assert(lr.pid == 1337);
+    assert(lr.size == stats.size);
+    assert(lr.record_count == stats.calls);
+    assert(lr.info_count == stats.infos);
+    assert(lr.buffer_count == stats.buffers);
+    assert(lr.unresolved_count == 0);
+    assert(lr.thread_count == LOGSYNTH_THREADS);
+    assert(lr.by_time != NULL);
+    _check_indices(&lr);
+
+    const logread_api_t *api = logread_api(&lr, 1);
+    assert(api != NULL && strcmp(api->name, "SyntheticApi1") == 0);
+    assert(strcmp(api->category, "registry") == 0);
+    assert(api->argc == 5 && strcmp(api->argnames[3], "arg1") == 0);
+    assert(api->argfmt[3] == 'x' && api->argfmt[2] == 0);
+    assert(logread_api(&lr, LOGSYNTH_APIS) == NULL);
+    assert(logread_thread(&lr, 1001) == NULL);
+
+    // Arguments are decoded straight from the mapping.
+    bson_iterator it; bson b; uint32_t count;
+    const uint32_t *recs = logread_api_records(&lr, 1, &count);
+    assert(recs != NULL && count != 0);
+    assert(logread_record_args(&lr,
+        logread_record(&lr, recs[0]), &b, &it) == 0);
+    assert(bson_data(&b) == logread_record_data(&lr,
+        logread_record(&lr, recs[0])));
+    assert(bson_iterator_next(&it) == BSON_INT);
+    assert(bson_iterator_next(&it) == BSON_LONG);
+    assert(bson_iterator_next(&it) == BSON_STRING);
+    bson_destroy(&b);
+
+    // Reading in chunks yields the exact same index.
+    assert(logread_open(&lr2, filepath, LOGREAD_NOMMAP) == 0);
+    assert(lr2.mapped == 0);
+    assert(lr2.record_count == lr.record_count);
+    assert(memcmp(lr.records, lr2.records,
+        lr.record_count * sizeof(logread_record_t)) == 0);
+    logread_close(&lr2);
+
+    uint32_t pos = logread_time_lower_bound(&lr, 100);
+    assert(pos == 0 ||
+        lr.records[logread_time_record(&lr, pos-1)].time < 100);
+    assert(pos == lr.record_count ||
+        lr.records[logread_time_record(&lr, pos)].time >= 100);
+
+    char *buf = _read_file(filepath, &size);
+    assert(size == lr.size);
+
+    // A truncated log keeps every complete record.
+    const logread_record_t *last = &lr.records[lr.record_count-1];
+    assert(logread_open_buffer(&lr2, buf, last->offset + 7) < 0);
+    assert(strcmp(lr2.error, "truncated document") == 0);
+    assert(lr2.error_offset == last->offset);
+    assert(lr2.record_count == lr.record_count - 1);
+    _check_indices(&lr2);
+    logread_close(&lr2);
+
+    // As does a corrupted one, up to the corrupted document.
+    const logread_record_t *mid = &lr.records[lr.record_count / 2];
+    buf[mid->offset + mid->length - 1] = 1;
+    assert(logread_open_buffer(&lr2, buf, size) < 0);
+    assert(strcmp(lr2.error, "malformed document") == 0);
+    assert(lr2.error_offset == mid->offset);
+    assert(lr2.record_count == lr.record_count / 2);
+    logread_close(&lr2);
+
+    buf[mid->offset + mid->length - 1] = 0;
+    memcpy(buf + mid->offset, "\xff\xff\xff\x7f", 4);
+    assert(logread_open_buffer(&lr2, buf, size) < 0);
+    assert(strcmp(lr2.error, "truncated document") == 0);
+    logread_close(&lr2);
+
+    assert(logread_open_buffer(&lr2, "ELF", 3) < 0);
+    assert(strcmp(lr2.error, "missing BSON header") == 0);
+    logread_close(&lr2);
+
+    free(buf);
+
+    // The same calls as packed records decode to the exact same BSON.
+    logsynth_stats_t stats2;
+    fp = fopen(packedpath, "wb");
+    assert(logsynth_write(fp, 4 * 1024 * 1024, 42,
+        LOGSYNTH_PACKED, &stats2) == 0);
+    fclose(fp);
+
+    assert(logread_open(&lr2, packedpath, 0) == 0);
+    assert(lr2.packed == 1 && lr2.ptrsize == 8);
+    assert(lr2.size == stats2.size);
+    assert(lr2.record_count == stats2.calls);
+    assert(lr2.buffer_count == stats2.buffers);
+    _check_indices(&lr2);
+
+    // Packed calls take less than half the space of their BSON equivalent.
+    uint64_t bson_bytes = 0, packed_bytes = 0;
+
+    for (uint32_t idx = 0; idx < lr2.record_count &&
+            idx < lr.record_count; idx++) {
+        const logread_record_t *r1 = logread_record(&lr, idx);
+        const logread_record_t *r2 = logread_record(&lr2, idx);
+        bson b1, b2;
+
+        assert(r1->index == r2->index && r1->tid == r2->tid &&
+            r1->time == r2->time);
+        bson_bytes += r1->length, packed_bytes += r2->length;
+
+        assert(logread_record_bson(&lr, r1, &b1) == 0);
+        assert(logread_record_bson(&lr2, r2, &b2) == 0);
+        assert(bson_size(&b1) == bson_size(&b2) &&
+            memcmp(bson_data(&b1), bson_data(&b2), bson_size(&b1)) == 0);
+        bson_destroy(&b1);
+        bson_destroy(&b2);
+
+        if(g_failed != 0) {
+            break;
+        }
+    }
+    assert(packed_bytes * 2 < bson_bytes);
+
+    // An unknown frame tag right after the header.
+    buf = _read_file(packedpath, &size);
+    logread_close(&lr2);
+
+    char *frame = memchr(buf + 4, '\n', size - 4) + 1;
+    assert(*frame == 0);
+    *frame = 7;
+    assert(logread_open_buffer(&lr2, buf, size) < 0);
+    assert(strcmp(lr2.error, "invalid frame tag") == 0);
+    assert(lr2.record_count == 0);
+    logread_close(&lr2);
+
+    free(buf);
+
+    // A compressed log yields the same records, shifted by the length of
+    // the "compress=lz4" option in the header.
+    buf = _read_file(filepath, &size);
+    uint64_t zsize; char *zbuf = _compress(buf, size, &zsize);
+    free(buf);
+
+    assert(zsize * 2 < size);
+    fp = fopen(packedpath, "wb");
+    assert(fwrite(zbuf, zsize, 1, fp) == 1);
+    fclose(fp);
+
+    for (uint32_t mode = 0; mode < 3; mode++) {
+        if(mode == 0) {
+            assert(logread_open_buffer(&lr2, zbuf, zsize) == 0);
+        }
+        else {
+            assert(logread_open(&lr2, packedpath,
+                mode == 1 ? 0 : LOGREAD_NOMMAP) == 0);
+        }
+
+        assert(lr2.compressed == 1 && lr2.mapped == 0);
+        assert(lr2.size == lr.size + 13);
+        assert(lr2.record_count == lr.record_count);
+        for (uint32_t idx = 0; idx < lr.record_count; idx++) {
+            const logread_record_t *r1 = logread_record(&lr, idx);
+            const logread_record_t *r2 = logread_record(&lr2, idx);
+            assert(r2->offset == r1->offset + 13 && r1->time == r2->time &&
+                r1->length == r2->length && r1->tid == r2->tid);
+            assert(memcmp(logread_record_data(&lr, r1),
+                logread_record_data(&lr2, r2), r1->length) == 0);
+            if(g_failed != 0) {
+                break;
+            }
+        }
+        _check_indices(&lr2);
+        logread_close(&lr2);
+    }
+
+    // A truncated frame keeps the records of all preceding frames.
+    assert(logread_open_buffer(&lr2, zbuf, zsize - 1) < 0);
+    assert(strcmp(lr2.error, "truncated frame") == 0);
+    assert(lr2.record_count != 0 && lr2.record_count < lr.record_count);
+    logread_close(&lr2);
+
+    // As does a corrupted one.
+    frame = memchr(zbuf + 4, '\n', zsize - 4) + 1;
+    uint32_t header;
+    memcpy(&header, frame, sizeof(header));
+    frame += LZ_FRAME_HEADER + (header & ~LZ_FRAME_RAW);
+    memcpy(frame, "\xff\xff\x01\x00", 4);
+    assert(logread_open_buffer(&lr2, zbuf, zsize) < 0);
+    assert(strcmp(lr2.error, "invalid frame length") == 0);
+    assert(lr2.record_count != 0 && lr2.record_count < lr.record_count);
+    logread_close(&lr2);
+    free(zbuf);
+
+    // Interned strings are resolved transparently, in either format.
+    for (int format = LOGSYNTH_BSON; format <= LOGSYNTH_PACKED; format++) {
+        logsynth_stats_t stats3;
+        fp = fopen(packedpath, "wb");
+        assert(logsynth_write(fp, 4 * 1024 * 1024, 42,
+            format | LOGSYNTH_STRINGS, &stats3) == 0);
+        fclose(fp);
+
+        assert(logread_open(&lr2, packedpath, 0) == 0);
+        assert(lr2.dict == 1 && lr2.packed == format);
+        assert(lr2.string_count > stats3.strings && stats3.strings != 0);
+        assert(lr2.record_count == stats3.calls);
+        assert(stats3.size / stats3.calls <
+            (format == LOGSYNTH_BSON ? stats : stats2).size /
+            (format == LOGSYNTH_BSON ? stats : stats2).calls);
+
+        for (uint32_t idx = 0; idx < lr2.record_count &&
+                idx < lr.record_count; idx++) {
+            bson b1, b2;
+            assert(logread_record_bson(&lr,
+                logread_record(&lr, idx), &b1) == 0);
+            assert(logread_record_bson(&lr2,
+                logread_record(&lr2, idx), &b2) == 0);
+            assert(bson_size(&b1) == bson_size(&b2) &&
+                memcmp(bson_data(&b1), bson_data(&b2), bson_size(&b1)) == 0);
+            bson_destroy(&b1);
+            bson_destroy(&b2);
+
+            if(g_failed != 0) {
+                break;
+            }
+        }
+        logread_close(&lr2);
+    }
+
+    // Collapsed calls are attached to the call they repeat.
+    for (int format = LOGSYNTH_BSON; format <= LOGSYNTH_PACKED; format++) {
+        logsynth_stats_t stats3; uint64_t repeated = 0;
+        fp = fopen(packedpath, "wb");
+        assert(logsynth_write(fp, 4 * 1024 * 1024, 42,
+            format | LOGSYNTH_REPEATS, &stats3) == 0);
+        fclose(fp);
+
+        assert(logread_open(&lr2, packedpath, 0) == 0);
+        assert(lr2.record_count == stats3.calls);
+        assert(lr2.repeat_count == stats3.repeats && stats3.repeats != 0);
+        assert(lr2.repeated_calls == stats3.repeated);
+
+        for (uint32_t idx = 0; idx < lr2.record_count; idx++) {
+            repeated += logread_record(&lr2, idx)->repeat;
+        }
+        assert(repeated == stats3.repeated);
+        _check_indices(&lr2);
+        logread_close(&lr2);
+    }
+
+    // A repeat document without preceding call of its thread is rejected.
+    bson rb;
+    bson_init(&rb);
+    bson_append_string(&rb, "type", "repeat");
+    bson_append_int(&rb, "I", 0);
+    bson_append_int(&rb, "T", 1);
+    bson_append_int(&rb, "t", 0);
+    bson_append_int(&rb, "n", 5);
+    bson_finish(&rb);
+
+    uint64_t rsize;
+    char *rbuf = _read_file(filepath, &rsize);
+    rbuf = realloc(rbuf, rsize + bson_size(&rb));
+    memcpy(rbuf + rsize, bson_data(&rb), bson_size(&rb));
+    assert(logread_open_buffer(&lr2, rbuf, rsize + bson_size(&rb)) < 0);
+    assert(strcmp(lr2.error, "unmatched repeat document") == 0);
+    assert(lr2.record_count == lr.record_count);
+    logread_close(&lr2);
+    bson_destroy(&rb);
+    free(rbuf);
+
+    // Rate limiting summaries are cumulative, so the last one counts.
+    bson sb[2];
+    for (uint32_t idx = 0; idx < 2; idx++) {
+        bson_init(&sb[idx]);
+        bson_append_string(&sb[idx], "type", "ratelimit");
+        bson_append_int(&sb[idx], "t", 1000 * idx);
+        bson_append_start_array(&sb[idx], "apis");
+        bson_append_start_array(&sb[idx], "0");
+        bson_append_int(&sb[idx], "0", 3);
+        bson_append_long(&sb[idx], "1", 5000 * (idx + 1));
+        bson_append_long(&sb[idx], "2", 4000 * (idx + 1));
+        bson_append_finish_array(&sb[idx]);
+        bson_append_finish_array(&sb[idx]);
+        bson_finish(&sb[idx]);
+    }
+
+    rbuf = _read_file(filepath, &rsize);
+    rbuf = realloc(rbuf, rsize + bson_size(&sb[0]) + bson_size(&sb[1]));
+    memcpy(rbuf + rsize, bson_data(&sb[0]), bson_size(&sb[0]));
+    memcpy(rbuf + rsize + bson_size(&sb[0]),
+        bson_data(&sb[1]), bson_size(&sb[1]));
+    assert(logread_open_buffer(&lr2, rbuf,
+        rsize + bson_size(&sb[0]) + bson_size(&sb[1])) == 0);
+    assert(lr2.ratelimit_count == 2);
+    assert(lr2.apis[3].calls == 10000 && lr2.apis[3].dropped == 8000);
+    assert(lr2.apis[4].calls == 0 && lr2.apis[4].dropped == 0);
+    logread_close(&lr2);
+    bson_destroy(&sb[0]);
+    bson_destroy(&sb[1]);
+    free(rbuf);
+
+    // As are the exception summaries, which only list the sites whose
+    // counts changed: sites 2 and 0 at first, then sites 1 and 0.
+    static const uint32_t ids[2][2] = {{2, 0}, {1, 0}};
+    for (uint32_t idx = 0; idx < 2; idx++) {
+        bson_init(&sb[idx]);
+        bson_append_string(&sb[idx], "type", "exceptions");
+        bson_append_int(&sb[idx], "t", 1000 * idx);
+        bson_append_long(&sb[idx], "n", 100 * (idx + 1));
+        bson_append_long(&sb[idx], "other", idx);
+        bson_append_start_array(&sb[idx], "sites");
+        for (uint32_t site = 0; site < 2; site++) {
+            uint32_t id = ids[idx][site]; char key[4];
+            snprintf(key, sizeof(key), "%u", site);
+            bson_append_start_array(&sb[idx], key);
+            bson_append_int(&sb[idx], "0", 0xc0000005);
+            bson_append_long(&sb[idx], "1", 0x401000 + id);
+            bson_append_long(&sb[idx], "2", 50 * (idx + 1) + id);
+            bson_append_int(&sb[idx], "3", id);
+            bson_append_finish_array(&sb[idx]);
+        }
+        bson_append_finish_array(&sb[idx]);
+        bson_finish(&sb[idx]);
+    }
+
+    rbuf = _read_file(filepath, &rsize);
+    rbuf = realloc(rbuf, rsize + bson_size(&sb[0]) + bson_size(&sb[1]));
+    memcpy(rbuf + rsize, bson_data(&sb[0]), bson_size(&sb[0]));
+    memcpy(rbuf + rsize + bson_size(&sb[0]),
+        bson_data(&sb[1]), bson_size(&sb[1]));
+    assert(logread_open_buffer(&lr2, rbuf,
+        rsize + bson_size(&sb[0]) + bson_size(&sb[1])) == 0);
+    assert(lr2.exception_summary_count == 2);
+    assert(lr2.exception_count == 200 && lr2.exception_other == 1);
+    assert(lr2.exception_site_count == 3);
+    assert(lr2.exceptions[0].address == 0x401000);
+    assert(lr2.exceptions[0].count == 100);
+    assert(lr2.exceptions[1].code == 0xc0000005);
+    assert(lr2.exceptions[1].address == 0x401001);
+    assert(lr2.exceptions[1].count == 101);
+    assert(lr2.exceptions[2].address == 0x401002);
+    assert(lr2.exceptions[2].count == 52);
+    logread_close(&lr2);
+    bson_destroy(&sb[0]);
+    bson_destroy(&sb[1]);
+    free(rbuf);
+
+    // Buffers referenced by their checksum resolve to their first copy.
+    rbuf = _read_file(filepath, &rsize);
+    for (uint32_t idx = 0; idx < 300; idx++) {
+        char checksum[41], contents[64];
+        // References are to the preceding buffer, or unknown ones.
+        uint32_t ref = idx % 3 != 2 ? idx : idx % 2 != 0 ? idx - 1 : 1000;
+        snprintf(checksum, sizeof(checksum), "%08x%032x",
+            ref * 2654435761u, ref);
+        snprintf(contents, sizeof(contents), "contents %u", idx);
+
+        bson_init(&sb[0]);
+        bson_append_string(&sb[0], "type", idx % 3 == 2 ? "bufref" : "buffer");
+        if(idx % 3 != 2) {
+            bson_append_binary(&sb[0], "buffer", BSON_BIN_BINARY,
+                contents, strlen(contents));
+        }
+        bson_append_string(&sb[0], "checksum", checksum);
+        bson_finish(&sb[0]);
+
+        rbuf = realloc(rbuf, rsize + bson_size(&sb[0]));
+        memcpy(rbuf + rsize, bson_data(&sb[0]), bson_size(&sb[0]));
+        rsize += bson_size(&sb[0]);
+        bson_destroy(&sb[0]);
+    }
+
+    assert(logread_open_buffer(&lr2, rbuf, rsize) == 0);
+    assert(lr2.bufref_count == 100 && lr2.unresolved_bufref_count == 50);
+    assert(lr2.unique_buffer_count == 200);
+    assert(lr2.buffer_count == lr.buffer_count + 200);
+
+    uint32_t buflen;
+    const uint8_t *contents = logread_buffer(&lr2,
+        "9e3779b100000000000000000000000000000001", &buflen);
+    assert(contents != NULL && buflen == 10);
+    assert(contents != NULL && memcmp(contents, "contents 1", 10) == 0);
+    assert(logread_buffer(&lr2,
+        "3c6ef36200000000000000000000000000000002", NULL) == NULL);
+    logread_close(&lr2);
+    free(rbuf);
+
+    // Streamed buffers are reassembled from chunks, which may be
+    // interleaved with those of other streams. Stream 3 is cut short, the
+    // contents of stream 4 don't match its checksum, and stream 5 never
+    // ends.
+    static const struct {
+        int end;
+        uint32_t stream;
+        uint32_t offset;
+        uint32_t checksum;
+    } streamdocs[] = {
+        {0, 1, 0, 0}, {0, 2, 0, 0}, {0, 1, 500, 0}, {0, 2, 500, 0},
+        {0, 3, 0, 0}, {0, 2, 1000, 0}, {0, 4, 1, 0}, {1, 1, 1000, 2},
+        {0, 2, 1500, 0}, {1, 3, 500, 0}, {1, 4, 500, 1}, {0, 5, 0, 0},
+        {1, 2, 2000, 3},
+    };
+
+    uint8_t *streamed = malloc(2000);
+    for (uint32_t idx = 0; idx < 2000; idx++) {
+        streamed[idx] = idx * 7;
+    }
+
+    // Checksums of the first 500, 1000 and 2000 bytes.
+    char streamsum[4][41] = {"???"}; uint8_t digest[SHA1_DIGEST_SIZE];
+    for (uint32_t sum = 1; sum < 4; sum++) {
+        sha1_t ctx;
+        sha1_init(&ctx);
+        sha1_update(&ctx, streamed, 250 << sum);
+        sha1_final(&ctx, digest);
+        for (uint32_t idx = 0; idx < SHA1_DIGEST_SIZE; idx++) {
+            sprintf(streamsum[sum] + 2 * idx, "%02x", digest[idx]);
+        }
+    }
+
+    rbuf = _read_file(filepath, &rsize);
+    for (uint32_t idx = 0; idx < sizeof(streamdocs)/sizeof(*streamdocs);
+            idx++) {
+        bson_init(&sb[0]);
+        bson_append_string(&sb[0], "type",
+            streamdocs[idx].end != 0 ? "bufend" : "bufchunk");
+        bson_append_int(&sb[0], "stream", streamdocs[idx].stream);
+        if(streamdocs[idx].end != 0) {
+            bson_append_long(&sb[0], "size", streamdocs[idx].offset);
+            bson_append_string(&sb[0], "checksum",
+                streamsum[streamdocs[idx].checksum]);
+        }
+        else {
+            uint32_t offset = streamdocs[idx].offset;
+            bson_append_long(&sb[0], "offset", offset & ~1);
+            bson_append_binary(&sb[0], "data", BSON_BIN_BINARY,
+                (const char *) streamed + offset, 500);
+        }
+        bson_finish(&sb[0]);
+
+        rbuf = realloc(rbuf, rsize + bson_size(&sb[0]));
+        memcpy(rbuf + rsize, bson_data(&sb[0]), bson_size(&sb[0]));
+        rsize += bson_size(&sb[0]);
+        bson_destroy(&sb[0]);
+    }
+
+    assert(logread_open_buffer(&lr2, rbuf, rsize) == 0);
+    assert(lr2.stream_count == 2 && lr2.incomplete_stream_count == 2);
+    assert(lr2.chunk_count == 1);
+    assert(logread_buffer(&lr2, streamsum[1], NULL) == NULL);
+    contents = logread_buffer(&lr2, streamsum[2], &buflen);
+    assert(contents != NULL && buflen == 1000);
+    assert(contents != NULL && memcmp(contents, streamed, 1000) == 0);
+    contents = logread_buffer(&lr2, streamsum[3], &buflen);
+    assert(contents != NULL && buflen == 2000);
+    assert(contents != NULL && memcmp(contents, streamed, 2000) == 0);
+    logread_close(&lr2);
+    free(streamed);
+    free(rbuf);
+
+    _test_lz();
+    _test_ring();
+    _test_ring_processes(filepath);
+    _test_symbolize();
+    _test_undecodable();
+
+    logread_close(&lr);
+    remove(filepath);
+    remove(packedpath);
+
+    printf("logread: %s\n", g_failed ? "FAILED" : "OK");
+    return g_failed;
+}
@@ -0,0 +1,161 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests the radix tree, single-threaded and with concurrent
+// writers and readers.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "radix.h"
+
+static int g_failed;
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        fprintf(stderr, "Test didn't pass: %s (line %d)\n", \
+            #expr, __LINE__); \
+        g_failed = 1; \
+    }
+
+#define RADIX_THREADS 8
+#define RADIX_KEYS 20000
+
+static uint32_t g_radix_nodes;
+static radix_t g_radix;
+static int g_radix_done;
+
+static void *_radix_alloc(uint32_t length)
+{
+    __atomic_fetch_add(&g_radix_nodes, 1, __ATOMIC_RELAXED);
+    return calloc(1, length);
+}
+
+static void _radix_free(void *ptr)
+{
+    __atomic_fetch_sub(&g_radix_nodes, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+// Keys are spread like thread identifiers, i.e., multiples of four, and
+// interleaved between the writers so that they race to create nodes.
+static uint32_t _radix_key(uint32_t idx)
+{
+    return idx * 4 * 37;
+}
+
+static void *_radix_value(uint32_t key)
+{
+    return (void *)(uintptr_t)(key * 2 + 1);
+}
+
+static void *_radix_writer(void *arg)
+{
+    uint32_t thread = (uint32_t)(uintptr_t) arg;
+
+    for (uint32_t idx = thread; idx < RADIX_KEYS; idx += RADIX_THREADS) {
+        uint32_t key = _radix_key(idx);
+        if(radix_set(&g_radix, key, _radix_value(key)) < 0) {
+            return (void *) 1;
+        }
+    }
+
+    // Then remove every other key again.
+    for (uint32_t idx = thread; idx < RADIX_KEYS; idx += RADIX_THREADS) {
+        if(idx % 2 != 0 && radix_unset(&g_radix, _radix_key(idx)) < 0) {
+            return (void *) 1;
+        }
+    }
+    return NULL;
+}
+
+// Readers should only ever see a key unset or set to its value.
+static void *_radix_reader(void *arg)
+{
+    uintptr_t errors = 0; (void) arg;
+
+    while (__atomic_load_n(&g_radix_done, __ATOMIC_ACQUIRE) == 0) {
+        for (uint32_t idx = 0; idx < RADIX_KEYS; idx++) {
+            uint32_t key = _radix_key(idx);
+            void *value = radix_get(&g_radix, key);
+            errors += value != NULL && value != _radix_value(key);
+        }
+    }
+    return (void *) errors;
+}
+
+int main()
+{
+    pthread_t writers[RADIX_THREADS], readers[2]; void *ret;
+
+    radix_init(&g_radix, &_radix_alloc, &_radix_free);
+    assert(radix_get(&g_radix, 0) == NULL);
+    assert(radix_unset(&g_radix, 0) < 0);
+    assert(radix_set(&g_radix, 0xffffffff, "last") == 0);
+    assert(radix_set(&g_radix, 0, "first") == 0);
+    assert(strcmp(radix_get(&g_radix, 0xffffffff), "last") == 0);
+    assert(strcmp(radix_get(&g_radix, 0), "first") == 0);
+    assert(radix_get(&g_radix, 0xfffffffe) == NULL);
+    assert(radix_get(&g_radix, 0x10000) == NULL);
+    assert(radix_unset(&g_radix, 1) == 0);
+    assert(radix_unset(&g_radix, 0x10000) < 0);
+    assert(radix_unset(&g_radix, 0) == 0 && radix_get(&g_radix, 0) == NULL);
+    radix_destroy(&g_radix);
+    assert(g_radix_nodes == 0);
+
+    for (uint32_t idx = 0; idx < 2; idx++) {
+        pthread_create(&readers[idx], NULL, &_radix_reader, NULL);
+    }
+    for (uint32_t idx = 0; idx < RADIX_THREADS; idx++) {
+        pthread_create(&writers[idx], NULL, &_radix_writer,
+            (void *)(uintptr_t) idx);
+    }
+
+    for (uint32_t idx = 0; idx < RADIX_THREADS; idx++) {
+        pthread_join(writers[idx], &ret);
+        assert(ret == NULL);
+    }
+
+    __atomic_store_n(&g_radix_done, 1, __ATOMIC_RELEASE);
+    for (uint32_t idx = 0; idx < 2; idx++) {
+        pthread_join(readers[idx], &ret);
+        assert(ret == NULL);
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t idx = 0; idx < RADIX_KEYS; idx++) {
+        uint32_t key = _radix_key(idx);
+        mismatches += radix_get(&g_radix, key) !=
+            (idx % 2 == 0 ? _radix_value(key) : NULL);
+    }
+    assert(mismatches == 0);
+
+    // The nodes of the losers of a race have been freed, so what is left
+    // is exactly the root, and the mid nodes and leaves in the key range.
+    uint32_t last = _radix_key(RADIX_KEYS - 1);
+    assert(g_radix_nodes == 1 + (last >> (RADIX_MID_BITS + RADIX_LEAF_BITS)) +
+        1 + (last >> RADIX_LEAF_BITS) + 1);
+    radix_destroy(&g_radix);
+    assert(g_radix_nodes == 0);
+
+    printf("radix: %s\n", g_failed ? "FAILED" : "OK");
+    return g_failed;
+}
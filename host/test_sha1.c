@@ -0,0 +1,129 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests SHA-1 against the FIPS 180 test vectors and chunked
+// updates, for every backend that the processor supports.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sha1.h"
+
+static int g_failed;
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        fprintf(stderr, "Test didn't pass: %s (line %d)\n", \
+            #expr, __LINE__); \
+        g_failed = 1; \
+    }
+
+static void _sha1_hex(const void *buf, uintptr_t length,
+    uintptr_t chunk, char *hexdigest)
+{
+    const uint8_t *ptr = (const uint8_t *) buf;
+    uint8_t digest[SHA1_DIGEST_SIZE]; sha1_t ctx;
+
+    sha1_init(&ctx);
+    for (uintptr_t offset = 0; offset < length; offset += chunk) {
+        sha1_update(&ctx, ptr + offset,
+            length - offset < chunk ? length - offset : chunk);
+    }
+    sha1_final(&ctx, digest);
+
+    for (uint32_t idx = 0; idx < SHA1_DIGEST_SIZE; idx++) {
+        sprintf(hexdigest + idx * 2, "%02x", digest[idx]);
+    }
+}
+
+int main()
+{
+    static const struct {
+        const char *message;
+        uint32_t repeat;
+        const char *digest;
+    } vectors[] = {
+        {"", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+        {"abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+            "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+            "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+            "a49b2446a02c645bf419f995b67091253a04a259"},
+        {"a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+    };
+    static const uintptr_t chunks[] = {1, 3, 63, 64, 65, 1000, 4096};
+    char hexdigest[SHA1_DIGEST_SIZE * 2 + 1], expected[sizeof(hexdigest)];
+    int initial = sha1_backend_current();
+
+    uint8_t *random = malloc(10007), *buf = malloc(1000000);
+    for (uint32_t idx = 0, seed = 1; idx < 10007; idx++) {
+        seed = seed * 1103515245 + 12345;
+        random[idx] = seed >> 16;
+    }
+
+    assert(sha1_backend(SHA1_BACKEND_PORTABLE) == 0);
+    assert(sha1_backend(SHA1_BACKEND_COUNT) < 0);
+    _sha1_hex(random, 10007, 10007, expected);
+
+    for (int backend = SHA1_BACKEND_PORTABLE;
+            backend < SHA1_BACKEND_COUNT; backend++) {
+        if(sha1_backend(backend) < 0) {
+            printf("sha1: %s not supported\n", sha1_backend_name(backend));
+            continue;
+        }
+
+        for (uint32_t idx = 0; idx < sizeof(vectors)/sizeof(*vectors);
+                idx++) {
+            uint32_t length = strlen(vectors[idx].message);
+            for (uint32_t j = 0; j < vectors[idx].repeat; j++) {
+                memcpy(buf + j * length, vectors[idx].message, length);
+            }
+
+            length *= vectors[idx].repeat;
+            _sha1_hex(buf, length, length != 0 ? length : 1, hexdigest);
+            assert(strcmp(hexdigest, vectors[idx].digest) == 0);
+            _sha1_hex(buf, length, 7, hexdigest);
+            assert(strcmp(hexdigest, vectors[idx].digest) == 0);
+        }
+
+        // Every length around the padding boundary, in chunks of every
+        // size, has to agree with the portable implementation.
+        for (uint32_t idx = 0; idx < sizeof(chunks)/sizeof(*chunks); idx++) {
+            _sha1_hex(random, 10007, chunks[idx], hexdigest);
+            assert(strcmp(hexdigest, expected) == 0);
+        }
+
+        for (uint32_t length = 0; length <= 200; length++) {
+            char reference[sizeof(hexdigest)];
+            sha1_backend(SHA1_BACKEND_PORTABLE);
+            _sha1_hex(random, length, 200, reference);
+            sha1_backend(backend);
+            _sha1_hex(random, length, 13, hexdigest);
+            assert(strcmp(hexdigest, reference) == 0);
+        }
+    }
+
+    sha1_backend(initial);
+    free(random);
+    free(buf);
+
+    printf("sha1: %s\n", g_failed ? "FAILED" : "OK");
+    return g_failed;
+}
@@ -59,6 +59,62 @@ typedef struct _config_t {
     // latest version on the Analyzer side).
     int pipe_pid;
 
+    // Whether notifications are sent to the host asynchronously.
+    int pipe_async;
+
+    // Format of the log, either LOG_FORMAT_BSON or LOG_FORMAT_PACKED.
+    int log_format;
+
+    // Compression of the log, either LOG_COMPRESS_NONE or LOG_COMPRESS_LZ4.
+    int log_compress;
+
+    // Size of the string dictionary of the log, zero to disable it.
+    uint32_t log_strings;
+
+    // Section name and size of the shared-memory ring to write the log to
+    // instead of the log pipe, see log_ring_init().
+    char log_ring[MAX_PATH];
+    uint32_t log_ring_size;
+
+    // Send the explain documents of all APIs at startup.
+    int log_explain_all;
+
+    // Where stack traces are symbolized, either LOG_SYMBOLS_MONITOR or
+    // LOG_SYMBOLS_HOST, and whether to log them outside debug builds.
+    int log_symbols;
+    int log_stacktrace;
+
+    // Comma-separated categories of which repeated calls are collapsed, and
+    // the interval in milliseconds at which such runs are reported.
+    char log_collapse[256];
+    uint32_t log_collapse_window;
+
+    // Number of buffer digests remembered to avoid sending the same
+    // contents twice, zero to disable it.
+    uint32_t log_buffer_dedup;
+
+    // Per-API rate limiting and sampling, see log_rate_init().
+    uint32_t log_rate;
+    uint32_t log_burst;
+    uint32_t log_sample;
+    uint32_t log_summary;
+
+    // Exception deduplication and the policy once the exception limit has
+    // been reached, see log_exception_init().
+    int exception_policy;
+    uint32_t exception_limit;
+    uint32_t exception_sites;
+    uint32_t exception_interval;
+
+    // Whether to cache the paths of registry key and file handles, see
+    // misc.c.
+    int regkey_cache;
+    int file_cache;
+
+    // Interval in milliseconds at which to poll the host for commands, such
+    // as filter rules. Zero disables polling.
+    uint32_t command_interval;
+
     // Dynamic triggers that start the logging for this analysis.
     wchar_t trigger[MAX_PATH+16];
 } config_t;
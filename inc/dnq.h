@@ -0,0 +1,70 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2015-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_DNQ_H
+#define MONITOR_DNQ_H
+
+#include <stdint.h>
+
+// Static set of 32-bit or 64-bit values, built once and then queried for
+// membership on the per-call path, e.g., for the guard page and diffing
+// whitelists.
+//
+// dnq_init() sorts the list in place, which remains available through the
+// dnq_iter*() functions. Small lists are searched by comparing blocks of
+// values at once. Larger ones get a copy in Eytzinger (breadth-first)
+// order, i.e., the children of the value at index k live at 2k and 2k+1,
+// so the first levels of the search share a few cache lines and the
+// deeper ones can be prefetched ahead of time, which is searched without
+// branches. If that copy can't be allocated, the sorted list is searched
+// instead.
+
+// Lists of at most this many bytes, i.e., 32 32-bit or 16 64-bit values,
+// are scanned linearly.
+#define DNQ_LINEAR_SIZE 128
+
+typedef void *(*dnq_alloc_t)(uint32_t length);
+typedef void (*dnq_free_t)(void *ptr);
+
+typedef struct _dnq_t {
+    void *list;
+    uint32_t size;
+    uint32_t length;
+
+    // The Eytzinger copy, one-based and cache line-aligned, and the
+    // allocation it lives in.
+    void *tree;
+    void *tree_alloc;
+} dnq_t;
+
+// Defaults to malloc() and free().
+void dnq_set_allocator(dnq_alloc_t alloc, dnq_free_t free);
+
+// Returns 0 on success and -1 for an unsupported value size.
+int dnq_init(dnq_t *dnq, void *list, uint32_t size, uint32_t length);
+void dnq_free(dnq_t *dnq);
+
+uint32_t *dnq_iter32(dnq_t *dnq);
+uint64_t *dnq_iter64(dnq_t *dnq);
+uintptr_t *dnq_iterptr(dnq_t *dnq);
+int dnq_isempty(dnq_t *dnq);
+int dnq_has32(dnq_t *dnq, uint32_t value);
+int dnq_has64(dnq_t *dnq, uint64_t value);
+int dnq_hasptr(dnq_t *dnq, uintptr_t value);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_FILTER_H
+#define MONITOR_FILTER_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+//
+// Filter API
+//
+// Calls matching a filter rule are dropped before they're serialized. The
+// rules are pushed by the host through the "FILTER" pipe command, one rule
+// per command, of the form
+//
+//   FILTER <api>|<predicate>[|<predicate>...]
+//
+// where api is the name or index of the API, and a call matches if all of
+// the predicates hold. A FILTER command without arguments removes all rules.
+// Each predicate is an argument index, numbered as in the "args" array of
+// the log (0 is is_success, 1 the return value), followed by one of
+//
+// =value      -> equals the integer or (case-insensitive) string value
+// ^value      -> string starting with value (case-insensitive)
+// :low,high   -> signed integer within low and high, inclusive
+// &mask       -> integer with any of the bits in mask set
+// &mask=value -> integer of which the bits in mask equal value
+//
+// Integers may be given in decimal or hexadecimal. Values can't contain '|'.
+//
+
+#define FILTER_PREDICATE_MAX 8
+
+void filter_init();
+
+// Compile a rule, returns 0 on success and -1 if it's invalid.
+int filter_add(const char *rule);
+void filter_clear();
+
+// Returns 1 if the call, with its logged arguments in args as passed to
+// log_api(), matches any of the rules of its API.
+int filter_match(uint32_t index, int is_success, uintptr_t return_value,
+    va_list args);
+
+#endif
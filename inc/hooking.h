@@ -125,6 +125,10 @@ typedef struct _hook_t {
     // Is this function already hooked?
     uint32_t is_hooked;
 
+    // Has this hook been disabled at runtime? A disabled hook stays in
+    // place but no longer redirects calls to its handler.
+    volatile uint32_t is_disabled;
+
     // Stub for calling the original function.
     uint8_t *func_stub;
 } hook_t;
@@ -143,6 +147,16 @@ int hook_insn(hook_t *h, uint32_t signature);
 uint8_t *hook_get_mem();
 int hook_missing_hooks(HMODULE module_handle);
 
+// Enable or disable an installed hook at runtime. Returns 1 if its state
+// changed, 0 if it already was in that state, and -1 if it can't be toggled.
+int hook_set_enabled(hook_t *h, int enabled);
+
+// Enable or disable all hooks matching the API name, category and monitor
+// mode bits, each of which is ignored if NULL or zero. Special hooks are
+// never toggled. Returns the amount of hooks that changed state.
+int hook_toggle(const char *apiname, const char *category, int mode,
+    int enabled);
+
 #define DISASM_BUFSIZ 128
 
 int disasm(const void *addr, char *str);
@@ -24,7 +24,76 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "bson.h"
 #include "native.h"
 
-void log_init(const char *pipe_name, int track);
+// Regular BSON documents, or packed records (see packed.h).
+#define LOG_FORMAT_BSON 0
+#define LOG_FORMAT_PACKED 1
+
+// Optional block compression of the log stream, see lz.h.
+#define LOG_COMPRESS_NONE 0
+#define LOG_COMPRESS_LZ4 1
+
+// With log_strings non-zero, up to that many distinct strings are kept in
+// the string dictionary, see packed.h.
+void log_init(const char *pipe_name, int track, int log_format,
+    int log_compress, uint32_t log_strings);
+
+// Write the log to a shared-memory ring with the given section name, see
+// ring.h, instead of to the log pipe. Must be called before log_init(). A
+// size of zero selects a ring of 4 MB. If the ring can't be created, or its
+// reader stalls, the log goes to the log pipe instead.
+void log_ring_init(const char *name, uint32_t size);
+
+// Tell the reader of the ring that no more data follows.
+void log_ring_close();
+
+// Return addresses in stack traces are either resolved by the monitor, or,
+// with LOG_SYMBOLS_HOST, logged as-is and resolved offline by the host (see
+// host/symbolize.h) against "module" documents announcing every module at
+// startup and as it is loaded. With stacktrace non-zero each call carries a
+// stack trace, which is otherwise only the case in debug builds. Must be
+// called before log_init().
+#define LOG_SYMBOLS_MONITOR 0
+#define LOG_SYMBOLS_HOST 1
+
+void log_symbols_init(int mode, int stacktrace);
+
+// Announce a module, given its full path, to the host. Only with
+// LOG_SYMBOLS_HOST; the path is only sent the first time it's seen.
+void log_module(const void *base, const wchar_t *path, uint32_t length);
+
+// Send the explain documents of all APIs right away, rather than right
+// before the first call to each API.
+void log_explain_all();
+
+// Write out any batched log data right away, e.g., before the process
+// terminates, preceded by the final "ratelimit" and exception summaries if
+// their counts changed since the last ones. Called on process detach.
+void log_flush();
+
+// Collapse runs of identical calls, made by the same thread, to APIs of
+// the given comma-separated categories. Runs are reported at least every
+// window milliseconds, or every second if window is zero.
+void log_collapse_init(const char *categories, uint32_t window);
+
+// Remember the digests of up to count non-truncated buffers, so that
+// buffers with the same contents are only referenced by their SHA-1
+// checksum through a "bufref" document rather than being sent again. A
+// repeat is recognized through a 64-bit hash of the contents and their
+// length, see hash_block().
+void log_buffer_dedup_init(uint32_t count);
+
+// Limit each API to rate calls per second with bursts of up to burst calls
+// (rate if zero). Calls beyond that are dropped, or, with sample non-zero,
+// logged one in every sample calls; a rate of zero samples all calls. The
+// exact number of calls and dropped calls is summarized every interval
+// milliseconds (five seconds if zero) as long as calls are being dropped.
+void log_rate_init(uint32_t rate, uint32_t burst, uint32_t sample,
+    uint32_t interval);
+
+// Whether a call to the given API should be logged, decided by log_api()
+// once the call has passed the filter rules and before its arguments are
+// serialized. Always true unless rate limiting is enabled.
+int log_admit(uint32_t index);
 
 void log_api(uint32_t index, int is_success, uintptr_t return_value,
     uint64_t hash, last_error_t *lasterr, ...);
@@ -54,6 +123,23 @@ void log_debug(const char *fmt, ...);
 
 #define LOG_EXC_NOSYMBOL 1
 
+// What happens once a process has raised the limit of exceptions: it's
+// terminated, its exceptions are only counted from then on, or nothing.
+#define LOG_EXC_POLICY_EXIT 0
+#define LOG_EXC_POLICY_COUNT 1
+#define LOG_EXC_POLICY_IGNORE 2
+
+// With sites set, only the first exception raised at each site, i.e., with
+// the same code, address and innermost return addresses, is logged in
+// detail. Up to sites sites are tracked (at most 1 << 20), exceptions at
+// further sites and repeated exceptions are summarized through
+// "exceptions" documents every interval milliseconds (five seconds if
+// zero), which only list the sites whose counts changed. Without sites,
+// or without calling this, every exception is logged until the limit is
+// reached. A limit of zero stands for 65536 exceptions.
+void log_exception_init(int policy, uint32_t limit, uint32_t sites,
+    uint32_t interval);
+
 // Following are function imports and declarations that are generated as part
 // of the automated code generation. However, as we don't want to recompile
 // everything every time this code is re-generated, we wrap its data in
@@ -70,6 +156,7 @@ const char *sig_apiname(uint32_t sigidx);
 const char *sig_category(uint32_t sigidx);
 const char *sig_paramtypes(uint32_t sigidx);
 const char *sig_param_name(uint32_t sigidx, uint32_t argidx);
+const uint8_t *sig_explain(uint32_t sigidx, uint32_t *length);
 uint32_t sig_count();
 const flag_repr_t *flag_value(uint32_t flagidx);
 const flag_repr_t *flag_bitmask(uint32_t flagidx);
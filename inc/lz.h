@@ -0,0 +1,64 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_LZ_H
+#define MONITOR_LZ_H
+
+#include <stdint.h>
+
+// Block compression of the log stream, negotiated through "compress=lz4"
+// in the "BSON <pid>" header. Everything following the header is split into
+// frames, each consisting of a 32-bit little-endian header and a payload.
+// The lower 31 bits of the header hold the payload length. If LZ_FRAME_RAW
+// is set the payload is stored as-is, otherwise it's a block in the LZ4
+// block format. Either way a frame represents at most LZ_BLOCK_MAX bytes of
+// the stream. Frames are independent of each other.
+
+#define LZ_BLOCK_MAX (64*1024)
+
+#define LZ_FRAME_HEADER 4
+#define LZ_FRAME_RAW 0x80000000
+
+#define LZ_HASH_LOG 12
+
+// Worst-case size of a frame for a block of the given length.
+#define LZ_FRAME_BOUND(length) (LZ_FRAME_HEADER + (length))
+
+// Match finder state, reset for each block. Kept out of the stack as it
+// is fairly large.
+typedef struct _lz_table_t {
+    uint32_t pos[1 << LZ_HASH_LOG];
+} lz_table_t;
+
+// Compress a block into dst. Returns the compressed length, or 0 if it
+// doesn't fit in capacity bytes.
+uint32_t lz_compress(const void *src, uint32_t length,
+    void *dst, uint32_t capacity, lz_table_t *table);
+
+// Decompress a block into dst. Returns the decompressed length, or -1 if
+// the block is malformed or doesn't fit in capacity bytes.
+int32_t lz_decompress(const void *src, uint32_t length,
+    void *dst, uint32_t capacity);
+
+// Write a block of at most LZ_BLOCK_MAX bytes as a frame into dst, which
+// has to hold LZ_FRAME_BOUND(length) bytes. Blocks which don't compress are
+// stored. Returns the length of the frame.
+uint32_t lz_frame(const void *src, uint32_t length,
+    void *dst, lz_table_t *table);
+
+#endif
@@ -21,23 +21,66 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 #include <windows.h>
+#include "dnq.h"
+#include "radix.h"
 
+// Map of thread identifiers, handles, etc, to pointers. Lookups are
+// lock-free, see radix.h.
 typedef struct _array_t {
-    uint32_t length;
-    void   **elements;
-    CRITICAL_SECTION cs;
+    radix_t map;
 } array_t;
 
+// Number of objects a thread caches per slab.
+#define SLAB_MAGAZINE_SIZE 16
+
+// Per-thread cache of free objects of a slab, so that most allocations
+// and frees don't take the lock of the slab.
+typedef struct _slab_magazine_t {
+    struct _slab_magazine_t *next;
+    uint32_t count;
+    uint32_t allocs;
+    uint32_t frees;
+    void *objects[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+// Allocator of fixed-size objects, which are carved from chunks of count
+// objects with the given memory protection, which has to be writable.
+// Objects are always zeroed when handed out.
 typedef struct _slab_t {
-    array_t array;
+    CRITICAL_SECTION cs;
     uint32_t size;
     uint32_t count;
+    uint32_t memprot;
+    const uint8_t *near;
 
+    // The chunk being carved up and the objects which have been freed,
+    // linked through their first pointer. Protected by cs.
+    uint8_t *chunk;
     uint32_t offset;
-    uint32_t length;
-    uint32_t memprot;
+    void *freelist;
+    uint32_t chunk_count;
+    uint32_t free_count;
+    uint32_t allocs;
+    uint32_t frees;
+
+    // Magazines by thread identifier, and all of them for the statistics.
+    array_t magazines;
+    slab_magazine_t *magazine_list;
 } slab_t;
 
+typedef struct _slab_stats_t {
+    uint32_t chunks;
+    uint32_t capacity;
+
+    // Objects handed out, on the free list, and cached by threads.
+    uint32_t used;
+    uint32_t free;
+    uint32_t cached;
+
+    uint32_t allocs;
+    uint32_t frees;
+} slab_stats_t;
+
 // Memory alignment compatible with XMM/YMM instructions on x86_64.
 #define MEM_ALIGNMENT 0x10
 
@@ -67,23 +110,17 @@ static inline uintptr_t array_geti(array_t *array, uintptr_t index)
 
 void slab_init(slab_t *slab, uint32_t size, uint32_t count,
     uint32_t memory_protection);
+
+// Place the chunks within reach of a 32-bit relative jump from addr, e.g.,
+// for stubs which jump back into the code of a module.
+void slab_init_near(slab_t *slab, uint32_t size, uint32_t count,
+    uint32_t memory_protection, const void *addr);
+
 void *slab_getmem(slab_t *slab);
-void slab_return_last(slab_t *slab);
+void slab_free(slab_t *slab, void *ptr);
 uint32_t slab_size(const slab_t *slab);
 
-typedef struct _dnq_t {
-    void *list;
-    uint32_t size;
-    uint32_t length;
-} dnq_t;
-
-int dnq_init(dnq_t *dnq, void *list, uint32_t size, uint32_t length);
-uint32_t *dnq_iter32(dnq_t *dnq);
-uint64_t *dnq_iter64(dnq_t *dnq);
-uintptr_t *dnq_iterptr(dnq_t *dnq);
-int dnq_isempty(dnq_t *dnq);
-int dnq_has32(dnq_t *dnq, uint32_t value);
-int dnq_has64(dnq_t *dnq, uint64_t value);
-int dnq_hasptr(dnq_t *dnq, uintptr_t value);
+// The statistics are only approximate while other threads use the slab.
+void slab_stats(slab_t *slab, slab_stats_t *stats);
 
 #endif
@@ -43,6 +43,9 @@ void misc_set_monitor_options(uint32_t track, uint32_t mode,
 wchar_t *get_unicode_buffer();
 void free_unicode_buffer(wchar_t *ptr);
 
+// Release the unicode buffers of the current thread as it exits.
+void free_unicode_buffers();
+
 uint32_t pid_from_process_handle(HANDLE process_handle);
 uint32_t pid_from_thread_handle(HANDLE thread_handle);
 uint32_t tid_from_thread_handle(HANDLE thread_handle);
@@ -55,6 +58,17 @@ uint32_t path_get_full_path_unistr(const UNICODE_STRING *in, wchar_t *out);
 uint32_t path_get_full_path_objattr(
     const OBJECT_ATTRIBUTES *in, wchar_t *out);
 
+// Cache of normalized paths of file handles, see misc.c. It's disabled by
+// default. The hooks in sigs/file_native.rst and sigs/handles.rst drop the
+// entries of handles which are closed, renamed, duplicated or handed out
+// anew.
+void file_path_cache_enable(int enable);
+void file_path_cache_set(HANDLE file_handle,
+    const wchar_t *path, uint32_t length);
+void file_path_cache_remove(HANDLE file_handle);
+void file_path_cache_stats(uint32_t *hits, uint32_t *misses,
+    uint32_t *entries);
+
 void wcsncpyA(wchar_t *dst, const char *src, uint32_t length);
 
 void hide_module_from_peb(HMODULE module_handle);
@@ -78,6 +92,16 @@ uint32_t reg_get_key_unistr(HANDLE key_handle,
     const UNICODE_STRING *unistr, wchar_t *regkey);
 uint32_t reg_get_key_objattr(const OBJECT_ATTRIBUTES *obj, wchar_t *regkey);
 
+// Cache of normalized paths of registry key handles, see misc.c. It's
+// disabled by default. The hooks in sigs/registry_native.rst and
+// sigs/handles.rst drop the entries of handles which are closed, deleted,
+// duplicated or handed out anew.
+void reg_key_cache_enable(int enable);
+void reg_key_cache_set(HANDLE key_handle,
+    const wchar_t *regkey, uint32_t length);
+void reg_key_cache_remove(HANDLE key_handle);
+void reg_key_cache_stats(uint32_t *hits, uint32_t *misses, uint32_t *entries);
+
 void reg_get_info_from_keyvalue(const void *buf, uint32_t length,
     KEY_VALUE_INFORMATION_CLASS information_class, wchar_t **reg_name,
     uint32_t *reg_type, uint32_t *data_length, uint8_t **data);
@@ -108,6 +132,10 @@ uint64_t hash_string(const char *buf, int32_t length);
 uint64_t hash_stringW(const wchar_t *buf, int32_t length);
 uint64_t hash_uint64(uint64_t value);
 
+// Hash of large buffers, several times faster than hash_buffer() as it
+// consumes 32 bytes per round.
+uint64_t hash_block(const void *buf, uintptr_t length);
+
 int ultostr(int64_t value, char *str, int base);
 
 int our_vsnprintf(char *buf, int length, const char *fmt, va_list args);
@@ -96,6 +96,17 @@ uint32_t get_tick_count();
 
 void register_dll_notification(LDR_DLL_NOTIFICATION_FUNCTION fn, void *param);
 
+// Thread-local slots of which the destructor is called with the value of
+// a thread as it exits. As the monitor is hidden from the loader it doesn't
+// get DLL_THREAD_DETACH, but fiber local storage callbacks are called
+// regardless. Before Windows Vista these are plain TLS slots and the
+// destructor is never called. Returns TLS_OUT_OF_INDEXES on failure.
+typedef void (WINAPI *tls_destructor_t)(void *value);
+
+uint32_t tls_alloc(tls_destructor_t destructor);
+void *tls_get(uint32_t index);
+void tls_set(uint32_t index, void *value);
+
 void get_last_error(last_error_t *error);
 void set_last_error(last_error_t *error);
 
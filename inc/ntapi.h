@@ -760,4 +760,36 @@ typedef enum _SHUTDOWN_ACTION {
 
 #define MOD_NOREPEAT 0x4000
 
+// Native APIs which are hooked to keep the handle caches of misc.c
+// up-to-date, see sigs/. Their hook handlers call them by name, so they're
+// imported from ntdll.
+NTSTATUS WINAPI NtClose(HANDLE Handle);
+
+NTSTATUS WINAPI NtDuplicateObject(HANDLE SourceProcessHandle,
+    HANDLE SourceHandle, HANDLE TargetProcessHandle, PHANDLE TargetHandle,
+    ACCESS_MASK DesiredAccess, ULONG HandleAttributes, ULONG Options);
+
+NTSTATUS WINAPI NtOpenKey(PHANDLE KeyHandle, ACCESS_MASK DesiredAccess,
+    POBJECT_ATTRIBUTES ObjectAttributes);
+
+NTSTATUS WINAPI NtCreateKey(PHANDLE KeyHandle, ACCESS_MASK DesiredAccess,
+    POBJECT_ATTRIBUTES ObjectAttributes, ULONG TitleIndex,
+    PUNICODE_STRING Class, ULONG CreateOptions, PULONG Disposition);
+
+NTSTATUS WINAPI NtDeleteKey(HANDLE KeyHandle);
+
+NTSTATUS WINAPI NtCreateFile(PHANDLE FileHandle, ACCESS_MASK DesiredAccess,
+    POBJECT_ATTRIBUTES ObjectAttributes, PIO_STATUS_BLOCK IoStatusBlock,
+    PLARGE_INTEGER AllocationSize, ULONG FileAttributes, ULONG ShareAccess,
+    ULONG CreateDisposition, ULONG CreateOptions, PVOID EaBuffer,
+    ULONG EaLength);
+
+NTSTATUS WINAPI NtOpenFile(PHANDLE FileHandle, ACCESS_MASK DesiredAccess,
+    POBJECT_ATTRIBUTES ObjectAttributes, PIO_STATUS_BLOCK IoStatusBlock,
+    ULONG ShareAccess, ULONG OpenOptions);
+
+NTSTATUS WINAPI NtSetInformationFile(HANDLE FileHandle,
+    PIO_STATUS_BLOCK IoStatusBlock, PVOID FileInformation, ULONG Length,
+    FILE_INFORMATION_CLASS FileInformationClass);
+
 #endif
@@ -0,0 +1,155 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_PACKED_H
+#define MONITOR_PACKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed record format, an alternative to one BSON document per call.
+//
+// In packed mode the log stream consists of frames, each starting with a
+// tag byte. PACKED_TAG_BSON is followed by a regular BSON document, which is
+// used for "info" and "buffer" documents. PACKED_TAG_CALL is followed by the
+// varint length of the record and the record itself:
+//
+//   svarint  timestamp delta to the previous call record
+//   svarint  thread identifier delta to the previous call record
+//   varint   API index
+//   varint   call hash
+//   uint8    PACKED_FLAG_* flags
+//   [varint  last error, varint nt status]      if PACKED_FLAG_ERROR
+//   [varint  count, count strings]              if PACKED_FLAG_STACKTRACE
+//   svarint  return value
+//   the arguments, typed and ordered as per the "fmt" of the API's
+//   "info" document
+//
+// Strings are encoded as varint (length << 2 | PACKED_STRING_*) followed by
+// the bytes, or, for references into the string dictionary, as varint
+// (identifier << 2 | PACKED_STRING_REF). Buffers are encoded as varint
+// length followed by the bytes, and integers as zigzag-encoded varints.
+// Registry values are prefixed by a PACKED_TYPE_* byte as their type is
+// only known at runtime.
+//
+// With "strings=dict" in the header, in either format, frequently logged
+// strings are sent once as a {"type": "string", "i": id, "s": string}
+// document and referenced by their identifier afterwards. Identifiers are
+// never reused, and a definition always precedes its first reference. In
+// BSON records a reference is a binary value of subtype
+// PACKED_BSON_STRINGREF holding the 32-bit little-endian identifier.
+
+#define PACKED_TAG_BSON 0
+#define PACKED_TAG_CALL 1
+
+#define PACKED_FLAG_SUCCESS     1
+#define PACKED_FLAG_ERROR       2
+#define PACKED_FLAG_STACKTRACE  4
+
+#define PACKED_STRING_TEXT    0
+#define PACKED_STRING_BINARY  1
+#define PACKED_STRING_REF     2
+
+#define PACKED_BSON_STRINGREF 0x80
+
+#define PACKED_TYPE_INT32   1
+#define PACKED_TYPE_STRING  2
+#define PACKED_TYPE_INT64   3
+#define PACKED_TYPE_BINARY  4
+
+// Room reserved in front of a packed record so the frame header can be
+// prepended without moving the record.
+#define PACKED_HEADROOM 32
+
+#define PACKED_VARINT_MAX 10
+
+typedef struct _packed_t {
+    uint8_t *buf;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t capacity;
+    int err;
+} packed_t;
+
+void packed_set_allocator(void *(*realloc_func)(void *ptr, size_t length),
+    void (*free_func)(void *ptr));
+
+void packed_init(packed_t *p, uint32_t size);
+void packed_destroy(packed_t *p);
+
+void packed_byte(packed_t *p, uint8_t value);
+void packed_bytes(packed_t *p, const void *buf, uint32_t length);
+void packed_varint(packed_t *p, uint64_t value);
+void packed_svarint(packed_t *p, int64_t value);
+void packed_blob(packed_t *p, const void *buf, uint32_t length);
+void packed_string(packed_t *p, const char *str,
+    uint32_t length, int is_binary);
+void packed_stringref(packed_t *p, uint32_t id);
+
+// Prepend data in the headroom of the record. Returns -1 if there's no
+// room left.
+int packed_prepend(packed_t *p, const void *buf, uint32_t length);
+
+static inline const uint8_t *packed_data(const packed_t *p)
+{
+    return p->buf + p->offset;
+}
+
+static inline uint32_t packed_size(const packed_t *p)
+{
+    return p->length - p->offset;
+}
+
+static inline uint32_t packed_encode_varint(uint8_t *out, uint64_t value)
+{
+    uint32_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t) value | 0x80;
+        value >>= 7;
+    }
+    out[length++] = (uint8_t) value;
+    return length;
+}
+
+static inline uint64_t packed_zigzag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t packed_unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Decode a varint from [*p, end). Returns -1 on truncated or overlong input.
+static inline int packed_read_varint(const uint8_t **p,
+    const uint8_t *end, uint64_t *value)
+{
+    uint64_t ret = 0;
+    for (uint32_t shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t ch = *(*p)++;
+        ret |= (uint64_t)(ch & 0x7f) << shift;
+        if((ch & 0x80) == 0) {
+            *value = ret;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -44,6 +44,39 @@ int32_t pipe2(void *out, uint32_t outlen, const char *fmt, ...);
 
 #define PIPE_MAX_TIMEOUT 10000
 
+// Asynchronous notifications. Once enabled, INFO, DEBUG, WARNING and
+// FILE_NEW messages sent through pipe() are queued and sent by a writer
+// thread instead of waiting for the round trip to the host. All other
+// messages, and everything sent through pipe2(), remain synchronous and are
+// only sent after the notifications queued before them. Identical pending
+// notifications are sent once. If the queue is full the message is sent
+// synchronously.
+
+#define PIPE_QUEUE_SIZE (256*1024)
+
+void pipe_async_init(int enable);
+
+// Send any pending notifications right away, e.g., before the process
+// terminates.
+void pipe_flush();
+
+// Commands from the host. As the pipe only carries requests from the
+// monitor, the monitor polls for commands by sending "COMMAND:", to which
+// the host replies with zero or more lines of the form "<NAME> <arguments>".
+// Each line is handed to the handler registered for NAME, in order.
+
+#define PIPE_COMMAND_MAX 16
+
+typedef void (*pipe_command_t)(char *args);
+
+void pipe_command_register(const char *name, pipe_command_t handler);
+
+// Poll for commands once. Returns the number of commands received.
+int pipe_command_poll();
+
+// Poll for commands every interval milliseconds, if non-zero.
+void pipe_command_init(uint32_t interval);
+
 #if DEBUG
 #define dpipe(fmt, ...) pipe(fmt, ##__VA_ARGS__)
 #else
@@ -0,0 +1,57 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_RADIX_H
+#define MONITOR_RADIX_H
+
+#include <stdint.h>
+
+// Sparse map of 32-bit keys, e.g., thread identifiers or handles, to
+// pointers. It's a three-level radix tree of which the nodes are allocated
+// as the keys are first set and published atomically, so lookups never
+// take a lock, and concurrent writers race through compare-and-swap, the
+// loser freeing its node. Nodes are never freed until radix_destroy(), so
+// readers don't need any form of reclamation; removing a key merely clears
+// its slot.
+
+#define RADIX_LEAF_BITS 9
+#define RADIX_MID_BITS 11
+#define RADIX_ROOT_BITS 12
+
+// The allocator has to return zeroed memory.
+typedef void *(*radix_alloc_t)(uint32_t length);
+typedef void (*radix_free_t)(void *ptr);
+
+typedef struct _radix_t {
+    void ***root;
+    radix_alloc_t alloc;
+    radix_free_t free;
+} radix_t;
+
+void radix_init(radix_t *map, radix_alloc_t alloc, radix_free_t free);
+void radix_destroy(radix_t *map);
+
+void *radix_get(const radix_t *map, uint32_t key);
+
+// Returns 0 on success and -1 if allocating a node failed.
+int radix_set(radix_t *map, uint32_t key, void *value);
+
+// Returns 0 on success and -1 if the key has never been set.
+int radix_unset(radix_t *map, uint32_t key);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_RING_H
+#define MONITOR_RING_H
+
+#include <stdint.h>
+
+// Shared-memory ring buffer transport of the log stream, an alternative to
+// the log pipe. The monitor is the only producer and a single reader drains
+// the ring, e.g., through a section object on Windows or an mmap'ed file.
+//
+// The mapping starts with a ring_header_t followed by the data area of
+// capacity bytes, a power of two. The stream is written as a sequence of
+// entries, each 8-byte aligned and consisting of
+//
+//   uint32   length of the payload, RING_PAD for padding up to the end
+//   uint32   sequence number
+//   payload  padded to a multiple of 8 bytes
+//
+// An entry never wraps around the end of the data area, instead a padding
+// entry fills the remainder. The producer writes the length and payload of
+// an entry before publishing its sequence number, which is one higher than
+// that of the previous entry, starting at 1. The reader only consumes the
+// entry at its position once it carries the expected sequence number, so a
+// stale entry of a previous lap is never mistaken for a new one. The
+// positions are free-running 32-bit byte counters.
+//
+// Concatenating the payloads yields exactly what would have been written to
+// the log pipe, starting with the process identifier.
+
+#define RING_MAGIC 0x474e4952
+#define RING_VERSION 1
+
+#define RING_STATE_OPEN 0
+#define RING_STATE_CLOSED 1
+#define RING_STATE_DETACHED 2
+
+#define RING_PAD 0xffffffff
+#define RING_ENTRY_HEADER 8
+
+// Payload of a single entry, larger writes are split into several entries.
+#define RING_CHUNK_MAX (64*1024)
+
+// Smallest and largest supported data area.
+#define RING_CAPACITY_MIN (4*RING_CHUNK_MAX)
+#define RING_CAPACITY_MAX (1U << 30)
+
+// The producer and reader fields live on separate cache lines.
+typedef struct _ring_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t reserved[13];
+
+    // Written by the producer only.
+    uint32_t head;
+    uint32_t state;
+    uint32_t producer[14];
+
+    // Written by the reader only. The reader sets attached once it starts
+    // draining the ring.
+    uint32_t tail;
+    uint32_t tail_seq;
+    uint32_t attached;
+    uint32_t consumer[13];
+} ring_header_t;
+
+// Local state of the producer or reader.
+typedef struct _ring_t {
+    ring_header_t *hdr;
+    uint8_t *data;
+    uint32_t mask;
+
+    // Position and sequence number of the next entry.
+    uint32_t pos;
+    uint32_t seq;
+} ring_t;
+
+// Size of a mapping holding a data area of the given capacity.
+#define RING_SIZE(capacity) (sizeof(ring_header_t) + (capacity))
+
+// Initialize a ring for producing in a mapping of size bytes, of which the
+// largest fitting power of two is used as data area. Returns 0 on success
+// and -1 if the mapping is too small.
+int ring_create(ring_t *ring, void *mem, uint32_t size);
+
+// Attach to a ring created by ring_create() for reading. Returns 0 on
+// success, 1 if the ring hasn't been initialized yet, and -1 if the mapping
+// of size bytes doesn't hold a valid ring.
+int ring_attach(ring_t *ring, void *mem, uint32_t size);
+
+// Write as much of buf as currently fits without waiting for the reader.
+// Returns the amount of bytes written, which is all or nothing for lengths
+// up to RING_CHUNK_MAX.
+uint32_t ring_write(ring_t *ring, const void *buf, uint32_t length);
+
+// Position up to which the reader has consumed the ring, used by the
+// producer to tell whether the reader is making progress.
+uint32_t ring_tail(const ring_t *ring);
+
+// Mark the ring as closed, or as detached if the producer gave up on the
+// reader and continues elsewhere.
+void ring_close(ring_t *ring, uint32_t state);
+
+// Returns the payload length of the next entry and points data to it, or 0
+// if there's no new entry yet. The entry remains valid until ring_consume().
+uint32_t ring_peek(ring_t *ring, const uint8_t **data);
+void ring_consume(ring_t *ring);
+
+// Returns RING_STATE_OPEN as long as more data may follow, and otherwise the
+// state the producer left the ring in. Any entries written before closing
+// can still be read.
+uint32_t ring_state(const ring_t *ring);
+
+#endif
@@ -0,0 +1,60 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONITOR_SHA1_H
+#define MONITOR_SHA1_H
+
+#include <stdint.h>
+
+// Streaming SHA-1. The compression function is picked at runtime from the
+// backends supported by the processor: the SHA extensions, SSSE3 or AVX2
+// message scheduling in front of scalar rounds, or plain C.
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+#define SHA1_BACKEND_AUTO 0
+#define SHA1_BACKEND_PORTABLE 1
+#define SHA1_BACKEND_SSSE3 2
+#define SHA1_BACKEND_AVX2 3
+#define SHA1_BACKEND_SHANI 4
+#define SHA1_BACKEND_COUNT 5
+
+typedef void (*sha1_blocks_t)(uint32_t *state,
+    const uint8_t *data, uintptr_t count);
+
+typedef struct _sha1_t {
+    uint32_t state[5];
+    uint64_t length;
+    uint8_t block[SHA1_BLOCK_SIZE];
+    uint32_t used;
+    sha1_blocks_t blocks;
+} sha1_t;
+
+// Select the backend for contexts initialized from now on, the fastest
+// one with SHA1_BACKEND_AUTO, which is also the default. Returns -1 if
+// the processor doesn't support it.
+int sha1_backend(int backend);
+int sha1_backend_current();
+const char *sha1_backend_name(int backend);
+
+void sha1_init(sha1_t *ctx);
+void sha1_update(sha1_t *ctx, const void *buf, uintptr_t length);
+void sha1_final(sha1_t *ctx, uint8_t *digest);
+
+#endif
@@ -33,6 +33,7 @@ typedef void (*symbol_callback_t)(const char *funcname,
 
 void symbol_init(HMODULE monitor_address);
 uint32_t module_image_size(const uint8_t *addr);
+uint32_t module_timestamp(const uint8_t *addr);
 
 int symbol_enumerate_module(HMODULE module_handle,
     symbol_callback_t callback, void *context);
@@ -25,6 +25,11 @@ void unhook_detect_add_region(const char *funcname, const uint8_t *addr,
     const uint8_t *orig, const uint8_t *our, uint32_t length);
 void unhook_detect_remove_dead_regions();
 
+// Stop and resume checking the regions of a hook that is disabled and
+// re-enabled at runtime, see hook_set_enabled().
+void unhook_detect_suspend(const char *funcname);
+void unhook_detect_resume(const char *funcname);
+
 int unhook_init_detection(int first_process);
 void unhook_detect_disable();
 void unhook_detect_enable();
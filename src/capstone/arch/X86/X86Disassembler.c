@@ -696,6 +696,129 @@ static void update_pub_insn(cs_insn *pub, InternalInstruction *inter, uint8_t *p
 	pub->detail->x86.sib_base = x86_map_sib_base(inter->sibBase);
 }
 
+// sign-extend a @size bytes value
+static int64_t sign_extend(uint64_t value, uint8_t size)
+{
+	switch (size) {
+		case 1:
+			return (int8_t)value;
+		case 2:
+			return (int16_t)value;
+		case 4:
+			return (int32_t)value;
+		default:
+			return (int64_t)value;
+	}
+}
+
+// Relocation-detail interface: decode a single instruction without
+// translating it to MCInst, printing it or filling in cs_detail
+bool X86_getReloc(cs_struct *handle, const uint8_t *code, size_t code_len,
+		uint64_t address, cs_reloc *reloc)
+{
+	InternalInstruction insn;
+	struct reader_info info;
+	uint64_t next, mask;
+	int index, imm = 0;
+	int ret;
+
+	info.code = code;
+	info.size = code_len;
+	info.offset = address;
+
+	memset(&insn, 0, offsetof(InternalInstruction, reader));
+
+	if (handle->mode & CS_MODE_16)
+		ret = decodeInstruction(&insn,
+				reader, &info,
+				address,
+				MODE_16BIT);
+	else if (handle->mode & CS_MODE_32)
+		ret = decodeInstruction(&insn,
+				reader, &info,
+				address,
+				MODE_32BIT);
+	else
+		ret = decodeInstruction(&insn,
+				reader, &info,
+				address,
+				MODE_64BIT);
+
+	if (ret || !insn.spec)
+		return false;
+
+	memset(reloc, 0, sizeof(*reloc));
+	reloc->address = address;
+	reloc->size = (uint16_t)insn.length;
+
+	next = address + insn.length;
+	mask = (insn.mode == MODE_64BIT) ? ~0ULL : 0xffffffffULL;
+
+	if (insn.consumedDisplacement && insn.displacementSize) {
+		reloc->disp_offset = insn.displacementOffset;
+		reloc->disp_size = insn.displacementSize;
+		reloc->disp = insn.displacement;
+	}
+
+	if (insn.numImmediatesConsumed) {
+		reloc->imm_offset = insn.immediateOffset;
+		reloc->imm_size = insn.immediateSize;
+	}
+
+	for (index = 0; index < X86_MAX_OPERANDS; ++index) {
+		const OperandSpecifier *operand = &insn.operands[index];
+
+		switch (operand->encoding) {
+			case ENCODING_CB:
+			case ENCODING_CW:
+			case ENCODING_CD:
+			case ENCODING_CP:
+			case ENCODING_CO:
+			case ENCODING_CT:
+				// translateOperand() rejects these, so must we
+				return false;
+			case ENCODING_IB:
+			case ENCODING_IW:
+			case ENCODING_ID:
+			case ENCODING_IO:
+			case ENCODING_Iv:
+			case ENCODING_Ia:
+				switch (operand->type) {
+					case TYPE_REL8:
+					case TYPE_REL16:
+					case TYPE_REL32:
+					case TYPE_REL64:
+					case TYPE_RELv:
+						reloc->flags |= CS_RELOC_REL;
+						reloc->target = (next +
+								sign_extend(insn.immediates[imm], insn.immediateSize)) & mask;
+						break;
+					default:
+						break;
+				}
+				imm++;
+				break;
+			case ENCODING_RM:
+				// mod == 00 && r/m == 101 in 64-bit mode: RIP-relative
+				if (insn.mode == MODE_64BIT && insn.eaBase == EA_BASE_NONE &&
+						insn.eaDisplacement != EA_DISP_NONE) {
+					reloc->flags |= CS_RELOC_RIP;
+					reloc->target = next + reloc->disp;
+					if (insn.prefix3 == 0x67)
+						// address-size prefix: EIP-relative
+						reloc->target &= 0xffffffffULL;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	X86_get_insn_reloc(handle, reloc, insn.instructionID);
+
+	return true;
+}
+
 // Public interface for the disassembler
 bool X86_getInstruction(csh ud, const uint8_t *code, size_t code_len,
 		MCInst *instr, uint16_t *size, uint64_t address, void *_info)
@@ -97,4 +97,7 @@
 bool X86_getInstruction(csh handle, const uint8_t *code, size_t code_len,
 		MCInst *instr, uint16_t *size, uint64_t address, void *info);
 
+bool X86_getReloc(cs_struct *handle, const uint8_t *code, size_t code_len,
+		uint64_t address, cs_reloc *reloc);
+
 #endif
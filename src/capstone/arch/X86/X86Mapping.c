@@ -41730,6 +41730,44 @@ void X86_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id)
 	}
 }
 
+// given internal insn id, return public instruction id & branch flags
+// for relocation-detail mode. this only looks at the mapped id, so it
+// also works in 'diet' mode where groups are unavailable.
+void X86_get_insn_reloc(cs_struct *h, cs_reloc *reloc, unsigned int id)
+{
+	int i = insn_find(insns, ARR_SIZE(insns), id, &h->insn_cache);
+
+	reloc->id = (i != 0) ? insns[i].mapid : 0;
+
+	switch (reloc->id) {
+		case X86_INS_CALL:
+		case X86_INS_LCALL:
+			reloc->flags |= CS_RELOC_CALL;
+			break;
+
+		case X86_INS_JMP:
+		case X86_INS_LJMP:
+			reloc->flags |= CS_RELOC_JMP;
+			break;
+
+		case X86_INS_RET:
+		case X86_INS_RETF:
+		case X86_INS_RETFQ:
+		case X86_INS_IRET:
+		case X86_INS_IRETD:
+		case X86_INS_IRETQ:
+			reloc->flags |= CS_RELOC_RET;
+			break;
+
+		default:
+			// every other insn with a relative branch target is conditional:
+			// jcc, jcxz/jecxz/jrcxz & loop/loope/loopne
+			if (reloc->flags & CS_RELOC_REL)
+				reloc->flags |= CS_RELOC_JCC;
+			break;
+	}
+}
+
 // map special instructions with accumulate registers.
 // this is needed because LLVM embeds these register names into AsmStrs[],
 // but not separately in operands
@@ -22,6 +22,9 @@ const char *X86_reg_name(csh handle, unsigned int reg);
 // given internal insn id, return public instruction info
 void X86_get_insn_id(cs_struct *h, cs_insn *insn, unsigned int id);
 
+// given internal insn id, return public insn id & branch flags (relocation-detail mode)
+void X86_get_insn_reloc(cs_struct *h, cs_reloc *reloc, unsigned int id);
+
 // return insn name, given insn id
 const char *X86_insn_name(csh handle, unsigned int id);
 
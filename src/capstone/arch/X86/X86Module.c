@@ -20,6 +20,7 @@ static cs_err init(cs_struct *ud)
 	ud->syntax = CS_OPT_SYNTAX_INTEL;
 	ud->printer_info = NULL;
 	ud->disasm = X86_getInstruction;
+	ud->disasm_reloc = X86_getReloc;
 	ud->reg_name = X86_reg_name;
 	ud->insn_id = X86_get_insn_id;
 	ud->insn_name = X86_insn_name;
@@ -0,0 +1,123 @@
+# Capstone Python bindings, by Nguyen Anh Quynnh <aquynh@gmail.com>
+
+import ctypes, sys
+
+_python2 = sys.version_info[0] < 3
+
+# packed arrays returned by cs_disasm_bulk()
+class _cs_bulk(ctypes.Structure):
+    _fields_ = (
+        ('count', ctypes.c_size_t),
+        ('address', ctypes.POINTER(ctypes.c_uint64)),
+        ('size', ctypes.POINTER(ctypes.c_uint16)),
+        ('id', ctypes.POINTER(ctypes.c_uint)),
+        ('mnemonic', ctypes.POINTER(ctypes.c_uint32)),
+        ('strings', ctypes.POINTER(ctypes.c_char)),
+        ('strings_size', ctypes.c_size_t),
+    )
+
+
+# copy @count entries of a C array into a Python-owned ctypes array
+def _copy_array(ctype, ptr, count):
+    arr = (ctype * count)()
+    if count:
+        ctypes.memmove(arr, ptr, count * ctypes.sizeof(ctype))
+    return arr
+
+
+# Instructions disassembled by disasm_bulk(), as packed arrays.
+# @address, @size, @id & @mnemonic are ctypes arrays, so they support the
+# buffer protocol (memoryview(), numpy.frombuffer(), ...). @mnemonic holds
+# offsets into the shared @strings blob, where each instruction's mnemonic &
+# op_str are stored as two NUL-terminated strings.
+# Indexing returns a full CsInsn, which is only disassembled on access.
+class CsBulk(object):
+    def __init__(self, md, code, base, address, size, id, mnemonic, strings):
+        self._md = md
+        self._code = code
+        self._base = base
+        self.address = address
+        self.size = size
+        self.id = id
+        self.mnemonic = mnemonic
+        self.strings = strings
+        self._insns = {}
+
+    @classmethod
+    def from_raw(cls, md, code, base, raw):
+        count = raw.count
+        return cls(md, code, base,
+            _copy_array(ctypes.c_uint64, raw.address, count),
+            _copy_array(ctypes.c_uint16, raw.size, count),
+            _copy_array(ctypes.c_uint, raw.id, count),
+            _copy_array(ctypes.c_uint32, raw.mnemonic, count),
+            ctypes.string_at(raw.strings, raw.strings_size))
+
+    def __len__(self):
+        return len(self.address)
+
+    def _string(self, offset):
+        end = self.strings.index(b'\0', offset)
+        s = self.strings[offset:end]
+        if not _python2:
+            s = s.decode('ascii')
+        return s
+
+    # return mnemonic of instruction at @index
+    def mnemonic_at(self, index):
+        return self._string(self.mnemonic[index])
+
+    # return op_str of instruction at @index
+    def op_str_at(self, index):
+        offset = self.mnemonic[index]
+        return self._string(self.strings.index(b'\0', offset) + 1)
+
+    # return (address, size, mnemonic, op_str) of instruction at @index,
+    # like Cs.disasm_lite() does
+    def lite(self, index):
+        return (self.address[index], self.size[index],
+            self.mnemonic_at(index), self.op_str_at(index))
+
+    # return CsInsn of instruction at @index, disassembling it on first access
+    def __getitem__(self, index):
+        if index < 0:
+            index += len(self)
+        if index < 0 or index >= len(self):
+            raise IndexError(index)
+
+        insn = self._insns.get(index)
+        if insn is None:
+            offset = self.address[index] - self._base
+            code = self._code[offset:offset + self.size[index]]
+            insn = next(self._md.disasm(code, self.address[index], 1))
+            self._insns[index] = insn
+        return insn
+
+    def __iter__(self):
+        for i in range(len(self)):
+            yield self[i]
+
+
+# Disassemble @code in one library call, and return the result as CsBulk.
+# @md is a Cs instance; its handle & options (mode, syntax, skipdata) are used.
+def disasm_bulk(md, code, offset, count=0):
+    from . import _cs, CsError
+
+    if not hasattr(_cs.cs_disasm_bulk, '_bulk_setup'):
+        _cs.cs_disasm_bulk.restype = ctypes.c_size_t
+        _cs.cs_disasm_bulk.argtypes = (ctypes.c_size_t, ctypes.POINTER(ctypes.c_char),
+            ctypes.c_size_t, ctypes.c_uint64, ctypes.c_size_t, ctypes.POINTER(_cs_bulk))
+        _cs.cs_bulk_free.restype = None
+        _cs.cs_bulk_free.argtypes = (ctypes.POINTER(_cs_bulk), )
+        _cs.cs_disasm_bulk._bulk_setup = True
+
+    raw = _cs_bulk()
+    res = _cs.cs_disasm_bulk(md.csh, code, len(code), offset, count, ctypes.byref(raw))
+    try:
+        if res == 0 and len(code) != 0:
+            status = _cs.cs_errno(md.csh)
+            if status != 0:
+                raise CsError(status)
+        return CsBulk.from_raw(md, code, offset, raw)
+    finally:
+        _cs.cs_bulk_free(ctypes.byref(raw))
@@ -1,7 +1,7 @@
 # By Dang Hoang Vu <danghvu@gmail.com>, 2014
 
 from libcpp cimport bool
-from libc.stdint cimport uint8_t, uint64_t, uint16_t
+from libc.stdint cimport uint8_t, uint64_t, uint16_t, uint32_t
 
 cdef extern from "<capstone/capstone.h>":
 
@@ -25,6 +25,15 @@ cdef extern from "<capstone/capstone.h>":
         char op_str[160]
         cs_detail *detail
 
+    ctypedef struct cs_bulk:
+        size_t count
+        uint64_t *address
+        uint16_t *size
+        unsigned int *id
+        uint32_t *mnemonic
+        char *strings
+        size_t strings_size
+
     ctypedef enum cs_err:
         pass
 
@@ -51,6 +60,14 @@ cdef extern from "<capstone/capstone.h>":
 
     void cs_free(cs_insn *insn, size_t count)
 
+    size_t cs_disasm_bulk(csh handle,
+        const uint8_t *code, size_t code_size,
+        uint64_t address,
+        size_t count,
+        cs_bulk *bulk)
+
+    void cs_bulk_free(cs_bulk *bulk)
+
     const char *cs_reg_name(csh handle, unsigned int reg_id)
 
     const char *cs_insn_name(csh handle, unsigned int insn_id)
@@ -3,6 +3,7 @@
 cimport pyx.ccapstone as cc
 import capstone, ctypes
 from capstone import arm, x86, mips, ppc, arm64, sparc, systemz, CsError
+from capstone.bulk import CsBulk
 
 _diet = cc.cs_support(capstone.CS_SUPPORT_DIET)
 
@@ -293,6 +294,39 @@ cdef class Cs(object):
         cc.cs_free(allinsn, res)
 
 
+    # Disassemble binary in a single call to the core, and return a CsBulk with
+    # packed arrays of (address, size, id, mnemonic offset) plus a shared string
+    # blob. CsInsn objects are only created when the CsBulk is indexed.
+    def disasm_bulk(self, code, addr, count=0):
+        cdef cc.cs_bulk bulk
+        cdef size_t n
+
+        cdef res = cc.cs_disasm_bulk(self.csh, code, len(code), addr, count, &bulk)
+        try:
+            if res == 0 and len(code) != 0:
+                status = cc.cs_errno(self.csh)
+                if status != capstone.CS_ERR_OK:
+                    raise CsError(status)
+
+            n = bulk.count
+            address = (ctypes.c_uint64 * n)()
+            size = (ctypes.c_uint16 * n)()
+            ids = (ctypes.c_uint * n)()
+            mnemonic = (ctypes.c_uint32 * n)()
+            if n:
+                ctypes.memmove(address, <size_t>bulk.address, n * sizeof(bulk.address[0]))
+                ctypes.memmove(size, <size_t>bulk.size, n * sizeof(bulk.size[0]))
+                ctypes.memmove(ids, <size_t>bulk.id, n * sizeof(bulk.id[0]))
+                ctypes.memmove(mnemonic, <size_t>bulk.mnemonic, n * sizeof(bulk.mnemonic[0]))
+                strings = bulk.strings[:bulk.strings_size]
+            else:
+                strings = b''
+
+            return CsBulk(self, code, addr, address, size, ids, mnemonic, strings)
+        finally:
+            cc.cs_bulk_free(&bulk)
+
+
 # print out debugging info
 def debug():
     if cc.cs_support(capstone.CS_SUPPORT_DIET):
@@ -10,6 +10,7 @@ compile_args = ['-O3', '-fomit-frame-pointer']
 ext_modules = [ Extension("capstone.capstone", ["pyx/capstone.pyx"], extra_compile_args=compile_args),
     Extension("capstone.ccapstone", ["pyx/ccapstone.pyx"], libraries=["capstone"], extra_compile_args=compile_args),
     Extension("capstone.arm", ["pyx/arm.pyx"], extra_compile_args=compile_args),
+    Extension("capstone.bulk", ["pyx/bulk.pyx"], extra_compile_args=compile_args),
     Extension("capstone.arm_const", ["pyx/arm_const.pyx"], extra_compile_args=compile_args),
     Extension("capstone.arm64", ["pyx/arm64.pyx"], extra_compile_args=compile_args),
     Extension("capstone.arm64_const", ["pyx/arm64_const.pyx"], extra_compile_args=compile_args),
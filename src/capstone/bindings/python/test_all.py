@@ -1,7 +1,7 @@
 #!/usr/bin/env python
 
 import test, test_arm, test_arm64, test_detail, test_lite, test_mips, test_ppc, \
-    test_x86, test_skipdata, test_sparc, test_systemz
+    test_x86, test_skipdata, test_sparc, test_systemz, test_bulk
 
 
 test.test_class()
@@ -15,3 +15,4 @@ test_sparc.test_class()
 test_systemz.test_class()
 test_x86.test_class()
 test_skipdata.test_class()
+test_bulk.test_class()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+
+# Capstone Python bindings, by Nguyen Anh Quynnh <aquynh@gmail.com>
+from __future__ import print_function
+from capstone import *
+from capstone.bulk import disasm_bulk
+from xprint import to_hex
+
+
+X86_CODE32 = b"\x8d\x4c\x32\x08\x01\xd8\x81\xc6\x34\x12\x00\x00\xe8\x10\x00\x00\x00\xc3"
+X86_CODE64 = b"\x55\x48\x8b\x05\xb8\x13\x00\x00\xe9\xea\xbe\xad\xde\xc3"
+ARM_CODE = b"\xED\xFF\xFF\xEB\x04\xe0\x2d\xe5\x00\x00\x00\x00\xe0\x83\x22\xe5\xf1\x02\x03\x0e\x00\x00\xa0\xe3\x02\x30\xc1\xe7\x00\x00\x53\xe3"
+
+all_tests = (
+        (CS_ARCH_X86, CS_MODE_32, X86_CODE32, "X86 32 (Intel syntax)"),
+        (CS_ARCH_X86, CS_MODE_64, X86_CODE64, "X86 64 (Intel syntax)"),
+        (CS_ARCH_ARM, CS_MODE_ARM, ARM_CODE, "ARM"),
+        )
+
+
+# ## Test bulk disassembly against disasm_lite()
+def test_class():
+    for (arch, mode, code, comment) in all_tests:
+        print('*' * 16)
+        print("Platform: %s" % comment)
+        print("Code: %s" % to_hex(code))
+        print("Disasm:")
+
+        try:
+            md = Cs(arch, mode)
+            bulk = disasm_bulk(md, code, 0x1000)
+            lite = list(md.disasm_lite(code, 0x1000))
+
+            if len(bulk) != len(lite):
+                print("ERROR: %u instructions, expected %u" % (len(bulk), len(lite)))
+
+            for i in range(len(bulk)):
+                (addr, size, mnemonic, op_str) = bulk.lite(i)
+                print("0x%x:\t%s\t%s" % (addr, mnemonic, op_str))
+                if (addr, size, mnemonic, op_str) != lite[i]:
+                    print("ERROR: mismatch with disasm_lite()")
+                if bulk[i].id != bulk.id[i]:
+                    print("ERROR: mismatch with lazily created CsInsn")
+
+            print()
+        except CsError as e:
+            print("ERROR: %s" % e)
+
+
+if __name__ == '__main__':
+    test_class()
@@ -19,6 +19,9 @@
 #define INSN_CACHE_SIZE 8
 #endif
 
+// number of insns disassembled per cs_disasm_ex() call by cs_disasm_bulk()
+#define BULK_BATCH_SIZE 256
+
 // default SKIPDATA mnemonic
 #define SKIPDATA_MNEM ".byte"
 
@@ -602,6 +605,176 @@ size_t cs_disasm_ex(csh ud, const uint8_t *buffer, size_t size, uint64_t offset,
 	return c;
 }
 
+// grow arrays of @bulk to contain at least @count insns & @strings bytes
+static bool bulk_reserve(cs_bulk *bulk, size_t *capacity, size_t count,
+		size_t *strings_capacity, size_t strings)
+{
+	void *tmp;
+
+	if (count > *capacity) {
+		size_t n = *capacity ? *capacity : BULK_BATCH_SIZE;
+		while (n < count)
+			n *= 2;
+
+		tmp = cs_mem_realloc(bulk->address, n * sizeof(*bulk->address));
+		if (!tmp)
+			return false;
+		bulk->address = tmp;
+
+		tmp = cs_mem_realloc(bulk->size, n * sizeof(*bulk->size));
+		if (!tmp)
+			return false;
+		bulk->size = tmp;
+
+		tmp = cs_mem_realloc(bulk->id, n * sizeof(*bulk->id));
+		if (!tmp)
+			return false;
+		bulk->id = tmp;
+
+		tmp = cs_mem_realloc(bulk->mnemonic, n * sizeof(*bulk->mnemonic));
+		if (!tmp)
+			return false;
+		bulk->mnemonic = tmp;
+
+		*capacity = n;
+	}
+
+	if (strings > *strings_capacity) {
+		size_t n = *strings_capacity ? *strings_capacity : BULK_BATCH_SIZE * 16;
+		while (n < strings)
+			n *= 2;
+
+		tmp = cs_mem_realloc(bulk->strings, n);
+		if (!tmp)
+			return false;
+		bulk->strings = tmp;
+
+		*strings_capacity = n;
+	}
+
+	return true;
+}
+
+// disassemble into packed arrays, in batches of BULK_BATCH_SIZE insns
+// NOTE: caller must call cs_bulk_free() on @bulk
+CAPSTONE_EXPORT
+size_t cs_disasm_bulk(csh ud, const uint8_t *buffer, size_t size, uint64_t offset, size_t count, cs_bulk *bulk)
+{
+	struct cs_struct *handle = (struct cs_struct *)(uintptr_t)ud;
+	cs_opt_value detail;
+	cs_insn *insn;
+	size_t c = 0, n, i, want, consumed;
+	size_t capacity = 0, strings_capacity = 0;
+	size_t mnem_len, op_len;
+
+	memset(bulk, 0, sizeof(*bulk));
+
+	if (!handle) {
+		// FIXME: how to handle this case:
+		// handle->errnum = CS_ERR_HANDLE;
+		return 0;
+	}
+
+	// details are not returned, so do not waste time building them
+	detail = handle->detail;
+	handle->detail = CS_OPT_OFF;
+
+	while (size > 0) {
+		want = BULK_BATCH_SIZE;
+		if (count && count - c < want)
+			want = count - c;
+
+		n = cs_disasm_ex(ud, buffer, size, offset, want, &insn);
+		if (n == 0)
+			break;
+
+		if (!bulk_reserve(bulk, &capacity, c + n, &strings_capacity,
+					bulk->strings_size + n * (sizeof(insn->mnemonic) + sizeof(insn->op_str)))) {
+			cs_free(insn, n);
+			handle->detail = detail;
+			handle->errnum = CS_ERR_MEM;
+			return 0;
+		}
+
+		for (i = 0; i < n; i++, c++) {
+			bulk->address[c] = insn[i].address;
+			bulk->size[c] = insn[i].size;
+			bulk->id[c] = insn[i].id;
+			bulk->mnemonic[c] = (uint32_t)bulk->strings_size;
+
+			mnem_len = strlen(insn[i].mnemonic) + 1;
+			op_len = strlen(insn[i].op_str) + 1;
+			memcpy(bulk->strings + bulk->strings_size, insn[i].mnemonic, mnem_len);
+			memcpy(bulk->strings + bulk->strings_size + mnem_len, insn[i].op_str, op_len);
+			bulk->strings_size += mnem_len + op_len;
+		}
+
+		consumed = (size_t)(insn[n - 1].address + insn[n - 1].size - offset);
+		buffer += consumed;
+		size -= consumed;
+		offset += consumed;
+
+		cs_free(insn, n);
+
+		if (n < want || (count && c == count))
+			// either the buffer is exhausted, or we hit an invalid insn
+			break;
+	}
+
+	handle->detail = detail;
+	bulk->count = c;
+
+	return c;
+}
+
+CAPSTONE_EXPORT
+void cs_bulk_free(cs_bulk *bulk)
+{
+	cs_mem_free(bulk->address);
+	cs_mem_free(bulk->size);
+	cs_mem_free(bulk->id);
+	cs_mem_free(bulk->mnemonic);
+	cs_mem_free(bulk->strings);
+
+	memset(bulk, 0, sizeof(*bulk));
+}
+
+// decode instruction boundaries & relocation info into caller's array
+// NOTE: this never allocates memory, unlike cs_disasm_ex()
+CAPSTONE_EXPORT
+size_t cs_disasm_reloc(csh ud, const uint8_t *buffer, size_t size, uint64_t offset, size_t count, cs_reloc *reloc)
+{
+	struct cs_struct *handle = (struct cs_struct *)(uintptr_t)ud;
+	size_t c = 0;
+
+	if (!handle) {
+		// FIXME: how to handle this case:
+		// handle->errnum = CS_ERR_HANDLE;
+		return 0;
+	}
+
+	handle->errnum = CS_ERR_OK;
+
+	if (!handle->disasm_reloc) {
+		handle->errnum = CS_ERR_OPTION;
+		return 0;
+	}
+
+	while (size > 0 && c < count) {
+		if (!handle->disasm_reloc(handle, buffer, size, offset, &reloc[c]))
+			// invalid instruction: stop here, like cs_disasm_ex() does
+			// without SKIPDATA
+			break;
+
+		buffer += reloc[c].size;
+		size -= reloc[c].size;
+		offset += reloc[c].size;
+		c++;
+	}
+
+	return c;
+}
+
 CAPSTONE_EXPORT
 void cs_free(cs_insn *insn, size_t count)
 {
@@ -0,0 +1,350 @@
+/* Capstone Disassembly Engine */
+/* By Nguyen Anh Quynh <aquynh@gmail.com>, 2013-2014 */
+#if defined (WIN32) || defined (WIN64) || defined (_WIN32) || defined (_WIN64)
+#pragma warning(disable:4996)
+#define CS_PARALLEL_WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include <capstone.h>
+
+#include "cs_priv.h"
+
+// do not split buffers into chunks smaller than this
+#define PARALLEL_MIN_CHUNK 0x10000
+// how far each chunk is disassembled past its end, to find a resync point
+#define PARALLEL_OVERLAP 0x400
+// bytes at the end of a truncated chunk which can't be trusted: an insn
+// crossing the truncation point fails to decode (or becomes data in
+// SKIPDATA mode), unlike in a sequential sweep
+#define PARALLEL_TAIL 16
+// number of identical consecutive insns required to accept a resync point.
+// this also covers state carried between insns, such as Thumb IT blocks.
+#define PARALLEL_SYNC 4
+#define PARALLEL_MAX_THREADS 64
+
+struct chunk {
+	csh handle;	// private handle of this chunk's worker
+	const uint8_t *code;
+	size_t size;	// number of bytes to disassemble, including overlap
+	uint64_t address;
+	uint64_t end;	// address where the next chunk starts
+	uint64_t limit;	// address where this chunk's disassembly was cut off
+	bool truncated;	// @limit is before the end of the whole buffer
+	cs_insn *insn;
+	size_t count;
+};
+
+#ifdef CS_PARALLEL_WIN32
+static DWORD WINAPI chunk_worker(LPVOID arg)
+#else
+static void *chunk_worker(void *arg)
+#endif
+{
+	struct chunk *c = arg;
+
+	c->count = cs_disasm_ex(c->handle, c->code, c->size, c->address, 0, &c->insn);
+
+	return 0;
+}
+
+// open a handle with the same arch, mode & options as @h
+static csh clone_handle(struct cs_struct *h)
+{
+	csh ud;
+
+	if (cs_open(h->arch, h->mode, &ud) != CS_ERR_OK)
+		return 0;
+
+	if (h->syntax)
+		cs_option(ud, CS_OPT_SYNTAX, h->syntax);
+
+	cs_option(ud, CS_OPT_DETAIL, h->detail);
+
+	if (h->skipdata) {
+		cs_option(ud, CS_OPT_SKIPDATA_SETUP, (size_t)&h->skipdata_setup);
+		cs_option(ud, CS_OPT_SKIPDATA, CS_OPT_ON);
+	}
+
+	return ud;
+}
+
+static bool insn_equal(cs_insn *a, cs_insn *b)
+{
+	return a->address == b->address && a->size == b->size && a->id == b->id &&
+		!strcmp(a->mnemonic, b->mnemonic) && !strcmp(a->op_str, b->op_str);
+}
+
+// return index of insn at @address in @c, or -1 if there is none
+static ptrdiff_t chunk_find(struct chunk *c, uint64_t address)
+{
+	size_t lo = 0, hi = c->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (c->insn[mid].address < address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < c->count && c->insn[lo].address == address)
+		return (ptrdiff_t)lo;
+
+	return -1;
+}
+
+// look for the first insn of @cur, from index @from, at which @next decodes
+// the same instruction stream. on success, return true with the indexes of
+// that insn in @cur & @next.
+static bool chunk_sync(struct chunk *cur, size_t from, struct chunk *next,
+		size_t *cur_idx, size_t *next_idx)
+{
+	size_t i, k;
+	ptrdiff_t j;
+
+	for (i = from; i < cur->count; i++) {
+		if (cur->insn[i].address < next->address)
+			continue;
+
+		j = chunk_find(next, cur->insn[i].address);
+		if (j < 0)
+			continue;
+
+		for (k = 0; k < PARALLEL_SYNC; k++) {
+			bool a = i + k < cur->count, b = (size_t)j + k < next->count;
+			if (a != b)
+				break;
+			if (!a) {
+				// both streams end here
+				k = PARALLEL_SYNC;
+				break;
+			}
+			if (!insn_equal(&cur->insn[i + k], &next->insn[j + k]))
+				break;
+		}
+
+		if (k == PARALLEL_SYNC) {
+			*cur_idx = i;
+			*next_idx = (size_t)j;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// append insns [@from, @to) of @c to @out, moving ownership of their details
+static bool append_insns(cs_insn **out, size_t *count, size_t *capacity,
+		struct chunk *c, size_t from, size_t to)
+{
+	size_t n = to - from, i;
+
+	if (!n)
+		return true;
+
+	if (*count + n > *capacity) {
+		size_t cap = *capacity ? *capacity : n;
+		void *tmp;
+
+		while (cap < *count + n)
+			cap *= 2;
+
+		tmp = cs_mem_realloc(*out, cap * sizeof(cs_insn));
+		if (!tmp)
+			return false;
+
+		*out = tmp;
+		*capacity = cap;
+	}
+
+	memcpy(*out + *count, c->insn + from, n * sizeof(cs_insn));
+	for (i = from; i < to; i++)
+		c->insn[i].detail = NULL;
+
+	*count += n;
+	return true;
+}
+
+// free insns left in @c, once it has been stitched to the output
+static void chunk_release(struct chunk *c)
+{
+	cs_free(c->insn, c->count);
+	c->insn = NULL;
+	c->count = 0;
+}
+
+CAPSTONE_EXPORT
+size_t cs_disasm_parallel(csh ud, const uint8_t *buffer, size_t size, uint64_t offset, unsigned int threads, cs_insn **insn)
+{
+	struct cs_struct *handle = (struct cs_struct *)(uintptr_t)ud;
+	struct chunk chunks[PARALLEL_MAX_THREADS];
+#ifdef CS_PARALLEL_WIN32
+	HANDLE tids[PARALLEL_MAX_THREADS];
+#else
+	pthread_t tids[PARALLEL_MAX_THREADS];
+	bool started[PARALLEL_MAX_THREADS];
+#endif
+	cs_insn *out = NULL;
+	size_t count = 0, capacity = 0, chunk_size, from, cur_idx, next_idx;
+	uint64_t resume, end, limit;
+	unsigned int n, k;
+	bool ok = true;
+	struct chunk *cur;
+
+	if (!handle) {
+		// FIXME: how to handle this case:
+		// handle->errnum = CS_ERR_HANDLE;
+		return 0;
+	}
+
+	if (threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+
+	n = threads;
+	if (size / PARALLEL_MIN_CHUNK < n)
+		n = (unsigned int)(size / PARALLEL_MIN_CHUNK);
+
+	if (n <= 1)
+		return cs_disasm_ex(ud, buffer, size, offset, 0, insn);
+
+	handle->errnum = CS_ERR_OK;
+
+	memset(chunks, 0, n * sizeof(chunks[0]));
+
+	chunk_size = size / n;
+	for (k = 0; k < n; k++) {
+		size_t start = k * chunk_size;
+		size_t end = k == n - 1 ? size : start + chunk_size;
+		size_t limit = end + PARALLEL_OVERLAP < size ? end + PARALLEL_OVERLAP : size;
+
+		chunks[k].code = buffer + start;
+		chunks[k].size = limit - start;
+		chunks[k].address = offset + start;
+		chunks[k].end = offset + end;
+		chunks[k].limit = offset + limit;
+		chunks[k].truncated = limit < size;
+
+		// the first chunk uses the caller's handle
+		chunks[k].handle = k == 0 ? ud : clone_handle(handle);
+		if (!chunks[k].handle) {
+			// out of memory: do the sequential sweep instead
+			for (k = 1; k < n && chunks[k].handle; k++)
+				cs_close(&chunks[k].handle);
+			return cs_disasm_ex(ud, buffer, size, offset, 0, insn);
+		}
+	}
+
+	// disassemble all chunks but the first one concurrently
+	for (k = 1; k < n; k++) {
+#ifdef CS_PARALLEL_WIN32
+		tids[k] = CreateThread(NULL, 0, chunk_worker, &chunks[k], 0, NULL);
+		if (!tids[k])
+			chunk_worker(&chunks[k]);
+#else
+		started[k] = pthread_create(&tids[k], NULL, chunk_worker, &chunks[k]) == 0;
+		if (!started[k])
+			chunk_worker(&chunks[k]);
+#endif
+	}
+
+	chunk_worker(&chunks[0]);
+
+	for (k = 1; k < n; k++) {
+#ifdef CS_PARALLEL_WIN32
+		if (tids[k]) {
+			WaitForSingleObject(tids[k], INFINITE);
+			CloseHandle(tids[k]);
+		}
+#else
+		if (started[k])
+			pthread_join(tids[k], NULL);
+#endif
+	}
+
+	// stitch chunks together: the instruction stream of @cur is always the
+	// one of a sequential sweep, starting from insn index @from
+	cur = &chunks[0];
+	from = 0;
+
+	for (k = 1; k < n && ok; k++) {
+		struct chunk *next = &chunks[k];
+
+		if (chunk_sync(cur, from, next, &cur_idx, &next_idx)) {
+			ok = append_insns(&out, &count, &capacity, cur, from, cur_idx);
+			chunk_release(cur);
+			cur = next;
+			from = next_idx;
+			continue;
+		}
+
+		// no resync point. if @cur reaches the end of the buffer, it is the
+		// rest of the sequential sweep.
+		if (!cur->truncated)
+			break;
+
+		// otherwise keep what @cur decoded reliably, then disassemble
+		// sequentially from there on, replacing @next
+		cur_idx = cur->count;
+		while (cur_idx > from && cur->insn[cur_idx - 1].address +
+				cur->insn[cur_idx - 1].size + PARALLEL_TAIL > cur->limit)
+			cur_idx--;
+
+		ok = append_insns(&out, &count, &capacity, cur, from, cur_idx);
+		if (!ok)
+			break;
+
+		if (cur_idx > from)
+			resume = cur->insn[cur_idx - 1].address + cur->insn[cur_idx - 1].size;
+		else if (from < cur->count)
+			resume = cur->insn[from].address;
+		else
+			resume = cur->address;
+
+		chunk_release(cur);
+
+		end = resume > next->end ? resume : next->end;
+		limit = end + PARALLEL_OVERLAP < offset + size ? end + PARALLEL_OVERLAP : offset + size;
+
+		chunk_release(next);
+		next->code = buffer + (size_t)(resume - offset);
+		next->size = (size_t)(limit - resume);
+		next->address = resume;
+		next->limit = limit;
+		next->truncated = limit < offset + size;
+		next->insn = NULL;
+		next->count = cs_disasm_ex(ud, next->code, next->size, next->address, 0, &next->insn);
+
+		cur = next;
+		from = 0;
+
+		if (!cur->count) {
+			// invalid insn at @resume: the sequential sweep stops here
+			cur = NULL;
+			break;
+		}
+	}
+
+	if (ok && cur)
+		ok = append_insns(&out, &count, &capacity, cur, from, cur->count);
+
+	for (k = 0; k < n; k++) {
+		chunk_release(&chunks[k]);
+		if (k)
+			cs_close(&chunks[k].handle);
+	}
+
+	if (!ok) {
+		cs_free(out, count);
+		handle->errnum = CS_ERR_MEM;
+		*insn = NULL;
+		return 0;
+	}
+
+	*insn = out;
+
+	return count;
+}
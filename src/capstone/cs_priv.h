@@ -19,6 +19,9 @@ typedef bool (*Disasm_t)(csh handle, const uint8_t *code, size_t code_len, MCIns
 
 typedef const char *(*GetName_t)(csh handle, unsigned int reg);
 
+// decode a single insn in relocation-detail mode (see cs_disasm_reloc())
+typedef bool (*DisasmReloc_t)(cs_struct *h, const uint8_t *code, size_t code_len, uint64_t address, cs_reloc *reloc);
+
 typedef void (*GetID_t)(cs_struct *h, cs_insn *insn, unsigned int id);
 
 // return register name, given register ID
@@ -52,6 +55,7 @@ struct cs_struct {
 	bool skipdata;	// set this to True if we skip data when disassembling
 	uint8_t skipdata_size;	// how many bytes to skip
 	cs_opt_skipdata skipdata_setup;	// user-defined skipdata setup
+	DisasmReloc_t disasm_reloc;	// relocation-detail decoder, NULL if unsupported
 };
 
 #define MAX_ARCH 8
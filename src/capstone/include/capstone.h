@@ -222,6 +222,77 @@ typedef struct cs_insn {
 } cs_insn;
 
 
+// Branch flags of an instruction, reported in cs_reloc.flags
+typedef enum cs_reloc_flag {
+	CS_RELOC_CALL = 1 << 0,	// call instruction (direct or indirect)
+	CS_RELOC_JMP = 1 << 1,	// unconditional jump (direct or indirect)
+	CS_RELOC_JCC = 1 << 2,	// conditional jump, including jecxz & loop
+	CS_RELOC_RET = 1 << 3,	// return instruction, including iret
+	CS_RELOC_REL = 1 << 4,	// @target holds a decoded relative branch target
+	CS_RELOC_RIP = 1 << 5,	// displacement is relative to the next instruction (RIP)
+} cs_reloc_flag;
+
+// Compact relocation information of a disassembled instruction, filled in by
+// cs_disasm_reloc(). This is all a code patcher needs to move an instruction
+// to another address, and it is produced without any memory allocation,
+// mnemonic/operand printing or cs_detail bookkeeping.
+typedef struct cs_reloc {
+	// Instruction ID, same value as cs_insn.id
+	unsigned int id;
+
+	// Address (EIP) of this instruction
+	uint64_t address;
+
+	// Size of this instruction
+	uint16_t size;
+
+	// Combination of CS_RELOC_* flags
+	uint8_t flags;
+
+	// Offset & size (in bytes) of the displacement within the instruction.
+	// @disp_size is 0 if there is no displacement.
+	uint8_t disp_offset;
+	uint8_t disp_size;
+
+	// Offset & size (in bytes) of the immediate within the instruction.
+	// For relative branches this is the encoded branch offset.
+	// @imm_size is 0 if there is no immediate.
+	uint8_t imm_offset;
+	uint8_t imm_size;
+
+	// Sign-extended displacement value
+	int64_t disp;
+
+	// Absolute branch target if CS_RELOC_REL is set, or the absolute address
+	// referenced by the displacement if CS_RELOC_RIP is set
+	uint64_t target;
+} cs_reloc;
+
+// Disassembled instructions in structure-of-arrays form, filled in by
+// cs_disasm_bulk(). All arrays have @count entries, and are allocated by
+// the engine: release them with cs_bulk_free().
+typedef struct cs_bulk {
+	// Number of disassembled instructions
+	size_t count;
+
+	// Address (EIP) of each instruction
+	uint64_t *address;
+
+	// Size of each instruction
+	uint16_t *size;
+
+	// Instruction ID of each instruction (same as cs_insn.id)
+	unsigned int *id;
+
+	// Offset of each instruction's text into @strings. The text is stored
+	// as the mnemonic and the operand string, each NUL-terminated, back to back.
+	uint32_t *mnemonic;
+
+	// Shared string blob for all mnemonics & operand strings, and its size
+	char *strings;
+	size_t strings_size;
+} cs_bulk;
+
 // Calculate the offset of a disassembled instruction in its buffer, given its position
 // in its array of disassembled insn
 // NOTE: this macro works with position (>=1), not index
@@ -380,6 +451,106 @@ size_t cs_disasm_ex(csh handle,
 		size_t count,
 		cs_insn **insn);
 
+/*
+ Disassemble instructions in relocation-detail mode: only the instruction
+ boundaries, branch targets, displacement offsets and branch flags are
+ decoded, into a caller-provided array. No memory is allocated, and the
+ CS_OPT_DETAIL & CS_OPT_SKIPDATA options are ignored.
+
+ NOTE: this API is currently only supported for X86; other architectures
+ return 0 and set CS_ERR_OPTION.
+
+ @handle: handle returned by cs_open()
+ @code: buffer containing raw binary code to be disassembled
+ @code_size: size of above code
+ @address: address of the first insn in given raw code buffer
+ @count: number of instructions to be disassembled, at most the number of
+       entries in @reloc
+ @reloc: array of at least @count entries filled in by this function
+
+ @return: the number of succesfully disassembled instructions,
+ or 0 if this function failed to disassemble the given code
+
+ On failure, call cs_errno() for error code.
+*/
+CAPSTONE_EXPORT
+size_t cs_disasm_reloc(csh handle,
+		const uint8_t *code, size_t code_size,
+		uint64_t address,
+		size_t count,
+		cs_reloc *reloc);
+
+/*
+ Disassemble a whole buffer into packed arrays (see cs_bulk above) rather
+ than an array of cs_insn. This is meant for bindings & tools which
+ process many instructions at once and don't want to cross the library
+ boundary, or allocate an object, for every single instruction.
+
+ NOTE 1: cs_detail is never provided by this API, regardless of the
+ CS_OPT_DETAIL option. Instructions of interest can be disassembled again
+ with cs_disasm_ex() using their address & size.
+ NOTE 2: caller must release @bulk with cs_bulk_free() once done with it,
+ even when this function fails.
+
+ @handle: handle returned by cs_open()
+ @code: buffer containing raw binary code to be disassembled
+ @code_size: size of above code
+ @address: address of the first insn in given raw code buffer
+ @count: number of instrutions to be disassembled, or 0 to get all of them
+ @bulk: arrays filled in by this function
+
+ @return: the number of succesfully disassembled instructions,
+ or 0 if this function failed to disassemble the given code
+
+ On failure, call cs_errno() for error code.
+*/
+CAPSTONE_EXPORT
+size_t cs_disasm_bulk(csh handle,
+		const uint8_t *code, size_t code_size,
+		uint64_t address,
+		size_t count,
+		cs_bulk *bulk);
+
+/*
+ Free memory allocated in @bulk by cs_disasm_bulk()
+
+ @bulk: structure filled in by cs_disasm_bulk()
+*/
+CAPSTONE_EXPORT
+void cs_bulk_free(cs_bulk *bulk);
+
+/*
+ Multi-threaded version of cs_disasm_ex() for big buffers, with @count = 0.
+ The buffer is split into one chunk per thread, and each chunk is disassembled
+ concurrently with its own private handle, configured like @handle. Chunks are
+ then stitched together where the instruction streams of two neighbouring
+ chunks agree, re-decoding sequentially when they don't. The output is
+ exactly the same instruction stream as the one of cs_disasm_ex().
+
+ NOTE 1: small buffers (under 64KB per thread) are disassembled sequentially.
+ NOTE 2: in SKIPDATA mode, a user-defined callback is called with the chunk
+ being disassembled, not the whole buffer, in @code & @offset.
+ NOTE 3: @insn must be freed with cs_free(), like for cs_disasm_ex().
+
+ @handle: handle returned by cs_open()
+ @code: buffer containing raw binary code to be disassembled
+ @code_size: size of above code
+ @address: address of the first insn in given raw code buffer
+ @threads: number of threads to use (at most 64)
+ @insn: array of insn filled in by this function
+
+ @return: the number of succesfully disassembled instructions,
+ or 0 if this function failed to disassemble the given code
+
+ On failure, call cs_errno() for error code.
+*/
+CAPSTONE_EXPORT
+size_t cs_disasm_parallel(csh handle,
+		const uint8_t *code, size_t code_size,
+		uint64_t address,
+		unsigned int threads,
+		cs_insn **insn);
+
 /*
  Free memory allocated in @insn by cs_disasm_ex()
 
@@ -0,0 +1,81 @@
+/* Capstone Disassembler Engine */
+/* By Nguyen Anh Quynh <aquynh@gmail.com>, 2013> */
+
+// Benchmark cs_disasm_parallel() against cs_disasm_ex() on big buffers.
+// Usage: benchmark_parallel [size in MB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <capstone.h>
+
+struct platform {
+	cs_arch arch;
+	cs_mode mode;
+	char *comment;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct platform platforms[] = {
+		{ CS_ARCH_X86, CS_MODE_64, "X86 64" },
+		{ CS_ARCH_ARM, CS_MODE_ARM, "ARM" },
+	};
+	unsigned int threads[] = { 1, 2, 4, 8, 16 };
+	size_t size = (argc > 1 ? atoi(argv[1]) : 8) * 1024 * 1024, i, count;
+	unsigned char *code = malloc(size);
+	uint32_t seed = 1;
+	double start, elapsed, base;
+	cs_insn *insn;
+	csh handle;
+	int p, t;
+
+	if (!code)
+		return 1;
+
+	// random bytes are the worst case for resynchronization
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		code[i] = (unsigned char)(seed >> 16);
+	}
+
+	for (p = 0; p < sizeof(platforms)/sizeof(platforms[0]); p++) {
+		if (cs_open(platforms[p].arch, platforms[p].mode, &handle) != CS_ERR_OK)
+			continue;
+
+		cs_option(handle, CS_OPT_SKIPDATA, CS_OPT_ON);
+
+		printf("%s, %zu MB:\n", platforms[p].comment, size / (1024 * 1024));
+
+		base = 0;
+		for (t = 0; t < sizeof(threads)/sizeof(threads[0]); t++) {
+			start = now();
+			if (threads[t] == 1)
+				count = cs_disasm_ex(handle, code, size, 0x1000, 0, &insn);
+			else
+				count = cs_disasm_parallel(handle, code, size, 0x1000, threads[t], &insn);
+			elapsed = now() - start;
+			cs_free(insn, count);
+
+			if (!base)
+				base = elapsed;
+
+			printf("  %2u threads: %8zu insns in %.3fs, %.2f Minsn/s, speedup %.2fx\n",
+					threads[t], count, elapsed, count / elapsed / 1e6, base / elapsed);
+		}
+
+		cs_close(&handle);
+	}
+
+	free(code);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/* Capstone Disassembler Engine */
+/* By Nguyen Anh Quynh <aquynh@gmail.com>, 2013> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <capstone.h>
+
+#define CODE_SIZE (1024 * 1024)
+
+struct platform {
+	cs_arch arch;
+	cs_mode mode;
+	unsigned char *code;
+	size_t size;
+	char *comment;
+	cs_opt_value skipdata;
+	cs_opt_value detail;
+};
+
+static int failed;
+
+// deterministic pseudo-random bytes, so the test output is stable
+static void fill_random(unsigned char *buf, size_t size, uint32_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (unsigned char)(seed >> 16);
+	}
+}
+
+// repeat a valid code sequence over the whole buffer
+static void fill_pattern(unsigned char *buf, size_t size, const char *code, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		buf[i] = code[i % len];
+}
+
+static void test()
+{
+#define X86_CODE64 "\x55\x48\x8b\x05\xb8\x13\x00\x00\xe8\x10\x00\x00\x00\x48\x89\x5c\x24\x08\x0f\x1f\x44\x00\x00"
+	static unsigned char x86_random[CODE_SIZE], x86_pattern[CODE_SIZE], x86_invalid[CODE_SIZE];
+	static unsigned char arm_random[CODE_SIZE], thumb_random[CODE_SIZE];
+	unsigned int threads[] = { 2, 3, 4, 8 };
+
+	struct platform platforms[] = {
+		{
+			CS_ARCH_X86,
+			CS_MODE_64,
+			x86_random,
+			sizeof(x86_random),
+			"X86 64 - random bytes (skip data)",
+			CS_OPT_ON,
+			CS_OPT_OFF,
+		},
+		{
+			CS_ARCH_X86,
+			CS_MODE_64,
+			x86_pattern,
+			sizeof(x86_pattern),
+			"X86 64 - unaligned code (detail)",
+			CS_OPT_OFF,
+			CS_OPT_ON,
+		},
+		{
+			CS_ARCH_X86,
+			CS_MODE_64,
+			x86_invalid,
+			sizeof(x86_invalid),
+			"X86 64 - invalid insn in the middle",
+			CS_OPT_OFF,
+			CS_OPT_OFF,
+		},
+		{
+			CS_ARCH_ARM,
+			CS_MODE_ARM,
+			arm_random,
+			sizeof(arm_random),
+			"ARM - random bytes (skip data)",
+			CS_OPT_ON,
+			CS_OPT_OFF,
+		},
+		{
+			CS_ARCH_ARM,
+			CS_MODE_THUMB,
+			thumb_random,
+			sizeof(thumb_random),
+			"THUMB - random bytes (skip data)",
+			CS_OPT_ON,
+			CS_OPT_OFF,
+		},
+	};
+
+	csh handle;
+	uint64_t address = 0x1000;
+	cs_insn *insn, *pinsn;
+	int i, t;
+	size_t count, pcount, j;
+	cs_err err;
+
+	fill_random(x86_random, sizeof(x86_random), 1);
+	fill_pattern(x86_pattern, sizeof(x86_pattern), X86_CODE64, sizeof(X86_CODE64) - 1);
+	memcpy(x86_invalid, x86_pattern, sizeof(x86_invalid));
+	// push es, which is invalid in 64-bit mode, in place of a "push rbp"
+	x86_invalid[sizeof(x86_invalid) / 2 / (sizeof(X86_CODE64) - 1) * (sizeof(X86_CODE64) - 1)] = 0x06;
+	fill_random(arm_random, sizeof(arm_random), 2);
+	fill_random(thumb_random, sizeof(thumb_random), 3);
+
+	for (i = 0; i < sizeof(platforms)/sizeof(platforms[0]); i++) {
+		printf("****************\n");
+		printf("Platform: %s\n", platforms[i].comment);
+		err = cs_open(platforms[i].arch, platforms[i].mode, &handle);
+		if (err) {
+			printf("Failed on cs_open() with error returned: %u\n", err);
+			continue;
+		}
+
+		cs_option(handle, CS_OPT_SKIPDATA, platforms[i].skipdata);
+		cs_option(handle, CS_OPT_DETAIL, platforms[i].detail);
+
+		count = cs_disasm_ex(handle, platforms[i].code, platforms[i].size, address, 0, &insn);
+		printf("Sequential: %zu instructions\n", count);
+
+		for (t = 0; t < sizeof(threads)/sizeof(threads[0]); t++) {
+			pcount = cs_disasm_parallel(handle, platforms[i].code, platforms[i].size, address, threads[t], &pinsn);
+			printf("%u threads: %zu instructions", threads[t], pcount);
+
+			for (j = 0; j < count && j < pcount; j++) {
+				if (insn[j].address != pinsn[j].address || insn[j].size != pinsn[j].size ||
+						insn[j].id != pinsn[j].id ||
+						strcmp(insn[j].mnemonic, pinsn[j].mnemonic) ||
+						strcmp(insn[j].op_str, pinsn[j].op_str) ||
+						(insn[j].detail && (insn[j].detail->groups_count != pinsn[j].detail->groups_count ||
+							insn[j].detail->x86.op_count != pinsn[j].detail->x86.op_count ||
+							memcmp(insn[j].detail->x86.operands, pinsn[j].detail->x86.operands,
+								insn[j].detail->x86.op_count * sizeof(cs_x86_op))))) {
+					printf(" - ERROR: mismatch at 0x%"PRIx64, insn[j].address);
+					failed = 1;
+					break;
+				}
+			}
+
+			if (count != pcount) {
+				printf(" - ERROR: expected %zu", count);
+				failed = 1;
+			}
+			printf("\n");
+
+			cs_free(pinsn, pcount);
+		}
+
+		printf("\n");
+
+		cs_free(insn, count);
+		cs_close(&handle);
+	}
+}
+
+int main()
+{
+	test();
+
+	if (failed)
+		printf("Parallel disassembly test FAILED\n");
+
+	return failed;
+}
@@ -0,0 +1,169 @@
+/* Capstone Disassembler Engine */
+/* By Nguyen Anh Quynh <aquynh@gmail.com>, 2013> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <capstone.h>
+
+struct platform {
+	cs_arch arch;
+	cs_mode mode;
+	unsigned char *code;
+	size_t size;
+	char *comment;
+};
+
+static int failed;
+
+static void print_string_hex(unsigned char *str, int len)
+{
+	unsigned char *c;
+
+	printf("Code: ");
+	for (c = str; c < str + len; c++) {
+		printf("0x%02x ", *c & 0xff);
+	}
+	printf("\n");
+}
+
+static void print_flags(uint8_t flags)
+{
+	if (flags & CS_RELOC_CALL)
+		printf(" call");
+	if (flags & CS_RELOC_JMP)
+		printf(" jmp");
+	if (flags & CS_RELOC_JCC)
+		printf(" jcc");
+	if (flags & CS_RELOC_RET)
+		printf(" ret");
+	if (flags & CS_RELOC_REL)
+		printf(" rel");
+	if (flags & CS_RELOC_RIP)
+		printf(" rip");
+}
+
+// verify relocation-detail output against the regular detail mode
+static void check(csh handle, cs_insn *insn, cs_reloc *reloc)
+{
+	uint8_t i;
+
+	if (insn->id != reloc->id || insn->size != reloc->size ||
+			insn->address != reloc->address) {
+		printf("ERROR: 0x%"PRIx64": reloc mismatch (id %u/%u, size %u/%u)\n",
+				insn->address, insn->id, reloc->id, insn->size, reloc->size);
+		failed = 1;
+		return;
+	}
+
+	// detail mode reports the default displacement size even without one
+	if (reloc->disp_size && (insn->detail->x86.disp_size != reloc->disp_size ||
+			insn->detail->x86.disp != reloc->disp)) {
+		printf("ERROR: 0x%"PRIx64": displacement mismatch\n", insn->address);
+		failed = 1;
+	}
+
+	if (cs_insn_group(handle, insn, X86_GRP_CALL) != !!(reloc->flags & CS_RELOC_CALL) ||
+			cs_insn_group(handle, insn, X86_GRP_RET) != !!(reloc->flags & CS_RELOC_RET)) {
+		printf("ERROR: 0x%"PRIx64": group mismatch\n", insn->address);
+		failed = 1;
+	}
+
+	if (reloc->flags & CS_RELOC_REL) {
+		for (i = 0; i < insn->detail->x86.op_count; i++) {
+			cs_x86_op *op = &insn->detail->x86.operands[i];
+			if (op->type == X86_OP_IMM && (uint64_t)op->imm != reloc->target) {
+				printf("ERROR: 0x%"PRIx64": branch target mismatch\n", insn->address);
+				failed = 1;
+			}
+		}
+	}
+}
+
+static void test()
+{
+#define X86_CODE32 "\x8d\x4c\x32\x08\x01\xd8\x81\xc6\x34\x12\x00\x00\xe8\x10\x00\x00\x00\x74\xfe\x0f\x85\x00\x01\x00\x00\xeb\x02\xe9\xf0\xff\xff\xff\xff\x15\x00\x10\x40\x00\xe3\x00\xe2\xfa\xc3\xc2\x08\x00"
+#define X86_CODE64 "\x48\x8b\x05\x10\x00\x00\x00\x48\x8d\x0d\xf0\xff\xff\xff\x4c\x8b\x45\x08\xff\x25\x00\x00\x00\x00\xe8\x00\x00\x00\x00\x0f\x84\x10\x00\x00\x00\x67\x8b\x05\x04\x00\x00\x00\x48\x89\x5c\x24\x08\xc3"
+
+	struct platform platforms[] = {
+		{
+			CS_ARCH_X86,
+			CS_MODE_32,
+			(unsigned char *)X86_CODE32,
+			sizeof(X86_CODE32) - 1,
+			"X86 32 - Relocation detail",
+		},
+		{
+			CS_ARCH_X86,
+			CS_MODE_64,
+			(unsigned char *)X86_CODE64,
+			sizeof(X86_CODE64) - 1,
+			"X86 64 - Relocation detail",
+		},
+	};
+
+	csh handle;
+	uint64_t address = 0x1000;
+	cs_insn *insn;
+	cs_reloc reloc[32];
+	int i;
+	size_t count, rcount, j;
+	cs_err err;
+
+	for (i = 0; i < sizeof(platforms)/sizeof(platforms[0]); i++) {
+		printf("****************\n");
+		printf("Platform: %s\n", platforms[i].comment);
+		err = cs_open(platforms[i].arch, platforms[i].mode, &handle);
+		if (err) {
+			printf("Failed on cs_open() with error returned: %u\n", err);
+			continue;
+		}
+
+		cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+		rcount = cs_disasm_reloc(handle, platforms[i].code, platforms[i].size, address, 32, reloc);
+		count = cs_disasm_ex(handle, platforms[i].code, platforms[i].size, address, 0, &insn);
+		print_string_hex(platforms[i].code, platforms[i].size);
+		printf("Disasm:\n");
+
+		if (count != rcount) {
+			printf("ERROR: %zu instructions, but %zu relocations\n", count, rcount);
+			failed = 1;
+		}
+
+		for (j = 0; j < rcount; j++) {
+			printf("0x%"PRIx64":\t%s\tsize: %u", reloc[j].address,
+					cs_insn_name(handle, reloc[j].id), reloc[j].size);
+			if (reloc[j].disp_size)
+				printf("\tdisp: %u@%u = 0x%"PRIx64, reloc[j].disp_size,
+						reloc[j].disp_offset, (uint64_t)reloc[j].disp);
+			if (reloc[j].imm_size)
+				printf("\timm: %u@%u", reloc[j].imm_size, reloc[j].imm_offset);
+			if (reloc[j].flags & (CS_RELOC_REL | CS_RELOC_RIP))
+				printf("\ttarget: 0x%"PRIx64, reloc[j].target);
+			print_flags(reloc[j].flags);
+			printf("\n");
+
+			if (j < count)
+				check(handle, &insn[j], &reloc[j]);
+		}
+
+		printf("\n");
+
+		if (count)
+			cs_free(insn, count);
+
+		cs_close(&handle);
+	}
+}
+
+int main()
+{
+	test();
+
+	if (failed)
+		printf("Relocation detail test FAILED\n");
+
+	return failed;
+}
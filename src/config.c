@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <windows.h>
 #include "config.h"
 #include "hooking.h"
+#include "log.h"
 #include "misc.h"
 #include "native.h"
 #include "ntapi.h"
@@ -140,6 +141,81 @@ void config_read(config_t *cfg)
         else if(strcmp(key, "pipe-pid") == 0) {
             cfg->pipe_pid = value[0] == '1';
         }
+        else if(strcmp(key, "pipe-async") == 0) {
+            cfg->pipe_async = value[0] == '1';
+        }
+        else if(strcmp(key, "log-format") == 0) {
+            cfg->log_format = strcmp(value, "packed") == 0 ?
+                LOG_FORMAT_PACKED : LOG_FORMAT_BSON;
+        }
+        else if(strcmp(key, "log-compress") == 0) {
+            cfg->log_compress = strcmp(value, "lz4") == 0 ?
+                LOG_COMPRESS_LZ4 : LOG_COMPRESS_NONE;
+        }
+        else if(strcmp(key, "log-strings") == 0) {
+            cfg->log_strings = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-ring") == 0) {
+            strncpy(cfg->log_ring, value, sizeof(cfg->log_ring));
+        }
+        else if(strcmp(key, "log-ring-size") == 0) {
+            cfg->log_ring_size = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-explain-all") == 0) {
+            cfg->log_explain_all = value[0] == '1';
+        }
+        else if(strcmp(key, "log-symbols") == 0) {
+            cfg->log_symbols = strcmp(value, "host") == 0 ?
+                LOG_SYMBOLS_HOST : LOG_SYMBOLS_MONITOR;
+        }
+        else if(strcmp(key, "log-stacktrace") == 0) {
+            cfg->log_stacktrace = value[0] == '1';
+        }
+        else if(strcmp(key, "log-collapse") == 0) {
+            strncpy(cfg->log_collapse, value, sizeof(cfg->log_collapse));
+        }
+        else if(strcmp(key, "log-collapse-window") == 0) {
+            cfg->log_collapse_window = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-buffer-dedup") == 0) {
+            cfg->log_buffer_dedup = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-rate") == 0) {
+            cfg->log_rate = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-burst") == 0) {
+            cfg->log_burst = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-sample") == 0) {
+            cfg->log_sample = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "log-summary") == 0) {
+            cfg->log_summary = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "exception-policy") == 0) {
+            cfg->exception_policy =
+                strcmp(value, "count") == 0 ? LOG_EXC_POLICY_COUNT :
+                strcmp(value, "ignore") == 0 ? LOG_EXC_POLICY_IGNORE :
+                LOG_EXC_POLICY_EXIT;
+        }
+        else if(strcmp(key, "exception-limit") == 0) {
+            cfg->exception_limit = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "exception-sites") == 0) {
+            cfg->exception_sites = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "exception-interval") == 0) {
+            cfg->exception_interval = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(key, "regkey-cache") == 0) {
+            cfg->regkey_cache = value[0] == '1';
+        }
+        else if(strcmp(key, "file-cache") == 0) {
+            cfg->file_cache = value[0] == '1';
+        }
+        else if(strcmp(key, "command-interval") == 0) {
+            cfg->command_interval = strtoul(value, NULL, 10);
+        }
         else if(strcmp(key, "trigger") == 0) {
             utf8_decode_strn(
                 value, cfg->trigger, sizeof(cfg->trigger) / sizeof(wchar_t)
@@ -0,0 +1,344 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2015-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnq.h"
+
+// Lists with at least this many values are radix sorted, smaller ones go
+// through qsort().
+#define DNQ_RADIX_MIN 1024
+
+// Keeps the size of the copies of larger lists in 32 bits.
+#define DNQ_TREE_MAX 0x10000000
+
+#define DNQ_CACHE_LINE 64
+
+typedef uint32_t dnq_v32 __attribute__((vector_size(16)));
+typedef int32_t dnq_m32 __attribute__((vector_size(16)));
+
+static void *_dnq_malloc(uint32_t length)
+{
+    return malloc(length);
+}
+
+static dnq_alloc_t g_alloc = &_dnq_malloc;
+static dnq_free_t g_free = &free;
+
+void dnq_set_allocator(dnq_alloc_t alloc, dnq_free_t free)
+{
+    g_alloc = alloc;
+    g_free = free;
+}
+
+static inline __attribute__((always_inline))
+uint64_t _dnq_get(const void *list, uint32_t size, uint32_t idx)
+{
+    if(size == sizeof(uint32_t)) {
+        return ((const uint32_t *) list)[idx];
+    }
+    return ((const uint64_t *) list)[idx];
+}
+
+static inline __attribute__((always_inline))
+void _dnq_put(void *list, uint32_t size, uint32_t idx, uint64_t value)
+{
+    if(size == sizeof(uint32_t)) {
+        ((uint32_t *) list)[idx] = (uint32_t) value;
+    }
+    else {
+        ((uint64_t *) list)[idx] = value;
+    }
+}
+
+static int _dnq_cmp32(const void *a, const void *b)
+{
+    uint32_t _a = *(const uint32_t *) a;
+    uint32_t _b = *(const uint32_t *) b;
+    return (_a > _b) - (_a < _b);
+}
+
+static int _dnq_cmp64(const void *a, const void *b)
+{
+    uint64_t _a = *(const uint64_t *) a;
+    uint64_t _b = *(const uint64_t *) b;
+    return (_a > _b) - (_a < _b);
+}
+
+// Least significant digit first radix sort on bytes. All histograms are
+// gathered in one pass and bytes which are the same for all values, e.g.,
+// the upper bytes of small values, are skipped.
+static inline __attribute__((always_inline))
+int _dnq_radix_sort(void *list, uint32_t size, uint32_t length)
+{
+    uint32_t counts[sizeof(uint64_t)][256];
+    memset(counts, 0, sizeof(counts));
+
+    for (uint32_t idx = 0; idx < length; idx++) {
+        uint64_t value = _dnq_get(list, size, idx);
+        for (uint32_t digit = 0; digit < size; digit++) {
+            counts[digit][(value >> (digit * 8)) & 0xff]++;
+        }
+    }
+
+    void *temp = g_alloc(length * size), *src = list, *dst = temp;
+    if(temp == NULL) {
+        return -1;
+    }
+
+    for (uint32_t digit = 0; digit < size; digit++) {
+        uint32_t shift = digit * 8, *offsets = counts[digit], offset = 0;
+        if(offsets[(_dnq_get(src, size, 0) >> shift) & 0xff] == length) {
+            continue;
+        }
+
+        for (uint32_t idx = 0; idx < 256; idx++) {
+            uint32_t count = offsets[idx];
+            offsets[idx] = offset;
+            offset += count;
+        }
+
+        for (uint32_t idx = 0; idx < length; idx++) {
+            uint64_t value = _dnq_get(src, size, idx);
+            _dnq_put(dst, size, offsets[(value >> shift) & 0xff]++, value);
+        }
+
+        void *swap = src; src = dst; dst = swap;
+    }
+
+    if(src != list) {
+        memcpy(list, src, length * size);
+    }
+
+    g_free(temp);
+    return 0;
+}
+
+static void _dnq_sort(void *list, uint32_t size, uint32_t length)
+{
+    if(length >= DNQ_RADIX_MIN && length < DNQ_TREE_MAX) {
+        int ret = size == sizeof(uint32_t) ?
+            _dnq_radix_sort(list, sizeof(uint32_t), length) :
+            _dnq_radix_sort(list, sizeof(uint64_t), length);
+        if(ret == 0) {
+            return;
+        }
+    }
+
+    qsort(list, length, size,
+        size == sizeof(uint32_t) ? &_dnq_cmp32 : &_dnq_cmp64);
+}
+
+// Fills the subtree rooted at node k with the sorted values, starting at
+// index idx, in order. Returns the index of the next value to be placed.
+static uint32_t _dnq_build(const void *list, void *tree, uint32_t size,
+    uint32_t length, uint32_t idx, uint32_t k)
+{
+    if(k <= length) {
+        idx = _dnq_build(list, tree, size, length, idx, 2 * k);
+        _dnq_put(tree, size, k, _dnq_get(list, size, idx++));
+        idx = _dnq_build(list, tree, size, length, idx, 2 * k + 1);
+    }
+    return idx;
+}
+
+int dnq_init(dnq_t *dnq, void *list, uint32_t size, uint32_t length)
+{
+    dnq->list = list;
+    dnq->size = size;
+    dnq->length = length;
+    dnq->tree = dnq->tree_alloc = NULL;
+
+    if(size != sizeof(uint32_t) && size != sizeof(uint64_t)) {
+        return -1;
+    }
+
+    _dnq_sort(list, size, length);
+
+    if(length <= DNQ_LINEAR_SIZE / size || length >= DNQ_TREE_MAX) {
+        return 0;
+    }
+
+    // Index 0 is unused, so that the children of k are at 2k and 2k+1.
+    dnq->tree_alloc = g_alloc((length + 1) * size + DNQ_CACHE_LINE);
+    if(dnq->tree_alloc != NULL) {
+        dnq->tree = (void *)(((uintptr_t) dnq->tree_alloc +
+            DNQ_CACHE_LINE - 1) & ~(uintptr_t)(DNQ_CACHE_LINE - 1));
+        _dnq_build(list, dnq->tree, size, length, 0, 1);
+    }
+    return 0;
+}
+
+void dnq_free(dnq_t *dnq)
+{
+    if(dnq->tree_alloc != NULL) {
+        g_free(dnq->tree_alloc);
+    }
+    dnq->tree = dnq->tree_alloc = NULL;
+}
+
+uint32_t *dnq_iter32(dnq_t *dnq)
+{
+    return (uint32_t *) dnq->list;
+}
+
+uint64_t *dnq_iter64(dnq_t *dnq)
+{
+    return (uint64_t *) dnq->list;
+}
+
+uintptr_t *dnq_iterptr(dnq_t *dnq)
+{
+    return (uintptr_t *) dnq->list;
+}
+
+int dnq_isempty(dnq_t *dnq)
+{
+    return dnq->list == NULL || dnq->length == 0;
+}
+
+// Compares four 32-bit or two 64-bit values at a time, which maps onto
+// SSE2 and is emulated by the compiler on targets without it.
+static int _dnq_scan32(const uint32_t *list, uint32_t length, uint32_t value)
+{
+    dnq_v32 needle = (dnq_v32){0} + value, block;
+    dnq_m32 hits = {0}; uint32_t idx = 0, ret = 0;
+
+    for (; idx + 4 <= length; idx += 4) {
+        memcpy(&block, &list[idx], sizeof(block));
+        hits |= block == needle;
+    }
+
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        ret |= hits[lane];
+    }
+
+    for (; idx < length; idx++) {
+        ret |= list[idx] == value;
+    }
+    return ret != 0;
+}
+
+// SSE2 has no 64-bit compare, so both halves of a value are compared as
+// 32-bit lanes and the results of either half are combined.
+static int _dnq_scan64(const uint64_t *list, uint32_t length, uint64_t value)
+{
+    dnq_v32 needle, block; dnq_m32 hits = {0}, swap = {1, 0, 3, 2};
+    uint32_t idx = 0, ret = 0;
+
+    memcpy(&needle, (uint64_t[2]){value, value}, sizeof(needle));
+
+    for (; idx + 2 <= length; idx += 2) {
+        memcpy(&block, &list[idx], sizeof(block));
+        dnq_m32 equal = block == needle;
+        hits |= equal & __builtin_shuffle(equal, swap);
+    }
+
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        ret |= hits[lane];
+    }
+
+    for (; idx < length; idx++) {
+        ret |= list[idx] == value;
+    }
+    return ret != 0;
+}
+
+// Branchless lower bound in the sorted list, for when there's no tree.
+static int _dnq_bisect32(const uint32_t *list, uint32_t length,
+    uint32_t value)
+{
+    while (length > 1) {
+        uint32_t half = length / 2;
+        list += (list[half - 1] < value) * half;
+        length -= half;
+    }
+    return *list == value;
+}
+
+static int _dnq_bisect64(const uint64_t *list, uint32_t length,
+    uint64_t value)
+{
+    while (length > 1) {
+        uint32_t half = length / 2;
+        list += (list[half - 1] < value) * half;
+        length -= half;
+    }
+    return *list == value;
+}
+
+// The descent takes one comparison per level, which only decides the
+// child. Sixteen 32-bit or eight 64-bit values fill a cache line, so
+// prefetching k * 16 or k * 8 fetches the great-grandchildren or the
+// grandchildren of k, respectively. Afterwards k has one trailing one
+// bit for every step to the right after the last step to the left, the
+// node which holds the lower bound of the value.
+int dnq_has32(dnq_t *dnq, uint32_t value)
+{
+    if(dnq->length <= DNQ_LINEAR_SIZE / sizeof(uint32_t)) {
+        return _dnq_scan32(dnq_iter32(dnq), dnq->length, value);
+    }
+
+    if(dnq->tree == NULL) {
+        return _dnq_bisect32(dnq_iter32(dnq), dnq->length, value);
+    }
+
+    const uint32_t *tree = (const uint32_t *) dnq->tree;
+    uint32_t k = 1, length = dnq->length;
+
+    while (k <= length) {
+        __builtin_prefetch((const uint8_t *) tree + k * DNQ_CACHE_LINE);
+        k = 2 * k + (tree[k] < value);
+    }
+
+    k >>= __builtin_ffs(~k);
+    return k != 0 && tree[k] == value;
+}
+
+int dnq_has64(dnq_t *dnq, uint64_t value)
+{
+    if(dnq->length <= DNQ_LINEAR_SIZE / sizeof(uint64_t)) {
+        return _dnq_scan64(dnq_iter64(dnq), dnq->length, value);
+    }
+
+    if(dnq->tree == NULL) {
+        return _dnq_bisect64(dnq_iter64(dnq), dnq->length, value);
+    }
+
+    const uint64_t *tree = (const uint64_t *) dnq->tree;
+    uint32_t k = 1, length = dnq->length;
+
+    while (k <= length) {
+        __builtin_prefetch((const uint8_t *) tree + k * DNQ_CACHE_LINE);
+        k = 2 * k + (tree[k] < value);
+    }
+
+    k >>= __builtin_ffs(~k);
+    return k != 0 && tree[k] == value;
+}
+
+int dnq_hasptr(dnq_t *dnq, uintptr_t value)
+{
+    if(sizeof(uintptr_t) == sizeof(uint32_t)) {
+        return dnq_has32(dnq, value);
+    }
+    return dnq_has64(dnq, value);
+}
@@ -328,6 +328,9 @@ int exploit_hotpatch_guard_page_referer(uintptr_t pc)
     uint8_t *insn = (uint8_t *) pc;
 
     hook_t *h = slab_getmem(&g_guard_page_referer_slab);
+    if(h == NULL) {
+        return -1;
+    }
 
     h->type = HOOK_TYPE_GUARD;
     h->addr = insn;
@@ -335,7 +338,7 @@ int exploit_hotpatch_guard_page_referer(uintptr_t pc)
 
     int r = hook(h, NULL);
     if(r < 0) {
-        slab_return_last(&g_guard_page_referer_slab);
+        slab_free(&g_guard_page_referer_slab, h);
         return r;
     }
     return h->stub_used;
@@ -0,0 +1,443 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "bson.h"
+#include "filter.h"
+#include "log.h"
+#include "memory.h"
+#include "misc.h"
+#include "ntapi.h"
+#include "pipe.h"
+#include "utf8.h"
+
+// Maximum number of arguments of a call and length of a string value.
+#define FILTER_ARG_MAX 32
+#define FILTER_VALUE_MAX 256
+
+typedef struct _filter_pred_t {
+    uint32_t argidx;
+    char op;
+    int is_string;
+
+    // Integer value or range, or the mask and its value.
+    int64_t low, high;
+    int has_value;
+
+    // String value as-is for ANSI arguments, and decoded for unicode ones.
+    uint32_t length, wlength;
+    char str[FILTER_VALUE_MAX];
+    wchar_t wstr[FILTER_VALUE_MAX];
+} filter_pred_t;
+
+// Rules are never modified nor released once they've been published, as
+// hooked threads may be walking them at any time.
+typedef struct _filter_rule_t {
+    struct _filter_rule_t *next;
+    uint32_t count;
+    filter_pred_t preds[FILTER_PREDICATE_MAX];
+} filter_rule_t;
+
+// An argument of a call, of which the value is only read from the (possibly
+// invalid) process memory once a predicate requires it.
+typedef struct _filter_arg_t {
+    char type;
+    int64_t value;
+    const void *ptr;
+    uint32_t length;
+} filter_arg_t;
+
+// Rules of each API index. Only the host command thread adds rules.
+static filter_rule_t *volatile *g_filters;
+
+static int _filter_lookup(const char *api, uint32_t *index)
+{
+    char *end;
+
+    *index = strtoul(api, &end, 0);
+    if(*api != 0 && *end == 0) {
+        return *index < sig_count() ? 0 : -1;
+    }
+
+    for (uint32_t idx = 0; idx < sig_count(); idx++) {
+        if(strcmp(sig_apiname(idx), api) == 0) {
+            *index = idx;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Parameter type of an argument, numbered as in the log.
+static char _filter_argtype(uint32_t index, uint32_t argidx)
+{
+    if(argidx < 2) {
+        return argidx == 0 ? 'i' : 'l';
+    }
+
+    for (const char *fmt = sig_paramtypes(index); *fmt != 0; fmt++) {
+        if(*fmt != '!' && argidx-- == 2) {
+            return *fmt;
+        }
+    }
+    return 0;
+}
+
+static int _filter_compile(filter_pred_t *pred, uint32_t index, char *text)
+{
+    char *end;
+
+    pred->argidx = strtoul(text, &end, 10);
+    if(end == text || *end == 0) {
+        return -1;
+    }
+
+    pred->op = *end++;
+
+    char type = _filter_argtype(index, pred->argidx);
+    if(type == 0) {
+        return -1;
+    }
+
+    pred->is_string = strchr("sSuUotv", type) != NULL;
+    if(pred->is_string == 0 && strchr("ixIlpLPqQ", type) == NULL) {
+        return -1;
+    }
+
+    if(pred->is_string != 0) {
+        if(pred->op != '=' && pred->op != '^') {
+            return -1;
+        }
+
+        pred->length = strlen(end);
+        if(pred->length >= FILTER_VALUE_MAX) {
+            return -1;
+        }
+
+        memcpy(pred->str, end, pred->length + 1);
+
+        int length = utf8_decode_strn(end, pred->wstr, FILTER_VALUE_MAX);
+        if(length < 0) {
+            return -1;
+        }
+
+        pred->wlength = length;
+        return 0;
+    }
+
+    switch (pred->op) {
+    case '=':
+        pred->low = strtoll(end, &end, 0);
+        return *end == 0 ? 0 : -1;
+
+    case ':':
+        pred->low = strtoll(end, &end, 0);
+        if(*end++ != ',') {
+            return -1;
+        }
+        pred->high = strtoll(end, &end, 0);
+        return *end == 0 ? 0 : -1;
+
+    case '&':
+        pred->low = strtoull(end, &end, 0);
+        if(*end == '=') {
+            pred->high = strtoull(end + 1, &end, 0);
+            pred->has_value = 1;
+        }
+        return *end == 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+int filter_add(const char *rule)
+{
+    char buf[1024], *fields[1 + FILTER_PREDICATE_MAX]; uint32_t count = 0;
+    uint32_t index;
+
+    if(g_filters == NULL || strlen(rule) >= sizeof(buf)) {
+        return -1;
+    }
+
+    strcpy(buf, rule);
+
+    char *p = buf;
+    while (p != NULL && count < 1 + FILTER_PREDICATE_MAX) {
+        fields[count++] = p;
+        p = strchr(p, '|');
+        if(p != NULL) {
+            *p++ = 0;
+        }
+    }
+
+    if(p != NULL || count < 2 || _filter_lookup(fields[0], &index) < 0) {
+        return -1;
+    }
+
+    filter_rule_t *r = (filter_rule_t *) mem_alloc(sizeof(filter_rule_t));
+    if(r == NULL) {
+        return -1;
+    }
+
+    for (uint32_t idx = 1; idx < count; idx++) {
+        if(_filter_compile(&r->preds[r->count++], index, fields[idx]) < 0) {
+            mem_free(r);
+            return -1;
+        }
+    }
+
+    r->next = g_filters[index];
+    InterlockedExchangePointer((void *volatile *) &g_filters[index], r);
+    return 0;
+}
+
+void filter_clear()
+{
+    for (uint32_t idx = 0; g_filters != NULL && idx < sig_count(); idx++) {
+        InterlockedExchangePointer((void *volatile *) &g_filters[idx], NULL);
+    }
+}
+
+static int64_t _filter_int(const filter_arg_t *arg)
+{
+    switch (arg->type) {
+    case 'I':
+        return arg->ptr != NULL ? copy_uint32(arg->ptr) : 0;
+
+    case 'L': case 'P':
+        return arg->ptr != NULL ? (int64_t) copy_uintptr(arg->ptr) : 0;
+
+    case 'Q':
+        return arg->ptr != NULL ? (int64_t) copy_uint64(arg->ptr) : 0;
+    }
+    return arg->value;
+}
+
+static int _filter_string(const filter_pred_t *pred, filter_arg_t *arg)
+{
+    const void *str = arg->ptr; uint32_t length = arg->length;
+    int wide = strchr("uUtv", arg->type) != NULL;
+    ANSI_STRING ansi;
+
+    if(arg->type == 'o') {
+        if(str == NULL || copy_bytes(&ansi, str, sizeof(ansi)) != 0) {
+            return 0;
+        }
+        str = ansi.Buffer, length = ansi.Length;
+    }
+    else if(arg->type == 's') {
+        length = str != NULL ? copy_strlen(str) : 0;
+    }
+    else if(arg->type == 'u') {
+        length = str != NULL ? copy_strlenW(str) : 0;
+    }
+
+    uint32_t expected = wide != 0 ? pred->wlength : pred->length;
+    if(length < expected || (pred->op == '=' && length != expected)) {
+        return 0;
+    }
+
+    if(expected == 0) {
+        return 1;
+    }
+
+    if(wide != 0) {
+        wchar_t buf[FILTER_VALUE_MAX];
+        return copy_bytes(buf, str, expected * sizeof(wchar_t)) == 0 &&
+            wcsnicmp(buf, pred->wstr, expected) == 0;
+    }
+
+    char buf[FILTER_VALUE_MAX];
+    return copy_bytes(buf, str, expected) == 0 &&
+        strnicmp(buf, pred->str, expected) == 0;
+}
+
+static int _filter_pred(const filter_pred_t *pred, filter_arg_t *arg)
+{
+    if(pred->is_string != 0) {
+        return _filter_string(pred, arg);
+    }
+
+    int64_t value = _filter_int(arg);
+
+    switch (pred->op) {
+    case '=':
+        return value == pred->low;
+
+    case ':':
+        return value >= pred->low && value <= pred->high;
+
+    case '&':
+        return pred->has_value != 0 ?
+            (value & pred->low) == pred->high : (value & pred->low) != 0;
+    }
+    return 0;
+}
+
+// Pick up the arguments the way log_api() consumes them, without touching
+// the memory they point to.
+static uint32_t _filter_args(uint32_t index, int is_success,
+    uintptr_t return_value, va_list args, filter_arg_t *out)
+{
+    uint32_t argnum = 2;
+
+    out[0].type = 'i', out[0].value = is_success;
+    out[1].type = 'l', out[1].value = (intptr_t) return_value;
+
+    for (const char *fmt = sig_paramtypes(index);
+            *fmt != 0 && argnum < FILTER_ARG_MAX; fmt++) {
+        if(*fmt == '!') {
+            continue;
+        }
+
+        filter_arg_t *arg = &out[argnum++];
+        arg->type = *fmt, arg->ptr = NULL, arg->length = 0, arg->value = 0;
+
+        switch (*fmt) {
+        case 's': case 'u': case 'o': case 'I': case 'L': case 'P':
+        case 'Q':
+            arg->ptr = va_arg(args, const void *);
+            break;
+
+        case 'S': case 'U':
+            arg->length = va_arg(args, int);
+            arg->ptr = va_arg(args, const void *);
+            break;
+
+        case 'b':
+            (void) va_arg(args, uintptr_t);
+            (void) va_arg(args, const uint8_t *);
+            break;
+
+        case 'B':
+            (void) va_arg(args, uintptr_t *);
+            (void) va_arg(args, const uint8_t *);
+            break;
+
+        case 'i':
+            arg->value = va_arg(args, int);
+            break;
+
+        case 'x':
+            arg->value = (uint32_t) va_arg(args, int);
+            break;
+
+        case 'l':
+            arg->value = (intptr_t) va_arg(args, uintptr_t);
+            break;
+
+        case 'p':
+            arg->value = va_arg(args, uintptr_t);
+            break;
+
+        case 'a': case 'A':
+            (void) va_arg(args, int);
+            (void) va_arg(args, const void *);
+            break;
+
+        case 'r': case 'R':
+            (void) va_arg(args, uint32_t *);
+            (void) va_arg(args, uint32_t *);
+            (void) va_arg(args, uint8_t *);
+            break;
+
+        case 'q':
+            arg->value = va_arg(args, int64_t);
+            break;
+
+        case 'z':
+            (void) va_arg(args, bson *);
+            break;
+
+        case 'c':
+            (void) va_arg(args, REFCLSID);
+            break;
+
+        case 't': {
+            const BSTR bstr = va_arg(args, const BSTR);
+            if(bstr != NULL) {
+                arg->ptr = bstr, arg->length = sys_string_length(bstr);
+            }
+            break;
+        }
+
+        case 'v': {
+            const VARIANT *v = va_arg(args, const VARIANT *);
+            if(v != NULL && v->vt == VT_BSTR && v->bstrVal != NULL) {
+                arg->ptr = v->bstrVal;
+                arg->length = sys_string_length(v->bstrVal);
+            }
+            break;
+        }
+
+        default:
+            return argnum - 1;
+        }
+    }
+    return argnum;
+}
+
+int filter_match(uint32_t index, int is_success, uintptr_t return_value,
+    va_list args)
+{
+    filter_rule_t *r = g_filters != NULL ? g_filters[index] : NULL;
+    if(r == NULL) {
+        return 0;
+    }
+
+    filter_arg_t argv[FILTER_ARG_MAX];
+    uint32_t argc = _filter_args(index, is_success, return_value, args, argv);
+
+    for (; r != NULL; r = r->next) {
+        uint32_t idx = 0;
+        while (idx < r->count && r->preds[idx].argidx < argc &&
+                _filter_pred(&r->preds[idx], &argv[r->preds[idx].argidx])) {
+            idx++;
+        }
+
+        if(idx == r->count) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void _filter_command(char *args)
+{
+    if(*args == 0) {
+        filter_clear();
+    }
+    else if(filter_add(args) < 0) {
+        pipe("WARNING:Invalid filter rule: %z", args);
+    }
+}
+
+void filter_init()
+{
+    g_filters = virtual_alloc_rw(NULL, sig_count() * sizeof(filter_rule_t *));
+    if(g_filters == NULL) {
+        pipe("CRITICAL:Error allocating memory for the filter rules!");
+        return;
+    }
+
+    pipe_command_register("FILTER", &_filter_command);
+}
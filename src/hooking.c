@@ -38,6 +38,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MISSING_HANDLE_COUNT 128
 #define FUNCTIONSTUBSIZE 256
 
+// Worst-case size of _hook_emit_jump(). On x86_64 a conditional jump is
+// emitted as an inverted "jcc rel8" skipping an absolute jump, which is
+// longer than the original jump it replaces. On x86 it is at most a
+// "jcc rel32".
+#if __x86_64__
+#define HOOK_EMIT_JUMP_MAXSIZE (2 + ASM_JUMP_SIZE)
+#else
+#define HOOK_EMIT_JUMP_MAXSIZE 6
+#endif
+
 static SYSTEM_INFO g_si;
 static csh g_capstone;
 SYSTEM_INFO system_info;
@@ -61,6 +71,8 @@ static const char *g_missing_blacklist[] = {
 // we are "inside" the monitor.
 static uintptr_t g_Old_LdrLoadDll_address;
 
+static void _hook_command(char *args);
+
 static void *_cs_malloc(size_t size)
 {
     return mem_alloc(size);
@@ -102,6 +114,10 @@ static void CALLBACK _ldr_dll_notification(ULONG reason,
         library_from_unicode_string(notification->Loaded.BaseDllName,
             library, sizeof(library));
 
+        log_module(notification->Loaded.DllBase,
+            notification->Loaded.FullDllName->Buffer,
+            notification->Loaded.FullDllName->Length / sizeof(wchar_t));
+
         hook_library(library, notification->Loaded.DllBase);
     }
 }
@@ -148,6 +164,8 @@ int hook_init2()
     // shown by Brad Spengler it's fairly trivial to achieve the same on
     // Windows XP but for now.. it's fine.
     register_dll_notification(&_ldr_dll_notification, NULL);
+
+    pipe_command_register("HOOK", &_hook_command);
     return 0;
 }
 
@@ -257,16 +275,15 @@ int lde(const void *addr)
         return 0;
     }
 
-    cs_insn *insn;
+    // Only the instruction length is required here, so use the relocation
+    // detail mode which doesn't allocate or format anything.
+    cs_reloc reloc;
 
     size_t count =
-        cs_disasm_ex(g_capstone, addr, 16, (uintptr_t) addr, 1, &insn);
+        cs_disasm_reloc(g_capstone, addr, 16, (uintptr_t) addr, 1, &reloc);
     if(count == 0) return 0;
 
-    int size = insn->size;
-
-    cs_free(insn, count);
-    return size;
+    return reloc.size;
 }
 
 int disasm(const void *addr, char *str)
@@ -676,43 +693,68 @@ static int _hook_call_method_arguments(uint8_t *ptr, uint32_t signature)
     return ptr - base;
 }
 
+// Copies the instructions overwritten by the jump to the hook into the stub.
+// A relative jump ends the copy and is returned through jmpaddr & relative
+// to be emitted by the caller, and RIP-relative operands are re-encoded
+// against the new address of the instruction.
 static int _hook_copy_insns(
     hook_t *h, uint8_t **ptr, uintptr_t *jmpaddr, int *relative,
     uintptr_t *spoff)
 {
-    uint8_t *addr = h->addr; *jmpaddr = *relative = *spoff = 0;
+    uint8_t *addr = h->addr; cs_reloc reloc;
+    *jmpaddr = *relative = *spoff = 0;
+
     while (addr - h->addr < 5) {
-        if(*addr == 0xe8) {
+        if(cs_disasm_reloc(g_capstone, addr, 16, (uintptr_t) addr,
+                1, &reloc) == 0) {
+            pipe("ERROR:Unable to disassemble instruction at 0x%x", addr);
+            return -1;
+        }
+
+        if((reloc.flags & CS_RELOC_CALL) != 0) {
             pipe("ERROR:call not yet supported");
-            // *relative = 0;
-            // *jmpaddr = (uintptr_t) addr + *(uint32_t *)(addr + 1) + 5;
             return -1;
         }
-        // TODO Implement support for 64-bit jumps & RIP-relative addressing.
-        if(*addr == 0xe9) {
-            *relative = 0;
-            *jmpaddr = (uintptr_t) addr + *(int32_t *)(addr + 1) + 5;
-            addr += 5;
-            continue;
+
+        if((reloc.flags & CS_RELOC_REL) != 0 && *jmpaddr != 0) {
+            pipe("ERROR:Multiple jumps at 0x%x not supported", h->addr);
+            return -1;
         }
-        if(*addr == 0xeb) {
+
+        if((reloc.flags & CS_RELOC_REL) != 0 &&
+                (reloc.flags & CS_RELOC_JMP) != 0) {
             *relative = 0;
-            *jmpaddr = (uintptr_t) addr + *(int8_t *)(addr + 1) + 2;
-            addr += 2;
+            *jmpaddr = (uintptr_t) reloc.target;
+            addr += reloc.size;
             continue;
         }
-        if(*addr >= 0x70 && *addr < 0x80) {
-            *relative = 1 + *addr - 0x70;
-            *jmpaddr = (uintptr_t) addr + *(int8_t *)(addr + 1) + 2;
-            addr += 2;
+
+        if((reloc.flags & CS_RELOC_REL) != 0 &&
+                (reloc.flags & CS_RELOC_JCC) != 0) {
+            // Only "jcc rel8" (7x) and "jcc rel32" (0f 8x) can be emitted
+            // again, jecxz and loop have no 32-bit form.
+            uint8_t opcode = addr[reloc.imm_offset - 1];
+            if(reloc.imm_size == 1 && opcode >= 0x70 && opcode < 0x80) {
+                *relative = 1 + opcode - 0x70;
+            }
+            else if(reloc.imm_size == 4 && opcode >= 0x80 && opcode < 0x90) {
+                *relative = 1 + opcode - 0x80;
+            }
+            else {
+                pipe("ERROR:Conditional jump at 0x%x not supported", addr);
+                return -1;
+            }
+
+            *jmpaddr = (uintptr_t) reloc.target;
+            addr += reloc.size;
             continue;
         }
-        if(*addr == 0x0f && addr[1] >= 0x80 && addr[1] < 0x90) {
-            *relative = 1 + addr[1] - 0x80;
-            *jmpaddr = (uintptr_t) addr + *(int32_t *)(addr + 2) + 6;
-            addr += 6;
-            continue;
+
+        if((reloc.flags & CS_RELOC_REL) != 0) {
+            pipe("ERROR:Relative branch at 0x%x not supported", addr);
+            return -1;
         }
+
         if(*addr >= 0x50 && *addr < 0x58) {
             *spoff += sizeof(void *);
         }
@@ -729,11 +771,21 @@ static int _hook_copy_insns(
             return -1;
         }
 
-        uint32_t len = lde(addr);
+        memcpy(*ptr, addr, reloc.size);
+
+        if((reloc.flags & CS_RELOC_RIP) != 0) {
+            int64_t disp = (int64_t)(reloc.target -
+                ((uintptr_t) *ptr + reloc.size));
+            if(reloc.disp_size != sizeof(int32_t) || disp != (int32_t) disp) {
+                pipe("ERROR:RIP-relative operand at 0x%x out of reach "
+                    "of the stub", addr);
+                return -1;
+            }
+            *(int32_t *)(*ptr + reloc.disp_offset) = (int32_t) disp;
+        }
 
-        memcpy(*ptr, addr, len);
-        addr += len;
-        *ptr += len;
+        addr += reloc.size;
+        *ptr += reloc.size;
     }
     return addr - h->addr;
 }
@@ -744,12 +796,29 @@ static int _hook_emit_jump(uint8_t *ptr, uintptr_t jmpaddr, int relative)
         return 0;
     }
 
+#if __x86_64__
+    // The jump target may be out of the reach of a 32-bit offset from the
+    // stub, so jump to it absolutely, which a conditional jump is turned
+    // into by skipping it with the inverted condition.
+    uint8_t *base = ptr;
+    if(relative != 0) {
+        *ptr++ = 0x70 + ((relative - 1) ^ 1);
+        ptr++;
+    }
+
+    int len = asm_jump(ptr, (void *) jmpaddr);
+    if(relative != 0) {
+        base[1] = len;
+    }
+    return ptr - base + len;
+#else
     if(relative == 0) {
         return asm_jump_32bit(ptr, (void *) jmpaddr);
     }
     else {
         return asm_jump_32bit_rel(ptr, (void *) jmpaddr, relative - 1);
     }
+#endif
 }
 
 int hook_insn(hook_t *h, uint32_t signature)
@@ -848,6 +917,17 @@ int hook_hotpatch_guardpage(hook_t *h)
     ptr += asm_pop_context(ptr);
     ptr += asm_add_esp_imm(ptr, 0x1000 - spoff);
 
+    // Make sure the (possibly grown) jump and the jump back still fit in
+    // the stub before emitting them.
+    if((uintptr_t)(ptr - h->func_stub) + HOOK_EMIT_JUMP_MAXSIZE +
+            ASM_JUMP_32BIT_SIZE > slab_size(&g_function_stubs)) {
+        pipe(
+            "ERROR:The stub created for hook %z used too much space, space "
+            "should be enlarged to accommodate such usage.", h->funcname
+        );
+        return -1;
+    }
+
     ptr += _hook_emit_jump(ptr, jmpaddr, relative);
 
     ptr += asm_jump_32bit(ptr, h->addr + h->stub_used);
@@ -927,9 +1007,18 @@ HMODULE handle;
 struct hookInfo {
     void* source;
     void* destination;
+    hook_t* hook;
     struct hookInfo* next;
 };
 
+// A node only redirects execution while its hook is enabled. Disabling a
+// hook merely flips is_disabled, so a call which already got redirected
+// completes normally while later calls go straight to the original.
+static inline int _hook_active(const struct hookInfo* node)
+{
+    return node->hook == NULL || node->hook->is_disabled == 0;
+}
+
 struct hookInfo* first = NULL;
 
 LONG exceptionHandler(EXCEPTION_POINTERS* exceptionInfo) {
@@ -938,7 +1027,8 @@ LONG exceptionHandler(EXCEPTION_POINTERS* exceptionInfo) {
     if (exceptionInfo -> ExceptionRecord -> ExceptionCode == EXCEPTION_GUARD_PAGE) {
         log_debug("in first if\n");
         do {
-            if (exceptionInfo -> ExceptionRecord -> ExceptionAddress == now -> source) {
+            if (exceptionInfo -> ExceptionRecord -> ExceptionAddress == now -> source &&
+                    _hook_active(now) != 0) {
 #if __x86_64__
                 exceptionInfo -> ContextRecord -> Rip = (void*) now -> destination;
 #else
@@ -958,7 +1048,9 @@ LONG exceptionHandler(EXCEPTION_POINTERS* exceptionInfo) {
         log_debug("in second if\n");
         do {
             DWORD tmp;
-            VirtualProtect(now -> source, system_info.dwPageSize, PAGE_EXECUTE_READ | PAGE_GUARD, &tmp);
+            if (_hook_active(now) != 0) {
+                VirtualProtect(now -> source, system_info.dwPageSize, PAGE_EXECUTE_READ | PAGE_GUARD, &tmp);
+            }
             now = now -> next;
         } while (now != NULL);
         log_debug("finish add PAGE_GUARD again\n");
@@ -969,7 +1061,7 @@ LONG exceptionHandler(EXCEPTION_POINTERS* exceptionInfo) {
 }
 
 
-struct hookInfo* createNode(void* source, void* destination) {
+struct hookInfo* createNode(void* source, void* destination, hook_t* hook) {
     struct hookInfo* newNode = (struct hookInfo*)malloc(sizeof(struct hookInfo));
     if (newNode == NULL) {
         log_debug("Memory allocation failed.\n");
@@ -977,12 +1069,13 @@ struct hookInfo* createNode(void* source, void* destination) {
     }
     newNode-> source = source;
     newNode->destination = destination;
+    newNode->hook = hook;
     newNode->next = NULL;
     return newNode;
 }
 
-void appendNode(struct hookInfo** headRef, void* source, void* destination) {
-    struct hookInfo* newNode = createNode(source, destination);
+void appendNode(struct hookInfo** headRef, void* source, void* destination, hook_t* hook) {
+    struct hookInfo* newNode = createNode(source, destination, hook);
     if (*headRef == NULL) {
         *headRef = newNode;
         return;
@@ -1001,7 +1094,7 @@ void setupHandler() {
     log_debug("success to setup handler\n");
 }
 
-BOOL Hook(void* source, void* destination) {
+BOOL Hook(void* source, void* destination, hook_t* hook) {
     if (!handle) return FALSE;
 
     MEMORY_BASIC_INFORMATION source_info;
@@ -1019,7 +1112,7 @@ BOOL Hook(void* source, void* destination) {
         log_debug("fail at three\n");
         return FALSE;
     }
-    appendNode(&first, source, destination);
+    appendNode(&first, source, destination, hook);
     DWORD tmp;
     VirtualProtect(source, system_info.dwPageSize, PAGE_EXECUTE_READ | PAGE_GUARD, &tmp);
     log_debug("finish hook\n");
@@ -1038,12 +1131,150 @@ int hook(hook_t *h, void *module_handle)
         return 0;
     }
     
-    if (Hook(GetProcAddress(GetModuleHandleA(h->library), h->funcname), h->handler)) {
+    h->addr = (uint8_t *) GetProcAddress(GetModuleHandleA(h->library), h->funcname);
+    if (Hook(h->addr, h->handler, h)) {
         h -> is_hooked = 1;
         return 1;
   }
 }
 
+// Whether another enabled hook shares the page of the given node, in which
+// case the page has to remain guarded.
+static int _hook_page_shared(const struct hookInfo* node)
+{
+    uintptr_t page = (uintptr_t) node->source & ~(system_info.dwPageSize - 1);
+
+    for (const struct hookInfo* now = first; now != NULL; now = now->next) {
+        uintptr_t other = (uintptr_t) now->source & ~(system_info.dwPageSize - 1);
+        if(now != node && other == page && _hook_active(now) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int hook_set_enabled(hook_t *h, int enabled)
+{
+    if(h->is_hooked == 0 || h->special != 0) {
+        return -1;
+    }
+
+    if((h->is_disabled == 0) == (enabled != 0)) {
+        return 0;
+    }
+
+    // Flip the flag first, so that the exception handler stops redirecting
+    // before the guard is dropped, and starts redirecting only once the
+    // guard is in place again. Calls already inside the handler complete
+    // normally either way.
+    InterlockedExchange((LONG volatile *) &h->is_disabled, enabled == 0);
+
+    for (struct hookInfo* now = first; now != NULL; now = now->next) {
+        if(now->hook != h) {
+            continue;
+        }
+
+        DWORD tmp;
+        if(enabled != 0) {
+            VirtualProtect(now->source, system_info.dwPageSize,
+                PAGE_EXECUTE_READ | PAGE_GUARD, &tmp);
+        }
+        else if(_hook_page_shared(now) == 0) {
+            VirtualProtect(now->source, system_info.dwPageSize,
+                PAGE_EXECUTE_READ, &tmp);
+        }
+    }
+
+    if(enabled != 0) {
+        unhook_detect_resume(h->funcname);
+    }
+    else {
+        unhook_detect_suspend(h->funcname);
+    }
+    return 1;
+}
+
+static const char *_hook_category(const hook_t *h)
+{
+    for (uint32_t idx = sig_index_firsthookidx(); idx < sig_count(); idx++) {
+        if(strcmp(sig_apiname(idx), h->funcname) == 0) {
+            return sig_category(idx);
+        }
+    }
+    return NULL;
+}
+
+int hook_toggle(const char *apiname, const char *category, int mode,
+    int enabled)
+{
+    int count = 0;
+
+    for (hook_t *h = sig_hooks(); h->funcname != NULL; h++) {
+        if(apiname != NULL && strcmp(h->funcname, apiname) != 0) {
+            continue;
+        }
+
+        if(mode != 0 && (h->mode & mode) == 0) {
+            continue;
+        }
+
+        if(category != NULL) {
+            const char *c = _hook_category(h);
+            if(c == NULL || strcmp(c, category) != 0) {
+                continue;
+            }
+        }
+
+        if(hook_set_enabled(h, enabled) > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// HOOK <enable|disable> <apiname|category=name|mode=value>
+static void _hook_command(char *args)
+{
+    const char *apiname = NULL, *category = NULL; int mode = 0, enabled;
+    char *target = strchr(args, ' ');
+
+    if(target == NULL) {
+        pipe("WARNING:Invalid hook command: %z", args);
+        return;
+    }
+
+    *target++ = 0;
+
+    if(strcmp(args, "enable") == 0) {
+        enabled = 1;
+    }
+    else if(strcmp(args, "disable") == 0) {
+        enabled = 0;
+    }
+    else {
+        pipe("WARNING:Invalid hook command action: %z", args);
+        return;
+    }
+
+    if(strncmp(target, "category=", 9) == 0) {
+        category = target + 9;
+    }
+    else if(strncmp(target, "mode=", 5) == 0) {
+        mode = strtoul(target + 5, NULL, 0);
+        if(mode == 0) {
+            pipe("WARNING:Invalid hook command mode: %z", target + 5);
+            return;
+        }
+    }
+    else {
+        apiname = target;
+    }
+
+    int count = hook_toggle(apiname, category, mode, enabled);
+    pipe("INFO:%s %d hook(s) matching %z",
+        enabled != 0 ? "Enabled" : "Disabled", count, target);
+}
+
 uint8_t *hook_get_mem()
 {
     return slab_getmem(&g_function_stubs);
@@ -1067,6 +1298,12 @@ static void _hook_missing_hooks_worker(
     }
 
     uint8_t *handler = slab_getmem(&g_function_stubs);
+    if(handler == NULL) {
+        pipe("WARNING:Error allocating the handler of missing hook %z",
+            funcname);
+        return;
+    }
+
     uint8_t *ptr = handler;
 
     hook_t h;
@@ -1083,6 +1320,7 @@ static void _hook_missing_hooks_worker(
         log_debug("Welcome missing hook: %s\n", funcname);
     }
     else {
+        slab_free(&g_function_stubs, handler);
         log_debug("Error hooking missing hook: %s\n", funcname);
     }
 }
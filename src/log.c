@@ -22,48 +22,264 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdarg.h>
 #include <windows.h>
 #include "bson.h"
+#include "filter.h"
 #include "hooking.h"
 #include "memory.h"
 #include "misc.h"
 #include "native.h"
 #include "ntapi.h"
 #include "log.h"
+#include "lz.h"
+#include "packed.h"
 #include "pipe.h"
+#include "ring.h"
+#include "sha1.h"
 #include "symbol.h"
 #include "utf8.h"
 
 // Maximum length of a buffer so we try to avoid polluting logs with garbage.
 #define BUFFER_LOG_MAX 4096
+
+// Non-truncated buffers larger than this are streamed as a series of
+// "bufchunk" documents of at most this size, so that the monitor never
+// holds more than one chunk of such a buffer in memory.
+#define BUFFER_CHUNK_SIZE 0x10000
 #define EXCEPTION_MAXCOUNT 0x10000
 
+// Default and maximum number of distinct exception sites which are
+// tracked, the number of return addresses which, along with the exception
+// code and address, identify a site, and the interval in milliseconds
+// between summaries of the exceptions which have not been logged in detail.
+#define EXCEPTION_SITES_MAX (1 << 20)
+#define EXCEPTION_FRAMES 4
+#define EXCEPTION_INTERVAL 5000
+
+// Size of the batches in which the log is compressed, and the interval in
+// milliseconds at which the flusher thread picks them up.
+#define LOG_BATCH_SIZE (256*1024)
+#define LOG_FLUSH_INTERVAL 10
+
+// Range of lengths, in characters, of strings which are worth interning.
+#define LOG_STRING_MIN 8
+#define LOG_STRING_MAX 512
+
+// Default interval in milliseconds after which a run of repeated calls is
+// reported even if it hasn't ended yet, and the largest record which is
+// considered for collapsing.
+#define LOG_COLLAPSE_WINDOW 1000
+#define LOG_COLLAPSE_MAX 1024
+
+// Default interval in milliseconds between rate limiting summaries.
+#define LOG_RATE_INTERVAL 5000
+
+// Default size of the shared-memory ring, and the time in milliseconds the
+// reader may hold up a full ring before we fall back to the log pipe.
+#define LOG_RING_SIZE (RING_SIZE(4*1024*1024))
+#define LOG_RING_STALL 5000
+
+// Number of module paths remembered as having been sent to the host.
+#define LOG_MODULE_MAX 1024
+
 static CRITICAL_SECTION g_mutex;
 static uint32_t g_starttick;
 static uint8_t *g_api_init;
 
+static int g_log_format;
+
+// Where stack traces are symbolized, and whether calls carry them at all.
+static int g_log_symbols;
+static int g_log_stacktrace = DEBUG;
+
+// Hashes of the module paths which have been sent along with a "module"
+// document. Only accessed while holding g_mutex.
+static uint32_t g_module_hashes[LOG_MODULE_MAX];
+static uint32_t g_module_count;
+
+// Timestamp and thread identifier of the last packed record, against which
+// the next one is delta-encoded. Only accessed while holding g_mutex.
+static uint32_t g_packed_tick;
+static uint32_t g_packed_tid;
+
+static int g_log_compress;
+static char g_log_header[64];
+
+// With compression enabled, log_raw() merely appends to the current batch.
+// The flusher thread swaps it with the spare one, compresses it, and writes
+// it to the log pipe. Hooked threads only ever hold g_batch_mutex for the
+// duration of a memcpy, unless the batch is full, in which case they wait
+// for the flusher much like they'd otherwise wait for the pipe.
+static CRITICAL_SECTION g_batch_mutex;
+static CRITICAL_SECTION g_flush_mutex;
+static uint8_t *g_batch, *g_batch_spare;
+static uint32_t g_batch_length;
+static uint8_t *g_frame;
+static lz_table_t *g_lz_table;
+
+// String dictionary, see packed.h. The table is two-way set associative
+// with least recently used replacement, and keyed by the hash of the raw
+// ANSI or UTF-16 bytes so that repeated strings aren't even transcoded.
+// Identifiers are never reused, so an evicted string simply gets defined
+// again under a new identifier. Only accessed while holding g_mutex.
+typedef struct _logstr_t {
+    uint64_t hash;
+    uint32_t id;
+    uint32_t size;
+    uint32_t wide;
+    uint32_t used;
+    uint8_t *raw;
+} logstr_t;
+
+static logstr_t *g_strings;
+static uint32_t g_string_sets;
+static uint32_t g_string_id;
+static uint32_t g_string_clock;
+
+// Digests of the non-truncated buffers which have been sent, so that
+// repeated contents are only referenced through a "bufref" document. The
+// table is set associative like the string dictionary, and keyed by a fast
+// 64-bit hash of the contents plus their length, so that a repeated buffer
+// is referenced without a SHA-1 pass. The SHA-1 is only computed for new
+// contents, and an entry is only remembered if the contents it was computed
+// over are the ones that were hashed. Only accessed while holding g_mutex.
+typedef struct _logbuf_t {
+    uint64_t hash;
+    uint64_t length;
+    uint32_t used;
+    char checksum[44];
+} logbuf_t;
+
+static logbuf_t *g_buffers;
+static uint32_t g_buffer_sets;
+static uint32_t g_buffer_clock;
+
+// Identifier of the last buffer stream, see _log_buffer_stream().
+static LONG g_buffer_stream;
+
+// Run of identical calls made by a thread. The first call of a run is
+// logged as usual, the calls repeating it are merely counted and reported
+// through a single "repeat" document once the run ends or the window
+// closes. Identical means the same API index and the same record apart
+// from the thread identifier and timestamp, i.e., the same call hash,
+// result and arguments. The run of a thread is reported and released as
+// the thread exits. Only accessed while holding g_mutex.
+typedef struct _logrun_t {
+    struct _logrun_t *next;
+    uint32_t tid;
+    uint32_t index;
+    uint64_t hash;
+    uint32_t count;
+    uint32_t first;
+    uint32_t last;
+    uint32_t size;
+    uint8_t body[LOG_COLLAPSE_MAX];
+} logrun_t;
+
+static uint8_t *g_collapse;
+static uint32_t g_collapse_window;
+static uint32_t g_collapse_sweep;
+static uint32_t g_run_tls;
+static logrun_t *g_runs;
+
+// Per-API token bucket and sampling state, see log_admit(). Tokens are
+// kept in thousandths, so that a rate of N calls per second refills N
+// thousandths per millisecond. Only accessed while holding g_mutex.
+typedef struct _lograte_t {
+    uint64_t tokens;
+    uint32_t refill;
+    uint32_t skipped;
+    uint64_t calls;
+    uint64_t dropped;
+} lograte_t;
+
+static lograte_t *g_rates;
+static uint64_t g_rate_step;
+static uint64_t g_rate_burst;
+static uint32_t g_rate_sample;
+static uint32_t g_rate_interval;
+static uint32_t g_rate_summary;
+static int g_rate_dirty;
+
+// Sites at which exceptions have been raised. Only the first exception of
+// each site is logged in detail, the others are merely counted and
+// summarized every g_exc_interval milliseconds. Once the table is full,
+// exceptions at new sites are counted in g_exc_other. Sites are numbered in
+// the order in which they're seen, and reported holds the count as of the
+// last summary. Only accessed while holding g_mutex.
+typedef struct _logexc_t {
+    uint32_t code;
+    uintptr_t address;
+    uintptr_t frames[EXCEPTION_FRAMES];
+    uint64_t count;
+    uint64_t reported;
+    uint32_t logged;
+    uint32_t id;
+} logexc_t;
+
+static logexc_t *g_exc_sites;
+static uint32_t g_exc_mask;
+static uint32_t g_exc_used;
+static uint32_t g_exc_capacity;
+static uint64_t g_exc_other;
+static uint64_t g_exc_count;
+static uint32_t g_exc_limit = EXCEPTION_MAXCOUNT;
+static int g_exc_policy;
+static int g_exc_limited;
+static uint32_t g_exc_interval;
+static uint32_t g_exc_summary;
+static int g_exc_dirty;
+
+// Serialization target of log_api(), either a BSON document or a packed
+// record, depending on the log format.
+typedef struct _logenc_t {
+    bson *b;
+    packed_t *p;
+
+    // Prefix packed values with their type, used for registry values.
+    int typed;
+} logenc_t;
+
 static wchar_t g_log_pipename[MAX_PATH];
 static HANDLE g_log_handle;
 
+// With the ring transport the log is written to the ring instead of the log
+// pipe, until the reader stalls, after which it continues on the pipe.
+static ring_t g_ring;
+static int g_ring_active;
+
 #if DEBUG
 static wchar_t g_debug_filepath[MAX_PATH];
 static HANDLE g_debug_handle;
 #endif
 
-static void log_raw(const char *buf, size_t length);
+static void _log_write(const char *buf, size_t length);
+static void _log_rate_summary(uint32_t tick);
+static void _log_exception_summary(uint32_t tick);
 
 static int open_handles()
 {
-    do {
+    while (g_ring_active == 0) {
         // TODO Use NtCreateFile instead of CreateFileW.
         g_log_handle = CreateFileW(g_log_pipename, GENERIC_WRITE,
             FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
             FILE_FLAG_WRITE_THROUGH, NULL);
 
         sleep(50);
-    } while (g_log_handle == INVALID_HANDLE_VALUE);
+
+        if(g_log_handle != INVALID_HANDLE_VALUE) {
+            break;
+        }
+    }
 
     // The process identifier.
     uint32_t process_identifier = get_current_process_id();
-    log_raw((const char *) &process_identifier, sizeof(process_identifier));
+    _log_write((const char *) &process_identifier,
+        sizeof(process_identifier));
+
+    // Each connection has to announce the compression as the frames that
+    // follow can't be interpreted otherwise.
+    if(g_log_compress != 0) {
+        _log_write(g_log_header, strlen(g_log_header));
+    }
 
 #if DEBUG
     g_debug_handle = CreateFileW(g_debug_filepath,
@@ -73,9 +289,59 @@ static int open_handles()
     return 0;
 }
 
-static void log_raw(const char *buf, size_t length)
+// Returns -1 if the reader didn't make any progress for LOG_RING_STALL
+// milliseconds while the ring was full.
+static int _log_ring_write(const char *buf, size_t length)
 {
-    EnterCriticalSection(&g_mutex);
+    uint32_t tail = ring_tail(&g_ring), idle = 0;
+
+    while (length != 0) {
+        uint32_t written = ring_write(&g_ring, buf, length);
+        if(written != 0) {
+            length -= written, buf += written, idle = 0;
+            continue;
+        }
+
+        if(ring_tail(&g_ring) != tail) {
+            tail = ring_tail(&g_ring), idle = 0;
+        }
+        else if(idle >= LOG_RING_STALL) {
+            return -1;
+        }
+
+        sleep(1), idle++;
+    }
+    return 0;
+}
+
+// Give up on the ring and continue on the log pipe. The pipe end sees a new
+// connection, so it's sent the process identifier and header again.
+static void _log_ring_fallback()
+{
+    ring_close(&g_ring, RING_STATE_DETACHED);
+    g_ring_active = 0;
+
+    pipe("WARNING:Log ring reader stalled, falling back to the log pipe.");
+
+    open_handles();
+    if(g_log_compress == 0) {
+        _log_write(g_log_header, strlen(g_log_header));
+    }
+}
+
+static void _log_write(const char *buf, size_t length)
+{
+    const char *start = buf; size_t total = length;
+
+    // A record that didn't entirely make it into the ring is resent as a
+    // whole on the pipe.
+    if(g_ring_active != 0) {
+        if(_log_ring_write(buf, length) == 0) {
+            return;
+        }
+
+        _log_ring_fallback();
+    }
 
     while (length != 0) {
         uint32_t written = 0; uint32_t status;
@@ -89,6 +355,13 @@ static void log_raw(const char *buf, size_t length)
                 if(open_handles() < 0) {
                     break;
                 }
+
+                // Compressed frames can't be resumed halfway on the new
+                // connection, so start over with the current frame.
+                if(g_log_compress != 0) {
+                    buf = start, length = total;
+                    continue;
+                }
             }
             else {
                 pipe("CRITICAL:Handle case where the log handle is closed "
@@ -99,10 +372,120 @@ static void log_raw(const char *buf, size_t length)
 
         length -= written, buf += written;
     }
+}
+
+// Append to the current batch, waiting for the flusher thread if the batch
+// is full. As g_mutex is held throughout, the data of one caller always
+// ends up contiguously in the stream.
+static void _log_batch(const char *buf, size_t length)
+{
+    EnterCriticalSection(&g_mutex);
+
+    while (length != 0) {
+        EnterCriticalSection(&g_batch_mutex);
+
+        uint32_t size = MIN(length, LOG_BATCH_SIZE - g_batch_length);
+        memcpy(g_batch + g_batch_length, buf, size);
+        g_batch_length += size;
+
+        LeaveCriticalSection(&g_batch_mutex);
+
+        length -= size, buf += size;
+        if(length != 0) {
+            sleep(1);
+        }
+    }
 
     LeaveCriticalSection(&g_mutex);
 }
 
+static void log_raw(const char *buf, size_t length)
+{
+    if(g_log_compress != 0) {
+        _log_batch(buf, length);
+        return;
+    }
+
+    EnterCriticalSection(&g_mutex);
+    _log_write(buf, length);
+    LeaveCriticalSection(&g_mutex);
+}
+
+// Compress and write the current batch. Returns the amount of bytes which
+// had been batched.
+static uint32_t _log_flush()
+{
+    EnterCriticalSection(&g_flush_mutex);
+
+    EnterCriticalSection(&g_batch_mutex);
+    uint8_t *batch = g_batch; uint32_t length = g_batch_length;
+    g_batch = g_batch_spare, g_batch_spare = batch, g_batch_length = 0;
+    LeaveCriticalSection(&g_batch_mutex);
+
+    for (uint32_t offset = 0; offset < length; offset += LZ_BLOCK_MAX) {
+        uint32_t size = MIN(length - offset, LZ_BLOCK_MAX);
+        size = lz_frame(batch + offset, size, g_frame, g_lz_table);
+        _log_write((const char *) g_frame, size);
+    }
+
+    LeaveCriticalSection(&g_flush_mutex);
+    return length;
+}
+
+static DWORD WINAPI _log_flush_thread(LPVOID param)
+{
+    (void) param;
+
+    while (1) {
+        // Keep going while there's a backlog.
+        if(_log_flush() < LOG_BATCH_SIZE / 2) {
+            sleep(LOG_FLUSH_INTERVAL);
+        }
+    }
+    return 0;
+}
+
+void log_flush()
+{
+    if(g_rates != NULL || g_exc_sites != NULL) {
+        EnterCriticalSection(&g_mutex);
+        if(g_rate_dirty != 0) {
+            _log_rate_summary(get_tick_count() - g_starttick);
+        }
+        if(g_exc_dirty != 0) {
+            _log_exception_summary(get_tick_count() - g_starttick);
+        }
+        LeaveCriticalSection(&g_mutex);
+    }
+
+    if(g_log_compress != 0) {
+        _log_flush();
+    }
+}
+
+static int _log_compress_init()
+{
+    InitializeCriticalSection(&g_batch_mutex);
+    InitializeCriticalSection(&g_flush_mutex);
+
+    g_batch = virtual_alloc_rw(NULL, LOG_BATCH_SIZE);
+    g_batch_spare = virtual_alloc_rw(NULL, LOG_BATCH_SIZE);
+    g_frame = virtual_alloc_rw(NULL, LZ_FRAME_BOUND(LZ_BLOCK_MAX));
+    g_lz_table = virtual_alloc_rw(NULL, sizeof(lz_table_t));
+
+    if(g_batch == NULL || g_batch_spare == NULL || g_frame == NULL ||
+            g_lz_table == NULL) {
+        pipe("CRITICAL:Error allocating memory for log compression!");
+        return -1;
+    }
+
+    if(CreateThread(NULL, 0, &_log_flush_thread, NULL, 0, NULL) == NULL) {
+        pipe("CRITICAL:Error creating log flusher thread!");
+        return -1;
+    }
+    return 0;
+}
+
 static void log_int32(bson *b, const char *idx, int value)
 {
     bson_append_int(b, idx, value);
@@ -214,151 +597,944 @@ static void log_buffer(bson *b, const char *idx,
     }
 }
 
-static void log_buffer_notrunc(const uint8_t *buf, uintptr_t length)
+// Write a BSON document to the log. In packed mode each BSON document is
+// tagged as such, see packed.h.
+static void _log_bson(const bson *b)
+{
+    EnterCriticalSection(&g_mutex);
+
+    if(g_log_format == LOG_FORMAT_PACKED) {
+        uint8_t tag = PACKED_TAG_BSON;
+        log_raw((const char *) &tag, sizeof(tag));
+    }
+
+    log_raw(bson_data(b), bson_size(b));
+
+    LeaveCriticalSection(&g_mutex);
+}
+
+static void _packed_string(logenc_t *e, const char *str,
+    uint32_t length, int is_binary)
+{
+    if(e->typed != 0) {
+        packed_byte(e->p, PACKED_TYPE_STRING);
+    }
+    packed_string(e->p, str, length, is_binary);
+}
+
+static void _packed_utf8(logenc_t *e, char *utf8s)
+{
+    if(utf8s != NULL) {
+        _packed_string(e, utf8s+4, *(int *) utf8s, 0);
+        mem_free(utf8s);
+    }
+    else {
+        _packed_string(e, "<INVALID POINTER>", 17, 1);
+    }
+}
+
+// Look up a string in the dictionary, adding it if it's not there yet.
+// Returns its identifier, or 0 if the string isn't interned.
+static uint32_t _log_intern(const void *str, uint32_t length, int wide)
+{
+    uint8_t buf[LOG_STRING_MAX * sizeof(wchar_t)];
+    uint32_t size = wide != 0 ? length * sizeof(wchar_t) : length;
+
+    if(g_string_sets == 0 || length < LOG_STRING_MIN ||
+            length > LOG_STRING_MAX || copy_bytes(buf, str, size) != 0) {
+        return 0;
+    }
+
+    uint64_t hash = hash_buffer(buf, size);
+
+    EnterCriticalSection(&g_mutex);
+
+    logstr_t *set = &g_strings[2 * (hash % g_string_sets)], *s = NULL;
+    for (uint32_t way = 0; way < 2; way++) {
+        if(set[way].id != 0 && set[way].hash == hash &&
+                set[way].size == size && set[way].wide == (uint32_t) wide &&
+                memcmp(set[way].raw, buf, size) == 0) {
+            s = &set[way];
+            break;
+        }
+    }
+
+    if(s == NULL) {
+        s = set[0].used <= set[1].used ? &set[0] : &set[1];
+
+        if(s->raw != NULL) {
+            mem_free(s->raw);
+        }
+
+        s->raw = mem_alloc(size);
+        if(s->raw == NULL) {
+            s->id = 0;
+            LeaveCriticalSection(&g_mutex);
+            return 0;
+        }
+
+        memcpy(s->raw, buf, size);
+        s->hash = hash, s->size = size, s->wide = wide;
+        s->id = ++g_string_id;
+
+        // The definition has to be written before any record can
+        // reference it, hence while still holding g_mutex.
+        bson b;
+        bson_init_size(&b, mem_suggested_size(size + 64));
+        bson_append_string(&b, "type", "string");
+        bson_append_int(&b, "i", s->id);
+        if(wide != 0) {
+            log_wstring(&b, "s", (const wchar_t *) buf, length);
+        }
+        else {
+            log_string(&b, "s", (const char *) buf, length);
+        }
+        bson_finish(&b);
+        _log_bson(&b);
+        bson_destroy(&b);
+    }
+
+    s->used = ++g_string_clock;
+    uint32_t id = s->id;
+
+    LeaveCriticalSection(&g_mutex);
+    return id;
+}
+
+// Log a reference to an interned string.
+static void _enc_stringref(logenc_t *e, const char *idx, uint32_t id)
+{
+    if(e->b != NULL) {
+        bson_append_binary(e->b, idx, PACKED_BSON_STRINGREF,
+            (const char *) &id, sizeof(id));
+    }
+    else {
+        packed_stringref(e->p, id);
+    }
+}
+
+static void _enc_int32(logenc_t *e, const char *idx, int value)
+{
+    if(e->b != NULL) {
+        log_int32(e->b, idx, value);
+        return;
+    }
+
+    if(e->typed != 0) {
+        packed_byte(e->p, PACKED_TYPE_INT32);
+    }
+    packed_svarint(e->p, value);
+}
+
+static void _enc_int64(logenc_t *e, const char *idx, int64_t value)
+{
+    if(e->b != NULL) {
+        log_int64(e->b, idx, value);
+        return;
+    }
+
+    if(e->typed != 0) {
+        packed_byte(e->p, PACKED_TYPE_INT64);
+    }
+    packed_svarint(e->p, value);
+}
+
+static void _enc_intptr(logenc_t *e, const char *idx, intptr_t value)
+{
+    if(e->b != NULL) {
+        log_intptr(e->b, idx, value);
+        return;
+    }
+
+    packed_svarint(e->p, value);
+}
+
+static void _enc_string(logenc_t *e, const char *idx,
+    const char *str, int length)
+{
+    uint32_t id = 0;
+    if(e->typed == 0 && idx != NULL && str != NULL) {
+        id = _log_intern(str, length, 0);
+    }
+
+    if(id != 0) {
+        _enc_stringref(e, idx, id);
+    }
+    else if(e->b != NULL) {
+        log_string(e->b, idx, str, length);
+    }
+    else if(str == NULL || length == 0) {
+        _packed_string(e, "", 0, 0);
+    }
+    else {
+        _packed_utf8(e, copy_utf8_string(str, length));
+    }
+}
+
+static void _enc_wstring(logenc_t *e, const char *idx,
+    const wchar_t *str, int length)
+{
+    uint32_t id = 0;
+    if(e->typed == 0 && idx != NULL && str != NULL) {
+        id = _log_intern(str, length, 1);
+    }
+
+    if(id != 0) {
+        _enc_stringref(e, idx, id);
+    }
+    else if(e->b != NULL) {
+        log_wstring(e->b, idx, str, length);
+    }
+    else if(str == NULL || length == 0) {
+        _packed_string(e, "", 0, 0);
+    }
+    else {
+        _packed_utf8(e, copy_utf8_wstring(str, length));
+    }
+}
+
+static void _enc_buffer(logenc_t *e, const char *idx,
+    const uint8_t *buf, uintptr_t length)
+{
+    if(e->b != NULL) {
+        log_buffer(e->b, idx, buf, length);
+        return;
+    }
+
+    uintptr_t trunclength = length < BUFFER_LOG_MAX ? length : BUFFER_LOG_MAX;
+
+    if(buf == NULL) {
+        trunclength = 0;
+    }
+
+    if(e->typed != 0) {
+        packed_byte(e->p, PACKED_TYPE_BINARY);
+    }
+
+    if(range_is_readable(buf, length) != 0) {
+        packed_blob(e->p, buf, trunclength);
+    }
+    else {
+        packed_blob(e->p, "<INVALID POINTER>", 17);
+    }
+}
+
+static void _enc_argv(logenc_t *e, const char *idx,
+    int argc, const char **argv)
+{
+    if(e->b != NULL) {
+        log_argv(e->b, idx, argc, argv);
+        return;
+    }
+
+    // Only the readable entries are logged, each with its index.
+    uint32_t count = 0;
+    for (int i = 0; i < argc; i++) {
+        count += copy_ptr(&argv[i]) != NULL;
+    }
+
+    packed_varint(e->p, count);
+    for (int i = 0; i < argc && count != 0; i++) {
+        char *value = copy_ptr(&argv[i]);
+        if(value != NULL) {
+            packed_varint(e->p, i);
+            _enc_string(e, NULL, value, copy_strlen(value));
+            count--;
+        }
+    }
+}
+
+static void _enc_wargv(logenc_t *e, const char *idx,
+    int argc, const wchar_t **argv)
+{
+    if(e->b != NULL) {
+        log_wargv(e->b, idx, argc, argv);
+        return;
+    }
+
+    uint32_t count = 0;
+    for (int i = 0; i < argc; i++) {
+        count += copy_ptr(&argv[i]) != NULL;
+    }
+
+    packed_varint(e->p, count);
+    for (int i = 0; i < argc && count != 0; i++) {
+        wchar_t *value = copy_ptr(&argv[i]);
+        if(value != NULL) {
+            packed_varint(e->p, i);
+            _enc_wstring(e, NULL, value, copy_strlenW(value));
+            count--;
+        }
+    }
+}
+
+// Embedded BSON object or array, or null.
+static void _enc_element(logenc_t *e, const char *idx, const bson *value)
+{
+    bson_iterator i;
+
+    if(value != NULL) {
+        bson_iterator_init(&i, value);
+        bson_iterator_next(&i);
+    }
+
+    if(e->b != NULL) {
+        if(value == NULL) {
+            bson_append_null(e->b, idx);
+        }
+        else {
+            bson_append_element(e->b, idx, &i);
+        }
+        return;
+    }
+
+    if(value == NULL) {
+        packed_byte(e->p, BSON_NULL);
+        return;
+    }
+
+    const char *data = bson_iterator_value(&i);
+    packed_byte(e->p, bson_iterator_type(&i));
+    packed_bytes(e->p, data, *(const int32_t *) data);
+}
+
+// Remember the checksum of a buffer which has just been logged. Requires
+// g_mutex to be held.
+static void _log_buffer_remember(logbuf_t *set, uint64_t hash,
+    uintptr_t length, const char *checksum)
+{
+    logbuf_t *entry = set[0].used <= set[1].used ? &set[0] : &set[1];
+    entry->hash = hash, entry->length = length;
+    entry->used = ++g_buffer_clock;
+    strcpy(entry->checksum, checksum);
+}
+
+// Write the header of a "bufchunk" document, i.e., everything up to the
+// contents of its "data" field, which directly follow it. Returns the
+// length of the header.
+static uint32_t _log_bufchunk_header(uint8_t *out, uint32_t stream,
+    uint64_t offset, uint32_t length)
+{
+    uint8_t *ptr = out + 4; int32_t value = 9;
+
+    *ptr++ = BSON_STRING;
+    memcpy(ptr, "type", 5), ptr += 5;
+    memcpy(ptr, &value, 4), ptr += 4;
+    memcpy(ptr, "bufchunk", 9), ptr += 9;
+
+    *ptr++ = BSON_INT;
+    memcpy(ptr, "stream", 7), ptr += 7;
+    memcpy(ptr, &stream, 4), ptr += 4;
+
+    *ptr++ = BSON_LONG;
+    memcpy(ptr, "offset", 7), ptr += 7;
+    memcpy(ptr, &offset, 8), ptr += 8;
+
+    *ptr++ = BSON_BINDATA;
+    memcpy(ptr, "data", 5), ptr += 5;
+    memcpy(ptr, &length, 4), ptr += 4;
+    *ptr++ = BSON_BIN_BINARY;
+
+    value = (ptr - out) + length + 1;
+    memcpy(out, &value, 4);
+    return ptr - out;
+}
+
+// Stream a large buffer as "bufchunk" documents which share a stream
+// identifier, followed by a "bufend" document with the total size and the
+// checksum. Each chunk is copied straight from the buffer into the
+// document through copy_bytes(), so the buffer may go away halfway, in
+// which case the checksum is "???" and the size is the amount of bytes
+// which made it. Chunks of other threads may be interleaved.
+static void _log_buffer_stream(const uint8_t *buf, uintptr_t length,
+    logbuf_t *set, uint64_t hash)
+{
+    uint8_t *chunk = mem_alloc(1 + 64 + BUFFER_CHUNK_SIZE);
+    if(chunk == NULL) {
+        pipe("CRITICAL:Error allocating memory for buffer chunk!");
+        return;
+    }
+
+    uint32_t stream = InterlockedIncrement(&g_buffer_stream);
+    uint32_t tagged = g_log_format == LOG_FORMAT_PACKED;
+    uintptr_t offset = 0; sha1_t ctx;
+
+    chunk[0] = PACKED_TAG_BSON;
+    sha1_init(&ctx);
+
+    while (offset < length) {
+        uint32_t size = MIN(length - offset, BUFFER_CHUNK_SIZE);
+        uint32_t header = _log_bufchunk_header(&chunk[1], stream,
+            offset, size);
+
+        uint8_t *data = &chunk[1 + header];
+        if(copy_bytes(data, buf + offset, size) < 0) {
+            break;
+        }
+        data[size] = 0;
+
+        sha1_update(&ctx, data, size);
+        log_raw((const char *) &chunk[1 - tagged], tagged + header + size + 1);
+        offset += size;
+    }
+
+    mem_free(chunk);
+
+    // The buffer may have been modified while it was being streamed, in
+    // which case the checksum doesn't belong to the hashed contents.
+    if(set != NULL && offset == length &&
+            (range_is_readable(buf, length) == 0 ||
+             hash_block(buf, length) != hash)) {
+        set = NULL;
+    }
+
+    char checksum[64]; uint8_t digest[SHA1_DIGEST_SIZE]; bson b;
+
+    sha1_final(&ctx, digest);
+    hexencode(checksum, digest, sizeof(digest));
+
+    bson_init(&b);
+    bson_append_string(&b, "type", "bufend");
+    bson_append_int(&b, "stream", stream);
+    bson_append_long(&b, "size", offset);
+    bson_append_string(&b, "checksum", offset == length ? checksum : "???");
+    bson_finish(&b);
+
+    EnterCriticalSection(&g_mutex);
+    _log_bson(&b);
+
+    if(set != NULL && offset == length) {
+        _log_buffer_remember(set, hash, length, checksum);
+    }
+
+    LeaveCriticalSection(&g_mutex);
+    bson_destroy(&b);
+}
+
+static void log_buffer_notrunc(const uint8_t *buf, uintptr_t length)
+{
+    if(buf == NULL || length == 0) {
+        return;
+    }
+
+    uint64_t hash = 0; logbuf_t *set = NULL;
+    char checksum[64]; bson b;
+
+    int readable = range_is_readable(buf, length);
+
+    if(readable != 0 && g_buffer_sets != 0) {
+        hash = hash_block(buf, length);
+        set = &g_buffers[2 * (hash % g_buffer_sets)];
+
+        EnterCriticalSection(&g_mutex);
+
+        for (uint32_t way = 0; way < 2; way++) {
+            if(set[way].used != 0 && set[way].hash == hash &&
+                    set[way].length == length) {
+                set[way].used = ++g_buffer_clock;
+
+                bson_init(&b);
+                bson_append_string(&b, "type", "bufref");
+                bson_append_string(&b, "checksum", set[way].checksum);
+                bson_append_long(&b, "size", length);
+                bson_finish(&b);
+
+                _log_bson(&b);
+
+                LeaveCriticalSection(&g_mutex);
+                bson_destroy(&b);
+                return;
+            }
+        }
+
+        LeaveCriticalSection(&g_mutex);
+    }
+
+    if(readable != 0 && length > BUFFER_CHUNK_SIZE) {
+        _log_buffer_stream(buf, length, set, hash);
+        return;
+    }
+
+    bson_init(&b);
+    bson_append_string(&b, "type", "buffer");
+
+    if(readable != 0) {
+        // Checksum the copy in the document rather than the buffer, which
+        // another thread may have modified since. Only remember it if the
+        // copy still has the contents that were hashed.
+        if(bson_append_binary(&b, "buffer", BSON_BIN_BINARY,
+                (const char *) buf, length) == BSON_OK) {
+            sha1(b.cur - length, length, checksum);
+            if(set != NULL && hash_block(b.cur - length, length) != hash) {
+                set = NULL;
+            }
+        }
+        else {
+            strcpy(checksum, "???"), set = NULL;
+        }
+        bson_append_string(&b, "checksum", checksum);
+    }
+    else {
+        bson_append_string(&b, "buffer", "<INVALID POINTER>");
+        bson_append_string(&b, "checksum", "???");
+    }
+
+    bson_finish(&b);
+
+    // Only remember the contents once they're in the log, as references
+    // may follow right away.
+    EnterCriticalSection(&g_mutex);
+    _log_bson(&b);
+
+    if(set != NULL) {
+        _log_buffer_remember(set, hash, length, checksum);
+    }
+
+    LeaveCriticalSection(&g_mutex);
+    bson_destroy(&b);
+}
+
+// Copy the precompiled explain document of an API into out, if not NULL,
+// and return its length. In packed mode it's tagged as BSON document and
+// the parameter types are appended, as the packed records are decoded
+// using them.
+static uint32_t _log_explain_copy(uint32_t index, uint8_t *out)
+{
+    uint32_t length; const uint8_t *blob = sig_explain(index, &length);
+
+    if(g_log_format != LOG_FORMAT_PACKED) {
+        if(out != NULL) {
+            memcpy(out, blob, length);
+        }
+        return length;
+    }
+
+    const char *fmt = sig_paramtypes(index);
+    uint32_t fmtlen = strlen(fmt) + 1, size = length + 9 + fmtlen;
+
+    if(out != NULL) {
+        *out++ = PACKED_TAG_BSON;
+        memcpy(out, &size, sizeof(size));
+        memcpy(out + 4, blob + 4, length - 5);
+        out += length - 1;
+
+        *out++ = BSON_STRING;
+        memcpy(out, "fmt", 4), out += 4;
+        memcpy(out, &fmtlen, sizeof(fmtlen)), out += 4;
+        memcpy(out, fmt, fmtlen), out += fmtlen;
+        *out = 0;
+    }
+    return 1 + size;
+}
+
+void log_explain(uint32_t index)
+{
+    uint32_t length; const uint8_t *blob = sig_explain(index, &length);
+
+    if(g_log_format != LOG_FORMAT_PACKED) {
+        log_raw((const char *) blob, length);
+        return;
+    }
+
+    length = _log_explain_copy(index, NULL);
+
+    uint8_t *buf = mem_alloc(length);
+    if(buf != NULL) {
+        _log_explain_copy(index, buf);
+        log_raw((const char *) buf, length);
+        mem_free(buf);
+    }
+}
+
+void log_explain_all()
+{
+    uint32_t length = 0;
+
+    EnterCriticalSection(&g_mutex);
+
+    for (uint32_t idx = 0; idx < sig_count(); idx++) {
+        if(g_api_init[idx] == 0) {
+            length += _log_explain_copy(idx, NULL);
+        }
+    }
+
+    // All at once, so that the log sees a single write.
+    uint8_t *buf = virtual_alloc_rw(NULL, length), *ptr = buf;
+    if(buf != NULL) {
+        for (uint32_t idx = 0; idx < sig_count(); idx++) {
+            if(g_api_init[idx] == 0) {
+                ptr += _log_explain_copy(idx, ptr);
+                g_api_init[idx] = 1;
+            }
+        }
+
+        log_raw((const char *) buf, length);
+        virtual_free(buf, 0, MEM_RELEASE);
+    }
+
+    LeaveCriticalSection(&g_mutex);
+}
+
+static void _log_stacktrace(logenc_t *e)
+{
+    uintptr_t addrs[RETADDRCNT], count;
+    char number[20], sym[512];
+
+    count = stacktrace(NULL, addrs, RETADDRCNT);
+
+    if(e->b != NULL) {
+        bson_append_start_array(e->b, "s");
+    }
+    else {
+        packed_varint(e->p, count > 4 ? count - 4 : 0);
+    }
+
+    for (uint32_t idx = 4; idx < count; idx++) {
+        ultostr(idx-4, number, 10);
+
+        sym[0] = 0;
+        if(g_log_symbols != LOG_SYMBOLS_HOST) {
+            symbol((const uint8_t *) addrs[idx], sym, sizeof(sym)-32);
+        }
+
+        if(sym[0] != 0) {
+            our_snprintf(sym + our_strlen(sym),
+                sizeof(sym) - our_strlen(sym), " @ ");
+        }
+
+        our_snprintf(sym + our_strlen(sym), sizeof(sym) - our_strlen(sym),
+            "%p", (const uint8_t *) addrs[idx]);
+
+        if(e->b != NULL) {
+            bson_append_string(e->b, number, sym);
+        }
+        else {
+            packed_string(e->p, sym, our_strlen(sym), 0);
+        }
+    }
+
+    if(e->b != NULL) {
+        bson_append_finish_array(e->b);
+    }
+}
+
+// FNV-1a hash of the lowercased path, which identifies a module file.
+static uint32_t _log_path_hash(const wchar_t *path, uint32_t length)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    for (uint32_t idx = 0; idx < length; idx++) {
+        wchar_t ch = path[idx];
+        if(ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+
+        hash = (hash ^ (ch & 0xff)) * 0x01000193;
+        hash = (hash ^ (ch >> 8)) * 0x01000193;
+    }
+    return hash;
+}
+
+void log_module(const void *base, const wchar_t *path, uint32_t length)
+{
+    if(g_log_symbols != LOG_SYMBOLS_HOST || base == NULL) {
+        return;
+    }
+
+    uint32_t hash = _log_path_hash(path, length), idx;
+
+    bson b;
+    bson_init_size(&b, mem_suggested_size(3 * length + 128));
+    bson_append_string(&b, "type", "module");
+    bson_append_long(&b, "base", (uintptr_t) base);
+    bson_append_int(&b, "size", module_image_size(base));
+    bson_append_int(&b, "hash", hash);
+    bson_append_int(&b, "timestamp", module_timestamp(base));
+
+    EnterCriticalSection(&g_mutex);
+
+    for (idx = 0; idx < g_module_count; idx++) {
+        if(g_module_hashes[idx] == hash) {
+            break;
+        }
+    }
+
+    // The host remembers the path of each hash, so later loads of the same
+    // module, e.g., after it has been unloaded, merely reference it.
+    if(idx == g_module_count) {
+        log_wstring(&b, "path", path, length);
+        if(g_module_count < LOG_MODULE_MAX) {
+            g_module_hashes[g_module_count++] = hash;
+        }
+    }
+
+    bson_finish(&b);
+    _log_bson(&b);
+
+    LeaveCriticalSection(&g_mutex);
+    bson_destroy(&b);
+}
+
+// Announce all modules which have been loaded so far.
+static void _log_module_map()
+{
+    LDR_MODULE *mod, *first_mod; PEB *peb = get_peb();
+
+    first_mod = mod =
+        (LDR_MODULE *) peb->LoaderData->InLoadOrderModuleList.Flink;
+
+    for (uint32_t idx = 0; idx < 0x1000 && mod->BaseAddress != NULL; idx++) {
+        log_module(mod->BaseAddress, mod->FullDllName.Buffer,
+            mod->FullDllName.Length / sizeof(wchar_t));
+
+        mod = (LDR_MODULE *) mod->InLoadOrderModuleList.Flink;
+        if(mod == first_mod) {
+            break;
+        }
+    }
+}
+
+// Frame a packed record and write it to the log. The timestamp and thread
+// identifier are delta-encoded against the previously written record, so
+// this has to happen in the same critical section as the write itself.
+static void _log_packed(packed_t *p, uint32_t tid, uint32_t tick)
+{
+    uint8_t header[1 + 2*PACKED_VARINT_MAX]; uint32_t length;
+
+    EnterCriticalSection(&g_mutex);
+
+    length = packed_encode_varint(header,
+        packed_zigzag((int32_t)(tick - g_packed_tick)));
+    length += packed_encode_varint(header + length,
+        packed_zigzag((int64_t) tid - g_packed_tid));
+    packed_prepend(p, header, length);
+
+    header[0] = PACKED_TAG_CALL;
+    length = 1 + packed_encode_varint(header + 1, packed_size(p));
+
+    if(packed_prepend(p, header, length) == 0) {
+        log_raw((const char *) packed_data(p), packed_size(p));
+        g_packed_tick = tick;
+        g_packed_tid = tid;
+    }
+    else {
+        pipe("CRITICAL:Error creating packed record (size %d).",
+            packed_size(p));
+    }
+
+    LeaveCriticalSection(&g_mutex);
+}
+
+// Report the calls repeating the first call of a run, if any. The host
+// attaches them to the most recent call record of the thread, which is
+// the first call of the run. Requires g_mutex to be held.
+static void _log_repeat(logrun_t *run)
 {
-    if(buf == NULL || length == 0) {
+    if(run->count == 0) {
         return;
     }
 
     bson b;
-    bson_init(&b);
-    bson_append_string(&b, "type", "buffer");
+    bson_init_size(&b, mem_suggested_size(128));
+    bson_append_string(&b, "type", "repeat");
+    bson_append_int(&b, "I", run->index);
+    bson_append_int(&b, "T", run->tid);
+    bson_append_int(&b, "t", run->first);
+    bson_append_int(&b, "l", run->last);
+    bson_append_long(&b, "h", run->hash);
+    bson_append_int(&b, "n", run->count);
+    bson_finish(&b);
+    _log_bson(&b);
+    bson_destroy(&b);
 
-    if(range_is_readable(buf, length) != 0) {
-        bson_append_binary(&b, "buffer", BSON_BIN_BINARY,
-            (const char *) buf, length);
+    run->count = 0;
+}
 
-        char checksum[64];
-        sha1(buf, length, checksum);
-        bson_append_string(&b, "checksum", checksum);
-    }
-    else {
-        bson_append_string(&b, "buffer", "<INVALID POINTER>");
-        bson_append_string(&b, "checksum", "???");
+// Destructor of the run of a thread, called as it exits. Reports the run
+// first, if it has been repeated.
+static void WINAPI _log_run_free(void *value)
+{
+    logrun_t *run = (logrun_t *) value;
+
+    EnterCriticalSection(&g_mutex);
+    _log_repeat(run);
+
+    for (logrun_t **r = &g_runs; *r != NULL; r = &(*r)->next) {
+        if(*r == run) {
+            *r = run->next;
+            break;
+        }
     }
 
-    bson_finish(&b);
-    log_raw(bson_data(&b), bson_size(&b));
-    bson_destroy(&b);
+    LeaveCriticalSection(&g_mutex);
+    mem_free(run);
 }
 
-void log_explain(uint32_t index)
+static logrun_t *_log_run(uint32_t tid)
 {
-    bson b; char argidx[4];
+    logrun_t *run = (logrun_t *) tls_get(g_run_tls);
+    if(run == NULL) {
+        run = (logrun_t *) mem_alloc(sizeof(logrun_t));
+        if(run == NULL) {
+            return NULL;
+        }
 
-    bson_init_size(&b, mem_suggested_size(1024));
-    bson_append_int(&b, "I", index);
-    bson_append_string(&b, "name", sig_apiname(index));
-    bson_append_string(&b, "type", "info");
-    bson_append_string(&b, "category", sig_category(index));
+        run->tid = tid;
+        tls_set(g_run_tls, run);
 
-    bson_append_start_array(&b, "args");
-    bson_append_string(&b, "0", "is_success");
-    bson_append_string(&b, "1", "retval");
+        EnterCriticalSection(&g_mutex);
+        run->next = g_runs, g_runs = run;
+        LeaveCriticalSection(&g_mutex);
+    }
+    return run;
+}
 
-    const char *fmt = sig_paramtypes(index);
+static int _log_category_listed(const char *list, const char *category)
+{
+    uint32_t length = strlen(category);
 
-    for (uint32_t argnum = 2; *fmt != 0; argnum++, fmt++) {
-        ultostr(argnum, argidx, 10);
+    while (*list != 0) {
+        const char *end = strchr(list, ',');
+        uint32_t toklen = end != NULL ? end - list : strlen(list);
 
-        // Handle overrides.
-        if(*fmt == '!') {
-            argnum--;
-            continue;
+        if(toklen == length && memcmp(list, category, length) == 0) {
+            return 1;
         }
 
-        const char *argname = sig_param_name(index, argnum-2);
+        if(end == NULL) {
+            break;
+        }
+        list = end + 1;
+    }
+    return 0;
+}
 
-        // On certain formats, we need to tell cuckoo about them for
-        // nicer display / matching.
-        if(*fmt == 'p' || *fmt == 'P' || *fmt == 'x') {
-            bson_append_start_array(&b, argidx);
-            bson_append_string(&b, "0", argname);
+// Check whether a call repeats the previous call of this thread, in which
+// case it's accounted for in the current run and shouldn't be logged. The
+// body is the record without its thread identifier and timestamp. Any run
+// that ends is reported before the call is logged, so that the host can
+// attach it to the right record.
+static int _log_collapse(uint32_t index, uint32_t tid, uint32_t tick,
+    uint64_t hash, const void *body, uint32_t size)
+{
+    logrun_t *run = _log_run(tid); int ret = 0;
+    if(run == NULL) {
+        return 0;
+    }
 
-            if(*fmt == 'p' || *fmt == 'P') {
-                bson_append_string(&b, "1", "p");
-            }
-            else if(*fmt == 'x') {
-                bson_append_string(&b, "1", "x");
-            }
-            bson_append_finish_array(&b);
+    EnterCriticalSection(&g_mutex);
+
+    if(run->size != 0 && run->index == index && run->size == size &&
+            memcmp(run->body, body, size) == 0) {
+        if(run->count != 0 && tick - run->first >= g_collapse_window) {
+            _log_repeat(run);
         }
-        else {
-            bson_append_string(&b, argidx, argname);
+
+        if(run->count++ == 0) {
+            run->first = tick;
         }
+        run->last = tick;
+        ret = 1;
     }
+    else {
+        _log_repeat(run);
+        run->size = 0;
 
-    bson_append_finish_array(&b);
-    bson_append_start_object(&b, "flags_value");
-
-    for (uint32_t idx = 0; sig_flag_name(index, idx) != NULL; idx++) {
-        const flag_repr_t *f = flag_value(sig_flag_value(index, idx));
-        bson_append_start_array(&b, sig_flag_name(index, idx));
-
-        for (uint32_t idx2 = 0; f->repr != NULL; idx2++, f++) {
-            ultostr(idx, argidx, 10);
-            bson_append_start_array(&b, argidx);
-            bson_append_int(&b, "0", f->value);
-            bson_append_string(&b, "1", f->repr);
-            bson_append_finish_array(&b);
+        if(g_collapse[index] != 0 && size <= LOG_COLLAPSE_MAX) {
+            memcpy(run->body, body, size);
+            run->index = index, run->hash = hash, run->size = size;
         }
+    }
 
-        bson_append_finish_array(&b);
+    // Threads which went quiet in the middle of a run are caught up with
+    // by whichever thread logs next.
+    if(tick - g_collapse_sweep >= g_collapse_window) {
+        for (logrun_t *r = g_runs; r != NULL; r = r->next) {
+            if(r->count != 0 && tick - r->first >= g_collapse_window) {
+                _log_repeat(r);
+            }
+        }
+        g_collapse_sweep = tick;
     }
 
-    bson_append_finish_object(&b);
-    bson_append_start_object(&b, "flags_bitmask");
+    LeaveCriticalSection(&g_mutex);
+    return ret;
+}
+
+// Report the exact number of calls and dropped calls of each API which
+// had calls dropped so far. Requires g_mutex to be held.
+static void _log_rate_summary(uint32_t tick)
+{
+    bson b; char idx[12]; uint32_t count = 0;
 
-    for (uint32_t idx = 0; sig_flag_name(index, idx) != NULL; idx++) {
-        const flag_repr_t *f = flag_bitmask(sig_flag_value(index, idx));
-        bson_append_start_array(&b, sig_flag_name(index, idx));
+    bson_init_size(&b, mem_suggested_size(1024));
+    bson_append_string(&b, "type", "ratelimit");
+    bson_append_int(&b, "t", tick);
+    bson_append_start_array(&b, "apis");
 
-        for (uint32_t idx2 = 0; f->repr != NULL; idx2++, f++) {
-            ultostr(idx, argidx, 10);
-            bson_append_start_array(&b, argidx);
-            bson_append_int(&b, "0", f->value);
-            bson_append_string(&b, "1", f->repr);
-            bson_append_finish_array(&b);
+    for (uint32_t index = 0; index < sig_count(); index++) {
+        if(g_rates[index].dropped == 0) {
+            continue;
         }
 
+        ultostr(count++, idx, 10);
+        bson_append_start_array(&b, idx);
+        bson_append_int(&b, "0", index);
+        bson_append_long(&b, "1", g_rates[index].calls);
+        bson_append_long(&b, "2", g_rates[index].dropped);
         bson_append_finish_array(&b);
     }
 
-    bson_append_finish_object(&b);
+    bson_append_finish_array(&b);
     bson_finish(&b);
-    log_raw(bson_data(&b), bson_size(&b));
+    _log_bson(&b);
     bson_destroy(&b);
-}
 
-#if DEBUG
+    g_rate_summary = tick;
+    g_rate_dirty = 0;
+}
 
-static void _log_stacktrace(bson *b)
+int log_admit(uint32_t index)
 {
-    uintptr_t addrs[RETADDRCNT], count;
-    char number[20], sym[512];
+    if(g_rates == NULL || index < sig_index_firsthookidx() ||
+            g_monitor_logging == 0) {
+        return 1;
+    }
 
-    bson_append_start_array(b, "s");
+    uint32_t tick = get_tick_count() - g_starttick; int ret = 1;
+    lograte_t *rate = &g_rates[index];
 
-    count = stacktrace(NULL, addrs, RETADDRCNT);
+    EnterCriticalSection(&g_mutex);
 
-    for (uint32_t idx = 4; idx < count; idx++) {
-        ultostr(idx-4, number, 10);
+    rate->calls++;
+    rate->tokens += (uint64_t)(tick - rate->refill) * g_rate_step;
+    rate->refill = tick;
 
-        symbol((const uint8_t *) addrs[idx], sym, sizeof(sym)-32);
-        if(sym[0] != 0) {
-            our_snprintf(sym + our_strlen(sym),
-                sizeof(sym) - our_strlen(sym), " @ ");
-        }
+    if(rate->tokens > g_rate_burst) {
+        rate->tokens = g_rate_burst;
+    }
 
-        our_snprintf(sym + our_strlen(sym), sizeof(sym) - our_strlen(sym),
-            "%p", (const uint8_t *) addrs[idx]);
-        bson_append_string(b, number, sym);
+    // Within budget, every call is logged. Beyond it, only one in every
+    // g_rate_sample calls is, if sampling is enabled at all.
+    if(rate->tokens >= 1000) {
+        rate->tokens -= 1000;
+    }
+    else if(g_rate_sample != 0 && ++rate->skipped >= g_rate_sample) {
+        rate->skipped = 0;
+    }
+    else {
+        rate->dropped++;
+        g_rate_dirty = 1;
+        ret = 0;
     }
 
-    bson_append_finish_array(b);
-}
+    if(g_rate_dirty != 0 && tick - g_rate_summary >= g_rate_interval) {
+        _log_rate_summary(tick);
+    }
 
-#endif
+    LeaveCriticalSection(&g_mutex);
+    return ret;
+}
 
 void log_api(uint32_t index, int is_success, uintptr_t return_value,
     uint64_t hash, last_error_t *lasterr, ...)
@@ -372,6 +1548,23 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
 
     va_start(args, lasterr);
 
+    // Calls matching one of the host's filter rules aren't even serialized.
+    va_list filter_args;
+    va_copy(filter_args, args);
+    int filtered = filter_match(index, is_success, return_value, filter_args);
+    va_end(filter_args);
+
+    if(filtered != 0) {
+        va_end(args);
+        return;
+    }
+
+    // Only calls which aren't filtered take from the rate limit budget.
+    if(log_admit(index) == 0) {
+        va_end(args);
+        return;
+    }
+
     EnterCriticalSection(&g_mutex);
 
     if(g_api_init[index] == 0) {
@@ -381,29 +1574,59 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
 
     LeaveCriticalSection(&g_mutex);
 
-    bson b;
+    bson b; packed_t p; logenc_t e = {}; uint32_t body = 0;
+    uint32_t tid = get_current_thread_id();
+    uint32_t tick = get_tick_count() - g_starttick;
 
-    bson_init_size(&b, mem_suggested_size(1024));
-    bson_append_int(&b, "I", index);
-    bson_append_int(&b, "T", get_current_thread_id());
-    bson_append_int(&b, "t", get_tick_count() - g_starttick);
-    bson_append_long(&b, "h", hash);
+    int has_stacktrace =
+        g_log_stacktrace != 0 && index != sig_index_exception();
+
+    if(g_log_format == LOG_FORMAT_PACKED) {
+        uint8_t flags = 0;
+        flags |= is_success != 0 ? PACKED_FLAG_SUCCESS : PACKED_FLAG_ERROR;
+        flags |= has_stacktrace != 0 ? PACKED_FLAG_STACKTRACE : 0;
+
+        packed_init(&p, mem_suggested_size(256));
+        packed_varint(&p, index);
+        packed_varint(&p, hash);
+        packed_byte(&p, flags);
 
-    // If failure has been determined, then log the last error as well.
-    if(is_success == 0) {
-        bson_append_int(&b, "e", lasterr->lasterror);
-        bson_append_int(&b, "E", lasterr->nt_status);
+        if(is_success == 0) {
+            packed_varint(&p, (uint32_t) lasterr->lasterror);
+            packed_varint(&p, (uint32_t) lasterr->nt_status);
+        }
+
+        e.p = &p;
+    }
+    else {
+        bson_init_size(&b, mem_suggested_size(1024));
+        bson_append_int(&b, "I", index);
+        bson_append_int(&b, "T", tid);
+        bson_append_int(&b, "t", tick);
+        body = b.cur - b.data;
+        bson_append_long(&b, "h", hash);
+
+        // If failure has been determined, then log the last error as well.
+        if(is_success == 0) {
+            bson_append_int(&b, "e", lasterr->lasterror);
+            bson_append_int(&b, "E", lasterr->nt_status);
+        }
+
+        e.b = &b;
     }
 
-#if DEBUG
-    if(index != sig_index_exception()) {
-        _log_stacktrace(&b);
+    if(has_stacktrace != 0) {
+        _log_stacktrace(&e);
     }
-#endif
 
-    bson_append_start_array(&b, "args");
-    bson_append_int(&b, "0", is_success);
-    bson_append_long(&b, "1", return_value);
+    if(e.b != NULL) {
+        bson_append_start_array(&b, "args");
+        bson_append_int(&b, "0", is_success);
+        bson_append_long(&b, "1", return_value);
+    }
+    else {
+        packed_svarint(&p, (intptr_t) return_value);
+    }
 
     int argnum = 2, override = 0;
 
@@ -420,30 +1643,30 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
 
         if(*fmt == 's') {
             const char *s = va_arg(args, const char *);
-            log_string(&b, idx, s, s != NULL ? copy_strlen(s) : 0);
+            _enc_string(&e, idx, s, s != NULL ? copy_strlen(s) : 0);
         }
         else if(*fmt == 'S') {
             int len = va_arg(args, int);
             const char *s = va_arg(args, const char *);
-            log_string(&b, idx, s, len);
+            _enc_string(&e, idx, s, len);
         }
         else if(*fmt == 'u') {
             const wchar_t *s = va_arg(args, const wchar_t *);
-            log_wstring(&b, idx, s, s != NULL ? copy_strlenW(s) : 0);
+            _enc_wstring(&e, idx, s, s != NULL ? copy_strlenW(s) : 0);
         }
         else if(*fmt == 'U') {
             int len = va_arg(args, int);
             const wchar_t *s = va_arg(args, const wchar_t *);
-            log_wstring(&b, idx, s, len);
+            _enc_wstring(&e, idx, s, len);
         }
         else if(*fmt == 'b') {
             uintptr_t len = va_arg(args, uintptr_t);
             const uint8_t *s = va_arg(args, const uint8_t *);
             if(override == 0 || len < BUFFER_LOG_MAX) {
-                log_buffer(&b, idx, s, len);
+                _enc_buffer(&e, idx, s, len);
             }
             else {
-                log_buffer(&b, idx, NULL, 0);
+                _enc_buffer(&e, idx, NULL, 0);
                 log_buffer_notrunc(s, len);
             }
         }
@@ -452,48 +1675,48 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
             uintptr_t len = ptr != NULL ? copy_uintptr(ptr) : 0;
             const uint8_t *s = va_arg(args, const uint8_t *);
             if(override == 0 || len < BUFFER_LOG_MAX) {
-                log_buffer(&b, idx, s, len);
+                _enc_buffer(&e, idx, s, len);
             }
             else {
-                log_buffer(&b, idx, NULL, 0);
+                _enc_buffer(&e, idx, NULL, 0);
                 log_buffer_notrunc(s, len);
             }
         }
         else if(*fmt == 'i' || *fmt == 'x') {
             int value = va_arg(args, int);
-            log_int32(&b, idx, value);
+            _enc_int32(&e, idx, value);
         }
         else if(*fmt == 'I') {
             uint32_t *value = va_arg(args, uint32_t *);
-            log_int32(&b, idx, value != NULL ? copy_uint32(value) : 0);
+            _enc_int32(&e, idx, value != NULL ? copy_uint32(value) : 0);
         }
         else if(*fmt == 'l' || *fmt == 'p') {
             uintptr_t value = va_arg(args, uintptr_t);
-            log_intptr(&b, idx, value);
+            _enc_intptr(&e, idx, value);
         }
         else if(*fmt == 'L' || *fmt == 'P') {
             uintptr_t *value = va_arg(args, uintptr_t *);
-            log_intptr(&b, idx, value != NULL ? copy_uintptr(value) : 0);
+            _enc_intptr(&e, idx, value != NULL ? copy_uintptr(value) : 0);
         }
         else if(*fmt == 'o') {
             ANSI_STRING *str = va_arg(args, ANSI_STRING *), str_;
             if(str != NULL &&
                     copy_bytes(&str_, str, sizeof(ANSI_STRING)) == 0) {
-                log_string(&b, idx, str_.Buffer, str_.Length);
+                _enc_string(&e, idx, str_.Buffer, str_.Length);
             }
             else {
-                log_string(&b, idx, "", 0);
+                _enc_string(&e, idx, "", 0);
             }
         }
         else if(*fmt == 'a') {
             int argc = va_arg(args, int);
             const char **argv = va_arg(args, const char **);
-            log_argv(&b, idx, argc, argv);
+            _enc_argv(&e, idx, argc, argv);
         }
         else if(*fmt == 'A') {
             int argc = va_arg(args, int);
             const wchar_t **argv = va_arg(args, const wchar_t **);
-            log_wargv(&b, idx, argc, argv);
+            _enc_wargv(&e, idx, argc, argv);
         }
         else if(*fmt == 'r' || *fmt == 'R') {
             uint32_t *type = va_arg(args, uint32_t *);
@@ -509,17 +1732,20 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
                 size = &_size;
             }
 
+            // The type of registry values is only known at runtime.
+            e.typed = 1;
+
             switch (copy_uint32(type)) {
             case REG_NONE:
-                log_string(&b, idx, NULL, 0);
+                _enc_string(&e, idx, NULL, 0);
                 break;
 
             case REG_DWORD:
-                log_int32(&b, idx, copy_uint32(data));
+                _enc_int32(&e, idx, copy_uint32(data));
                 break;
 
             case REG_DWORD_BIG_ENDIAN:
-                log_int32(&b, idx, our_htonl(copy_uint32(data)));
+                _enc_int32(&e, idx, our_htonl(copy_uint32(data)));
                 break;
 
             case REG_EXPAND_SZ: case REG_SZ: case REG_MULTI_SZ:
@@ -532,7 +1758,7 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
                             copy_strlen((const char *) data) == length - 1) {
                         length--;
                     }
-                    log_string(&b, idx, (const char *) data, length);
+                    _enc_string(&e, idx, (const char *) data, length);
                 }
                 else {
                     uint32_t length = copy_uint32(size) / sizeof(wchar_t);
@@ -543,45 +1769,39 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
                             (const wchar_t *) data) == length - 1) {
                         length--;
                     }
-                    log_wstring(&b, idx, (const wchar_t *) data, length);
+                    _enc_wstring(&e, idx, (const wchar_t *) data, length);
                 }
                 break;
 
             case REG_QWORD:
-                log_int64(&b, idx, copy_uint64(data));
+                _enc_int64(&e, idx, copy_uint64(data));
                 break;
 
             default:
-                log_buffer(&b, idx, data, copy_uint32(size));
+                _enc_buffer(&e, idx, data, copy_uint32(size));
                 break;
             }
+
+            e.typed = 0;
         }
         else if(*fmt == 'q') {
             int64_t value = va_arg(args, int64_t);
-            log_int64(&b, idx, value);
+            _enc_int64(&e, idx, value);
         }
         else if(*fmt == 'Q') {
             LARGE_INTEGER *value = va_arg(args, LARGE_INTEGER *);
-            log_int64(&b, idx,
+            _enc_int64(&e, idx,
                 value != NULL ? copy_uint64(&value->QuadPart) : 0);
         }
         else if(*fmt == 'z') {
             bson *value = va_arg(args, bson *);
-            if(value == NULL) {
-                bson_append_null(&b, idx);
-            }
-            else {
-                bson_iterator i;
-                bson_iterator_init(&i, value);
-                bson_iterator_next(&i);
-                bson_append_element(&b, idx, &i);
-            }
+            _enc_element(&e, idx, value);
         }
         else if(*fmt == 'c') {
             char buf[64];
             REFCLSID rclsid = va_arg(args, REFCLSID);
             clsid_to_string(rclsid, buf);
-            log_string(&b, idx, buf, strlen(buf));
+            _enc_string(&e, idx, buf, strlen(buf));
         }
         else if(*fmt == 't') {
             const BSTR bstr = va_arg(args, const BSTR);
@@ -592,7 +1812,7 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
                 len = sys_string_length(bstr);
             }
 
-            log_wstring(&b, idx, s, len);
+            _enc_wstring(&e, idx, s, len);
         }
         else if(*fmt == 'v') {
             const VARIANT *v = va_arg(args, const VARIANT *);
@@ -604,7 +1824,7 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
                 len = sys_string_length(v->bstrVal);
             }
 
-            log_wstring(&b, idx, s, len);
+            _enc_wstring(&e, idx, s, len);
         }
         else {
             char buf[2] = {*fmt, 0};
@@ -616,9 +1836,22 @@ void log_api(uint32_t index, int is_success, uintptr_t return_value,
 
     va_end(args);
 
+    if(e.p != NULL) {
+        if(g_collapse == NULL || _log_collapse(index, tid, tick, hash,
+                packed_data(&p), packed_size(&p)) == 0) {
+            _log_packed(&p, tid, tick);
+        }
+        packed_destroy(&p);
+        return;
+    }
+
     bson_append_finish_array(&b);
     bson_finish(&b);
-    log_raw(bson_data(&b), bson_size(&b));
+
+    if(g_collapse == NULL || _log_collapse(index, tid, tick, hash,
+            bson_data(&b) + body, bson_size(&b) - body) == 0) {
+        log_raw(bson_data(&b), bson_size(&b));
+    }
     bson_destroy(&b);
 }
 
@@ -641,6 +1874,9 @@ void log_new_process(int track)
     int is_64bit = 0;
 #endif
 
+    // Before the first call, which may already carry a stack trace.
+    _log_module_map();
+
     bson modules;
     bson_init_size(&modules, mem_suggested_size(4096));
     bson_append_start_array(&modules, "modules");
@@ -664,11 +1900,143 @@ void log_anomaly(const char *subcategory,
         get_current_thread_id(), subcategory, funcname, msg);
 }
 
+// Report the number of exceptions of each site which have not all been
+// logged in detail, for the sites of which it changed since the previous
+// summary. Like the rate limiting summaries, the counters are cumulative.
+// Requires g_mutex to be held.
+static void _log_exception_summary(uint32_t tick)
+{
+    bson b; char idx[12]; uint32_t count = 0;
+
+    bson_init_size(&b, mem_suggested_size(1024));
+    bson_append_string(&b, "type", "exceptions");
+    bson_append_int(&b, "t", tick);
+    bson_append_long(&b, "n", g_exc_count);
+    bson_append_long(&b, "other", g_exc_other);
+    bson_append_start_array(&b, "sites");
+
+    for (uint32_t slot = 0; slot <= g_exc_mask; slot++) {
+        logexc_t *site = &g_exc_sites[slot];
+        if(site->count <= site->logged || site->count == site->reported) {
+            continue;
+        }
+
+        ultostr(count++, idx, 10);
+        bson_append_start_array(&b, idx);
+        bson_append_int(&b, "0", site->code);
+        bson_append_long(&b, "1", site->address);
+        bson_append_long(&b, "2", site->count);
+        bson_append_int(&b, "3", site->id);
+        bson_append_finish_array(&b);
+        site->reported = site->count;
+    }
+
+    bson_append_finish_array(&b);
+    bson_finish(&b);
+    _log_bson(&b);
+    bson_destroy(&b);
+
+    g_exc_summary = tick;
+    g_exc_dirty = 0;
+}
+
+// Account for an exception and decide whether it's logged in detail, i.e.,
+// whether it's the first one raised at its site.
+static int _log_exception_admit(const EXCEPTION_RECORD *rec,
+    const uintptr_t *return_addresses, uint32_t count)
+{
+    logexc_t key = {}; char buf[128]; int ret = 1;
+
+    key.code = rec != NULL ? rec->ExceptionCode : 0;
+    key.address = rec != NULL ? (uintptr_t) rec->ExceptionAddress : 0;
+    for (uint32_t idx = 0; idx < count && idx < EXCEPTION_FRAMES; idx++) {
+        key.frames[idx] = return_addresses[idx];
+    }
+
+    EnterCriticalSection(&g_mutex);
+
+    if(g_exc_count++ == g_exc_limit && g_exc_policy != LOG_EXC_POLICY_IGNORE) {
+        our_snprintf(buf, sizeof(buf), "Encountered %d exceptions, %s.",
+            (int) g_exc_count, g_exc_policy == LOG_EXC_POLICY_EXIT ?
+            "quitting" : "only counting them from now on");
+        log_anomaly("exception", NULL, buf);
+
+        if(g_exc_policy == LOG_EXC_POLICY_EXIT) {
+            LeaveCriticalSection(&g_mutex);
+            log_flush();
+            ExitProcess(1);
+        }
+
+        g_exc_limited = 1;
+    }
+
+    if(g_exc_sites == NULL) {
+        LeaveCriticalSection(&g_mutex);
+        return g_exc_limited == 0;
+    }
+
+    uint32_t hash = key.code ^ (uint32_t) key.address;
+    for (uint32_t idx = 0; idx < EXCEPTION_FRAMES; idx++) {
+        hash = (hash ^ (uint32_t) key.frames[idx]) * 0x01000193;
+    }
+
+    // Linear probing, the table is never emptied.
+    logexc_t *site = NULL;
+    for (uint32_t slot = hash & g_exc_mask; ; slot = (slot + 1) & g_exc_mask) {
+        logexc_t *entry = &g_exc_sites[slot];
+        if(entry->count == 0) {
+            if(g_exc_used < g_exc_capacity) {
+                *entry = key;
+                entry->id = g_exc_used++;
+                site = entry;
+            }
+            break;
+        }
+
+        if(entry->code == key.code && entry->address == key.address &&
+                memcmp(entry->frames, key.frames, sizeof(key.frames)) == 0) {
+            site = entry;
+            break;
+        }
+    }
+
+    if(site == NULL) {
+        g_exc_other++;
+        ret = 0;
+    }
+    else if(site->count++ != 0 || g_exc_limited != 0) {
+        ret = 0;
+    }
+    else {
+        site->logged = 1;
+    }
+
+    uint32_t tick = get_tick_count() - g_starttick;
+
+    g_exc_dirty |= ret == 0;
+    if(g_exc_dirty != 0 && tick - g_exc_summary >= g_exc_interval) {
+        _log_exception_summary(tick);
+    }
+
+    LeaveCriticalSection(&g_mutex);
+    return ret;
+}
+
 void log_exception(CONTEXT *ctx, EXCEPTION_RECORD *rec,
     uintptr_t *return_addresses, uint32_t count, uint32_t flags)
 {
     char buf[128]; bson e, r, s;
-    static int exception_count;
+
+    // Repeated exceptions are only counted, as samples which fault in a
+    // loop would otherwise spend most of their time in here.
+    if(_log_exception_admit(rec, return_addresses, count) == 0) {
+        return;
+    }
+
+    // The host resolves the addresses offline.
+    if(g_log_symbols == LOG_SYMBOLS_HOST) {
+        flags |= LOG_EXC_NOSYMBOL;
+    }
 
     bson_init(&e);
     bson_init(&r);
@@ -678,13 +2046,6 @@ void log_exception(CONTEXT *ctx, EXCEPTION_RECORD *rec,
     bson_append_start_object(&r, "registers");
     bson_append_start_array(&s, "stacktrace");
 
-    if(exception_count++ == EXCEPTION_MAXCOUNT) {
-        our_snprintf(buf, sizeof(buf), "Encountered %d exceptions, quitting.",
-            exception_count);
-        log_anomaly("exception", NULL, buf);
-        ExitProcess(1);
-    }
-
 #if __x86_64__
     static const char *regnames[] = {
         "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
@@ -855,13 +2216,29 @@ void WINAPI log_missing_hook(const char *funcname)
     // }
 }
 
-void log_init(const char *pipe_name, int track)
+void log_init(const char *pipe_name, int track, int log_format,
+    int log_compress, uint32_t log_strings)
 {
     InitializeCriticalSection(&g_mutex);
 
     bson_set_heap_stuff(&_bson_malloc, &_bson_realloc, &_bson_free);
+    packed_set_allocator(&_bson_realloc, &_bson_free);
+    g_log_format = log_format;
     g_api_init = virtual_alloc_rw(NULL, sig_count() * sizeof(uint8_t));
 
+    if(log_strings != 0) {
+        g_strings = virtual_alloc_rw(NULL,
+            (log_strings + 1) / 2 * 2 * sizeof(logstr_t));
+        if(g_strings != NULL) {
+            g_string_sets = (log_strings + 1) / 2;
+        }
+    }
+
+    // Without the flusher thread we fall back to uncompressed logging.
+    if(log_compress == LOG_COMPRESS_LZ4 && _log_compress_init() == 0) {
+        g_log_compress = log_compress;
+    }
+
 #if DEBUG
     char filepath[MAX_PATH];
     our_snprintf(filepath, MAX_PATH, "C:\\monitor-debug-%d.txt",
@@ -870,12 +2247,172 @@ void log_init(const char *pipe_name, int track)
     wcsncpyA(g_debug_filepath, filepath, MAX_PATH);
 #endif
 
+    uint32_t process_identifier = get_current_process_id();
+    int length = our_snprintf(g_log_header, sizeof(g_log_header),
+        "BSON %d", process_identifier);
+
+    if(g_log_format == LOG_FORMAT_PACKED) {
+        length += our_snprintf(g_log_header + length,
+            sizeof(g_log_header) - length, " format=packed ptr=%d",
+            (int) sizeof(uintptr_t));
+    }
+
+    if(g_string_sets != 0) {
+        length += our_snprintf(g_log_header + length,
+            sizeof(g_log_header) - length, " strings=dict");
+    }
+
+    if(g_log_compress == LOG_COMPRESS_LZ4) {
+        length += our_snprintf(g_log_header + length,
+            sizeof(g_log_header) - length, " compress=lz4");
+    }
+
+    our_snprintf(g_log_header + length, sizeof(g_log_header) - length, "\n");
+
+    // In compressed mode the header is sent by open_handles().
     wcsncpyA(g_log_pipename, pipe_name, MAX_PATH);
     open_handles();
 
-    char header[64]; uint32_t process_identifier = get_current_process_id();
-    our_snprintf(header, sizeof(header), "BSON %d\n", process_identifier);
+    if(g_log_compress == 0) {
+        log_raw(g_log_header, strlen(g_log_header));
+    }
 
-    log_raw(header, strlen(header));
     log_new_process(track);
 }
+
+void log_symbols_init(int mode, int stacktrace)
+{
+    g_log_symbols = mode;
+    g_log_stacktrace = DEBUG != 0 || stacktrace != 0;
+}
+
+void log_ring_init(const char *name, uint32_t size)
+{
+    if(*name == 0) {
+        return;
+    }
+
+    if(size == 0) {
+        size = LOG_RING_SIZE;
+    }
+
+    HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+        PAGE_READWRITE, 0, size, name);
+    if(section == NULL) {
+        pipe("WARNING:Error creating the log ring %z, using the log pipe "
+            "instead (error %d).", name, GetLastError());
+        return;
+    }
+
+    void *mem = MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, size);
+    if(mem == NULL || ring_create(&g_ring, mem, size) < 0) {
+        pipe("WARNING:Error mapping the log ring %z, using the log pipe "
+            "instead.", name);
+        CloseHandle(section);
+        return;
+    }
+
+    g_ring_active = 1;
+}
+
+void log_ring_close()
+{
+    if(g_ring_active != 0) {
+        ring_close(&g_ring, RING_STATE_CLOSED);
+    }
+}
+
+void log_collapse_init(const char *categories, uint32_t window)
+{
+    if(*categories == 0) {
+        return;
+    }
+
+    g_run_tls = tls_alloc(&_log_run_free);
+    if(g_run_tls == TLS_OUT_OF_INDEXES) {
+        pipe("CRITICAL:Unable to allocate TLS index for collapsing calls!");
+        return;
+    }
+
+    uint8_t *collapse = virtual_alloc_rw(NULL, sig_count() * sizeof(uint8_t));
+    if(collapse == NULL) {
+        return;
+    }
+
+    for (uint32_t index = 0; index < sig_count(); index++) {
+        collapse[index] = _log_category_listed(categories,
+            sig_category(index));
+    }
+
+    g_collapse_window = window != 0 ? window : LOG_COLLAPSE_WINDOW;
+    g_collapse = collapse;
+}
+
+void log_buffer_dedup_init(uint32_t count)
+{
+    if(count == 0) {
+        return;
+    }
+
+    logbuf_t *buffers =
+        virtual_alloc_rw(NULL, (count + 1) / 2 * 2 * sizeof(logbuf_t));
+    if(buffers == NULL) {
+        return;
+    }
+
+    g_buffers = buffers;
+    g_buffer_sets = (count + 1) / 2;
+}
+
+void log_exception_init(int policy, uint32_t limit, uint32_t sites,
+    uint32_t interval)
+{
+    logexc_t *table = NULL; uint32_t size = 64;
+
+    // Larger tables would overflow the size computed below.
+    if(sites > EXCEPTION_SITES_MAX) {
+        sites = EXCEPTION_SITES_MAX;
+    }
+
+    // Keep a quarter of the table free so that probes stay short.
+    while (size - size / 4 < sites) {
+        size *= 2;
+    }
+
+    // Deduplication is opt-in, as it changes what is logged.
+    if(sites != 0) {
+        table = virtual_alloc_rw(NULL, size * sizeof(logexc_t));
+        if(table == NULL) {
+            pipe("WARNING:Error allocating the exception table, exceptions "
+                "won't be deduplicated.");
+        }
+    }
+
+    EnterCriticalSection(&g_mutex);
+    g_exc_policy = policy;
+    g_exc_limit = limit != 0 ? limit : EXCEPTION_MAXCOUNT;
+    g_exc_interval = interval != 0 ? interval : EXCEPTION_INTERVAL;
+    g_exc_mask = size - 1;
+    g_exc_capacity = size - size / 4;
+    g_exc_sites = table;
+    LeaveCriticalSection(&g_mutex);
+}
+
+void log_rate_init(uint32_t rate, uint32_t burst, uint32_t sample,
+    uint32_t interval)
+{
+    if(rate == 0 && sample == 0) {
+        return;
+    }
+
+    lograte_t *rates = virtual_alloc_rw(NULL, sig_count() * sizeof(lograte_t));
+    if(rates == NULL) {
+        return;
+    }
+
+    g_rate_step = rate;
+    g_rate_burst = (uint64_t)(burst != 0 ? burst : rate) * 1000;
+    g_rate_sample = sample;
+    g_rate_interval = interval != 0 ? interval : LOG_RATE_INTERVAL;
+    g_rates = rates;
+}
@@ -0,0 +1,237 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <string.h>
+#include "lz.h"
+
+// Parameters of the LZ4 block format. The last match has to start at
+// least LZ_MFLIMIT bytes before the end of the block, and the last
+// LZ_LASTLITERALS bytes are always literals.
+#define LZ_MINMATCH 4
+#define LZ_MFLIMIT 12
+#define LZ_LASTLITERALS 5
+#define LZ_MAX_DISTANCE 65535
+
+// Skip ahead faster through data which doesn't seem to compress.
+#define LZ_SKIP_TRIGGER 6
+
+static inline uint32_t _read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t _hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static inline uint8_t *_length(uint8_t *op, uint32_t length)
+{
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+// Emit a sequence of literals followed by a match, or only literals if
+// offset is zero. Returns NULL if it doesn't fit.
+static uint8_t *_sequence(uint8_t *op, const uint8_t *oend,
+    const uint8_t *literals, uint32_t litlen,
+    uint32_t offset, uint32_t matchlen)
+{
+    uint32_t required = 1 + litlen + litlen / 255 + 1;
+    required += 2 + matchlen / 255 + 1;
+    if(required > (uint32_t)(oend - op)) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (litlen < 15 ? litlen : 15) << 4;
+    if(litlen >= 15) {
+        op = _length(op, litlen - 15);
+    }
+
+    memcpy(op, literals, litlen);
+    op += litlen;
+
+    if(offset != 0) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+
+        matchlen -= LZ_MINMATCH;
+        *token |= matchlen < 15 ? matchlen : 15;
+        if(matchlen >= 15) {
+            op = _length(op, matchlen - 15);
+        }
+    }
+    return op;
+}
+
+uint32_t lz_compress(const void *src, uint32_t length,
+    void *dst, uint32_t capacity, lz_table_t *table)
+{
+    const uint8_t *base = src, *end = base + length;
+    const uint8_t *ip = base, *anchor = base;
+    uint8_t *op = dst; const uint8_t *oend = op + capacity;
+
+    memset(table, 0, sizeof(lz_table_t));
+
+    if(length > LZ_MFLIMIT) {
+        const uint8_t *mflimit = end - LZ_MFLIMIT;
+        const uint8_t *matchlimit = end - LZ_LASTLITERALS;
+        uint32_t misses = 0;
+
+        while (ip < mflimit) {
+            uint32_t value = _read32(ip), h = _hash(value);
+            const uint8_t *ref = base + table->pos[h];
+            table->pos[h] = ip - base;
+
+            if(ref >= ip || ip - ref > LZ_MAX_DISTANCE ||
+                    _read32(ref) != value) {
+                ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+                continue;
+            }
+
+            // Extend the match backwards into the pending literals and
+            // forwards as far as the block permits.
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--, ref--;
+            }
+
+            const uint8_t *mp = ip + LZ_MINMATCH, *rp = ref + LZ_MINMATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++, rp++;
+            }
+
+            op = _sequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip);
+            if(op == NULL) {
+                return 0;
+            }
+
+            ip = anchor = mp, misses = 0;
+
+            if(ip < mflimit) {
+                table->pos[_hash(_read32(ip - 2))] = ip - 2 - base;
+            }
+        }
+    }
+
+    op = _sequence(op, oend, anchor, end - anchor, 0, 0);
+    return op != NULL ? op - (uint8_t *) dst : 0;
+}
+
+int32_t lz_decompress(const void *src, uint32_t length,
+    void *dst, uint32_t capacity)
+{
+    const uint8_t *ip = src, *iend = ip + length;
+    uint8_t *op = dst, *oend = op + capacity;
+
+    while (ip < iend) {
+        uint32_t token = *ip++, litlen = token >> 4, value;
+
+        if(litlen == 15) {
+            do {
+                if(ip == iend) {
+                    return -1;
+                }
+                value = *ip++;
+                litlen += value;
+            } while (value == 255);
+        }
+
+        if(litlen > (uint32_t)(iend - ip) || litlen > (uint32_t)(oend - op)) {
+            return -1;
+        }
+
+        memcpy(op, ip, litlen);
+        op += litlen, ip += litlen;
+
+        // The last sequence consists of literals only.
+        if(ip == iend) {
+            break;
+        }
+
+        if(iend - ip < 2) {
+            return -1;
+        }
+
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if(offset == 0 || offset > (uint32_t)(op - (uint8_t *) dst)) {
+            return -1;
+        }
+
+        uint32_t matchlen = token & 15;
+        if(matchlen == 15) {
+            do {
+                if(ip == iend) {
+                    return -1;
+                }
+                value = *ip++;
+                matchlen += value;
+            } while (value == 255);
+        }
+
+        matchlen += LZ_MINMATCH;
+        if(matchlen > (uint32_t)(oend - op)) {
+            return -1;
+        }
+
+        // Overlapping matches repeat the last offset bytes.
+        const uint8_t *match = op - offset;
+        if(offset >= matchlen) {
+            memcpy(op, match, matchlen);
+            op += matchlen;
+        }
+        else {
+            while (matchlen-- != 0) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op - (uint8_t *) dst;
+}
+
+uint32_t lz_frame(const void *src, uint32_t length,
+    void *dst, lz_table_t *table)
+{
+    uint8_t *payload = (uint8_t *) dst + LZ_FRAME_HEADER;
+    uint32_t size = lz_compress(src, length, payload, length, table), header;
+
+    if(size != 0 && size < length) {
+        header = size;
+    }
+    else {
+        memcpy(payload, src, length);
+        header = size = length;
+        header |= LZ_FRAME_RAW;
+    }
+
+    uint8_t *p = dst;
+    p[0] = header, p[1] = header >> 8;
+    p[2] = header >> 16, p[3] = header >> 24;
+    return LZ_FRAME_HEADER + size;
+}
@@ -54,6 +54,7 @@ uintptr_t mem_suggested_size(uintptr_t size)
 void mem_init()
 {
     GetSystemInfo(&g_si);
+    dnq_set_allocator(&mem_alloc, &mem_free);
 }
 
 void *mem_alloc(uint32_t length)
@@ -118,243 +119,293 @@ void mem_free(void *ptr)
 
 void array_init(array_t *array)
 {
-    array->length = 0;
-    array->elements = NULL;
-    InitializeCriticalSection(&array->cs);
+    radix_init(&array->map, &mem_alloc, &mem_free);
 }
 
-static uintptr_t _suggested_array_length(uintptr_t length)
+int array_set(array_t *array, uintptr_t index, void *value)
 {
-    return mem_suggested_size(length * sizeof(void *)) / sizeof(void *);
+    if(index > UINT32_MAX) {
+        return -1;
+    }
+    return radix_set(&array->map, index, value);
 }
 
-static int _array_ensure(array_t *array, uint32_t index)
+void *array_get(array_t *array, uintptr_t index)
 {
-    if(array->elements == NULL || index >= array->length) {
-        uintptr_t newlength = _suggested_array_length(index + 1);
-
-        array->elements = (void **)
-            mem_realloc(array->elements, newlength * sizeof(void *));
-        if(array->elements == NULL) {
-            return -1;
-        }
-
-        array->length = newlength;
+    if(index > UINT32_MAX) {
+        return NULL;
     }
-    return 0;
+    return radix_get(&array->map, index);
 }
 
-int array_set(array_t *array, uintptr_t index, void *value)
+int array_unset(array_t *array, uintptr_t index)
 {
-    EnterCriticalSection(&array->cs);
-
-    if(_array_ensure(array, index) < 0) {
-        LeaveCriticalSection(&array->cs);
+    if(index > UINT32_MAX) {
         return -1;
     }
-
-    array->elements[index] = value;
-
-    LeaveCriticalSection(&array->cs);
-    return 0;
+    return radix_unset(&array->map, index);
 }
 
-void *array_get(array_t *array, uintptr_t index)
+// Maximum distance of a chunk of a slab placed near an address, leaving
+// some slack for 32-bit relative jumps into and out of the chunk.
+#define SLAB_NEAR_RANGE 0x70000000
+
+// Find a free region for a chunk within SLAB_NEAR_RANGE of slab->near,
+// first walking the address space upwards and then downwards.
+static uint8_t *_slab_alloc_near(slab_t *slab, uintptr_t length)
 {
-    EnterCriticalSection(&array->cs);
+    uintptr_t granularity = g_si.dwAllocationGranularity, end;
+    uintptr_t near = (uintptr_t) slab->near & ~(granularity - 1);
+    uintptr_t high = (uintptr_t) g_si.lpMaximumApplicationAddress;
+    uintptr_t low = (uintptr_t) g_si.lpMinimumApplicationAddress;
+    MEMORY_BASIC_INFORMATION_CROSS mbi; uint8_t *ret;
+
+    if(high - near > SLAB_NEAR_RANGE) {
+        high = near + SLAB_NEAR_RANGE;
+    }
+    if(near - low > SLAB_NEAR_RANGE) {
+        low = near - SLAB_NEAR_RANGE;
+    }
+
+    for (uintptr_t addr = near; addr < high; ) {
+        if(virtual_query((const void *) addr, &mbi) == 0) {
+            break;
+        }
 
-    void *ret = NULL;
-    if(index < array->length) {
-        ret = array->elements[index];
+        end = (uintptr_t) mbi.BaseAddress + (uintptr_t) mbi.RegionSize;
+        if(mbi.State == MEM_FREE && end - addr >= length &&
+                addr + length <= high) {
+            ret = virtual_alloc((void *) addr, length,
+                MEM_COMMIT | MEM_RESERVE, slab->memprot);
+            if(ret != NULL) {
+                return ret;
+            }
+        }
+        addr = (end + granularity - 1) & ~(granularity - 1);
     }
 
-    LeaveCriticalSection(&array->cs);
-    return ret;
-}
+    for (uintptr_t addr = near; addr >= low + granularity; ) {
+        addr -= granularity;
+        if(virtual_query((const void *) addr, &mbi) == 0) {
+            break;
+        }
 
-int array_unset(array_t *array, uintptr_t index)
-{
-    EnterCriticalSection(&array->cs);
+        if(mbi.State != MEM_FREE) {
+            addr = (uintptr_t) mbi.AllocationBase;
+            continue;
+        }
 
-    int ret = -1;
-    if(index < array->length) {
-        array->elements[index] = NULL;
-        ret = 0;
+        // Use the top of the free region.
+        end = (uintptr_t) mbi.BaseAddress + (uintptr_t) mbi.RegionSize;
+        if(end - (uintptr_t) mbi.BaseAddress >= length) {
+            uintptr_t start = (end - length) & ~(granularity - 1);
+            if(start >= (uintptr_t) mbi.BaseAddress && start >= low) {
+                ret = virtual_alloc((void *) start, length,
+                    MEM_COMMIT | MEM_RESERVE, slab->memprot);
+                if(ret != NULL) {
+                    return ret;
+                }
+            }
+        }
+        addr = (uintptr_t) mbi.BaseAddress & ~(granularity - 1);
     }
-
-    LeaveCriticalSection(&array->cs);
-    return ret;
+    return NULL;
 }
 
-static int _slab_ensure(slab_t *slab)
+// Carve a fresh object from the current chunk, allocating a new chunk if
+// it's used up. Requires slab->cs to be held.
+static void *_slab_carve(slab_t *slab)
 {
-    if(slab->offset == slab->length) {
-        uint8_t *mem = virtual_alloc(NULL, slab->size * slab->count,
-            MEM_COMMIT | MEM_RESERVE, slab->memprot);
+    if(slab->chunk == NULL || slab->offset == slab->count) {
+        uint8_t *mem; uintptr_t length = slab->size * slab->count;
+
+        if(slab->near != NULL) {
+            mem = _slab_alloc_near(slab, length);
+        }
+        else {
+            mem = virtual_alloc(NULL, length,
+                MEM_COMMIT | MEM_RESERVE, slab->memprot);
+        }
+
         if(mem == NULL) {
             pipe("CRITICAL:Error allocating memory for slab!");
-            return -1;
+            return NULL;
         }
 
-        array_set(&slab->array, slab->offset / slab->count, mem);
-
-        slab->length += slab->count;
+        slab->chunk = mem, slab->offset = 0;
+        slab->chunk_count++;
     }
-    return 0;
-}
 
-void slab_init(slab_t *slab, uint32_t size, uint32_t count,
-    uint32_t memory_protection)
-{
-    array_init(&slab->array);
-    slab->size = size;
-    slab->count = count;
-    slab->offset = 0;
-    slab->length = 0;
-    slab->memprot = memory_protection;
+    return slab->chunk + slab->size * slab->offset++;
 }
 
-void *slab_getmem(slab_t *slab)
+// The magazine of the current thread, created on first use. Thread
+// identifiers are reused, and so are the magazines of exited threads.
+static slab_magazine_t *_slab_magazine(slab_t *slab)
 {
-    if(_slab_ensure(slab) == 0) {
-        uint8_t *mem = array_get(&slab->array, slab->offset / slab->count);
-        uint8_t *ret = mem + slab->size * (slab->offset % slab->count);
-        slab->offset++;
-        return ret;
-    }
-    return NULL;
-}
+    uint32_t tid = get_current_thread_id();
 
-void slab_return_last(slab_t *slab)
-{
-    if(slab->offset != 0) {
-        slab->offset--;
+    slab_magazine_t *mag = array_get(&slab->magazines, tid);
+    if(mag != NULL) {
+        return mag;
     }
-}
-
-uint32_t slab_size(const slab_t *slab)
-{
-    return slab->size;
-}
-
-static int _sort_uint32(const void *a, const void *b)
-{
-    uint32_t _a = *(const uint32_t *) a;
-    uint32_t _b = *(const uint32_t *) b;
-    return _a - _b;
-}
 
-static int _sort_uint64(const void *a, const void *b)
-{
-    uint64_t _a = *(const uint64_t *) a;
-    uint64_t _b = *(const uint64_t *) b;
-    return _a - _b;
-}
+    mag = (slab_magazine_t *) mem_alloc(sizeof(slab_magazine_t));
+    if(mag == NULL) {
+        return NULL;
+    }
 
-int dnq_init(dnq_t *dnq, void *list, uint32_t size, uint32_t length)
-{
-    dnq->list = list;
-    dnq->size = size;
-    dnq->length = length;
-
-    switch (size) {
-    case sizeof(uint32_t):
-        qsort(list, length, size, &_sort_uint32);
-        break;
-
-    case sizeof(uint64_t):
-        qsort(list, length, size, &_sort_uint64);
-        break;
+    if(array_set(&slab->magazines, tid, mag) < 0) {
+        mem_free(mag);
+        return NULL;
     }
 
-    return 0;
+    EnterCriticalSection(&slab->cs);
+    mag->next = slab->magazine_list, slab->magazine_list = mag;
+    LeaveCriticalSection(&slab->cs);
+    return mag;
 }
 
-uint32_t *dnq_iter32(dnq_t *dnq)
+static void *_slab_pop(slab_t *slab)
 {
-    return (uint32_t *) dnq->list;
+    void *ret = slab->freelist;
+    slab->freelist = *(void **) ret;
+    slab->free_count--;
+    return ret;
 }
 
-uint64_t *dnq_iter64(dnq_t *dnq)
+static void _slab_push(slab_t *slab, void *ptr)
 {
-    return (uint64_t *) dnq->list;
+    *(void **) ptr = slab->freelist;
+    slab->freelist = ptr;
+    slab->free_count++;
 }
 
-uintptr_t *dnq_iterptr(dnq_t *dnq)
+void slab_init(slab_t *slab, uint32_t size, uint32_t count,
+    uint32_t memory_protection)
 {
-    return (uintptr_t *) dnq->list;
+    slab_init_near(slab, size, count, memory_protection, NULL);
 }
 
-int dnq_isempty(dnq_t *dnq)
+void slab_init_near(slab_t *slab, uint32_t size, uint32_t count,
+    uint32_t memory_protection, const void *addr)
 {
-    return dnq->list == NULL || dnq->length == 0;
+    memset(slab, 0, sizeof(slab_t));
+    InitializeCriticalSection(&slab->cs);
+    array_init(&slab->magazines);
+
+    // Freed objects hold the link of the free list.
+    slab->size = size < sizeof(void *) ? sizeof(void *) : size;
+    slab->count = count;
+    slab->memprot = memory_protection;
+    slab->near = (const uint8_t *) addr;
 }
 
-int dnq_has32(dnq_t *dnq, uint32_t value)
+void *slab_getmem(slab_t *slab)
 {
-    uint32_t low = 0, high = dnq->length - 1;
-    uint32_t *list = dnq_iter32(dnq);
+    slab_magazine_t *mag = _slab_magazine(slab); uint8_t *ret = NULL;
 
-    while (high - low > 1) {
-        uint32_t index = low + (high - low) / 2;
-        if(value == list[index]) {
-            return 1;
-        }
+    if(mag != NULL && mag->count != 0) {
+        ret = mag->objects[--mag->count];
+        mag->allocs++;
+        memset(ret, 0, slab->size);
+        return ret;
+    }
 
-        if(value > list[index]) {
-            low = index;
-            continue;
-        }
+    EnterCriticalSection(&slab->cs);
 
-        if(value < list[index]) {
-            high = index;
-            continue;
+    if(mag == NULL) {
+        slab->allocs++;
+    }
+    else {
+        mag->allocs++;
+
+        // Refill half the magazine at once, so that the next allocations
+        // of this thread don't need the lock.
+        while (slab->freelist != NULL &&
+                mag->count < SLAB_MAGAZINE_SIZE / 2) {
+            mag->objects[mag->count++] = _slab_pop(slab);
         }
     }
 
-    if(value == list[low] || value == list[high]) {
-        return 1;
+    if(mag != NULL && mag->count != 0) {
+        ret = mag->objects[--mag->count];
     }
+    else if(slab->freelist != NULL) {
+        ret = _slab_pop(slab);
+    }
+    else {
+        // Fresh objects are zeroed already.
+        ret = _slab_carve(slab);
+        LeaveCriticalSection(&slab->cs);
+        return ret;
+    }
+
+    LeaveCriticalSection(&slab->cs);
 
-    return 0;
+    memset(ret, 0, slab->size);
+    return ret;
 }
 
-int dnq_has64(dnq_t *dnq, uint64_t value)
+void slab_free(slab_t *slab, void *ptr)
 {
-    uint32_t low = 0, high = dnq->length - 1;
-    uint64_t *list = dnq_iter64(dnq);
+    if(ptr == NULL) {
+        return;
+    }
 
-    while (high - low > 1) {
-        uint32_t index = low + (high - low) / 2;
-        if(value == list[index]) {
-            return 1;
-        }
+    slab_magazine_t *mag = _slab_magazine(slab);
+    if(mag == NULL) {
+        EnterCriticalSection(&slab->cs);
+        _slab_push(slab, ptr);
+        slab->frees++;
+        LeaveCriticalSection(&slab->cs);
+        return;
+    }
 
-        if(value > list[index]) {
-            low = index;
-            continue;
+    // Return half of a full magazine to the free list, so that the other
+    // threads may use them.
+    if(mag->count == SLAB_MAGAZINE_SIZE) {
+        EnterCriticalSection(&slab->cs);
+        while (mag->count > SLAB_MAGAZINE_SIZE / 2) {
+            _slab_push(slab, mag->objects[--mag->count]);
         }
+        LeaveCriticalSection(&slab->cs);
+    }
 
-        if(value < list[index]) {
-            high = index;
-            continue;
-        }
+    mag->objects[mag->count++] = ptr;
+    mag->frees++;
+}
+
+void slab_stats(slab_t *slab, slab_stats_t *stats)
+{
+    memset(stats, 0, sizeof(slab_stats_t));
+
+    EnterCriticalSection(&slab->cs);
+
+    for (slab_magazine_t *mag = slab->magazine_list;
+            mag != NULL; mag = mag->next) {
+        stats->cached += mag->count;
+        stats->allocs += mag->allocs;
+        stats->frees += mag->frees;
     }
 
-    if(value == list[low] || value == list[high]) {
-        return 1;
+    stats->chunks = slab->chunk_count;
+    stats->capacity = slab->chunk_count * slab->count;
+    stats->free = slab->free_count;
+    stats->allocs += slab->allocs;
+    stats->frees += slab->frees;
+
+    // Objects which have been carved from the chunks but aren't free.
+    uint32_t carved = stats->capacity;
+    if(slab->chunk != NULL) {
+        carved -= slab->count - slab->offset;
     }
+    stats->used = carved - stats->free - stats->cached;
 
-    return 0;
+    LeaveCriticalSection(&slab->cs);
 }
 
-int dnq_hasptr(dnq_t *dnq, uintptr_t value)
+uint32_t slab_size(const slab_t *slab)
 {
-    switch (sizeof(uintptr_t)) {
-    case sizeof(uint32_t):
-        return dnq_has32(dnq, value);
-
-    case sizeof(uint64_t):
-        return dnq_has64(dnq, value);
-    }
+    return slab->size;
 }
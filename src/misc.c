@@ -35,8 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "symbol.h"
 
 static char g_shutdown_mutex[MAX_PATH];
-static array_t g_unicode_buffer_ptr_array;
-static array_t g_unicode_buffer_use_array;
+static uint32_t g_unicode_tls = TLS_OUT_OF_INDEXES;
 
 static monitor_hook_t g_hook_library;
 static monitor_hook_t g_unhook_library;
@@ -48,6 +47,62 @@ static monitor_hook_t g_unhook_library;
 static wchar_t g_aliases[64][2][MAX_PATH];
 static uint32_t g_alias_index;
 
+// Handles which have been resolved to a path before, i.e., registry keys
+// and files, mapped by handle / 4 onto their normalized path, so that
+// repeated queries on the same handle skip the system call and the
+// normalization. Entries are added on the first query of a handle. As
+// handles are reused, the hooks in sigs/handles.rst remove the entries of
+// handles which are closed, of the source handle of DUPLICATE_CLOSE_SOURCE
+// and of the new handle of NtDuplicateObject. The hooks in
+// sigs/registry_native.rst and sigs/file_native.rst remove those of
+// deleted keys and renamed files, and of the handles handed out for opened
+// or created objects. Each cache is disabled unless turned on through its
+// config key. Lookups don't take a lock, updates take the lock of the
+// shard of the handle, so that threads working on different handles don't
+// contend. Only shorter paths, and a limited number, are cached.
+#define HANDLE_CACHE_SHARDS 16
+
+// The statistics are reported every this many lookups.
+#define HANDLE_CACHE_REPORT 0x1000
+
+#define REG_KEY_CACHE_LENGTH 256
+#define REG_KEY_CACHE_ENTRIES 4096
+
+#define FILE_PATH_CACHE_LENGTH 512
+#define FILE_PATH_CACHE_ENTRIES 8192
+
+typedef struct _handle_path_t {
+    HANDLE handle;
+    uint32_t length;
+
+    // Unique for every time the entry is filled in, and zero once it's
+    // released, so readers notice when it's reused under their feet.
+    uint32_t generation;
+    wchar_t path[0];
+} handle_path_t;
+
+typedef struct _handle_cache_t {
+    const char *name;
+    int enabled;
+    uint32_t max_length;
+    uint32_t max_entries;
+    array_t paths;
+    slab_t slab;
+    CRITICAL_SECTION cs[HANDLE_CACHE_SHARDS];
+    LONG hits;
+    LONG misses;
+    LONG entries;
+    LONG generation;
+} handle_cache_t;
+
+static handle_cache_t g_reg_keys;
+static handle_cache_t g_file_paths;
+
+static void _handle_cache_init(handle_cache_t *cache, const char *name,
+    uint32_t max_length, uint32_t max_entries);
+
+static void WINAPI _unicode_stack_free(void *value);
+
 static uintptr_t g_exception_addrs[32];
 static uint32_t g_exception_addr_count;
 
@@ -73,11 +128,15 @@ int misc_init(const char *shutdown_mutex)
 {
     strncpy(g_shutdown_mutex, shutdown_mutex, sizeof(g_shutdown_mutex));
 
-    // TODO Replace custom unicode buffer logic by implementing free() support
-    // to our slab allocator (which is actually what a slab allocator is
-    // supposed to do, afaik).
-    array_init(&g_unicode_buffer_ptr_array);
-    array_init(&g_unicode_buffer_use_array);
+    g_unicode_tls = tls_alloc(&_unicode_stack_free);
+    if(g_unicode_tls == TLS_OUT_OF_INDEXES) {
+        pipe("CRITICAL:Unable to allocate TLS index for unicode buffers!");
+    }
+
+    _handle_cache_init(&g_reg_keys, "regkey",
+        REG_KEY_CACHE_LENGTH, REG_KEY_CACHE_ENTRIES);
+    _handle_cache_init(&g_file_paths, "file",
+        FILE_PATH_CACHE_LENGTH, FILE_PATH_CACHE_ENTRIES);
 
     ADD_ALIAS(L"\\SystemRoot\\", L"C:\\Windows\\");
 
@@ -133,44 +192,105 @@ void misc_set_monitor_options(uint32_t track, uint32_t mode,
     }
 }
 
-// Maximum number of buffers that we reuse.
+// Each thread has a stack of scratch buffers for unicode strings of up to
+// MAX_PATH_W characters. The buffers are carved from reservations of
+// UNICODE_BLOCK_BUFFERS buffers, of which the first page holds the
+// unicode_stack_t, and are only committed the first time they're handed
+// out. When all buffers of a reservation are in use the next one is
+// chained to it, up to UNICODE_BUFFER_COUNT buffers per thread. As the
+// lowest free buffer is handed out first, and buffers are mostly released
+// in reverse order, only the bottom few ever get committed. The
+// reservations are released by the destructor of the TLS slot as the
+// thread exits.
 #define UNICODE_BUFFER_COUNT (0x1000/sizeof(void *))
+#define UNICODE_BLOCK_BUFFERS 16
+#define UNICODE_BUFFER_SIZE ((MAX_PATH_W+1) * sizeof(wchar_t))
+#define UNICODE_STACK_HEADER 0x1000
+#define UNICODE_STACK_SIZE \
+    (UNICODE_STACK_HEADER + UNICODE_BLOCK_BUFFERS * UNICODE_BUFFER_SIZE)
+
+typedef struct _unicode_stack_t {
+    struct _unicode_stack_t *next;
+    uint32_t used;
+    uint32_t committed;
+} unicode_stack_t;
+
+static unicode_stack_t *_unicode_stack_alloc()
+{
+    unicode_stack_t *stack = (unicode_stack_t *) virtual_alloc(NULL,
+        UNICODE_STACK_SIZE, MEM_RESERVE, PAGE_READWRITE);
+    if(stack == NULL) {
+        return NULL;
+    }
 
-wchar_t *get_unicode_buffer()
-{
-    uint8_t *used = (uint8_t *)
-        array_get(&g_unicode_buffer_use_array, get_current_thread_id());
-
-    wchar_t **ptrs = (wchar_t **)
-        array_get(&g_unicode_buffer_ptr_array, get_current_thread_id());
+    if(virtual_alloc(stack, UNICODE_STACK_HEADER,
+            MEM_COMMIT, PAGE_READWRITE) == NULL) {
+        virtual_free(stack, 0, MEM_RELEASE);
+        return NULL;
+    }
+    return stack;
+}
 
-    // If not done yet, allocate initial memory management data.
-    if(used == NULL && ptrs == NULL) {
-        used = (uint8_t *)
-            virtual_alloc_rw(NULL, UNICODE_BUFFER_COUNT * sizeof(uint8_t));
+static void WINAPI _unicode_stack_free(void *value)
+{
+    unicode_stack_t *stack = (unicode_stack_t *) value;
+    while (stack != NULL) {
+        unicode_stack_t *next = stack->next;
+        virtual_free(stack, 0, MEM_RELEASE);
+        stack = next;
+    }
+}
 
-        ptrs = (wchar_t **)
-            virtual_alloc_rw(NULL, UNICODE_BUFFER_COUNT * sizeof(wchar_t **));
+static unicode_stack_t *_unicode_stack()
+{
+    if(g_unicode_tls == TLS_OUT_OF_INDEXES) {
+        return NULL;
+    }
 
-        array_set(&g_unicode_buffer_use_array, get_current_thread_id(), used);
-        array_set(&g_unicode_buffer_ptr_array, get_current_thread_id(), ptrs);
+    unicode_stack_t *stack = (unicode_stack_t *) tls_get(g_unicode_tls);
+    if(stack == NULL) {
+        stack = _unicode_stack_alloc();
+        if(stack != NULL) {
+            tls_set(g_unicode_tls, stack);
+        }
     }
+    return stack;
+}
 
-    for (uint32_t idx = 0; idx < UNICODE_BUFFER_COUNT; idx++) {
-        if(ptrs[idx] == NULL) {
-            ptrs[idx] =
-                virtual_alloc_rw(NULL, (MAX_PATH_W+1) * sizeof(wchar_t));
-            if(ptrs[idx] == NULL) {
-                pipe("WARNING:Error allocating memory for unicode buffer");
+wchar_t *get_unicode_buffer()
+{
+    unicode_stack_t *stack = _unicode_stack();
+
+    for (uint32_t count = UNICODE_BLOCK_BUFFERS; stack != NULL;
+            count += UNICODE_BLOCK_BUFFERS) {
+        if(stack->used != (1u << UNICODE_BLOCK_BUFFERS) - 1) {
+            uint32_t idx = __builtin_ctz(~stack->used);
+            wchar_t *ptr = (wchar_t *)((uint8_t *) stack +
+                UNICODE_STACK_HEADER + idx * UNICODE_BUFFER_SIZE);
+
+            // The buffers below this one are all in use, so it's either
+            // committed already or the next one to be committed.
+            if(idx == stack->committed) {
+                if(virtual_alloc(ptr, UNICODE_BUFFER_SIZE,
+                        MEM_COMMIT, PAGE_READWRITE) != NULL) {
+                    stack->committed++;
+                }
+                else {
+                    pipe("WARNING:Error allocating memory for unicode "
+                        "buffer");
+                    break;
+                }
             }
+
+            // Zero-terminate it just in case.
+            stack->used |= 1u << idx, *ptr = 0;
+            return ptr;
         }
 
-        // Return this pointer if it has not been used yet. Zero-terminate it
-        // just in case.
-        if(used[idx] == 0) {
-            used[idx] = 1, *ptrs[idx] = 0;
-            return ptrs[idx];
+        if(stack->next == NULL && count < UNICODE_BUFFER_COUNT) {
+            stack->next = _unicode_stack_alloc();
         }
+        stack = stack->next;
     }
 
     // If we get here there is probably a memory leak going on somewhere.
@@ -178,7 +298,7 @@ wchar_t *get_unicode_buffer()
         "unicode buffers somewhere");
 
     // However, just in case, return some memory in order not to crash.
-    return virtual_alloc_rw(NULL, (MAX_PATH_W+1) * sizeof(wchar_t));
+    return virtual_alloc_rw(NULL, UNICODE_BUFFER_SIZE);
 }
 
 void free_unicode_buffer(wchar_t *ptr)
@@ -187,24 +307,36 @@ void free_unicode_buffer(wchar_t *ptr)
         return;
     }
 
-    uint8_t *used = (uint8_t *)
-        array_get(&g_unicode_buffer_use_array, get_current_thread_id());
-
-    wchar_t **ptrs = (wchar_t **)
-        array_get(&g_unicode_buffer_ptr_array, get_current_thread_id());
+    unicode_stack_t *stack = NULL;
+    if(g_unicode_tls != TLS_OUT_OF_INDEXES) {
+        stack = (unicode_stack_t *) tls_get(g_unicode_tls);
+    }
 
-    // Cross-reference the pointer against the list of pointers. If found,
-    // set used to zero.
-    for (uint32_t idx = 0; idx < UNICODE_BUFFER_COUNT; idx++) {
-        if(ptrs[idx] == ptr) {
-            used[idx] = 0;
+    for (; stack != NULL; stack = stack->next) {
+        uintptr_t offset = (uint8_t *) ptr - (uint8_t *) stack;
+        if(offset >= UNICODE_STACK_HEADER && offset < UNICODE_STACK_SIZE) {
+            offset -= UNICODE_STACK_HEADER;
+            stack->used &= ~(1u << (offset / UNICODE_BUFFER_SIZE));
             return;
         }
     }
 
-    // If we reach here, then this buffer is not maintained by the list of
-    // available buffers, and we have to deallocate it manually.
-    virtual_free(ptr, (MAX_PATH_W+1) * sizeof(wchar_t), MEM_RELEASE);
+    // If we reach here, then this buffer is not part of the stack of this
+    // thread, and we have to deallocate it manually.
+    virtual_free(ptr, 0, MEM_RELEASE);
+}
+
+void free_unicode_buffers()
+{
+    if(g_unicode_tls == TLS_OUT_OF_INDEXES) {
+        return;
+    }
+
+    unicode_stack_t *stack = (unicode_stack_t *) tls_get(g_unicode_tls);
+    if(stack != NULL) {
+        tls_set(g_unicode_tls, NULL);
+        _unicode_stack_free(stack);
+    }
 }
 
 uint32_t pid_from_process_handle(HANDLE process_handle)
@@ -417,6 +549,169 @@ wchar_t *extract_unicode_string_objattr(const OBJECT_ATTRIBUTES *objattr)
     return extract_unicode_string_unistr(obj.ObjectName);
 }
 
+static void _handle_cache_init(handle_cache_t *cache, const char *name,
+    uint32_t max_length, uint32_t max_entries)
+{
+    cache->name = name;
+    cache->max_length = max_length;
+    cache->max_entries = max_entries;
+    array_init(&cache->paths);
+    slab_init(&cache->slab,
+        sizeof(handle_path_t) + max_length * sizeof(wchar_t), 64,
+        PAGE_READWRITE);
+
+    for (uint32_t idx = 0; idx < HANDLE_CACHE_SHARDS; idx++) {
+        InitializeCriticalSection(&cache->cs[idx]);
+    }
+}
+
+static CRITICAL_SECTION *_handle_cache_shard(
+    handle_cache_t *cache, HANDLE handle)
+{
+    return &cache->cs[(uintptr_t) handle / 4 % HANDLE_CACHE_SHARDS];
+}
+
+// Every so many lookups the statistics are reported to the host.
+static void _handle_cache_count(handle_cache_t *cache, int hit)
+{
+    InterlockedIncrement(hit != 0 ? &cache->hits : &cache->misses);
+
+    uint32_t hits = cache->hits, misses = cache->misses;
+    if((hits + misses) % HANDLE_CACHE_REPORT == 0) {
+        pipe("INFO:%z cache: %d hits, %d misses, %d entries",
+            cache->name, hits, misses, cache->entries);
+    }
+}
+
+// Copies the cached path of handle, if any, and returns its length.
+static uint32_t _handle_cache_get(handle_cache_t *cache,
+    HANDLE handle, wchar_t *path)
+{
+    if(cache->enabled == 0) {
+        return 0;
+    }
+
+    uintptr_t index = (uintptr_t) handle / 4;
+    handle_path_t *entry = (handle_path_t *) array_get(&cache->paths, index);
+    uint32_t generation = 0, length = 0;
+
+    if(entry != NULL) {
+        generation = __atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE);
+        length = entry->length;
+    }
+
+    if(generation == 0 || length == 0 || length >= cache->max_length) {
+        _handle_cache_count(cache, 0);
+        return 0;
+    }
+
+    memcpy(path, entry->path, length * sizeof(wchar_t));
+    path[length] = 0;
+
+    // The entry may have been replaced or removed while we were copying
+    // it, and even been handed out again for the same handle, in which case
+    // it has a new generation.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE) != generation ||
+            entry->handle != handle || entry->length != length ||
+            array_get(&cache->paths, index) != entry) {
+        _handle_cache_count(cache, 0);
+        return 0;
+    }
+
+    _handle_cache_count(cache, 1);
+    return length;
+}
+
+// Invalidates an entry for concurrent readers before it's released.
+static void _handle_cache_free(handle_cache_t *cache, handle_path_t *entry)
+{
+    __atomic_store_n(&entry->generation, 0, __ATOMIC_RELEASE);
+    slab_free(&cache->slab, entry);
+}
+
+static void _handle_cache_remove(handle_cache_t *cache, HANDLE handle)
+{
+    uintptr_t index = (uintptr_t) handle / 4;
+
+    // Most handles which are closed aren't in this cache at all.
+    if(array_get(&cache->paths, index) == NULL) {
+        return;
+    }
+
+    CRITICAL_SECTION *cs = _handle_cache_shard(cache, handle);
+    EnterCriticalSection(cs);
+
+    handle_path_t *old = (handle_path_t *) array_get(&cache->paths, index);
+    if(old != NULL) {
+        array_unset(&cache->paths, index);
+        _handle_cache_free(cache, old);
+        InterlockedDecrement(&cache->entries);
+    }
+
+    LeaveCriticalSection(cs);
+}
+
+static void _handle_cache_set(handle_cache_t *cache,
+    HANDLE handle, const wchar_t *path, uint32_t length)
+{
+    if(cache->enabled == 0) {
+        return;
+    }
+
+    if(length == 0 || length >= cache->max_length) {
+        _handle_cache_remove(cache, handle);
+        return;
+    }
+
+    uintptr_t index = (uintptr_t) handle / 4;
+    CRITICAL_SECTION *cs = _handle_cache_shard(cache, handle);
+    EnterCriticalSection(cs);
+
+    handle_path_t *old = (handle_path_t *) array_get(&cache->paths, index);
+
+    // When full, only existing entries are updated.
+    if(old == NULL && (uint32_t) cache->entries >= cache->max_entries) {
+        LeaveCriticalSection(cs);
+        return;
+    }
+
+    handle_path_t *entry = (handle_path_t *) slab_getmem(&cache->slab);
+    if(entry == NULL) {
+        LeaveCriticalSection(cs);
+        return;
+    }
+
+    entry->handle = handle;
+    entry->length = length;
+    memcpy(entry->path, path, length * sizeof(wchar_t));
+
+    // Published last, so readers which see it also see the path.
+    uint32_t generation = (uint32_t) InterlockedIncrement(&cache->generation);
+    __atomic_store_n(&entry->generation,
+        generation != 0 ? generation : 1, __ATOMIC_RELEASE);
+
+    if(array_set(&cache->paths, index, entry) < 0) {
+        slab_free(&cache->slab, entry);
+    }
+    else if(old != NULL) {
+        _handle_cache_free(cache, old);
+    }
+    else {
+        InterlockedIncrement(&cache->entries);
+    }
+
+    LeaveCriticalSection(cs);
+}
+
+static void _handle_cache_stats(handle_cache_t *cache,
+    uint32_t *hits, uint32_t *misses, uint32_t *entries)
+{
+    *hits = cache->hits;
+    *misses = cache->misses;
+    *entries = cache->entries;
+}
+
 static uint32_t _path_from_handle(HANDLE handle, wchar_t *path)
 {
     OBJECT_NAME_INFORMATION *object_name = (OBJECT_NAME_INFORMATION *)
@@ -644,10 +939,16 @@ uint32_t path_get_full_pathW(const wchar_t *in, wchar_t *out)
 
 uint32_t path_get_full_path_handle(HANDLE file_handle, wchar_t *out)
 {
-    wchar_t *input = get_unicode_buffer(); uint32_t ret = 0;
+    uint32_t ret = _handle_cache_get(&g_file_paths, file_handle, out);
+    if(ret != 0) {
+        return ret;
+    }
+
+    wchar_t *input = get_unicode_buffer();
 
     if(_path_from_handle(file_handle, input) != 0) {
         ret = path_get_full_pathW(input, out);
+        _handle_cache_set(&g_file_paths, file_handle, out, ret);
     }
     else {
         out[0] = 0;
@@ -657,6 +958,28 @@ uint32_t path_get_full_path_handle(HANDLE file_handle, wchar_t *out)
     return ret;
 }
 
+void file_path_cache_enable(int enable)
+{
+    g_file_paths.enabled = enable;
+}
+
+void file_path_cache_set(HANDLE file_handle,
+    const wchar_t *path, uint32_t length)
+{
+    _handle_cache_set(&g_file_paths, file_handle, path, length);
+}
+
+void file_path_cache_remove(HANDLE file_handle)
+{
+    _handle_cache_remove(&g_file_paths, file_handle);
+}
+
+void file_path_cache_stats(uint32_t *hits, uint32_t *misses,
+    uint32_t *entries)
+{
+    _handle_cache_stats(&g_file_paths, hits, misses, entries);
+}
+
 uint32_t path_get_full_path_unistr(const UNICODE_STRING *in, wchar_t *out)
 {
     wchar_t *input = get_unicode_buffer(); uint32_t ret = 0;
@@ -816,6 +1139,27 @@ static uint32_t _reg_key_normalize(wchar_t *regkey)
     return lstrlenW(regkey);
 }
 
+void reg_key_cache_enable(int enable)
+{
+    g_reg_keys.enabled = enable;
+}
+
+void reg_key_cache_set(HANDLE key_handle,
+    const wchar_t *regkey, uint32_t length)
+{
+    _handle_cache_set(&g_reg_keys, key_handle, regkey, length);
+}
+
+void reg_key_cache_remove(HANDLE key_handle)
+{
+    _handle_cache_remove(&g_reg_keys, key_handle);
+}
+
+void reg_key_cache_stats(uint32_t *hits, uint32_t *misses, uint32_t *entries)
+{
+    _handle_cache_stats(&g_reg_keys, hits, misses, entries);
+}
+
 uint32_t reg_get_key(HANDLE key_handle, wchar_t *regkey)
 {
     uint32_t buffer_length =
@@ -827,6 +1171,11 @@ uint32_t reg_get_key(HANDLE key_handle, wchar_t *regkey)
         return offset;
     }
 
+    offset = _handle_cache_get(&g_reg_keys, key_handle, regkey);
+    if(offset != 0) {
+        return offset;
+    }
+
     KEY_NAME_INFORMATION *key_name_information =
         (KEY_NAME_INFORMATION *) mem_alloc(buffer_length);
     if(key_name_information == NULL) return 0;
@@ -846,7 +1195,10 @@ uint32_t reg_get_key(HANDLE key_handle, wchar_t *regkey)
         regkey[offset + length] = 0;
 
         mem_free(key_name_information);
-        return _reg_key_normalize(regkey);
+
+        length = _reg_key_normalize(regkey);
+        reg_key_cache_set(key_handle, regkey, length);
+        return length;
     }
     mem_free(key_name_information);
     return 0;
@@ -1318,6 +1670,72 @@ uint64_t hash_uint64(uint64_t value)
     return hash_buffer(&value, sizeof(value));
 }
 
+static inline uint64_t _rotl64(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+static inline uint64_t _read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t _hash_round(uint64_t acc, uint64_t value)
+{
+    return _rotl64(acc + value * 0xc2b2ae3d27d4eb4full, 31) *
+        0x9e3779b185ebca87ull;
+}
+
+uint64_t hash_block(const void *buf, uintptr_t length)
+{
+    const uint8_t *p = (const uint8_t *) buf, *end = p + length;
+    uint64_t ret = 0x27d4eb2f165667c5ull;
+
+    // Four independent lanes, so that we're not bound by the latency of
+    // the multiplications.
+    if(length >= 32) {
+        uint64_t lanes[4] = {
+            0x60ea27eeadc0b5d6ull, 0xc2b2ae3d27d4eb4full,
+            0x0000000000000000ull, 0x61c8864e7a143579ull,
+        };
+
+        for (; end - p >= 32; p += 32) {
+            lanes[0] = _hash_round(lanes[0], _read64(p));
+            lanes[1] = _hash_round(lanes[1], _read64(p + 8));
+            lanes[2] = _hash_round(lanes[2], _read64(p + 16));
+            lanes[3] = _hash_round(lanes[3], _read64(p + 24));
+        }
+
+        ret = _rotl64(lanes[0], 1) + _rotl64(lanes[1], 7) +
+            _rotl64(lanes[2], 12) + _rotl64(lanes[3], 18);
+        for (uint32_t idx = 0; idx < 4; idx++) {
+            ret = (ret ^ _hash_round(0, lanes[idx])) * 0x9e3779b185ebca87ull +
+                0x85ebca77c2b2ae63ull;
+        }
+    }
+
+    ret += length;
+
+    for (; end - p >= 8; p += 8) {
+        ret ^= _hash_round(0, _read64(p));
+        ret = _rotl64(ret, 27) * 0x9e3779b185ebca87ull +
+            0x85ebca77c2b2ae63ull;
+    }
+
+    for (; p < end; p++) {
+        ret ^= *p * 0x27d4eb2f165667c5ull;
+        ret = _rotl64(ret, 11) * 0x9e3779b185ebca87ull;
+    }
+
+    ret ^= ret >> 33;
+    ret *= 0xc2b2ae3d27d4eb4full;
+    ret ^= ret >> 29;
+    ret *= 0x165667b19e3779f9ull;
+    return ret ^ (ret >> 32);
+}
+
 // http://stackoverflow.com/questions/9655202/how-to-convert-integer-to-string-in-c
 int ultostr(int64_t value, char *str, int base)
 {
@@ -1453,20 +1871,12 @@ void hexencode(char *dst, const uint8_t *src, uint32_t length)
 
 void sha1(const void *buffer, uintptr_t buflen, char *hexdigest)
 {
-    SHA1Context ctx;
-    SHA1Reset(&ctx);
-    SHA1Input(&ctx, buffer, buflen);
-    SHA1Result(&ctx);
+    uint8_t digest[SHA1_DIGEST_SIZE]; sha1_t ctx;
 
-    const uint32_t *digest = (const uint32_t *) ctx.Message_Digest;
-    for (uint32_t idx = 0; idx < 5; idx++) {
-        // TODO Our custom snprintf doesn't have proper %08x support yet.
-        hexdigest += our_snprintf(hexdigest, 32, "%x%x%x%x",
-            (digest[idx] >> 24) & 0xff,
-            (digest[idx] >> 16) & 0xff,
-            (digest[idx] >>  8) & 0xff,
-            (digest[idx] >>  0) & 0xff);
-    }
+    sha1_init(&ctx);
+    sha1_update(&ctx, buffer, buflen);
+    sha1_final(&ctx, digest);
+    hexencode(hexdigest, digest, sizeof(digest));
 }
 
 // Various Windows functions feature a string parameter which can also be a
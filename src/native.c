@@ -116,6 +116,10 @@ static NTSTATUS (WINAPI *pLdrRegisterDllNotification)(ULONG Flags,
     LDR_DLL_NOTIFICATION_FUNCTION LdrDllNotificationFunction,
     VOID *Context, VOID **Cookie);
 
+static DWORD (WINAPI *pFlsAlloc)(tls_destructor_t destructor);
+static PVOID (WINAPI *pFlsGetValue)(DWORD index);
+static BOOL (WINAPI *pFlsSetValue)(DWORD index, PVOID value);
+
 static DWORD (WINAPI *pGetWindowThreadProcessId)(
     HWND hWnd, DWORD *lpdwProcessId);
 
@@ -262,6 +266,15 @@ int native_init()
     *(FARPROC *) &pLdrRegisterDllNotification = GetProcAddress(
         GetModuleHandle("ntdll"), "LdrRegisterDllNotification");
 
+    // Fiber local storage is only available as of Windows Vista.
+    HMODULE kernel32 = GetModuleHandle("kernel32");
+    *(FARPROC *) &pFlsAlloc = GetProcAddress(kernel32, "FlsAlloc");
+    *(FARPROC *) &pFlsGetValue = GetProcAddress(kernel32, "FlsGetValue");
+    *(FARPROC *) &pFlsSetValue = GetProcAddress(kernel32, "FlsSetValue");
+    if(pFlsAlloc == NULL || pFlsGetValue == NULL || pFlsSetValue == NULL) {
+        pFlsAlloc = NULL;
+    }
+
     FARPROC pRtlGetLastWin32Error = GetProcAddress(
         GetModuleHandle("ntdll"), "RtlGetLastWin32Error");
 
@@ -557,6 +570,32 @@ void register_dll_notification(LDR_DLL_NOTIFICATION_FUNCTION fn, void *param)
     }
 }
 
+uint32_t tls_alloc(tls_destructor_t destructor)
+{
+    if(pFlsAlloc != NULL) {
+        return pFlsAlloc(destructor);
+    }
+    return TlsAlloc();
+}
+
+void *tls_get(uint32_t index)
+{
+    if(pFlsAlloc != NULL) {
+        return pFlsGetValue(index);
+    }
+    return TlsGetValue(index);
+}
+
+void tls_set(uint32_t index, void *value)
+{
+    if(pFlsAlloc != NULL) {
+        pFlsSetValue(index, value);
+    }
+    else {
+        TlsSetValue(index, value);
+    }
+}
+
 void get_last_error(last_error_t *error)
 {
     assert(g_win32_error_offset != 0, "Win32 error offset is 0!", );
@@ -0,0 +1,136 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packed.h"
+
+static void *(*g_realloc)(void *ptr, size_t length) = &realloc;
+static void (*g_free)(void *ptr) = &free;
+
+void packed_set_allocator(void *(*realloc_func)(void *ptr, size_t length),
+    void (*free_func)(void *ptr))
+{
+    g_realloc = realloc_func;
+    g_free = free_func;
+}
+
+static int _packed_grow(packed_t *p, uint32_t length)
+{
+    if(p->err != 0) {
+        return -1;
+    }
+
+    if(p->capacity - p->length >= length) {
+        return 0;
+    }
+
+    uint32_t capacity = p->capacity != 0 ? p->capacity : 256;
+    while (capacity - p->length < length) {
+        if(capacity >= 0x80000000) {
+            p->err = 1;
+            return -1;
+        }
+        capacity *= 2;
+    }
+
+    uint8_t *buf = g_realloc(p->buf, capacity);
+    if(buf == NULL) {
+        p->err = 1;
+        return -1;
+    }
+
+    p->buf = buf;
+    p->capacity = capacity;
+    return 0;
+}
+
+void packed_init(packed_t *p, uint32_t size)
+{
+    memset(p, 0, sizeof(packed_t));
+    _packed_grow(p, size > PACKED_HEADROOM ? size : PACKED_HEADROOM * 2);
+    p->offset = p->length = PACKED_HEADROOM;
+}
+
+void packed_destroy(packed_t *p)
+{
+    if(p->buf != NULL) {
+        g_free(p->buf);
+    }
+    memset(p, 0, sizeof(packed_t));
+}
+
+void packed_byte(packed_t *p, uint8_t value)
+{
+    if(_packed_grow(p, 1) == 0) {
+        p->buf[p->length++] = value;
+    }
+}
+
+void packed_bytes(packed_t *p, const void *buf, uint32_t length)
+{
+    if(length != 0 && _packed_grow(p, length) == 0) {
+        memcpy(p->buf + p->length, buf, length);
+        p->length += length;
+    }
+}
+
+void packed_varint(packed_t *p, uint64_t value)
+{
+    if(_packed_grow(p, PACKED_VARINT_MAX) == 0) {
+        p->length += packed_encode_varint(p->buf + p->length, value);
+    }
+}
+
+void packed_svarint(packed_t *p, int64_t value)
+{
+    packed_varint(p, packed_zigzag(value));
+}
+
+void packed_blob(packed_t *p, const void *buf, uint32_t length)
+{
+    packed_varint(p, length);
+    packed_bytes(p, buf, length);
+}
+
+void packed_string(packed_t *p, const char *str,
+    uint32_t length, int is_binary)
+{
+    packed_varint(p, ((uint64_t) length << 2) |
+        (is_binary != 0 ? PACKED_STRING_BINARY : PACKED_STRING_TEXT));
+    packed_bytes(p, str, length);
+}
+
+void packed_stringref(packed_t *p, uint32_t id)
+{
+    packed_varint(p, ((uint64_t) id << 2) | PACKED_STRING_REF);
+}
+
+int packed_prepend(packed_t *p, const void *buf, uint32_t length)
+{
+    if(p->err != 0 || p->offset < length) {
+        return -1;
+    }
+
+    p->offset -= length;
+    memcpy(p->buf + p->offset, buf, length);
+    return 0;
+}
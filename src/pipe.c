@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <windows.h>
 #include "misc.h"
 #include "native.h"
@@ -29,6 +30,32 @@ static wchar_t g_pipe_name[MAX_PATH];
 static HANDLE g_pipe_handle;
 static int g_pipe_pid;
 
+// Notifications which need no answer are queued and sent by the writer
+// thread, see pipe_async_init(). Each queued message is a 32-bit length
+// followed by the message. Messages are only sent while holding g_cs, and
+// any pending notifications are sent before a synchronous message, so the
+// host sees all messages in the order they were issued. The queue itself is
+// protected by g_queue_cs, which is never held across a transaction.
+static CRITICAL_SECTION g_queue_cs;
+static uint8_t *g_queue, *g_queue_spare;
+static uint32_t g_queue_length;
+static HANDLE g_queue_event;
+static int g_pipe_async;
+
+// Prefixes of the notifications that may be sent asynchronously.
+static const char *g_async_prefixes[] = {
+    "INFO:", "DEBUG:", "WARNING:", "FILE_NEW:", NULL,
+};
+
+typedef struct _pipe_handler_t {
+    const char *name;
+    pipe_command_t handler;
+} pipe_handler_t;
+
+static pipe_handler_t g_handlers[PIPE_COMMAND_MAX];
+static uint32_t g_handler_count;
+static uint32_t g_command_interval;
+
 static int _pipe_utf8x(char **out, unsigned short x)
 {
     unsigned char buf[3];
@@ -174,6 +201,79 @@ static int _prepend_pid(char *buf, ...)
     return ret;
 }
 
+static int _pipe_is_async(const char *fmt)
+{
+    for (const char **prefix = g_async_prefixes; *prefix != NULL; prefix++) {
+        if(strncmp(fmt, *prefix, strlen(*prefix)) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Send all pending notifications. Must be called while holding g_cs.
+static void _pipe_drain()
+{
+    static char reply[0x1000];
+
+    EnterCriticalSection(&g_queue_cs);
+    uint8_t *queue = g_queue; uint32_t length = g_queue_length;
+    g_queue = g_queue_spare, g_queue_spare = queue, g_queue_length = 0;
+    LeaveCriticalSection(&g_queue_cs);
+
+    for (uint32_t offset = 0; offset < length; ) {
+        uint32_t size = *(uint32_t *)(queue + offset);
+        transact_named_pipe(g_pipe_handle, queue + offset + sizeof(uint32_t),
+            size, reply, sizeof(reply), NULL);
+        offset += sizeof(uint32_t) + ((size + 3) & ~3);
+    }
+}
+
+// Queue a notification. Notifications identical to one that's still
+// pending are coalesced, as is common for, e.g., FILE_NEW of a file that's
+// written to repeatedly. Returns -1 if the queue is full.
+static int _pipe_enqueue(const char *fmt, va_list args)
+{
+    static char buf[0x10000]; int ret = 0, len = 0;
+
+    EnterCriticalSection(&g_queue_cs);
+
+    if(g_pipe_pid != 0) {
+        len = _prepend_pid(buf, get_current_process_id());
+    }
+
+    len += _pipe_sprintf(buf+len, fmt, args);
+
+    for (uint32_t offset = 0; len > 0 && offset < g_queue_length; ) {
+        uint32_t size = *(uint32_t *)(g_queue + offset);
+        if(size == (uint32_t) len &&
+                memcmp(g_queue + offset + sizeof(uint32_t), buf, len) == 0) {
+            len = 0;
+            break;
+        }
+        offset += sizeof(uint32_t) + ((size + 3) & ~3);
+    }
+
+    if(len > 0) {
+        uint32_t size = sizeof(uint32_t) + ((len + 3) & ~3);
+        if(g_queue_length + size <= PIPE_QUEUE_SIZE) {
+            *(uint32_t *)(g_queue + g_queue_length) = len;
+            memcpy(g_queue + g_queue_length + sizeof(uint32_t), buf, len);
+            g_queue_length += size;
+        }
+        else {
+            ret = -1;
+        }
+    }
+
+    LeaveCriticalSection(&g_queue_cs);
+
+    if(ret == 0) {
+        SetEvent(g_queue_event);
+    }
+    return ret;
+}
+
 int pipe(const char *fmt, ...)
 {
 #if DEBUG_STANDALONE
@@ -189,12 +289,27 @@ int pipe(const char *fmt, ...)
         return -1;
     }
 
-    open_pipe_handle();
-
     static char buf[0x10000]; va_list args; int ret = -1, len = 0;
 
+    if(g_pipe_async != 0 && _pipe_is_async(fmt) != 0) {
+        va_start(args, fmt);
+        ret = _pipe_enqueue(fmt, args);
+        va_end(args);
+
+        // With a full queue we wait for the round trip after all.
+        if(ret == 0) {
+            return 0;
+        }
+    }
+
+    open_pipe_handle();
+
     EnterCriticalSection(&g_cs);
 
+    if(g_pipe_async != 0) {
+        _pipe_drain();
+    }
+
     if(g_pipe_pid != 0) {
         len = _prepend_pid(buf, get_current_process_id());
     }
@@ -203,6 +318,7 @@ int pipe(const char *fmt, ...)
     len += _pipe_sprintf(buf+len, fmt, args);
     va_end(args);
 
+    ret = -1;
     if(len > 0) {
         transact_named_pipe(g_pipe_handle, buf, len, buf, sizeof(buf), NULL);
         ret = 0;
@@ -234,6 +350,10 @@ int32_t pipe2(void *out, uint32_t outlen, const char *fmt, ...)
 
     EnterCriticalSection(&g_cs);
 
+    if(g_pipe_async != 0) {
+        _pipe_drain();
+    }
+
     if(g_pipe_pid != 0) {
         len = _prepend_pid(buf, get_current_process_id());
     }
@@ -250,3 +370,140 @@ int32_t pipe2(void *out, uint32_t outlen, const char *fmt, ...)
     LeaveCriticalSection(&g_cs);
     return ret;
 }
+
+static DWORD WINAPI _pipe_writer_thread(LPVOID param)
+{
+    (void) param;
+
+    while (1) {
+        WaitForSingleObject(g_queue_event, INFINITE);
+
+        open_pipe_handle();
+
+        EnterCriticalSection(&g_cs);
+        _pipe_drain();
+        LeaveCriticalSection(&g_cs);
+    }
+    return 0;
+}
+
+void pipe_async_init(int enable)
+{
+    if(enable == 0) {
+        return;
+    }
+
+    InitializeCriticalSection(&g_queue_cs);
+
+    g_queue = virtual_alloc_rw(NULL, PIPE_QUEUE_SIZE);
+    g_queue_spare = virtual_alloc_rw(NULL, PIPE_QUEUE_SIZE);
+    g_queue_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(g_queue == NULL || g_queue_spare == NULL || g_queue_event == NULL) {
+        pipe("CRITICAL:Error initializing the pipe notification queue!");
+        return;
+    }
+
+    if(CreateThread(NULL, 0, &_pipe_writer_thread, NULL, 0, NULL) == NULL) {
+        pipe("CRITICAL:Error creating pipe writer thread!");
+        return;
+    }
+
+    g_pipe_async = 1;
+}
+
+void pipe_flush()
+{
+    // Avoid waiting on a writer thread that was terminated halfway through
+    // a transaction, e.g., when the process is exiting.
+    if(g_pipe_async == 0 || TryEnterCriticalSection(&g_cs) == FALSE) {
+        return;
+    }
+
+    open_pipe_handle();
+    _pipe_drain();
+    LeaveCriticalSection(&g_cs);
+}
+
+void pipe_command_register(const char *name, pipe_command_t handler)
+{
+    if(g_handler_count == PIPE_COMMAND_MAX) {
+        pipe("CRITICAL:Too many pipe command handlers!");
+        return;
+    }
+
+    g_handlers[g_handler_count].name = name;
+    g_handlers[g_handler_count].handler = handler;
+    g_handler_count++;
+}
+
+// Dispatch a single "<NAME> <arguments>" line to its handler.
+static void _pipe_dispatch(char *line)
+{
+    char *args = strchr(line, ' ');
+    if(args != NULL) {
+        *args++ = 0;
+    }
+    else {
+        args = line + strlen(line);
+    }
+
+    for (uint32_t idx = 0; idx < g_handler_count; idx++) {
+        if(strcmp(g_handlers[idx].name, line) == 0) {
+            g_handlers[idx].handler(args);
+            return;
+        }
+    }
+
+    pipe("WARNING:Unknown pipe command: %z", line);
+}
+
+int pipe_command_poll()
+{
+    static char buf[0x10000];
+
+    // Leave room for the terminator. Only one thread polls at a time, as
+    // the reply buffer is shared.
+    int32_t length = pipe2(buf, sizeof(buf) - 1, "COMMAND:");
+    if(length <= 0) {
+        return 0;
+    }
+
+    buf[length] = 0;
+
+    int count = 0;
+    for (char *line = buf, *end; *line != 0; line = end) {
+        end = line + strcspn(line, "\r\n");
+        if(*end != 0) {
+            *end++ = 0;
+        }
+
+        if(*line != 0) {
+            _pipe_dispatch(line);
+            count++;
+        }
+    }
+    return count;
+}
+
+static DWORD WINAPI _pipe_command_thread(LPVOID param)
+{
+    (void) param;
+
+    while (1) {
+        sleep(g_command_interval);
+        pipe_command_poll();
+    }
+    return 0;
+}
+
+void pipe_command_init(uint32_t interval)
+{
+    if(interval == 0) {
+        return;
+    }
+
+    g_command_interval = interval;
+    if(CreateThread(NULL, 0, &_pipe_command_thread, NULL, 0, NULL) == NULL) {
+        pipe("CRITICAL:Error creating pipe command thread!");
+    }
+}
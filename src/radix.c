@@ -0,0 +1,158 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <string.h>
+#include "radix.h"
+
+#define RADIX_LEAF_COUNT (1 << RADIX_LEAF_BITS)
+#define RADIX_MID_COUNT (1 << RADIX_MID_BITS)
+#define RADIX_ROOT_COUNT (1 << RADIX_ROOT_BITS)
+
+#define RADIX_ROOT_INDEX(key) ((key) >> (RADIX_MID_BITS + RADIX_LEAF_BITS))
+#define RADIX_MID_INDEX(key) \
+    (((key) >> RADIX_LEAF_BITS) & (RADIX_MID_COUNT - 1))
+#define RADIX_LEAF_INDEX(key) ((key) & (RADIX_LEAF_COUNT - 1))
+
+static inline void *_load(void *const *slot)
+{
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+// Return the node in slot, allocating and publishing it if there's none
+// yet. If another thread beats us to it, its node is used instead.
+static void **_radix_node(radix_t *map, void **slot, uint32_t count)
+{
+    void **node = (void **) _load(slot), *expected = NULL;
+    if(node != NULL) {
+        return node;
+    }
+
+    node = (void **) map->alloc(count * sizeof(void *));
+    if(node == NULL) {
+        return NULL;
+    }
+
+    if(__atomic_compare_exchange_n(slot, &expected, node, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == 0) {
+        map->free(node);
+        return (void **) expected;
+    }
+    return node;
+}
+
+// The leaf which holds key, if it exists or, with create, could be
+// allocated.
+static void **_radix_leaf(radix_t *map, uint32_t key, int create)
+{
+    void **root = (void **) _load((void **) &map->root);
+    if(root == NULL) {
+        if(create == 0) {
+            return NULL;
+        }
+
+        root = _radix_node(map, (void **) &map->root, RADIX_ROOT_COUNT);
+        if(root == NULL) {
+            return NULL;
+        }
+    }
+
+    void **mid = (void **) _load(&root[RADIX_ROOT_INDEX(key)]);
+    if(mid == NULL) {
+        if(create == 0) {
+            return NULL;
+        }
+
+        mid = _radix_node(map, &root[RADIX_ROOT_INDEX(key)],
+            RADIX_MID_COUNT);
+        if(mid == NULL) {
+            return NULL;
+        }
+    }
+
+    void **leaf = (void **) _load(&mid[RADIX_MID_INDEX(key)]);
+    if(leaf == NULL && create != 0) {
+        leaf = _radix_node(map, &mid[RADIX_MID_INDEX(key)],
+            RADIX_LEAF_COUNT);
+    }
+    return leaf;
+}
+
+void radix_init(radix_t *map, radix_alloc_t alloc, radix_free_t free)
+{
+    map->root = NULL;
+    map->alloc = alloc;
+    map->free = free;
+}
+
+void radix_destroy(radix_t *map)
+{
+    void ***root = map->root;
+    if(root == NULL) {
+        return;
+    }
+
+    for (uint32_t idx = 0; idx < RADIX_ROOT_COUNT; idx++) {
+        if(root[idx] == NULL) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < RADIX_MID_COUNT; j++) {
+            if(root[idx][j] != NULL) {
+                map->free(root[idx][j]);
+            }
+        }
+        map->free(root[idx]);
+    }
+
+    map->free(root);
+    map->root = NULL;
+}
+
+void *radix_get(const radix_t *map, uint32_t key)
+{
+    void **leaf = _radix_leaf((radix_t *) map, key, 0);
+    if(leaf == NULL) {
+        return NULL;
+    }
+    return _load(&leaf[RADIX_LEAF_INDEX(key)]);
+}
+
+int radix_set(radix_t *map, uint32_t key, void *value)
+{
+    void **leaf = _radix_leaf(map, key, 1);
+    if(leaf == NULL) {
+        return -1;
+    }
+
+    __atomic_store_n(&leaf[RADIX_LEAF_INDEX(key)], value, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int radix_unset(radix_t *map, uint32_t key)
+{
+    void **leaf = _radix_leaf(map, key, 0);
+    if(leaf == NULL) {
+        return -1;
+    }
+
+    __atomic_store_n(&leaf[RADIX_LEAF_INDEX(key)], NULL, __ATOMIC_RELEASE);
+    return 0;
+}
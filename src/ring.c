@@ -0,0 +1,199 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <string.h>
+#include "ring.h"
+
+#define RING_ALIGN(length) (((length) + 7) & ~7U)
+
+static inline uint32_t _load(const uint32_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void _store(uint32_t *ptr, uint32_t value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+int ring_create(ring_t *ring, void *mem, uint32_t size)
+{
+    if(size < RING_SIZE(RING_CAPACITY_MIN)) {
+        return -1;
+    }
+
+    uint32_t capacity = RING_CAPACITY_MIN;
+    while (capacity < RING_CAPACITY_MAX &&
+            RING_SIZE(capacity * 2) <= size) {
+        capacity *= 2;
+    }
+
+    ring->hdr = (ring_header_t *) mem;
+    ring->data = (uint8_t *) mem + sizeof(ring_header_t);
+    ring->mask = capacity - 1;
+    ring->pos = ring->seq = 0;
+
+    // Entries of an earlier ring in the same mapping would otherwise carry
+    // the sequence numbers the reader is waiting for.
+    _store(&ring->hdr->magic, 0);
+    memset(ring->hdr, 0, sizeof(ring_header_t));
+    memset(ring->data, 0, capacity);
+
+    ring->hdr->version = RING_VERSION;
+    ring->hdr->capacity = capacity;
+    _store(&ring->hdr->magic, RING_MAGIC);
+    return 0;
+}
+
+int ring_attach(ring_t *ring, void *mem, uint32_t size)
+{
+    ring_header_t *hdr = (ring_header_t *) mem;
+
+    if(size < sizeof(ring_header_t)) {
+        return -1;
+    }
+
+    uint32_t magic = _load(&hdr->magic);
+    if(magic != RING_MAGIC) {
+        return magic == 0 ? 1 : -1;
+    }
+
+    uint32_t capacity = hdr->capacity;
+    if(hdr->version != RING_VERSION || capacity < RING_CAPACITY_MIN ||
+            capacity > RING_CAPACITY_MAX || (capacity & (capacity - 1)) != 0 ||
+            RING_SIZE(capacity) > size) {
+        return -1;
+    }
+
+    ring->hdr = hdr;
+    ring->data = (uint8_t *) mem + sizeof(ring_header_t);
+    ring->mask = capacity - 1;
+    ring->pos = _load(&hdr->tail);
+    ring->seq = _load(&hdr->tail_seq);
+
+    _store(&hdr->attached, 1);
+    return 0;
+}
+
+static void _ring_entry(ring_t *ring, uint32_t length,
+    const void *payload, uint32_t size)
+{
+    uint8_t *entry = ring->data + (ring->pos & ring->mask);
+
+    if(payload != NULL) {
+        memcpy(entry + RING_ENTRY_HEADER, payload, length);
+    }
+
+    memcpy(entry, &length, sizeof(length));
+    _store((uint32_t *)(entry + 4), ++ring->seq);
+    ring->pos += size;
+}
+
+uint32_t ring_write(ring_t *ring, const void *buf, uint32_t length)
+{
+    uint32_t capacity = ring->mask + 1, written = 0;
+    uint32_t used = ring->pos - _load(&ring->hdr->tail);
+
+    while (written < length) {
+        uint32_t chunk = length - written;
+        if(chunk > RING_CHUNK_MAX) {
+            chunk = RING_CHUNK_MAX;
+        }
+
+        uint32_t size = RING_ENTRY_HEADER + RING_ALIGN(chunk);
+        uint32_t offset = ring->pos & ring->mask;
+        uint32_t pad = capacity - offset < size ? capacity - offset : 0;
+
+        if(used + pad + size > capacity) {
+            break;
+        }
+
+        if(pad != 0) {
+            _ring_entry(ring, RING_PAD, NULL, pad);
+        }
+
+        _ring_entry(ring, chunk, (const uint8_t *) buf + written, size);
+        used += pad + size, written += chunk;
+    }
+
+    if(written != 0) {
+        _store(&ring->hdr->head, ring->pos);
+    }
+    return written;
+}
+
+uint32_t ring_tail(const ring_t *ring)
+{
+    return _load(&ring->hdr->tail);
+}
+
+void ring_close(ring_t *ring, uint32_t state)
+{
+    _store(&ring->hdr->state, state);
+}
+
+uint32_t ring_state(const ring_t *ring)
+{
+    return _load(&ring->hdr->state);
+}
+
+uint32_t ring_peek(ring_t *ring, const uint8_t **data)
+{
+    uint32_t capacity = ring->mask + 1;
+
+    while (1) {
+        uint32_t offset = ring->pos & ring->mask, length;
+        uint8_t *entry = ring->data + offset;
+
+        if(_load((const uint32_t *)(entry + 4)) != ring->seq + 1) {
+            return 0;
+        }
+
+        memcpy(&length, entry, sizeof(length));
+
+        if(length == RING_PAD) {
+            ring->pos += capacity - offset, ring->seq++;
+            _store(&ring->hdr->tail_seq, ring->seq);
+            _store(&ring->hdr->tail, ring->pos);
+            continue;
+        }
+
+        // A corrupted entry is never handed out.
+        if(length == 0 || length > RING_CHUNK_MAX ||
+                offset + RING_ENTRY_HEADER + length > capacity) {
+            return 0;
+        }
+
+        *data = entry + RING_ENTRY_HEADER;
+        return length;
+    }
+}
+
+void ring_consume(ring_t *ring)
+{
+    uint32_t length;
+
+    memcpy(&length, ring->data + (ring->pos & ring->mask), sizeof(length));
+
+    ring->pos += RING_ENTRY_HEADER + RING_ALIGN(length), ring->seq++;
+    _store(&ring->hdr->tail_seq, ring->seq);
+    _store(&ring->hdr->tail, ring->pos);
+}
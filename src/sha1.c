@@ -0,0 +1,417 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is shared with the host-side tools, so no Windows dependencies.
+
+#include <stdint.h>
+#include <string.h>
+#include "sha1.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define SHA1_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SHA1_X86 0
+#endif
+
+// The 32-bit Windows ABI only guarantees a 4-byte aligned stack, while the
+// SIMD backends spill 16-byte vectors to it.
+#if defined(__i386__)
+#define SHA1_SIMD(isa) \
+    __attribute__((target(isa), force_align_arg_pointer))
+#else
+#define SHA1_SIMD(isa) __attribute__((target(isa)))
+#endif
+
+#define SHA1_K0 0x5a827999
+#define SHA1_K1 0x6ed9eba1
+#define SHA1_K2 0x8f1bbcdc
+#define SHA1_K3 0xca62c1d6
+
+static const uint32_t g_sha1_init[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const char *g_sha1_names[SHA1_BACKEND_COUNT] = {
+    "auto", "portable", "ssse3", "avx2", "shani",
+};
+
+static int g_sha1_backend;
+static sha1_blocks_t g_sha1_blocks;
+
+static inline uint32_t _rol32(uint32_t value, uint32_t count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+static inline uint32_t _read32be(const uint8_t *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+        (uint32_t) p[2] << 8 | p[3];
+}
+
+static inline void _write32be(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t) value;
+}
+
+// The 80 rounds of one block, of which the message schedule has been
+// expanded into wk[] with the round constants added already. This is where
+// the portable and the vectorized schedules meet.
+static void _sha1_rounds(uint32_t *state, const uint32_t *wk)
+{
+    uint32_t a = state[0], b = state[1], c = state[2];
+    uint32_t d = state[3], e = state[4], t;
+
+#define SHA1_ROUND(f) \
+    t = _rol32(a, 5) + (f) + e + *wk++; \
+    e = d, d = c, c = _rol32(b, 30), b = a, a = t
+
+    for (uint32_t idx = 0; idx < 20; idx++) {
+        SHA1_ROUND(d ^ (b & (c ^ d)));
+    }
+    for (uint32_t idx = 0; idx < 20; idx++) {
+        SHA1_ROUND(b ^ c ^ d);
+    }
+    for (uint32_t idx = 0; idx < 20; idx++) {
+        SHA1_ROUND((b & c) | (d & (b | c)));
+    }
+    for (uint32_t idx = 0; idx < 20; idx++) {
+        SHA1_ROUND(b ^ c ^ d);
+    }
+
+#undef SHA1_ROUND
+
+    state[0] += a, state[1] += b, state[2] += c;
+    state[3] += d, state[4] += e;
+}
+
+static void _sha1_blocks_portable(uint32_t *state,
+    const uint8_t *data, uintptr_t count)
+{
+    uint32_t w[80], wk[80];
+
+    for (; count != 0; count--, data += SHA1_BLOCK_SIZE) {
+        for (uint32_t idx = 0; idx < 16; idx++) {
+            w[idx] = _read32be(&data[idx * 4]);
+        }
+        for (uint32_t idx = 16; idx < 80; idx++) {
+            w[idx] = _rol32(
+                w[idx-3] ^ w[idx-8] ^ w[idx-14] ^ w[idx-16], 1
+            );
+        }
+        for (uint32_t idx = 0; idx < 80; idx++) {
+            static const uint32_t k[4] = {
+                SHA1_K0, SHA1_K1, SHA1_K2, SHA1_K3,
+            };
+            wk[idx] = w[idx] + k[idx / 20];
+        }
+        _sha1_rounds(state, wk);
+    }
+}
+
+#if SHA1_X86
+
+// Message schedule four words at a time. For W[t..t+3] the W[t-3] term of
+// the last lane is W[t] itself, so that lane is first computed without it
+// and then patched up with the rotated first lane.
+static inline __attribute__((always_inline, target("ssse3")))
+void _sha1_blocks_vector(uint32_t *state,
+    const uint8_t *data, uintptr_t count)
+{
+    const __m128i bswap = _mm_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+    );
+    const __m128i k[4] = {
+        _mm_set1_epi32(SHA1_K0), _mm_set1_epi32(SHA1_K1),
+        _mm_set1_epi32(SHA1_K2), _mm_set1_epi32(SHA1_K3),
+    };
+    uint32_t wk[80]; __m128i w[20], r;
+
+    for (; count != 0; count--, data += SHA1_BLOCK_SIZE) {
+        for (uint32_t idx = 0; idx < 4; idx++) {
+            w[idx] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *) &data[idx * 16]), bswap
+            );
+        }
+
+        for (uint32_t idx = 4; idx < 20; idx++) {
+            r = _mm_xor_si128(
+                _mm_xor_si128(w[idx-4], _mm_alignr_epi8(w[idx-3], w[idx-4], 8)),
+                _mm_xor_si128(w[idx-2], _mm_srli_si128(w[idx-1], 4))
+            );
+            r = _mm_or_si128(_mm_slli_epi32(r, 1), _mm_srli_epi32(r, 31));
+
+            __m128i fix = _mm_slli_si128(r, 12);
+            fix = _mm_or_si128(_mm_slli_epi32(fix, 1), _mm_srli_epi32(fix, 31));
+            w[idx] = _mm_xor_si128(r, fix);
+        }
+
+        for (uint32_t idx = 0; idx < 20; idx++) {
+            _mm_storeu_si128((__m128i *) &wk[idx * 4],
+                _mm_add_epi32(w[idx], k[idx / 5]));
+        }
+        _sha1_rounds(state, wk);
+    }
+}
+
+static SHA1_SIMD("ssse3") void _sha1_blocks_ssse3(uint32_t *state,
+    const uint8_t *data, uintptr_t count)
+{
+    _sha1_blocks_vector(state, data, count);
+}
+
+// Same schedule, but with the three-operand VEX encodings.
+static SHA1_SIMD("avx2") void _sha1_blocks_avx2(uint32_t *state,
+    const uint8_t *data, uintptr_t count)
+{
+    _sha1_blocks_vector(state, data, count);
+}
+
+// Four rounds with the SHA extensions, following the reference layout in
+// which the schedule for the upcoming groups is interleaved with the rounds.
+// The E value alternates between e0 and e1.
+#define SHA1_NI_GROUP(i, ein, eout) \
+    if((i) < 4) { \
+        msg[(i) % 4] = _mm_shuffle_epi8( \
+            _mm_loadu_si128((const __m128i *) &data[(i) * 16]), bswap); \
+    } \
+    if((i) == 0) { \
+        ein = _mm_add_epi32(ein, msg[0]); \
+    } \
+    else { \
+        ein = _mm_sha1nexte_epu32(ein, msg[(i) % 4]); \
+    } \
+    eout = abcd; \
+    if((i) >= 3 && (i) <= 18) { \
+        msg[((i) + 1) % 4] = \
+            _mm_sha1msg2_epu32(msg[((i) + 1) % 4], msg[(i) % 4]); \
+    } \
+    abcd = _mm_sha1rnds4_epu32(abcd, ein, (i) / 5); \
+    if((i) >= 1 && (i) <= 16) { \
+        msg[((i) + 3) % 4] = \
+            _mm_sha1msg1_epu32(msg[((i) + 3) % 4], msg[(i) % 4]); \
+    } \
+    if((i) >= 2 && (i) <= 17) { \
+        msg[((i) + 2) % 4] = \
+            _mm_xor_si128(msg[((i) + 2) % 4], msg[(i) % 4]); \
+    }
+
+static SHA1_SIMD("sha,sse4.1,ssse3") void _sha1_blocks_shani(
+    uint32_t *state, const uint8_t *data, uintptr_t count)
+{
+    const __m128i bswap = _mm_set_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+    );
+    __m128i abcd, abcd_save, e0, e0_save, e1, msg[4];
+
+    abcd = _mm_shuffle_epi32(
+        _mm_loadu_si128((const __m128i *) state), 0x1b
+    );
+    e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for (; count != 0; count--, data += SHA1_BLOCK_SIZE) {
+        abcd_save = abcd, e0_save = e0;
+
+        SHA1_NI_GROUP(0, e0, e1);  SHA1_NI_GROUP(1, e1, e0);
+        SHA1_NI_GROUP(2, e0, e1);  SHA1_NI_GROUP(3, e1, e0);
+        SHA1_NI_GROUP(4, e0, e1);  SHA1_NI_GROUP(5, e1, e0);
+        SHA1_NI_GROUP(6, e0, e1);  SHA1_NI_GROUP(7, e1, e0);
+        SHA1_NI_GROUP(8, e0, e1);  SHA1_NI_GROUP(9, e1, e0);
+        SHA1_NI_GROUP(10, e0, e1); SHA1_NI_GROUP(11, e1, e0);
+        SHA1_NI_GROUP(12, e0, e1); SHA1_NI_GROUP(13, e1, e0);
+        SHA1_NI_GROUP(14, e0, e1); SHA1_NI_GROUP(15, e1, e0);
+        SHA1_NI_GROUP(16, e0, e1); SHA1_NI_GROUP(17, e1, e0);
+        SHA1_NI_GROUP(18, e0, e1); SHA1_NI_GROUP(19, e1, e0);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_NI_GROUP
+
+static int _sha1_supported(int backend)
+{
+    uint32_t eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+    if(backend == SHA1_BACKEND_PORTABLE) {
+        return 1;
+    }
+
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 ||
+            (ecx & bit_SSSE3) == 0) {
+        return 0;
+    }
+
+    if(backend == SHA1_BACKEND_SSSE3) {
+        return 1;
+    }
+
+    if(__get_cpuid_max(0, NULL) < 7) {
+        return 0;
+    }
+
+    uint32_t osxsave = ecx & bit_OSXSAVE, sse41 = ecx & bit_SSE4_1;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    if(backend == SHA1_BACKEND_SHANI) {
+        return sse41 != 0 && (ebx & bit_SHA) != 0;
+    }
+
+    // AVX2 additionally requires the OS to save the YMM state.
+    if(osxsave == 0 || (ebx & bit_AVX2) == 0) {
+        return 0;
+    }
+
+    __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+    (void) xcr0_hi;
+    return (xcr0_lo & 6) == 6;
+}
+
+#else
+
+static int _sha1_supported(int backend)
+{
+    return backend == SHA1_BACKEND_PORTABLE;
+}
+
+#endif
+
+int sha1_backend(int backend)
+{
+    static const sha1_blocks_t blocks[SHA1_BACKEND_COUNT] = {
+#if SHA1_X86
+        NULL, _sha1_blocks_portable, _sha1_blocks_ssse3,
+        _sha1_blocks_avx2, _sha1_blocks_shani,
+#else
+        NULL, _sha1_blocks_portable, NULL, NULL, NULL,
+#endif
+    };
+
+    if(backend == SHA1_BACKEND_AUTO) {
+        static const int preference[] = {
+            SHA1_BACKEND_SHANI, SHA1_BACKEND_AVX2, SHA1_BACKEND_SSSE3,
+        };
+
+        backend = SHA1_BACKEND_PORTABLE;
+        for (uint32_t idx = 0; idx < 3; idx++) {
+            if(_sha1_supported(preference[idx]) != 0) {
+                backend = preference[idx];
+                break;
+            }
+        }
+    }
+
+    if(backend <= SHA1_BACKEND_AUTO || backend >= SHA1_BACKEND_COUNT ||
+            _sha1_supported(backend) == 0) {
+        return -1;
+    }
+
+    g_sha1_backend = backend;
+    g_sha1_blocks = blocks[backend];
+    return 0;
+}
+
+int sha1_backend_current()
+{
+    if(g_sha1_blocks == NULL) {
+        sha1_backend(SHA1_BACKEND_AUTO);
+    }
+    return g_sha1_backend;
+}
+
+const char *sha1_backend_name(int backend)
+{
+    if(backend < 0 || backend >= SHA1_BACKEND_COUNT) {
+        return "unknown";
+    }
+    return g_sha1_names[backend];
+}
+
+void sha1_init(sha1_t *ctx)
+{
+    // Selecting the backend lazily may race, but every thread ends up
+    // with the same choice anyway.
+    if(g_sha1_blocks == NULL) {
+        sha1_backend(SHA1_BACKEND_AUTO);
+    }
+
+    memcpy(ctx->state, g_sha1_init, sizeof(ctx->state));
+    ctx->length = 0;
+    ctx->used = 0;
+    ctx->blocks = g_sha1_blocks;
+}
+
+void sha1_update(sha1_t *ctx, const void *buf, uintptr_t length)
+{
+    const uint8_t *ptr = (const uint8_t *) buf;
+
+    ctx->length += length;
+
+    if(ctx->used != 0) {
+        uint32_t left = SHA1_BLOCK_SIZE - ctx->used;
+        if(length < left) {
+            memcpy(&ctx->block[ctx->used], ptr, length);
+            ctx->used += length;
+            return;
+        }
+
+        memcpy(&ctx->block[ctx->used], ptr, left);
+        ctx->blocks(ctx->state, ctx->block, 1);
+        ptr += left, length -= left, ctx->used = 0;
+    }
+
+    if(length >= SHA1_BLOCK_SIZE) {
+        uintptr_t count = length / SHA1_BLOCK_SIZE;
+        ctx->blocks(ctx->state, ptr, count);
+        ptr += count * SHA1_BLOCK_SIZE;
+        length -= count * SHA1_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->block, ptr, length);
+    ctx->used = length;
+}
+
+void sha1_final(sha1_t *ctx, uint8_t *digest)
+{
+    uint64_t bits = ctx->length * 8;
+
+    ctx->block[ctx->used++] = 0x80;
+    if(ctx->used > SHA1_BLOCK_SIZE - 8) {
+        memset(&ctx->block[ctx->used], 0, SHA1_BLOCK_SIZE - ctx->used);
+        ctx->blocks(ctx->state, ctx->block, 1);
+        ctx->used = 0;
+    }
+
+    memset(&ctx->block[ctx->used], 0, SHA1_BLOCK_SIZE - 8 - ctx->used);
+    _write32be(&ctx->block[SHA1_BLOCK_SIZE - 8], (uint32_t)(bits >> 32));
+    _write32be(&ctx->block[SHA1_BLOCK_SIZE - 4], (uint32_t) bits);
+    ctx->blocks(ctx->state, ctx->block, 1);
+
+    for (uint32_t idx = 0; idx < 5; idx++) {
+        _write32be(&digest[idx * 4], ctx->state[idx]);
+    }
+}
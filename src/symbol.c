@@ -30,6 +30,7 @@ static uint32_t *g_monitor_names_addresses;
 static uint16_t *g_monitor_ordinals;
 static uint32_t g_monitor_number_of_names;
 static uint32_t g_monitor_image_size;
+static uint32_t g_monitor_timestamp;
 
 const uint8_t *module_from_address(const uint8_t *addr)
 {
@@ -75,6 +76,30 @@ uint32_t module_image_size(const uint8_t *addr)
     return image_nt_headers->OptionalHeader.SizeOfImage;
 }
 
+uint32_t module_timestamp(const uint8_t *addr)
+{
+    if(addr == g_monitor_base_address) {
+        return g_monitor_timestamp;
+    }
+
+    if(addr == NULL) {
+        return 0;
+    }
+
+    IMAGE_DOS_HEADER *image_dos_header = (IMAGE_DOS_HEADER *) addr;
+    if(image_dos_header->e_magic != IMAGE_DOS_SIGNATURE) {
+        return 0;
+    }
+
+    IMAGE_NT_HEADERS_CROSS *image_nt_headers =
+        (IMAGE_NT_HEADERS_CROSS *)(addr + image_dos_header->e_lfanew);
+    if(image_nt_headers->Signature != IMAGE_NT_SIGNATURE) {
+        return 0;
+    }
+
+    return image_nt_headers->FileHeader.TimeDateStamp;
+}
+
 static int _eat_pointers_for_module(const uint8_t *mod,
     uint32_t **function_addresses, uint32_t **names_addresses,
     uint16_t **ordinals, uint32_t *number_of_names)
@@ -133,6 +158,7 @@ void symbol_init(HMODULE monitor_address)
 
     g_monitor_image_size =
         module_image_size((const uint8_t *) monitor_address);
+    g_monitor_timestamp = module_timestamp((const uint8_t *) monitor_address);
 
     // It's important to resolve the base address at the end of this function
     // because otherwise the earlier function calls will return NULL pointers
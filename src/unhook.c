@@ -34,6 +34,9 @@ typedef struct _region_t {
 
     char            funcname[64];
     uint32_t        region_reported;
+
+    // The hook of this region has been disabled at runtime.
+    volatile uint32_t region_suspended;
 } region_t;
 
 static HANDLE g_unhook_thread_handle, g_watcher_thread_handle, g_main_thread;
@@ -63,6 +66,26 @@ void unhook_detect_add_region(const char *funcname, const uint8_t *addr,
     g_region_index++;
 }
 
+static void _unhook_detect_suspend(const char *funcname, uint32_t suspended)
+{
+    for (uint32_t idx = 0; idx < g_region_index; idx++) {
+        region_t *r = &g_regions[idx];
+        if(strcmp(r->funcname, funcname) == 0) {
+            r->region_suspended = suspended;
+        }
+    }
+}
+
+void unhook_detect_suspend(const char *funcname)
+{
+    _unhook_detect_suspend(funcname, 1);
+}
+
+void unhook_detect_resume(const char *funcname)
+{
+    _unhook_detect_suspend(funcname, 0);
+}
+
 void unhook_detect_remove_dead_regions()
 {
     uint32_t outidx = 0;
@@ -107,6 +130,12 @@ static DWORD WINAPI _unhook_detect_thread(LPVOID param)
         for (uint32_t idx = 0; idx < g_region_index; idx++) {
             region_t *r = &g_regions[idx];
 
+            // The hook has been disabled on purpose, its region may be
+            // restored while it remains disabled.
+            if(r->region_suspended != 0) {
+                continue;
+            }
+
             // Check whether this memory region still equals what we made it.
             if(memcmp(r->region_address, r->region_modified,
                     r->region_length) == 0) {
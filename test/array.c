@@ -63,6 +63,12 @@ int main()
     assert(array_get(&arr, 2) == NULL);
     assert(strcmp(array_get(&arr, 1), "hoi1") == 0);
     assert(array_unset(&arr, 2) == 0);
+
+    // Indices are sparse, e.g., thread identifiers.
+    assert(array_set(&arr, 0xfffffffc, "hoi4") == 0);
+    assert(strcmp(array_get(&arr, 0xfffffffc), "hoi4") == 0);
+    assert(array_get(&arr, 0xfffffff8) == NULL);
+    assert(array_get(&arr, 0x7ffffffc) == NULL);
     pipe("INFO:Test finished!");
     return 0;
 }
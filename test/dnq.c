@@ -126,6 +126,36 @@ int main()
     assert(dnq_iter32(&d1)[4] == 42);
     assert(dnq_iter64(&d2)[4] == 42);
     assert(dnq_iterptr(&d3)[4] == 42);
+
+    dnq_t d4, d5;
+
+    // Values which only differ in their upper half.
+    uint64_t val4[] = {
+        3ull << 32, 1ull << 32, 2ull << 32, 1,
+    };
+    uint64_t val4_sorted[] = {
+        1, 1ull << 32, 2ull << 32, 3ull << 32,
+    };
+
+    dnq_init(&d4, val4, sizeof(uint64_t), sizeof(val4) / sizeof(uint64_t));
+    assert(memcmp(d4.list, val4_sorted, sizeof(val4_sorted)) == 0);
+    assert(dnq_has64(&d4, 2ull << 32) == 1);
+    assert(dnq_has64(&d4, 4ull << 32) == 0);
+
+    // Large enough to be searched through the Eytzinger copy.
+    static uint32_t val5[4096];
+    for (uint32_t idx = 0; idx < 4096; idx++) {
+        val5[idx] = (4095 - idx) * 0x1000;
+    }
+
+    dnq_init(&d5, val5, sizeof(uint32_t), 4096);
+    assert(d5.tree != NULL);
+    assert(dnq_iter32(&d5)[1] == 0x1000);
+    assert(dnq_has32(&d5, 0) == 1);
+    assert(dnq_has32(&d5, 0x123000) == 1);
+    assert(dnq_has32(&d5, 0x123001) == 0);
+    assert(dnq_has32(&d5, 0xfff000) == 1);
+    assert(dnq_has32(&d5, 0x1000000) == 0);
     pipe("INFO:Test finished!");
     return 0;
 }
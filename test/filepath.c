@@ -0,0 +1,139 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2010-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Tests the cache of file handle paths.
+
+/// FINISH= yes
+/// FREE= yes
+/// PIPE= yes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <windows.h>
+#include "hooking.h"
+#include "memory.h"
+#include "misc.h"
+#include "native.h"
+#include "pipe.h"
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        pipe("CRITICAL:Test didn't pass: %z", #expr); \
+    } \
+    else { \
+        pipe("INFO:Test passed: %z", #expr); \
+    }
+
+int main()
+{
+    pipe_init("\\\\.\\PIPE\\cuckoo", 0);
+
+    hook_init(GetModuleHandle(NULL));
+    mem_init();
+    assert(native_init() == 0);
+    misc_init("hoi");
+
+    static wchar_t path[MAX_PATH_W+1], first[MAX_PATH_W+1];
+    static const wchar_t renamed[] = L"\\??\\C:\\filepath-renamed.txt";
+    uint32_t info_length = sizeof(FILE_RENAME_INFORMATION) + sizeof(renamed);
+    uint32_t hits, misses, entries, length; DWORD written;
+    IO_STATUS_BLOCK status_block;
+
+    // The hooks which drop the entries of closed, renamed and new handles.
+    for (hook_t *h = sig_hooks(); h->funcname != NULL; h++) {
+        if(strcmp(h->funcname, "NtClose") == 0 ||
+                strcmp(h->funcname, "NtDuplicateObject") == 0 ||
+                strcmp(h->funcname, "NtCreateFile") == 0 ||
+                strcmp(h->funcname, "NtOpenFile") == 0 ||
+                strcmp(h->funcname, "NtSetInformationFile") == 0) {
+            assert(hook(h, GetModuleHandle("ntdll")) == 1);
+        }
+    }
+
+    HANDLE file_handle = CreateFileW(L"C:\\filepath-cache.txt",
+        GENERIC_WRITE | DELETE, 0, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    assert(file_handle != INVALID_HANDLE_VALUE);
+
+    // The cache is disabled by default.
+    assert((length = path_get_full_path_handle(file_handle, first)) != 0);
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(hits == 0 && misses == 0 && entries == 0);
+
+    file_path_cache_enable(1);
+
+    assert((length = path_get_full_path_handle(file_handle, first)) != 0);
+    assert(wcsicmp(first, L"C:\\filepath-cache.txt") == 0);
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(hits == 0 && misses == 1 && entries == 1);
+
+    // Many small writes only query the path once.
+    for (uint32_t idx = 0; idx < 100; idx++) {
+        assert(WriteFile(file_handle, "x", 1, &written, NULL) != FALSE);
+        memset(path, 0, sizeof(path));
+        assert(path_get_full_path_handle(file_handle, path) == length);
+        assert(wcscmp(path, first) == 0);
+    }
+
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(hits == 100 && misses == 1 && entries == 1);
+
+    // Paths may be registered as well.
+    file_path_cache_set(file_handle, L"C:\\renamed.txt", 14);
+    assert(path_get_full_path_handle(file_handle, path) == 14);
+    assert(wcscmp(path, L"C:\\renamed.txt") == 0);
+    file_path_cache_remove(file_handle);
+    assert(path_get_full_path_handle(file_handle, path) == length);
+
+    // Renaming the file drops its entry, through the NtSetInformationFile
+    // hook, so that the new path is returned.
+    FILE_RENAME_INFORMATION *info = mem_alloc(info_length);
+    memset(info, 0, info_length);
+    info->ReplaceIfExists = TRUE;
+    info->FileNameLength = sizeof(renamed) - sizeof(wchar_t);
+    memcpy(info->FileName, renamed, sizeof(renamed));
+    assert(NT_SUCCESS(NtSetInformationFile(file_handle, &status_block,
+        info, info_length, FileRenameInformation)) != FALSE);
+    mem_free(info);
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+    assert(path_get_full_path_handle(file_handle, path) == 23);
+    assert(wcsicmp(path, L"C:\\filepath-renamed.txt") == 0);
+
+    // As does closing the handle, through the NtClose hook, so a reused
+    // handle resolves to its new file.
+    assert(CloseHandle(file_handle) != FALSE);
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+
+    file_handle = CreateFileW(L"C:\\filepath-cache.txt",
+        GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    assert(file_handle != INVALID_HANDLE_VALUE);
+    assert(path_get_full_path_handle(file_handle, path) == length);
+    assert(wcscmp(path, first) == 0);
+    assert(CloseHandle(file_handle) != FALSE);
+    file_path_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+
+    DeleteFileW(L"C:\\filepath-cache.txt");
+    DeleteFileW(L"C:\\filepath-renamed.txt");
+
+    pipe("INFO:Test finished!");
+    return 0;
+}
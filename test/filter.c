@@ -0,0 +1,107 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests the compilation and evaluation of filter rules.
+
+/// FINISH= yes
+/// PIPE= yes
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <windows.h>
+#include "filter.h"
+#include "hooking.h"
+#include "log.h"
+#include "memory.h"
+#include "native.h"
+#include "pipe.h"
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        pipe("CRITICAL:Test didn't pass: %z", #expr); \
+    } \
+    else { \
+        pipe("INFO:Test passed: %z", #expr); \
+    }
+
+static uint32_t g_index;
+
+// MessageBoxA(window_handle, text, caption, flags), logged as arguments
+// 2 through 5.
+static int _match(int is_success, uintptr_t ret, ...)
+{
+    va_list args;
+    va_start(args, ret);
+    int match = filter_match(g_index, is_success, ret, args);
+    va_end(args);
+    return match;
+}
+
+int main()
+{
+    pipe_init("\\\\.\\PIPE\\cuckoo", 0);
+
+    hook_init(GetModuleHandle(NULL));
+    mem_init();
+    assert(native_init() == 0);
+
+    for (g_index = 0; g_index < sig_count(); g_index++) {
+        if(strcmp(sig_apiname(g_index), "MessageBoxA") == 0) {
+            break;
+        }
+    }
+    assert(g_index != sig_count());
+
+    filter_init();
+
+    HWND hwnd = (HWND) 0x1234;
+    assert(_match(1, 1, hwnd, "Hello world", "Caption", 0x40) == 0);
+
+    // Invalid rules.
+    assert(filter_add("NoSuchApi|3=Hello") < 0);
+    assert(filter_add("MessageBoxA") < 0);
+    assert(filter_add("MessageBoxA|3:1,2") < 0);
+    assert(filter_add("MessageBoxA|5^Hello") < 0);
+    assert(filter_add("MessageBoxA|9=1") < 0);
+    assert(filter_add("MessageBoxA|1|2|3|4|5|0|1|2|3") < 0);
+
+    // String prefixes are case-insensitive.
+    assert(filter_add("MessageBoxA|3^HELLO") == 0);
+    assert(_match(1, 1, hwnd, "Hello world", "Caption", 0x40) == 1);
+    assert(_match(1, 1, hwnd, "Hell", "Caption", 0x40) == 0);
+    assert(_match(1, 1, hwnd, NULL, "Caption", 0x40) == 0);
+
+    // All predicates of a rule have to hold.
+    filter_clear();
+    assert(filter_add("MessageBoxA|4=caption|5&0x40|1:1,10") == 0);
+    assert(_match(1, 1, hwnd, "Hello", "Caption", 0x41) == 1);
+    assert(_match(1, 1, hwnd, "Hello", "Captions", 0x41) == 0);
+    assert(_match(1, 1, hwnd, "Hello", "Caption", 0x01) == 0);
+    assert(_match(1, 11, hwnd, "Hello", "Caption", 0x40) == 0);
+
+    // Any rule may match.
+    assert(filter_add("MessageBoxA|2=0x1234|5&0x0f=0x02") == 0);
+    assert(_match(1, 11, hwnd, "Hello", "Caption", 0x12) == 1);
+    assert(_match(1, 11, hwnd, "Hello", "Caption", 0x13) == 0);
+
+    filter_clear();
+    assert(_match(1, 1, hwnd, "Hello", "Caption", 0x41) == 0);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests disabling and re-enabling a hook at runtime.
+
+/// FINISH= yes
+/// PIPE= yes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <windows.h>
+#include "hooking.h"
+#include "memory.h"
+#include "native.h"
+#include "pipe.h"
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        pipe("CRITICAL:Test didn't pass: %z", #expr); \
+    } \
+    else { \
+        pipe("INFO:Test passed: %z", #expr); \
+    }
+
+static UINT WINAPI _New_GetDoubleClickTime()
+{
+    return 4242;
+}
+
+int main()
+{
+    pipe_init("\\\\.\\PIPE\\cuckoo", 0);
+
+    hook_init(GetModuleHandle(NULL));
+    mem_init();
+    assert(native_init() == 0);
+
+    UINT original = GetDoubleClickTime();
+
+    hook_t h = {
+        .library = "user32",
+        .funcname = "GetDoubleClickTime",
+        .handler = (FARPROC) &_New_GetDoubleClickTime,
+    };
+    assert(hook(&h, GetModuleHandle("user32")) == 1);
+    assert(GetDoubleClickTime() == 4242);
+
+    // Disabled hooks no longer redirect to their handler.
+    assert(hook_set_enabled(&h, 0) == 1);
+    assert(hook_set_enabled(&h, 0) == 0);
+    assert(GetDoubleClickTime() == original);
+    assert(GetDoubleClickTime() == original);
+
+    assert(hook_set_enabled(&h, 1) == 1);
+    assert(GetDoubleClickTime() == 4242);
+
+    // Special hooks can't be toggled.
+    h.special = 1;
+    assert(hook_set_enabled(&h, 0) < 0);
+    assert(GetDoubleClickTime() == 4242);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2010-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Tests the cache of registry key handle paths.
+
+/// FINISH= yes
+/// FREE= yes
+/// PIPE= yes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <windows.h>
+#include "hooking.h"
+#include "memory.h"
+#include "misc.h"
+#include "native.h"
+#include "pipe.h"
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        pipe("CRITICAL:Test didn't pass: %z", #expr); \
+    } \
+    else { \
+        pipe("INFO:Test passed: %z", #expr); \
+    }
+
+int main()
+{
+    pipe_init("\\\\.\\PIPE\\cuckoo", 0);
+
+    hook_init(GetModuleHandle(NULL));
+    mem_init();
+    assert(native_init() == 0);
+    misc_init("hoi");
+
+    static wchar_t regkey[MAX_PATH_W+1], longkey[300];
+    uint32_t hits, misses, entries; HKEY key, other; HANDLE dup;
+
+    // The hooks which drop the entries of closed and new handles.
+    for (hook_t *h = sig_hooks(); h->funcname != NULL; h++) {
+        if(strcmp(h->funcname, "NtClose") == 0 ||
+                strcmp(h->funcname, "NtDuplicateObject") == 0 ||
+                strcmp(h->funcname, "NtOpenKey") == 0 ||
+                strcmp(h->funcname, "NtCreateKey") == 0 ||
+                strcmp(h->funcname, "NtDeleteKey") == 0) {
+            assert(hook(h, GetModuleHandle("ntdll")) == 1);
+        }
+    }
+
+    assert(RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft", 0,
+        KEY_READ, &key) == ERROR_SUCCESS);
+
+    // The cache is disabled by default.
+    assert(reg_get_key(key, regkey) == 37);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(hits == 0 && misses == 0 && entries == 0);
+
+    reg_key_cache_enable(1);
+
+    // Root keys don't go through the cache.
+    assert(reg_get_key(HKEY_LOCAL_MACHINE, regkey) == 18);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(hits == 0 && misses == 0 && entries == 0);
+
+    assert(reg_get_key(key, regkey) == 37);
+    assert(wcsicmp(regkey, L"HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft") == 0);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(hits == 0 && misses == 1 && entries == 1);
+
+    memset(regkey, 0, sizeof(regkey));
+    assert(reg_get_key(key, regkey) == 37);
+    assert(wcsicmp(regkey, L"HKEY_LOCAL_MACHINE\\SOFTWARE\\Microsoft") == 0);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(hits == 1 && misses == 1 && entries == 1);
+
+    // Subkeys are appended to the cached path.
+    assert(reg_get_key_uniz(key, L"Windows", regkey) == 45);
+
+    // What the NtOpenKey hook would register is returned as-is.
+    reg_key_cache_set(key, L"HKEY_CURRENT_USER\\Cached", 24);
+    assert(reg_get_key(key, regkey) == 24);
+    assert(wcscmp(regkey, L"HKEY_CURRENT_USER\\Cached") == 0);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(hits == 3 && entries == 1);
+
+    // Closing the handle drops its entry, through the NtClose hook.
+    assert(RegCloseKey(key) == ERROR_SUCCESS);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+    assert(reg_get_key(key, regkey) == 0);
+
+    // So a reused handle resolves to its new key, rather than to the path
+    // of the key it used to refer to.
+    assert(RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft", 0,
+        KEY_READ, &key) == ERROR_SUCCESS);
+    assert(reg_get_key(key, regkey) == 37);
+    assert(RegCloseKey(key) == ERROR_SUCCESS);
+    assert(RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Classes", 0,
+        KEY_READ, &other) == ERROR_SUCCESS);
+    assert(reg_get_key(other, regkey) == 35);
+    assert(wcsicmp(regkey, L"HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes") == 0);
+
+    // As does duplicating a handle while closing the original, after which
+    // the duplicate resolves to the same key.
+    assert(DuplicateHandle(GetCurrentProcess(), other, GetCurrentProcess(),
+        &dup, 0, FALSE, DUPLICATE_SAME_ACCESS | DUPLICATE_CLOSE_SOURCE)
+        != FALSE);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+    assert(reg_get_key(dup, regkey) == 35);
+    assert(wcsicmp(regkey, L"HKEY_LOCAL_MACHINE\\SOFTWARE\\Classes") == 0);
+    assert(CloseHandle(dup) != FALSE);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+
+    // Long paths aren't cached.
+    for (uint32_t idx = 0; idx < 299; idx++) {
+        longkey[idx] = 'A';
+    }
+    reg_key_cache_set((HANDLE) 0x1234, longkey, 299);
+    reg_key_cache_stats(&hits, &misses, &entries);
+    assert(entries == 0);
+
+    pipe("INFO:Test finished!");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+Cuckoo Sandbox - Automated Malware Analysis.
+Copyright (C) 2012-2018 Cuckoo Foundation.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This program tests the slab allocator, including concurrent use.
+
+/// FINISH= yes
+/// FREE= yes
+/// PIPE= yes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <windows.h>
+#include "hooking.h"
+#include "memory.h"
+#include "native.h"
+#include "pipe.h"
+
+#define assert(expr) \
+    if((expr) == 0) { \
+        pipe("CRITICAL:Test didn't pass: %z", #expr); \
+    } \
+    else { \
+        pipe("INFO:Test passed: %z", #expr); \
+    }
+
+#define THREADS 8
+#define OBJECTS 1000
+
+static slab_t g_slab;
+
+static DWORD WINAPI _worker(LPVOID param)
+{
+    static uint8_t *ptrs[THREADS][OBJECTS];
+    uint32_t thread = (uint32_t)(uintptr_t) param, errors = 0;
+
+    for (uint32_t round = 0; round < 10; round++) {
+        for (uint32_t idx = 0; idx < OBJECTS; idx++) {
+            uint8_t *ptr = ptrs[thread][idx] = slab_getmem(&g_slab);
+            errors += ptr == NULL || ptr[0] != 0 || ptr[63] != 0;
+            if(ptr != NULL) {
+                memset(ptr, thread + 1, 64);
+            }
+        }
+
+        // Another thread would have overwritten an object handed out twice.
+        for (uint32_t idx = 0; idx < OBJECTS; idx++) {
+            uint8_t *ptr = ptrs[thread][idx];
+            errors += ptr != NULL && (ptr[0] != thread + 1 ||
+                ptr[63] != thread + 1);
+            slab_free(&g_slab, ptr);
+        }
+    }
+    return errors;
+}
+
+int main()
+{
+    pipe_init("\\\\.\\PIPE\\cuckoo", 0);
+
+    hook_init(GetModuleHandle(NULL));
+    mem_init();
+    assert(native_init() == 0);
+
+    slab_t slab; slab_stats_t stats;
+    slab_init(&slab, 64, 16, PAGE_READWRITE);
+
+    uint8_t *a = slab_getmem(&slab), *b = slab_getmem(&slab);
+    assert(a != NULL && b != NULL && a != b);
+
+    // Freed objects are reused, and zeroed again.
+    memset(a, 0x41, 64);
+    slab_free(&slab, a);
+    assert(slab_getmem(&slab) == a && a[0] == 0 && a[63] == 0);
+
+    for (uint32_t idx = 0; idx < 40; idx++) {
+        assert(slab_getmem(&slab) != NULL);
+    }
+
+    slab_free(&slab, b);
+    slab_stats(&slab, &stats);
+    assert(stats.chunks == 3 && stats.capacity == 48);
+    assert(stats.used == 41 && stats.cached == 1 && stats.free == 0);
+    assert(stats.allocs == 43 && stats.frees == 2);
+
+    // Chunks of executable memory close to the module.
+    uint8_t *module = (uint8_t *) GetModuleHandle(NULL);
+    slab_init_near(&slab, 256, 128, PAGE_EXECUTE_READWRITE, module);
+    uint8_t *stub = slab_getmem(&slab);
+    assert(stub != NULL);
+    assert(stub - module < 0x7fffffff && module - stub < 0x7fffffff);
+
+    // Concurrent allocations should never hand out an object twice.
+    slab_init(&g_slab, 64, 128, PAGE_EXECUTE_READWRITE);
+
+    HANDLE threads[THREADS];
+    for (uint32_t idx = 0; idx < THREADS; idx++) {
+        threads[idx] = CreateThread(NULL, 0, &_worker,
+            (LPVOID)(uintptr_t) idx, 0, NULL);
+    }
+
+    WaitForMultipleObjects(THREADS, threads, TRUE, INFINITE);
+    for (uint32_t idx = 0; idx < THREADS; idx++) {
+        DWORD errors = 1;
+        GetExitCodeThread(threads[idx], &errors);
+        assert(errors == 0);
+        CloseHandle(threads[idx]);
+    }
+
+    slab_stats(&g_slab, &stats);
+    assert(stats.used == 0);
+    assert(stats.allocs == THREADS * OBJECTS * 10);
+    assert(stats.allocs == stats.frees);
+    assert(stats.capacity <=
+        THREADS * OBJECTS + THREADS * SLAB_MAGAZINE_SIZE + 128);
+    pipe("INFO:Test finished!");
+    return 0;
+}
@@ -38,6 +38,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
         pipe("INFO:Test passed: %z", #expr); \
     }
 
+static DWORD WINAPI _thread(LPVOID param)
+{
+    *(wchar_t **) param = get_unicode_buffer();
+    return 0;
+}
+
 int main()
 {
     pipe_init("\\\\.\\PIPE\\cuckoo", 0);
@@ -77,6 +83,16 @@ int main()
     for (uint32_t idx = 0; idx < bufcount; idx++) {
         free_unicode_buffer(ptrs[idx]);
     }
+
+    // The buffers of a thread are released as it exits.
+    wchar_t *buf = NULL; MEMORY_BASIC_INFORMATION mbi;
+    HANDLE thread_handle = CreateThread(NULL, 0, &_thread, &buf, 0, NULL);
+    WaitForSingleObject(thread_handle, INFINITE);
+    CloseHandle(thread_handle);
+
+    assert(buf != NULL);
+    assert(VirtualQuery(buf, &mbi, sizeof(mbi)) == sizeof(mbi) &&
+        mbi.State == MEM_FREE);
     pipe("INFO:Test finished!");
     return 0;
 }
@@ -53,6 +53,125 @@ class DefinitionProcessor(object):
             f.write(self.template(template).render(**kwargs))
 
 
+class ExplainSerializer(object):
+    """Pre-serializes the explain document of each signature, as otherwise
+    built by log_explain() in src/log.c, into a C array initializer. Values
+    only known to the compiler, i.e., the signature index and flag values,
+    are emitted as constant expressions."""
+
+    def __init__(self, types, flags):
+        self.types = types
+        self.flags = flags
+
+    def _int32(self, value):
+        if isinstance(value, int):
+            return [(value >> shift) & 0xff for shift in (0, 8, 16, 24)]
+
+        return ['(uint8_t)((uint32_t)(%s) >> %d)' % (value, shift)
+                for shift in (0, 8, 16, 24)]
+
+    def _cstring(self, value):
+        return list(bytearray(value.encode('utf8'))) + [0]
+
+    def _document(self, elements):
+        body = []
+        for element in elements:
+            body.extend(element)
+        return self._int32(4 + len(body) + 1) + body + [0]
+
+    def _int(self, key, value):
+        return [0x10] + self._cstring(key) + self._int32(value)
+
+    def _string(self, key, value):
+        value = self._cstring(value)
+        return [0x02] + self._cstring(key) + self._int32(len(value)) + value
+
+    def _object(self, key, elements):
+        return [0x03] + self._cstring(key) + self._document(elements)
+
+    def _array(self, key, elements):
+        return [0x04] + self._cstring(key) + self._document(elements)
+
+    def _args(self, sig):
+        fmt, names = [], []
+        if sig.get('prelog'):
+            fmt.append(sig['prelog']['argtype'])
+            names.append(sig['prelog']['argname'])
+
+        for param in sig.get('parameters', []):
+            if param['log']:
+                fmt.append(self.types[param['argtype']])
+                names.append(param['alias'])
+
+        for param in sig.get('logging', []):
+            fmt.append(param['argtype'])
+            names.append(param['argname'])
+
+        ret = [
+            self._string('0', 'is_success'),
+            self._string('1', 'retval'),
+        ]
+
+        argnum = 2
+        for ch in ''.join(fmt):
+            # Overrides don't take up an argument.
+            if ch == '!':
+                continue
+
+            key, name = '%d' % argnum, names[argnum-2]
+            if ch in 'pPx':
+                ret.append(self._array(key, [
+                    self._string('0', name),
+                    self._string('1', 'x' if ch == 'x' else 'p'),
+                ]))
+            else:
+                ret.append(self._string(key, name))
+            argnum += 1
+        return ret
+
+    def _flags(self, sig, kind):
+        ret = []
+        for flag in sig.get('flags', []):
+            rows = self.flags[flag['flagname']][kind]
+            ret.append(self._array(flag['name'], [
+                self._array('%d' % idx, [
+                    self._int('0', row),
+                    self._string('1', row),
+                ]) for idx, row in enumerate(rows)
+            ]))
+        return ret
+
+    def serialize(self, sig):
+        """Returns the explain document of a signature as lines of a C
+        array initializer."""
+        blob = self._document([
+            self._int('I', 'SIG_%s_%s' % (sig.get('library', ''),
+                                          sig['apiname'])),
+            self._string('name', sig['apiname']),
+            self._string('type', 'info'),
+            self._string('category', sig['signature']['category']),
+            self._array('args', self._args(sig)),
+            self._object('flags_value', self._flags(sig, 'value')),
+            self._object('flags_bitmask', self._flags(sig, 'enum')),
+        ])
+
+        # Constant expressions get a line of their own.
+        lines, line = [], []
+        for value in blob:
+            if isinstance(value, int):
+                line.append('%d' % value)
+            else:
+                line.append(value)
+
+            if len(line) == 16 or not isinstance(value, int):
+                lines.append(', '.join(line) + ',')
+                line = []
+
+        if line:
+            lines.append(', '.join(line) + ',')
+        return lines
+
+
 class SignatureProcessor(object):
     CALLING_CONVENTIONS = {
         'WINAPI': 'WINAPI',
@@ -494,6 +613,11 @@ class SignatureProcessor(object):
                     not sig['apiname'].startswith('__'):
                 sig['ignore'] = True
 
+        es = ExplainSerializer(self.types, self.flags)
+        for sig in self.sigs:
+            if not sig.get('ignore'):
+                sig['explain'] = es.serialize(sig)
+
         self.dp.render('hook-header', self.hooks_h, sigs=self.sigs)
         self.dp.render('hook-source', self.hooks_c,
                        sigs=self.sigs, types=self.types, debug=debug)
@@ -762,7 +886,7 @@ if __name__ == '__main__':
     fp.process(args.flags_directory)
 
     dp = SignatureProcessor(args.data_directory, args.output_directory,
-                            args.signatures_directory, fp.flags.keys(), ip)
+                            args.signatures_directory, fp.flags, ip)
     dp.process()
 
     apis = []